@@ -0,0 +1,227 @@
+#ifndef HEADER_BENCHMARK_H
+#define HEADER_BENCHMARK_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Clock.h"
+
+/**
+ * A micro-benchmark, run by a BenchmarkSuite.
+ *
+ * run() is called with a number of iterations chosen so that it lasts long
+ * enough to be measured, several times; it returns the number of items
+ * (lines, bytes, calls, ...) it processed, and the results are given per
+ * item.
+ */
+class Benchmark {
+
+private:
+    std::string m_sName;
+    std::string m_sUnit;
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param name Dotted name, starting with the module, and the parameters
+     * after a slash: "irc.parse/PRIVMSG", "sockets.wait/epoll/1000/10", ...
+     * @param unit What run() counts, singular: "line", "call", ...
+     */
+    Benchmark(const std::string &name, const std::string &unit)
+      : m_sName(name), m_sUnit(unit)
+    {
+    }
+
+    virtual ~Benchmark() {}
+
+    inline const std::string &getName() const
+    {
+        return m_sName;
+    }
+
+    inline const std::string &getUnit() const
+    {
+        return m_sUnit;
+    }
+
+    /** Called before the runs; the setup is not measured. */
+    virtual void setUp() {}
+
+    /**
+     * Does the work being measured.
+     *
+     * The results should be used somehow (added to a member, ...), so that
+     * the compiler can't drop the work.
+     * @return The number of items processed.
+     */
+    virtual unsigned long long run(unsigned long long iterations) = 0;
+
+    /** Called after the runs. */
+    virtual void tearDown() {}
+
+};
+
+/**
+ * Runs benchmarks and prints their results.
+ *
+ * Each benchmark is calibrated (the iterations are doubled until a run lasts
+ * a tenth of the minimum time, then scaled up), then run a number of times;
+ * the median and the minimum time per item are reported. The median is the
+ * figure to track, the minimum shows how noisy the machine was.
+ *
+ * The output has one line per benchmark, either as text (whitespace-separated
+ * columns, with a header line starting with '#'):
+ * @code
+ * # name             unit   iterations   median_ns      min_ns    items_per_s
+ * irc.parse/PING     line       186598       530.6       516.4        1884785
+ * @endcode
+ * or with --json, as one JSON object per line:
+ * @code
+ * {"name": "irc.parse/PING", "unit": "line", "iterations": 186598,
+ *  "repeat": 5, "median_ns": 530.6, "min_ns": 516.4, "items_per_s": 1884785}
+ * @endcode
+ *
+ * Usage: bench_xxx [--json] [--repeat=N] [--min-time=MS] [filter...]
+ * Only the benchmarks whose name contains one of the filters are run.
+ */
+class BenchmarkSuite {
+
+private:
+    std::vector<Benchmark*> m_Benchmarks;
+    bool m_bJson;
+    unsigned int m_iRepeat;
+    unsigned long long m_iMinTime;      // Nanoseconds
+    std::vector<std::string> m_Filters;
+
+    BenchmarkSuite(const BenchmarkSuite&);
+    BenchmarkSuite &operator=(const BenchmarkSuite&);
+
+    bool selected(const Benchmark *bench) const
+    {
+        if(m_Filters.empty())
+            return true;
+        std::vector<std::string>::const_iterator it = m_Filters.begin();
+        for(; it != m_Filters.end(); ++it)
+            if(bench->getName().find(*it) != std::string::npos)
+                return true;
+        return false;
+    }
+
+    /** Returns the duration of a run in nanoseconds, and the items. */
+    static unsigned long long timeRun(Benchmark *bench,
+            unsigned long long iterations, unsigned long long *items)
+    {
+        unsigned long long start = monotonicNanos();
+        *items = bench->run(iterations);
+        return monotonicNanos() - start;
+    }
+
+    void runBenchmark(Benchmark *bench)
+    {
+        bench->setUp();
+
+        // Calibration
+        unsigned long long iterations = 1;
+        unsigned long long items;
+        unsigned long long elapsed = timeRun(bench, iterations, &items);
+        while(elapsed < m_iMinTime / 10 && iterations < (1ULL << 40))
+        {
+            iterations *= 2;
+            elapsed = timeRun(bench, iterations, &items);
+        }
+        if(elapsed < m_iMinTime)
+            iterations = (unsigned long long)((double)iterations * m_iMinTime
+                    / (elapsed?elapsed:1)) + 1;
+
+        std::vector<double> times;
+        unsigned int i;
+        for(i = 0; i < m_iRepeat; i++)
+        {
+            elapsed = timeRun(bench, iterations, &items);
+            times.push_back((double)elapsed / (items?items:1));
+        }
+        bench->tearDown();
+
+        std::sort(times.begin(), times.end());
+        double median = times[times.size() / 2];
+        if(times.size() % 2 == 0)
+            median = (median + times[times.size() / 2 - 1]) / 2;
+        double rate = (median > 0)?1000000000.0 / median:0;
+        if(m_bJson)
+            printf("{\"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %llu"
+                    ", \"repeat\": %u, \"median_ns\": %.1f, \"min_ns\": %.1f"
+                    ", \"items_per_s\": %.0f}\n",
+                    bench->getName().c_str(), bench->getUnit().c_str(),
+                    iterations, m_iRepeat, median, times[0], rate);
+        else
+            printf("%-34s %-5s %11llu %11.1f %11.1f %14.0f\n",
+                    bench->getName().c_str(), bench->getUnit().c_str(),
+                    iterations, median, times[0], rate);
+        fflush(stdout);
+    }
+
+public:
+    BenchmarkSuite()
+      : m_bJson(false), m_iRepeat(5), m_iMinTime(100000000)
+    {
+    }
+
+    ~BenchmarkSuite()
+    {
+        std::vector<Benchmark*>::iterator it = m_Benchmarks.begin();
+        for(; it != m_Benchmarks.end(); ++it)
+            delete *it;
+    }
+
+    /** Adds a benchmark, which the suite will delete. */
+    void add(Benchmark *bench)
+    {
+        m_Benchmarks.push_back(bench);
+    }
+
+    /**
+     * Parses the command line and runs the selected benchmarks.
+     *
+     * @return The exit status of the program.
+     */
+    int main(int argc, char **argv)
+    {
+        int i;
+        for(i = 1; i < argc; i++)
+        {
+            if(strcmp(argv[i], "--json") == 0)
+                m_bJson = true;
+            else if(strncmp(argv[i], "--repeat=", 9) == 0)
+                m_iRepeat = strtoul(argv[i] + 9, NULL, 10);
+            else if(strncmp(argv[i], "--min-time=", 11) == 0)
+                m_iMinTime = strtoull(argv[i] + 11, NULL, 10) * 1000000;
+            else if(argv[i][0] == '-')
+            {
+                fprintf(stderr, "usage: %s [--json] [--repeat=N] "
+                        "[--min-time=MS] [filter...]\n", argv[0]);
+                return 2;
+            }
+            else
+                m_Filters.push_back(argv[i]);
+        }
+        if(m_iRepeat == 0)
+            m_iRepeat = 1;
+
+        if(!m_bJson)
+            printf("# %-32s %-5s %11s %11s %11s %14s\n", "name", "unit",
+                    "iterations", "median_ns", "min_ns", "items_per_s");
+        std::vector<Benchmark*>::iterator it = m_Benchmarks.begin();
+        for(; it != m_Benchmarks.end(); ++it)
+            if(selected(*it))
+                runBenchmark(*it);
+        return 0;
+    }
+
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef HEADER_CLOCK_H
+#define HEADER_CLOCK_H
+
+#ifdef __WIN32__
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+/**
+ * Returns the value of a monotonic clock, in nanoseconds.
+ *
+ * The origin is unspecified; this is only useful to measure durations.
+ */
+inline unsigned long long monotonicNanos()
+{
+#ifdef __WIN32__
+    static LARGE_INTEGER frequency = {{0, 0}};
+    if(frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return (unsigned long long)(now.QuadPart / frequency.QuadPart) * 1000000000
+        + (unsigned long long)(now.QuadPart % frequency.QuadPart) * 1000000000
+        / frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/**
+ * Returns the value of a monotonic clock, in microseconds.
+ */
+inline unsigned long long monotonicMicros()
+{
+    return monotonicNanos() / 1000;
+}
+
+/**
+ * Returns the value of a monotonic clock, in milliseconds.
+ */
+inline unsigned long long monotonicMillis()
+{
+    return monotonicMicros() / 1000;
+}
+
+#endif
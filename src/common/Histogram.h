@@ -0,0 +1,138 @@
+#ifndef HEADER_HISTOGRAM_H
+#define HEADER_HISTOGRAM_H
+
+#include <cstring>
+
+/**
+ * A histogram of positive values, typically latencies in microseconds.
+ *
+ * Values are counted in log-linear buckets: each power of two is divided in
+ * SUB_BUCKETS buckets, so the relative error of the percentiles is bounded
+ * (about 6%) whatever the range of the values, while the histogram takes a
+ * fixed amount of memory. Recording is a few atomic increments, so a
+ * histogram can be shared between threads without locking.
+ */
+class Histogram {
+
+public:
+    static const unsigned int SUB_BITS = 4;
+    static const unsigned int SUB_BUCKETS = 1 << SUB_BITS;
+    static const unsigned int BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+private:
+    unsigned long long m_Counts[BUCKETS];
+    unsigned long long m_iCount;
+    unsigned long long m_iSum;
+    unsigned long long m_iMax;
+
+    static unsigned int bucketOf(unsigned long long value)
+    {
+        if(value < SUB_BUCKETS)
+            return (unsigned int)value;
+        unsigned int magnitude = 63 - __builtin_clzll(value);
+        unsigned int shift = magnitude - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS
+            + (unsigned int)((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    /** Highest value that falls in a bucket. */
+    static unsigned long long bucketMax(unsigned int bucket)
+    {
+        if(bucket < SUB_BUCKETS)
+            return bucket;
+        unsigned int shift = bucket / SUB_BUCKETS - 1;
+        unsigned long long base = (unsigned long long)
+            (SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+        return base + ((1ULL << shift) - 1);
+    }
+
+public:
+    Histogram()
+    {
+        reset();
+    }
+
+    /** Counts a value. */
+    void record(unsigned long long value)
+    {
+        __sync_fetch_and_add(&m_Counts[bucketOf(value)], 1);
+        __sync_fetch_and_add(&m_iCount, 1);
+        __sync_fetch_and_add(&m_iSum, value);
+        unsigned long long max = m_iMax;
+        while(value > max)
+        {
+            unsigned long long prev = __sync_val_compare_and_swap(
+                    &m_iMax, max, value);
+            if(prev == max)
+                break;
+            max = prev;
+        }
+    }
+
+    /** Adds the values counted by another histogram. */
+    void merge(const Histogram &other)
+    {
+        unsigned int i;
+        for(i = 0; i < BUCKETS; i++)
+            if(other.m_Counts[i] != 0)
+                __sync_fetch_and_add(&m_Counts[i], other.m_Counts[i]);
+        __sync_fetch_and_add(&m_iCount, other.m_iCount);
+        __sync_fetch_and_add(&m_iSum, other.m_iSum);
+        if(other.m_iMax > m_iMax)
+            m_iMax = other.m_iMax;
+    }
+
+    void reset()
+    {
+        memset(m_Counts, 0, sizeof(m_Counts));
+        m_iCount = 0;
+        m_iSum = 0;
+        m_iMax = 0;
+    }
+
+    inline unsigned long long count() const
+    {
+        return m_iCount;
+    }
+
+    inline unsigned long long max() const
+    {
+        return m_iMax;
+    }
+
+    inline unsigned long long mean() const
+    {
+        return (m_iCount == 0)?0:m_iSum / m_iCount;
+    }
+
+    /**
+     * Returns the value below which the given fraction of the values fall.
+     *
+     * @param p Fraction between 0 and 1, for instance 0.99 for the 99th
+     * percentile.
+     */
+    unsigned long long percentile(double p) const
+    {
+        unsigned long long total = m_iCount;
+        if(total == 0)
+            return 0;
+        unsigned long long rank = (unsigned long long)(p * total + 0.5);
+        if(rank == 0)
+            rank = 1;
+        unsigned long long seen = 0;
+        unsigned int i;
+        for(i = 0; i < BUCKETS; i++)
+        {
+            seen += m_Counts[i];
+            if(seen >= rank)
+            {
+                unsigned long long value = bucketMax(i);
+                return (value > m_iMax)?m_iMax:value;
+            }
+        }
+        return m_iMax;
+    }
+
+};
+
+#endif
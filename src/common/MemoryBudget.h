@@ -0,0 +1,96 @@
+#ifndef HEADER_MEMORYBUDGET_H
+#define HEADER_MEMORYBUDGET_H
+
+#include <cstddef>
+
+/**
+ * A limit on the memory used by a set of buffers.
+ *
+ * Buffers reserve() bytes before growing and release() them when they
+ * shrink; once the limit is reached, reservations fail and the owner of the
+ * buffer has to drop data instead. This is shared between the connections
+ * of a process (or of a thread), so a few peers misbehaving can't exhaust
+ * the memory. Counters are updated with atomic operations, so a budget can
+ * be shared between threads without locking.
+ */
+class MemoryBudget {
+
+private:
+    size_t m_iLimit;
+    size_t m_iUsed;
+    size_t m_iPeak;
+    unsigned long long m_iRefused;
+
+    MemoryBudget(const MemoryBudget&);
+    MemoryBudget &operator=(const MemoryBudget&);
+
+public:
+    /**
+     * Creates a budget.
+     *
+     * @param limit Maximum number of bytes, 0 meaning no limit (usage is
+     * still counted).
+     */
+    MemoryBudget(size_t limit = 0)
+      : m_iLimit(limit), m_iUsed(0), m_iPeak(0), m_iRefused(0)
+    {
+    }
+
+    /**
+     * Reserves bytes.
+     *
+     * @return false if that would exceed the limit; nothing is reserved then.
+     */
+    bool reserve(size_t size)
+    {
+        size_t used = __sync_add_and_fetch(&m_iUsed, size);
+        if(m_iLimit != 0 && used > m_iLimit)
+        {
+            __sync_fetch_and_sub(&m_iUsed, size);
+            __sync_fetch_and_add(&m_iRefused, 1);
+            return false;
+        }
+        size_t peak = m_iPeak;
+        while(used > peak
+         && !__sync_bool_compare_and_swap(&m_iPeak, peak, used))
+            peak = m_iPeak;
+        return true;
+    }
+
+    /** Gives back bytes obtained from reserve(). */
+    void release(size_t size)
+    {
+        __sync_fetch_and_sub(&m_iUsed, size);
+    }
+
+    inline void setLimit(size_t limit)
+    {
+        m_iLimit = limit;
+    }
+
+    inline size_t getLimit() const
+    {
+        return m_iLimit;
+    }
+
+    /** Number of bytes currently reserved. */
+    inline size_t getUsed() const
+    {
+        return m_iUsed;
+    }
+
+    /** Highest number of bytes reserved at once. */
+    inline size_t getPeak() const
+    {
+        return m_iPeak;
+    }
+
+    /** Number of reservations that failed because of the limit. */
+    inline unsigned long long getRefused() const
+    {
+        return m_iRefused;
+    }
+
+};
+
+#endif
@@ -0,0 +1,174 @@
+#ifndef HEADER_METRICS_H
+#define HEADER_METRICS_H
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+#include "Histogram.h"
+#include "Thread.h"
+
+/**
+ * A counter updated from several threads.
+ *
+ * Each thread adds to its own shard (on its own cache line), so threads
+ * counting the same event don't fight over a cache line; the shards are
+ * summed when the value is read. Values can go down, so this is also used
+ * for gauges (queue depths, ...).
+ */
+class Counter {
+
+public:
+    static const unsigned int SHARDS = 16;
+
+private:
+    struct Shard {
+        long long value;
+        char padding[64 - sizeof(long long)];
+    };
+
+    Shard m_Shards[SHARDS];
+
+    Counter(const Counter&);
+    Counter &operator=(const Counter&);
+
+    /** Index of the shard of the calling thread. */
+    static unsigned int threadShard()
+    {
+        static unsigned int next = 0;
+        static __thread unsigned int shard = 0;
+        if(shard == 0)
+            shard = __sync_add_and_fetch(&next, 1);
+        return (shard - 1) % SHARDS;
+    }
+
+public:
+    Counter()
+    {
+        memset(m_Shards, 0, sizeof(m_Shards));
+    }
+
+    inline void add(long long n = 1)
+    {
+        // Atomic in case more than SHARDS threads share the shards; this is
+        // cheap as the cache line is not contended
+        __sync_fetch_and_add(&m_Shards[threadShard()].value, n);
+    }
+
+    inline void sub(long long n = 1)
+    {
+        add(-n);
+    }
+
+    long long value() const
+    {
+        long long total = 0;
+        unsigned int i;
+        for(i = 0; i < SHARDS; i++)
+            total += m_Shards[i].value;
+        return total;
+    }
+
+};
+
+/**
+ * The metrics of a process.
+ *
+ * Counters and histograms are created on first use, by name, and live as long
+ * as the registry; code looks them up once (typically into a static
+ * reference) and then updates them directly, without locking. Names are
+ * dotted, starting with the module: "net.bytes_sent", "irc.parse_ns", ...
+ * Histograms of durations end with their unit: "_ns" or "_us".
+ */
+class Metrics {
+
+private:
+    mutable Mutex m_Mutex;
+    std::map<std::string, Counter*> m_Counters;
+    std::map<std::string, Histogram*> m_Histograms;
+
+    Metrics(const Metrics&);
+    Metrics &operator=(const Metrics&);
+
+public:
+    Metrics()
+    {
+    }
+
+    ~Metrics()
+    {
+        std::map<std::string, Counter*>::iterator c = m_Counters.begin();
+        for(; c != m_Counters.end(); ++c)
+            delete c->second;
+        std::map<std::string, Histogram*>::iterator h = m_Histograms.begin();
+        for(; h != m_Histograms.end(); ++h)
+            delete h->second;
+    }
+
+    /** Gets a counter, creating it if needed. */
+    Counter &counter(const std::string &name)
+    {
+        MutexLock lock(m_Mutex);
+        Counter *&c = m_Counters[name];
+        if(c == NULL)
+            c = new Counter;
+        return *c;
+    }
+
+    /** Gets a histogram, creating it if needed. */
+    Histogram &histogram(const std::string &name)
+    {
+        MutexLock lock(m_Mutex);
+        Histogram *&h = m_Histograms[name];
+        if(h == NULL)
+            h = new Histogram;
+        return *h;
+    }
+
+    /**
+     * Writes the current values, one metric per line; counters then
+     * histograms, each sorted by name:
+     * @code
+     * net.bytes_sent 123456
+     * irc.parse_ns count=1000 mean=210 p50=191 p90=255 p99=511 max=4863
+     * @endcode
+     */
+    std::string dump() const
+    {
+        std::string result;
+        char buffer[256];
+        MutexLock lock(m_Mutex);
+        std::map<std::string, Counter*>::const_iterator c;
+        for(c = m_Counters.begin(); c != m_Counters.end(); ++c)
+        {
+            snprintf(buffer, sizeof(buffer), " %lld\n", c->second->value());
+            result += c->first;
+            result += buffer;
+        }
+        std::map<std::string, Histogram*>::const_iterator h;
+        for(h = m_Histograms.begin(); h != m_Histograms.end(); ++h)
+        {
+            const Histogram &hist = *h->second;
+            snprintf(buffer, sizeof(buffer),
+                    " count=%llu mean=%llu p50=%llu p90=%llu p99=%llu"
+                    " max=%llu\n",
+                    hist.count(), hist.mean(), hist.percentile(0.5),
+                    hist.percentile(0.9), hist.percentile(0.99), hist.max());
+            result += h->first;
+            result += buffer;
+        }
+        return result;
+    }
+
+    /** The registry used by the modules. */
+    static Metrics &global()
+    {
+        // Never destroyed: threads might still count while the process exits
+        static Metrics *metrics = new Metrics;
+        return *metrics;
+    }
+
+};
+
+#endif
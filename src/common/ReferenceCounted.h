@@ -37,6 +37,14 @@ public:
         m_iRefs++;
     }
 
+    /**
+     * The number of references; 1 means only the creator holds it.
+     */
+    inline unsigned int getReferences() const
+    {
+        return m_iRefs;
+    }
+
     /**
      * We no longer keep a reference to that object.
      */
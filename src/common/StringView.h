@@ -0,0 +1,96 @@
+#ifndef HEADER_STRINGVIEW_H
+#define HEADER_STRINGVIEW_H
+
+#include <cstring>
+#include <string>
+
+/**
+ * A reference to a part of a string, that doesn't own or copy it.
+ *
+ * The referenced characters must outlive the view; it is typically used to
+ * return parts of a string that the caller already holds.
+ */
+class StringView {
+
+private:
+    const char *m_pData;
+    size_t m_iSize;
+
+public:
+    StringView()
+      : m_pData(""), m_iSize(0)
+    {
+    }
+
+    StringView(const char *data, size_t size)
+      : m_pData(data), m_iSize(size)
+    {
+    }
+
+    StringView(const std::string &str)
+      : m_pData(str.data()), m_iSize(str.size())
+    {
+    }
+
+    /** A view on str[pos:pos+size]. */
+    StringView(const std::string &str, size_t pos, size_t size)
+      : m_pData(str.data() + pos), m_iSize(size)
+    {
+    }
+
+    inline const char *data() const
+    {
+        return m_pData;
+    }
+
+    inline size_t size() const
+    {
+        return m_iSize;
+    }
+
+    inline bool empty() const
+    {
+        return m_iSize == 0;
+    }
+
+    inline char operator[](size_t i) const
+    {
+        return m_pData[i];
+    }
+
+    /** Makes a copy, as a std::string. */
+    inline std::string str() const
+    {
+        return std::string(m_pData, m_iSize);
+    }
+
+    /** Replaces the content of 'dest', reusing its buffer. */
+    inline void copyTo(std::string *dest) const
+    {
+        dest->assign(m_pData, m_iSize);
+    }
+
+    inline bool operator==(const StringView &other) const
+    {
+        return m_iSize == other.m_iSize
+            && memcmp(m_pData, other.m_pData, m_iSize) == 0;
+    }
+
+    inline bool operator!=(const StringView &other) const
+    {
+        return !(*this == other);
+    }
+
+};
+
+inline bool operator==(const std::string &a, const StringView &b)
+{
+    return StringView(a) == b;
+}
+
+inline bool operator!=(const std::string &a, const StringView &b)
+{
+    return !(StringView(a) == b);
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef HEADER_THREAD_H
+#define HEADER_THREAD_H
+
+#include <pthread.h>
+
+/**
+ * A mutual exclusion lock.
+ */
+class Mutex {
+
+private:
+    pthread_mutex_t m_Mutex;
+
+    Mutex(const Mutex&);
+    Mutex &operator=(const Mutex&);
+
+public:
+    Mutex()
+    {
+        pthread_mutex_init(&m_Mutex, NULL);
+    }
+
+    ~Mutex()
+    {
+        pthread_mutex_destroy(&m_Mutex);
+    }
+
+    inline void lock()
+    {
+        pthread_mutex_lock(&m_Mutex);
+    }
+
+    inline void unlock()
+    {
+        pthread_mutex_unlock(&m_Mutex);
+    }
+
+    friend class Condition;
+
+};
+
+/**
+ * Holds a Mutex for the duration of a scope.
+ */
+class MutexLock {
+
+private:
+    Mutex &m_Mutex;
+
+    MutexLock(const MutexLock&);
+    MutexLock &operator=(const MutexLock&);
+
+public:
+    MutexLock(Mutex &mutex)
+      : m_Mutex(mutex)
+    {
+        m_Mutex.lock();
+    }
+
+    ~MutexLock()
+    {
+        m_Mutex.unlock();
+    }
+
+};
+
+/**
+ * A condition variable, used with a Mutex.
+ */
+class Condition {
+
+private:
+    pthread_cond_t m_Cond;
+
+    Condition(const Condition&);
+    Condition &operator=(const Condition&);
+
+public:
+    Condition()
+    {
+        pthread_cond_init(&m_Cond, NULL);
+    }
+
+    ~Condition()
+    {
+        pthread_cond_destroy(&m_Cond);
+    }
+
+    /** Releases the mutex, which must be locked, and waits to be woken up. */
+    inline void wait(Mutex &mutex)
+    {
+        pthread_cond_wait(&m_Cond, &mutex.m_Mutex);
+    }
+
+    inline void signal()
+    {
+        pthread_cond_signal(&m_Cond);
+    }
+
+    inline void broadcast()
+    {
+        pthread_cond_broadcast(&m_Cond);
+    }
+
+};
+
+/**
+ * Base class for threads.
+ *
+ * Subclass it and implement run(), which will be called in the new thread
+ * once start() is called.
+ */
+class Thread {
+
+private:
+    pthread_t m_Thread;
+    bool m_bStarted;
+
+    Thread(const Thread&);
+    Thread &operator=(const Thread&);
+
+    static void *trampoline(void *arg)
+    {
+        ((Thread*)arg)->run();
+        return NULL;
+    }
+
+protected:
+    /** The code of the thread. */
+    virtual void run() = 0;
+
+public:
+    Thread()
+      : m_bStarted(false)
+    {
+    }
+
+    /**
+     * Destructor.
+     *
+     * @warning The thread must have been joined.
+     */
+    virtual ~Thread() {}
+
+    /**
+     * Starts the thread.
+     *
+     * @return false if the thread couldn't be created.
+     */
+    bool start()
+    {
+        if(m_bStarted)
+            return false;
+        m_bStarted = pthread_create(&m_Thread, NULL, trampoline, this) == 0;
+        return m_bStarted;
+    }
+
+    /** Waits for the thread to finish. */
+    void join()
+    {
+        if(m_bStarted)
+        {
+            pthread_join(m_Thread, NULL);
+            m_bStarted = false;
+        }
+    }
+
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "CoreRuntime.h"
+
+#ifdef __WIN32__
+    #include <windows.h>
+#endif
+
+class CoreRuntime::ListenHandler : public EventHandler {
+
+private:
+    AcceptHandler *m_pHandler;
+
+public:
+    ListenHandler(AcceptHandler *handler)
+      : m_pHandler(handler)
+    {
+    }
+
+    void ready(EventLoop *loop, Waitable *obj)
+    {
+        TCPServer *server = dynamic_cast<TCPServer*>(obj);
+        std::vector<TCPSocket*> sockets;
+        server->AcceptAll(&sockets);
+        std::vector<TCPSocket*>::iterator it = sockets.begin();
+        for(; it != sockets.end(); ++it)
+            m_pHandler->accepted(loop, *it);
+    }
+
+};
+
+CoreRuntime::CoreRuntime(unsigned int threads) throw(SocketError)
+  : m_bRunning(false)
+{
+    if(threads == 0)
+        threads = cpuCount();
+    unsigned int i;
+    for(i = 0; i < threads; i++)
+        m_Loops.push_back(new EventLoop);
+}
+
+CoreRuntime::~CoreRuntime()
+{
+    stop();
+    std::vector<EventLoop*>::iterator it = m_Loops.begin();
+    for(; it != m_Loops.end(); ++it)
+        delete *it;
+    std::vector<TCPServer*>::iterator l = m_Listeners.begin();
+    for(; l != m_Listeners.end(); ++l)
+        delete *l;
+    std::vector<ListenHandler*>::iterator h = m_ListenHandlers.begin();
+    for(; h != m_ListenHandlers.end(); ++h)
+        delete *h;
+}
+
+void CoreRuntime::start()
+{
+    if(m_bRunning)
+        return;
+    std::vector<EventLoop*>::iterator it = m_Loops.begin();
+    for(; it != m_Loops.end(); ++it)
+        (*it)->start();
+    m_bRunning = true;
+}
+
+void CoreRuntime::stop()
+{
+    if(!m_bRunning)
+        return;
+    std::vector<EventLoop*>::iterator it;
+    for(it = m_Loops.begin(); it != m_Loops.end(); ++it)
+        (*it)->stop();
+    for(it = m_Loops.begin(); it != m_Loops.end(); ++it)
+        (*it)->join();
+    m_bRunning = false;
+}
+
+EventLoop *CoreRuntime::attach(Waitable *obj, EventHandler *handler)
+{
+    EventLoop *best = m_Loops[0];
+    std::vector<EventLoop*>::iterator it = m_Loops.begin() + 1;
+    for(; it != m_Loops.end(); ++it)
+        if((*it)->load() < best->load())
+            best = *it;
+    best->attach(obj, handler);
+    return best;
+}
+
+int CoreRuntime::listen(int port, AcceptHandler *handler, int backlog)
+    throw(SocketCantUsePort)
+{
+    bool reusePort = TCPServer::CanReusePort() && m_Loops.size() > 1;
+    std::vector<TCPServer*> servers;
+    try
+    {
+        servers.push_back(TCPServer::Listen(port, backlog, reusePort));
+        // The other listeners need the port the first one got
+        port = servers[0]->GetLocalPort();
+        size_t i;
+        for(i = 1; reusePort && i < m_Loops.size(); i++)
+            servers.push_back(TCPServer::Listen(port, backlog, true));
+    }
+    catch(SocketCantUsePort &e)
+    {
+        std::vector<TCPServer*>::iterator it = servers.begin();
+        for(; it != servers.end(); ++it)
+            delete *it;
+        throw;
+    }
+
+    ListenHandler *listenHandler = new ListenHandler(handler);
+    m_ListenHandlers.push_back(listenHandler);
+    size_t i;
+    for(i = 0; i < servers.size(); i++)
+    {
+        m_Listeners.push_back(servers[i]);
+        m_Loops[i]->attach(servers[i], listenHandler);
+    }
+    return port;
+}
+
+unsigned int CoreRuntime::cpuCount()
+{
+#ifdef __WIN32__
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0)?n:1;
+#endif
+}
@@ -0,0 +1,100 @@
+#ifndef HEADER_CORERUNTIME_H
+#define HEADER_CORERUNTIME_H
+
+#include <vector>
+
+#include "EventLoop.h"
+
+/**
+ * Callback for the connections accepted by the listeners of a CoreRuntime.
+ */
+class AcceptHandler {
+
+public:
+    virtual ~AcceptHandler() {}
+    /**
+     * Called from the thread of the loop whose listener accepted the
+     * connection; the socket belongs to the handler, which will usually add it
+     * to this same loop.
+     */
+    virtual void accepted(EventLoop *loop, TCPSocket *sock) = 0;
+
+};
+
+/**
+ * The threads of the core.
+ *
+ * The core runs a fixed number of event loops, each in its own thread.
+ * Connections (to IRC networks and from clients) are spread over them and
+ * stay on the same loop for their whole life; a connection that needs to
+ * talk to a connection on another loop posts a LoopTask to it.
+ */
+class CoreRuntime {
+
+private:
+    class ListenHandler;
+
+    std::vector<EventLoop*> m_Loops;
+    std::vector<TCPServer*> m_Listeners;
+    std::vector<ListenHandler*> m_ListenHandlers;
+    bool m_bRunning;
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param threads Number of event loops to run, or 0 to use one per CPU.
+     */
+    CoreRuntime(unsigned int threads = 0) throw(SocketError);
+
+    /**
+     * Destructor: stops the loops if they are running, and closes the
+     * listeners.
+     */
+    ~CoreRuntime();
+
+    /** Starts the threads. */
+    void start();
+
+    /** Stops the loops and waits for the threads to finish. */
+    void stop();
+
+    /**
+     * Hands a Waitable over to the least loaded loop.
+     *
+     * @return The loop that will handle it.
+     */
+    EventLoop *attach(Waitable *obj, EventHandler *handler);
+
+    /**
+     * Listens for connections on a port.
+     *
+     * Where SO_REUSEPORT is available, each loop gets its own listener on the
+     * port, and the system spreads the incoming connections between them;
+     * otherwise, a single listener is added to the first loop. The pending
+     * connections are all accepted when a listener becomes readable.
+     *
+     * @param port Port number, or 0 for a random port.
+     * @param handler Called for each connection.
+     * @param backlog Length of the queue of each listener.
+     * @return The port number used.
+     */
+    int listen(int port, AcceptHandler *handler, int backlog = SOMAXCONN)
+        throw(SocketCantUsePort);
+
+    inline size_t loops() const
+    {
+        return m_Loops.size();
+    }
+
+    inline EventLoop *getLoop(size_t i) const
+    {
+        return m_Loops[i];
+    }
+
+    /** Returns the number of processors available, or 1 if unknown. */
+    static unsigned int cpuCount();
+
+};
+
+#endif
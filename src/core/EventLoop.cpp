@@ -0,0 +1,211 @@
+#include "EventLoop.h"
+
+#include <algorithm>
+
+#include "common/Clock.h"
+
+class EventLoop::AttachTask : public LoopTask {
+
+private:
+    Waitable *m_pObject;
+    EventHandler *m_pHandler;
+
+public:
+    AttachTask(Waitable *obj, EventHandler *handler)
+      : m_pObject(obj), m_pHandler(handler)
+    {
+    }
+
+    void run(EventLoop *loop)
+    {
+        loop->m_Set.Add(m_pObject);
+        loop->m_Handlers[m_pObject] = m_pHandler;
+        m_pObject->SetFlushScheduler(loop);
+    }
+
+};
+
+class EventLoop::StopTask : public LoopTask {
+
+public:
+    void run(EventLoop *loop)
+    {
+        loop->m_bStop = true;
+    }
+
+};
+
+EventLoop::EventLoop() throw(SocketError)
+  : m_Timers(monotonicMillis()), m_iWakePending(0), m_iLoad(0),
+    m_bStop(false)
+{
+    // A connected pair of sockets, used to wake the loop up when a task is
+    // posted
+#ifndef __WIN32__
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        throw SocketFatalError();
+    m_pWakeRead = new TCPSocket(fds[0]);
+    m_pWakeWrite = new TCPSocket(fds[1]);
+#else
+    TCPServer *server = TCPServer::Listen(0);
+    m_pWakeWrite = TCPSocket::Connect("127.0.0.1", server->GetLocalPort());
+    m_pWakeRead = server->Accept(-1);
+    delete server;
+#endif
+    m_Set.Add(m_pWakeRead);
+}
+
+EventLoop::~EventLoop()
+{
+    LoopTask *task;
+    while((task = m_Mailbox.pop()) != NULL)
+        delete task;
+    delete m_pWakeRead;
+    delete m_pWakeWrite;
+}
+
+void EventLoop::add(Waitable *obj, EventHandler *handler)
+{
+    __sync_fetch_and_add(&m_iLoad, 1);
+    m_Set.Add(obj);
+    m_Handlers[obj] = handler;
+    obj->SetFlushScheduler(this);
+}
+
+bool EventLoop::remove(Waitable *obj)
+{
+    if(m_Handlers.erase(obj) == 0)
+        return false;
+    m_Set.Remove(obj);
+    m_Again.erase(std::remove(m_Again.begin(), m_Again.end(), obj),
+            m_Again.end());
+    m_Running.erase(std::remove(m_Running.begin(), m_Running.end(), obj),
+            m_Running.end());
+    obj->SetFlushScheduler(NULL);
+    __sync_fetch_and_sub(&m_iLoad, 1);
+    return true;
+}
+
+void EventLoop::readyAgain(Waitable *obj)
+{
+    if(std::find(m_Again.begin(), m_Again.end(), obj) == m_Again.end())
+        m_Again.push_back(obj);
+}
+
+void EventLoop::attach(Waitable *obj, EventHandler *handler)
+{
+    __sync_fetch_and_add(&m_iLoad, 1);
+    post(new AttachTask(obj, handler));
+}
+
+void EventLoop::post(LoopTask *task)
+{
+    m_Mailbox.push(task);
+    // Only the first poster since the loop last woke up writes to the socket
+    if(__sync_bool_compare_and_swap(&m_iWakePending, 0, 1))
+        m_pWakeWrite->Send("!", 1);
+}
+
+void EventLoop::stop()
+{
+    post(new StopTask);
+}
+
+void EventLoop::runOnce(int timeout)
+{
+    // Objects asking to be called again from now on are for the next
+    // iteration
+    m_Running.swap(m_Again);
+    m_Timers.Advance(monotonicMillis());
+    int next = m_Timers.NextTimeout();
+    if(next >= 0 && (timeout < 0 || next < timeout))
+        timeout = next;
+    if(!m_Running.empty())
+        timeout = 0;
+
+    Waitable *obj = m_Set.Wait(timeout);
+    if(obj == m_pWakeRead)
+    {
+        char buffer[64];
+        while(m_pWakeRead->Recv(buffer, sizeof(buffer), false) > 0)
+            ;
+        __sync_lock_release(&m_iWakePending);
+    }
+    else if(obj != NULL)
+    {
+        std::map<Waitable*, EventHandler*>::iterator it;
+        it = m_Handlers.find(obj);
+        if(it != m_Handlers.end())
+            it->second->ready(this, obj);
+    }
+    runAgain(obj);
+    m_Timers.Advance(monotonicMillis());
+    runTasks();
+    flushOutput();
+}
+
+void EventLoop::runAgain(Waitable *handled)
+{
+    // Handlers can remove objects, which takes them off the list
+    while(!m_Running.empty())
+    {
+        Waitable *obj = m_Running.back();
+        m_Running.pop_back();
+        // Already had its turn
+        if(obj == handled)
+            continue;
+        std::map<Waitable*, EventHandler*>::iterator it;
+        it = m_Handlers.find(obj);
+        if(it != m_Handlers.end())
+            it->second->ready(this, obj);
+    }
+}
+
+void EventLoop::runTasks()
+{
+    LoopTask *task;
+    while((task = m_Mailbox.pop()) != NULL)
+    {
+        task->run(this);
+        delete task;
+    }
+}
+
+void EventLoop::ScheduleFlush(Flushable *obj)
+{
+    m_Flush.push_back(obj);
+}
+
+void EventLoop::CancelFlush(Flushable *obj)
+{
+    m_Flush.erase(std::remove(m_Flush.begin(), m_Flush.end(), obj),
+            m_Flush.end());
+    m_Flushing.erase(std::remove(m_Flushing.begin(), m_Flushing.end(), obj),
+            m_Flushing.end());
+}
+
+void EventLoop::flushOutput()
+{
+    // Objects can be scheduled again (or cancelled) while flushing
+    m_Flushing.swap(m_Flush);
+    while(!m_Flushing.empty())
+    {
+        Flushable *obj = m_Flushing.back();
+        m_Flushing.pop_back();
+        try
+        {
+            obj->Flush();
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            // The handler will find out when reading
+        }
+    }
+}
+
+void EventLoop::run()
+{
+    while(!m_bStop)
+        runOnce();
+}
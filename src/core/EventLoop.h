@@ -0,0 +1,172 @@
+#ifndef HEADER_EVENTLOOP_H
+#define HEADER_EVENTLOOP_H
+
+#include <map>
+#include <vector>
+
+#include "sockets/Socket.h"
+#include "sockets/TCP.h"
+#include "sockets/TimerWheel.h"
+#include "common/Thread.h"
+#include "Mailbox.h"
+
+class EventLoop;
+
+/**
+ * A message sent to an EventLoop from another thread.
+ *
+ * Tasks are run on the thread of the loop they are posted to, then deleted.
+ */
+class LoopTask : public MailboxNode {
+
+public:
+    virtual ~LoopTask() {}
+    virtual void run(EventLoop *loop) = 0;
+
+};
+
+/**
+ * Callback for the Waitables handled by an EventLoop.
+ */
+class EventHandler {
+
+public:
+    virtual ~EventHandler() {}
+    /**
+     * Called from the thread of the loop when something happened on the
+     * Waitable (data can be read, connection was closed, ...).
+     */
+    virtual void ready(EventLoop *loop, Waitable *obj) = 0;
+
+};
+
+/**
+ * An event loop, running in its own thread.
+ *
+ * Each loop waits on its own SocketSet, so that a connection is only ever
+ * handled by a single thread; objects that belong to a loop must only be
+ * accessed from this thread. Other threads communicate with it by posting
+ * LoopTasks, through a lock-free mailbox.
+ *
+ * Output buffered by the objects of the loop (see Flushable) is sent at the
+ * end of each iteration, so everything a connection produced while handling
+ * an event goes out in one write.
+ */
+class EventLoop : public Thread, public FlushScheduler {
+
+private:
+    class AttachTask;
+    class StopTask;
+
+    SocketSet m_Set;
+    TimerWheel m_Timers;
+    std::map<Waitable*, EventHandler*> m_Handlers;
+    std::vector<Flushable*> m_Flush;
+    std::vector<Flushable*> m_Flushing;
+    std::vector<Waitable*> m_Again;
+    std::vector<Waitable*> m_Running;
+    Mailbox<LoopTask> m_Mailbox;
+    TCPSocket *m_pWakeRead;
+    TCPSocket *m_pWakeWrite;
+    volatile int m_iWakePending;
+    volatile int m_iLoad;
+    bool m_bStop;
+
+public:
+    EventLoop() throw(SocketError);
+    ~EventLoop();
+
+    /**
+     * Adds a Waitable to this loop.
+     *
+     * Must be called from the thread of the loop; use attach() from other
+     * threads.
+     */
+    void add(Waitable *obj, EventHandler *handler);
+
+    /**
+     * Removes a Waitable from this loop.
+     *
+     * Must be called from the thread of the loop.
+     */
+    bool remove(Waitable *obj);
+
+    /**
+     * Calls the handler of a Waitable again on the next iteration, whether
+     * or not something happens on it.
+     *
+     * This is for handlers that stopped before doing all they could, so that
+     * the other objects of the loop get their turn (see
+     * IRCClient::process()); the loop doesn't wait while such work is left,
+     * and no system call is needed to get back to it. Must be called from the
+     * thread of the loop.
+     */
+    void readyAgain(Waitable *obj);
+
+    /**
+     * Adds a Waitable to this loop, from any thread.
+     *
+     * The object is handed over to the loop: the calling thread must not use
+     * it anymore.
+     */
+    void attach(Waitable *obj, EventHandler *handler);
+
+    /**
+     * Posts a task to be run on the thread of this loop.
+     *
+     * Can be called from any thread. The task is deleted after it ran.
+     */
+    void post(LoopTask *task);
+
+    /** Asks the loop to stop; can be called from any thread. */
+    void stop();
+
+    /**
+     * Runs one iteration of the loop: waits for an event, handles it, calls
+     * the handlers that asked with readyAgain(), fires the timers that
+     * expired, then runs the tasks that were posted.
+     *
+     * @param timeout Maximum time (in milliseconds) to wait for an event; a
+     * negative value means to wait forever. The wait is shortened so that
+     * timers fire on time, and doesn't happen if handlers are to be called
+     * again.
+     */
+    void runOnce(int timeout = -1);
+
+    /**
+     * The timers of this loop.
+     *
+     * Must only be used from the thread of the loop; timers fire from
+     * runOnce().
+     */
+    inline TimerWheel &timers()
+    {
+        return m_Timers;
+    }
+
+    /**
+     * Flushes an object at the end of the current iteration.
+     *
+     * Must be called from the thread of the loop.
+     */
+    void ScheduleFlush(Flushable *obj);
+
+    void CancelFlush(Flushable *obj);
+
+    /** Number of Waitables handled by this loop. */
+    inline int load() const
+    {
+        return m_iLoad;
+    }
+
+protected:
+    void run();
+
+private:
+    void runAgain(Waitable *handled);
+    void runTasks();
+    void flushOutput();
+
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "HandshakePool.h"
+
+#include "common/Clock.h"
+#include "common/Metrics.h"
+
+static Histogram &queueWaitTime =
+        Metrics::global().histogram("ssl.handshake_queue_us");
+static Histogram &handshakeDuration =
+        Metrics::global().histogram("ssl.handshake_us");
+static Counter &queuedHandshakes =
+        Metrics::global().counter("ssl.handshake_queue");
+static Counter &handshakeFailures =
+        Metrics::global().counter("ssl.handshake_failures");
+
+/**
+ * Sets the timeout of the blocking reads and writes on a socket; 0 waits
+ * forever.
+ */
+static void SetTimeouts(int sock, unsigned int timeout)
+{
+#ifndef __WIN32__
+    struct timeval tv;
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+#else
+    DWORD tv = timeout;
+#endif
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof(tv));
+}
+
+class HandshakePool::Job {
+
+public:
+    SSLClient *client;
+    EventLoop *loop;
+    HandshakeObserver *observer;
+    unsigned long long submitted;
+
+};
+
+class HandshakePool::Worker : public Thread {
+
+private:
+    HandshakePool *m_pPool;
+
+public:
+    Worker(HandshakePool *pool)
+      : m_pPool(pool)
+    {
+    }
+
+protected:
+    void run();
+
+};
+
+/**
+ * Hands the result back to the loop the handshake was submitted from.
+ */
+class HandshakePool::DoneTask : public LoopTask {
+
+private:
+    SSLClient *m_pClient;
+    HandshakeObserver *m_pObserver;
+    std::string m_sError;
+
+public:
+    DoneTask(SSLClient *client, HandshakeObserver *observer,
+            const std::string &error)
+      : m_pClient(client), m_pObserver(observer), m_sError(error)
+    {
+    }
+
+    void run(EventLoop*)
+    {
+        if(m_pClient != NULL)
+            m_pObserver->handshakeDone(m_pClient);
+        else
+            m_pObserver->handshakeFailed(m_sError);
+    }
+
+};
+
+void HandshakePool::Worker::run()
+{
+    Job *job;
+    while((job = m_pPool->nextJob()) != NULL)
+    {
+        unsigned long long start = monotonicMicros();
+        m_pPool->m_QueueWait.record(start - job->submitted);
+        queueWaitTime.record(start - job->submitted);
+        SSLClient *client = job->client;
+        std::string error;
+        // SSL_connect()/SSL_accept() block on the socket: bound each wait,
+        // then give the loop back a socket without timeouts
+        SetTimeouts(client->GetSocket(), m_pPool->m_iTimeout);
+        try {
+            client->Handshake();
+            SetTimeouts(client->GetSocket(), 0);
+        }
+        catch(SSLError &e)
+        {
+            error = e.what();
+            delete client;
+            client = NULL;
+            __sync_fetch_and_add(&m_pPool->m_iFailures, 1);
+            handshakeFailures.add();
+        }
+        unsigned long long duration = monotonicMicros() - start;
+        m_pPool->m_HandshakeTime.record(duration);
+        handshakeDuration.record(duration);
+        job->loop->post(new DoneTask(client, job->observer, error));
+        delete job;
+    }
+}
+
+HandshakePool::HandshakePool(unsigned int threads, size_t max_queue,
+        unsigned int timeout)
+  : m_iMaxQueue(max_queue), m_iTimeout(timeout), m_bStop(false),
+    m_iFailures(0)
+{
+    unsigned int i;
+    for(i = 0; i < threads; i++)
+    {
+        Worker *worker = new Worker(this);
+        if(worker->start())
+            m_Workers.push_back(worker);
+        else
+            delete worker;
+    }
+}
+
+HandshakePool::~HandshakePool()
+{
+    {
+        MutexLock lock(m_Mutex);
+        m_bStop = true;
+        m_Condition.broadcast();
+    }
+    std::vector<Worker*>::iterator w = m_Workers.begin();
+    for(; w != m_Workers.end(); ++w)
+    {
+        (*w)->join();
+        delete *w;
+    }
+    std::deque<Job*>::iterator j = m_Queue.begin();
+    for(; j != m_Queue.end(); ++j)
+    {
+        (*j)->loop->post(new DoneTask(NULL, (*j)->observer,
+                "Handshake aborted"));
+        delete (*j)->client;
+        delete *j;
+    }
+    queuedHandshakes.sub(m_Queue.size());
+}
+
+bool HandshakePool::submit(SSLClient *client, EventLoop *loop,
+        HandshakeObserver *observer)
+{
+    MutexLock lock(m_Mutex);
+    if(m_Workers.empty() || m_Queue.size() >= m_iMaxQueue)
+        return false;
+    Job *job = new Job;
+    job->client = client;
+    job->loop = loop;
+    job->observer = observer;
+    job->submitted = monotonicMicros();
+    m_Queue.push_back(job);
+    queuedHandshakes.add();
+    m_Condition.signal();
+    return true;
+}
+
+size_t HandshakePool::queueDepth()
+{
+    MutexLock lock(m_Mutex);
+    return m_Queue.size();
+}
+
+HandshakePool::Job *HandshakePool::nextJob()
+{
+    MutexLock lock(m_Mutex);
+    while(!m_bStop && m_Queue.empty())
+        m_Condition.wait(m_Mutex);
+    if(m_bStop)
+        return NULL;
+    Job *job = m_Queue.front();
+    m_Queue.pop_front();
+    queuedHandshakes.sub();
+    return job;
+}
@@ -0,0 +1,127 @@
+#ifndef HEADER_HANDSHAKEPOOL_H
+#define HEADER_HANDSHAKEPOOL_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "sockets/SSLSocket.h"
+#include "common/Histogram.h"
+#include "common/Thread.h"
+#include "EventLoop.h"
+
+/**
+ * Callback for a handshake done by a HandshakePool.
+ */
+class HandshakeObserver {
+
+public:
+    virtual ~HandshakeObserver() {}
+    /**
+     * Called on the thread of the loop the handshake was submitted from, once
+     * the connection is ready to be used.
+     */
+    virtual void handshakeDone(SSLClient *client) = 0;
+    /**
+     * Called on the thread of the loop the handshake was submitted from, if
+     * the handshake failed. The client has been deleted.
+     */
+    virtual void handshakeFailed(const std::string &error) = 0;
+
+};
+
+/**
+ * A pool of threads doing SSL handshakes.
+ *
+ * The key exchange of an SSL handshake is expensive; when a lot of them
+ * happen at once (reconnecting to all the networks, or a lot of clients
+ * reattaching), doing them on the event loops would stall every other
+ * connection of these loops. Instead, a connection created with
+ * SSLClient::Prepare() or SSLServer::AcceptDeferred() can be submitted to
+ * this pool, which hands it back to the loop once the handshake is done.
+ */
+class HandshakePool {
+
+public:
+    /** Default for the timeout of the handshakes, in milliseconds. */
+    static const unsigned int DEFAULT_TIMEOUT = 10000;
+
+private:
+    class Job;
+    class Worker;
+    class DoneTask;
+
+    std::vector<Worker*> m_Workers;
+    std::deque<Job*> m_Queue;
+    const size_t m_iMaxQueue;
+    const unsigned int m_iTimeout;
+    Mutex m_Mutex;
+    Condition m_Condition;
+    bool m_bStop;
+
+    Histogram m_QueueWait;
+    Histogram m_HandshakeTime;
+    volatile unsigned int m_iFailures;
+
+public:
+    /**
+     * Constructor: starts the threads.
+     *
+     * @param threads Number of threads doing handshakes.
+     * @param max_queue Maximum number of handshakes waiting for a thread.
+     * @param timeout Maximum time (in milliseconds) a handshake waits on each
+     * read or write; a peer that stops answering fails the handshake instead
+     * of holding a thread forever. 0 waits forever.
+     */
+    HandshakePool(unsigned int threads, size_t max_queue = 256,
+            unsigned int timeout = DEFAULT_TIMEOUT);
+
+    /**
+     * Destructor: stops the threads; pending handshakes are aborted.
+     *
+     * Waits for the handshakes in progress (at most the timeout). Their
+     * results and the aborted handshakes are posted to the loops they were
+     * submitted from, so the pool has to be destroyed before these loops, and
+     * the observers have to stay around until the loops run the posted tasks.
+     */
+    ~HandshakePool();
+
+    /**
+     * Submits a connection to do the handshake on.
+     *
+     * Must be called from the thread of the given loop. The client belongs to
+     * the pool until the observer is called.
+     * @return false if the queue is full, in which case nothing was done and
+     * the caller keeps the client (it might do the handshake itself or drop
+     * the connection).
+     */
+    bool submit(SSLClient *client, EventLoop *loop,
+            HandshakeObserver *observer);
+
+    /** Number of handshakes waiting for a thread. */
+    size_t queueDepth();
+
+    /** Time spent waiting for a thread, in microseconds. */
+    inline const Histogram &queueWait() const
+    {
+        return m_QueueWait;
+    }
+
+    /** Duration of the handshakes themselves, in microseconds. */
+    inline const Histogram &handshakeTime() const
+    {
+        return m_HandshakeTime;
+    }
+
+    /** Number of handshakes that failed. */
+    inline unsigned int failures() const
+    {
+        return m_iFailures;
+    }
+
+private:
+    Job *nextJob();
+
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef HEADER_MAILBOX_H
+#define HEADER_MAILBOX_H
+
+#include <cstddef>
+
+/**
+ * Base class for the objects that can be posted to a Mailbox.
+ *
+ * The link is stored in the object itself, so posting doesn't allocate.
+ */
+class MailboxNode {
+
+public:
+    MailboxNode *volatile m_pNext;
+
+    MailboxNode()
+      : m_pNext(NULL)
+    {
+    }
+
+};
+
+/**
+ * A lock-free multiple-producers single-consumer queue.
+ *
+ * Any thread can push(), but only one thread (the owner of the mailbox) may
+ * pop(). Pushing is a single atomic exchange, and the consumer never blocks
+ * the producers.
+ *
+ * This is the intrusive queue described by Dmitry Vyukov; T has to derive
+ * from MailboxNode, and a node may only be in one mailbox at a time.
+ */
+template<class T>
+class Mailbox {
+
+private:
+    MailboxNode *volatile m_pHead;
+    MailboxNode *m_pTail;
+    MailboxNode m_Stub;
+
+    Mailbox(const Mailbox&);
+    Mailbox &operator=(const Mailbox&);
+
+    void pushNode(MailboxNode *node)
+    {
+        node->m_pNext = NULL;
+        __sync_synchronize();
+        MailboxNode *prev = __sync_lock_test_and_set(&m_pHead, node);
+        prev->m_pNext = node;
+    }
+
+public:
+    Mailbox()
+      : m_pHead(&m_Stub), m_pTail(&m_Stub)
+    {
+    }
+
+    /** Adds an object to the queue; can be called from any thread. */
+    void push(T *obj)
+    {
+        pushNode(obj);
+    }
+
+    /**
+     * Gets the next object from the queue.
+     *
+     * May only be called from the consumer thread.
+     * @return The oldest object or NULL. Note that NULL might be returned if
+     * a producer is in the middle of a push(); it will be available on the
+     * next call.
+     */
+    T *pop()
+    {
+        MailboxNode *tail = m_pTail;
+        MailboxNode *next = tail->m_pNext;
+        if(tail == &m_Stub)
+        {
+            if(next == NULL)
+                return NULL;
+            m_pTail = next;
+            tail = next;
+            next = next->m_pNext;
+        }
+        if(next != NULL)
+        {
+            m_pTail = next;
+            __sync_synchronize();
+            return static_cast<T*>(tail);
+        }
+        if(tail != m_pHead)
+            return NULL;
+        pushNode(&m_Stub);
+        next = tail->m_pNext;
+        if(next != NULL)
+        {
+            m_pTail = next;
+            __sync_synchronize();
+            return static_cast<T*>(tail);
+        }
+        return NULL;
+    }
+
+};
+
+#endif
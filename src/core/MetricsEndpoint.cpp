@@ -0,0 +1,85 @@
+#include "MetricsEndpoint.h"
+
+#include <cstring>
+#include <vector>
+
+#ifndef __WIN32__
+    #include <fcntl.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * Makes a socket non-blocking.
+ */
+static bool SetNonBlocking(int sock)
+{
+#ifndef __WIN32__
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags != -1 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+#else
+    return false;
+#endif
+}
+
+MetricsEndpoint::MetricsEndpoint(const std::string &path,
+        const Metrics &metrics)
+    throw(SocketCantUsePort)
+  : m_pServer(NULL), m_sPath(path), m_Metrics(metrics)
+{
+#ifndef __WIN32__
+    struct sockaddr_un sun;
+    if(path.empty() || path.size() >= sizeof(sun.sun_path))
+        throw SocketCantUsePort();
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    memcpy(sun.sun_path, path.c_str(), path.size());
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sock == -1)
+        throw SocketCantUsePort();
+    // Left behind by a process that didn't exit cleanly
+    unlink(path.c_str());
+    if( (bind(sock, (struct sockaddr*)&sun, sizeof(sun)) == -1)
+     || (listen(sock, 16) == -1)
+     || !SetNonBlocking(sock) )
+    {
+        close(sock);
+        throw SocketCantUsePort();
+    }
+    m_pServer = new TCPServer(sock);
+#else
+    throw SocketCantUsePort();
+#endif
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+    delete m_pServer;
+#ifndef __WIN32__
+    unlink(m_sPath.c_str());
+#endif
+}
+
+void MetricsEndpoint::ready(EventLoop*, Waitable*)
+{
+    std::vector<TCPSocket*> sockets;
+    m_pServer->AcceptAll(&sockets);
+    if(sockets.empty())
+        return ;
+    std::string dump = m_Metrics.dump();
+    std::vector<TCPSocket*>::iterator it = sockets.begin();
+    for(; it != sockets.end(); ++it)
+    {
+        SetNonBlocking((*it)->GetSocket());
+        try
+        {
+            (*it)->Send(dump.data(), dump.size());
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            // Gone already, or not reading
+        }
+        delete *it;
+    }
+}
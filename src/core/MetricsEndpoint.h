@@ -0,0 +1,68 @@
+#ifndef HEADER_METRICSENDPOINT_H
+#define HEADER_METRICSENDPOINT_H
+
+#include <string>
+
+#include "common/Metrics.h"
+#include "EventLoop.h"
+
+/**
+ * Serves Metrics::dump() on a local (Unix domain) socket.
+ *
+ * Each connection gets the current values, in the format of dump(), and is
+ * closed right away; ie "nc -U <path>" prints the metrics of the process.
+ * The socket is only reachable from the machine, with the permissions of its
+ * file.
+ *
+ * The endpoint is an EventHandler for its own listener:
+ * @code
+ * MetricsEndpoint endpoint("metrics.sock");
+ * loop->attach(endpoint.server(), &endpoint);
+ * @endcode
+ * The connections are answered from the loop without blocking it: a client
+ * that doesn't read gets a truncated dump (the socket buffer is much larger
+ * than a dump, though).
+ */
+class MetricsEndpoint : public EventHandler {
+
+private:
+    TCPServer *m_pServer;
+    std::string m_sPath;
+    const Metrics &m_Metrics;
+
+public:
+    /**
+     * Constructor: listens on a Unix domain socket.
+     *
+     * @param path Path of the socket; a stale file there is replaced.
+     * @param metrics The registry to serve.
+     * @throws SocketCantUsePort if the socket can't be created, or on
+     * Windows.
+     */
+    MetricsEndpoint(const std::string &path,
+            const Metrics &metrics = Metrics::global())
+        throw(SocketCantUsePort);
+
+    /**
+     * Destructor: closes the listener and removes the file.
+     *
+     * The listener must have been removed from its loop first.
+     */
+    ~MetricsEndpoint();
+
+    /** The listener, to add to a loop with this endpoint as handler. */
+    inline TCPServer *server()
+    {
+        return m_pServer;
+    }
+
+    inline const std::string &path() const
+    {
+        return m_sPath;
+    }
+
+    void ready(EventLoop *loop, Waitable *obj);
+
+};
+
+#endif
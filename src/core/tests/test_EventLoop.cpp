@@ -0,0 +1,358 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <ctime>
+#include <set>
+#include <vector>
+
+#ifdef __WIN32__
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "CoreRuntime.h"
+#include "EventLoop.h"
+#include "common/Clock.h"
+
+static void pause(unsigned int ms)
+{
+#ifdef __WIN32__
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+/**
+ * A connected pair of sockets.
+ */
+struct SocketPair {
+
+    TCPSocket *client;
+    TCPSocket *accepted;
+
+    SocketPair()
+    {
+        TCPServer *server = TCPServer::Listen(0);
+        client = TCPSocket::Connect("127.0.0.1", server->GetLocalPort());
+        accepted = server->Accept(-1);
+        delete server;
+    }
+
+    ~SocketPair()
+    {
+        delete client;
+        delete accepted;
+    }
+
+};
+
+class CountTask : public LoopTask {
+
+private:
+    volatile int *m_pCount;
+
+public:
+    CountTask(volatile int *count)
+      : m_pCount(count)
+    {
+    }
+
+    void run(EventLoop*)
+    {
+        __sync_fetch_and_add(m_pCount, 1);
+    }
+
+};
+
+class Poster : public Thread {
+
+private:
+    EventLoop *m_pLoop;
+    volatile int *m_pCount;
+    unsigned int m_iTasks;
+    unsigned int m_iDelay;
+
+public:
+    Poster(EventLoop *loop, volatile int *count, unsigned int tasks,
+            unsigned int delay = 0)
+      : m_pLoop(loop), m_pCount(count), m_iTasks(tasks), m_iDelay(delay)
+    {
+    }
+
+protected:
+    void run()
+    {
+        if(m_iDelay > 0)
+            pause(m_iDelay);
+        unsigned int i;
+        for(i = 0; i < m_iTasks; i++)
+            m_pLoop->post(new CountTask(m_pCount));
+    }
+
+};
+
+/**
+ * Records the calls, drains the sockets, and asks to be called again if
+ * told to.
+ */
+class RecordingHandler : public EventHandler {
+
+public:
+    std::vector<Waitable*> calls;
+    unsigned int again;
+
+    RecordingHandler()
+      : again(0)
+    {
+    }
+
+    void ready(EventLoop *loop, Waitable *obj)
+    {
+        calls.push_back(obj);
+        TCPSocket *sock = dynamic_cast<TCPSocket*>(obj);
+        char buffer[64];
+        if(sock != NULL)
+            sock->Recv(buffer, sizeof(buffer), false);
+        if(again > 0)
+        {
+            again--;
+            loop->readyAgain(obj);
+        }
+    }
+
+};
+
+class CountingFlushable : public Flushable {
+
+public:
+    unsigned int flushes;
+
+    CountingFlushable()
+      : flushes(0)
+    {
+    }
+
+    void Flush() throw(SocketConnectionClosed)
+    {
+        flushes++;
+    }
+
+};
+
+class FlagTimer : public Timer {
+
+public:
+    bool expired;
+
+    FlagTimer()
+      : expired(false)
+    {
+    }
+
+    void Expired()
+    {
+        expired = true;
+    }
+
+};
+
+class CountingAcceptHandler : public AcceptHandler {
+
+public:
+    volatile int count;
+
+    CountingAcceptHandler()
+      : count(0)
+    {
+    }
+
+    void accepted(EventLoop*, TCPSocket *sock)
+    {
+        delete sock;
+        __sync_fetch_and_add(&count, 1);
+    }
+
+};
+
+class EventLoop_Test : public CppUnit::TestFixture {
+
+public:
+    void test_post()
+    {
+        EventLoop loop;
+        volatile int count = 0;
+        std::vector<Poster*> posters;
+        unsigned int i;
+        for(i = 0; i < 4; i++)
+        {
+            posters.push_back(new Poster(&loop, &count, 10000));
+            posters.back()->start();
+        }
+        time_t start = time(NULL);
+        while(count < 40000 && time(NULL) - start < 10)
+            loop.runOnce(1000);
+        for(i = 0; i < posters.size(); i++)
+        {
+            posters[i]->join();
+            delete posters[i];
+        }
+        CPPUNIT_ASSERT(count == 40000);
+    }
+
+    void test_wakeup()
+    {
+        // A task posted from another thread interrupts the wait
+        EventLoop loop;
+        volatile int count = 0;
+        Poster poster(&loop, &count, 1, 50);
+        poster.start();
+        time_t start = time(NULL);
+        while(count == 0 && time(NULL) - start < 10)
+            loop.runOnce(5000);
+        time_t elapsed = time(NULL) - start;
+        poster.join();
+        CPPUNIT_ASSERT(count == 1);
+        CPPUNIT_ASSERT(elapsed < 3);
+    }
+
+    void test_attach()
+    {
+        EventLoop loop;
+        SocketPair pair;
+        RecordingHandler handler;
+        loop.attach(pair.accepted, &handler);
+        CPPUNIT_ASSERT(loop.load() == 1);
+        loop.runOnce(0);
+        pair.client->Send("x", 1);
+        time_t start = time(NULL);
+        while(handler.calls.empty() && time(NULL) - start < 5)
+            loop.runOnce(1000);
+        CPPUNIT_ASSERT(handler.calls.size() == 1);
+        CPPUNIT_ASSERT(handler.calls[0] == pair.accepted);
+
+        CPPUNIT_ASSERT(loop.remove(pair.accepted));
+        CPPUNIT_ASSERT(!loop.remove(pair.accepted));
+        CPPUNIT_ASSERT(loop.load() == 0);
+        pair.client->Send("y", 1);
+        loop.runOnce(50);
+        CPPUNIT_ASSERT(handler.calls.size() == 1);
+    }
+
+    void test_timers()
+    {
+        EventLoop loop;
+        FlagTimer timer;
+        loop.timers().Schedule(&timer, 30);
+        unsigned long long start = monotonicMillis();
+        while(!timer.expired && monotonicMillis() - start < 5000)
+            loop.runOnce(-1);
+        unsigned long long elapsed = monotonicMillis() - start;
+        CPPUNIT_ASSERT(timer.expired);
+        CPPUNIT_ASSERT(elapsed >= 25 && elapsed < 2000);
+    }
+
+    void test_flush()
+    {
+        EventLoop loop;
+        CountingFlushable flushable;
+        loop.ScheduleFlush(&flushable);
+        CPPUNIT_ASSERT(flushable.flushes == 0);
+        loop.runOnce(0);
+        CPPUNIT_ASSERT(flushable.flushes == 1);
+        loop.runOnce(0);
+        CPPUNIT_ASSERT(flushable.flushes == 1);
+
+        loop.ScheduleFlush(&flushable);
+        loop.CancelFlush(&flushable);
+        loop.runOnce(0);
+        CPPUNIT_ASSERT(flushable.flushes == 1);
+    }
+
+    void test_readyAgain()
+    {
+        EventLoop loop;
+        SocketPair pair;
+        RecordingHandler handler;
+        loop.add(pair.accepted, &handler);
+        handler.again = 2;
+        pair.client->Send("x", 1);
+        unsigned long long start = monotonicMillis();
+        while(handler.calls.empty() && monotonicMillis() - start < 5000)
+            loop.runOnce(1000);
+        CPPUNIT_ASSERT(handler.calls.size() == 1);
+
+        // Called again without being readable, and without waiting
+        start = monotonicMillis();
+        loop.runOnce(5000);
+        CPPUNIT_ASSERT(handler.calls.size() == 2);
+        loop.runOnce(5000);
+        CPPUNIT_ASSERT(handler.calls.size() == 3);
+        CPPUNIT_ASSERT(monotonicMillis() - start < 2000);
+        loop.runOnce(50);
+        CPPUNIT_ASSERT(handler.calls.size() == 3);
+
+        // Removing the object cancels it
+        handler.again = 1;
+        pair.client->Send("y", 1);
+        start = monotonicMillis();
+        while(handler.calls.size() == 3 && monotonicMillis() - start < 5000)
+            loop.runOnce(1000);
+        CPPUNIT_ASSERT(handler.calls.size() == 4);
+        loop.remove(pair.accepted);
+        loop.runOnce(50);
+        CPPUNIT_ASSERT(handler.calls.size() == 4);
+    }
+
+    void test_leastLoaded()
+    {
+        SocketPair pairs[4];
+        RecordingHandler handler;
+        {
+            // Not started: the objects stay in the mailboxes
+            CoreRuntime runtime(3);
+            std::set<EventLoop*> loops;
+            int i;
+            for(i = 0; i < 3; i++)
+                loops.insert(runtime.attach(pairs[i].accepted, &handler));
+            CPPUNIT_ASSERT(loops.size() == 3);
+            runtime.getLoop(1)->attach(pairs[3].client, &handler);
+            EventLoop *loop = runtime.attach(pairs[3].accepted, &handler);
+            CPPUNIT_ASSERT(loop != runtime.getLoop(1));
+            CPPUNIT_ASSERT(loop->load() == 2);
+        }
+    }
+
+    void test_listen()
+    {
+        CoreRuntime runtime(2);
+        runtime.start();
+        CountingAcceptHandler handler;
+        int port = runtime.listen(0, &handler);
+        std::vector<TCPSocket*> clients;
+        int i;
+        for(i = 0; i < 8; i++)
+            clients.push_back(TCPSocket::Connect("127.0.0.1", port));
+        time_t start = time(NULL);
+        while(handler.count < 8 && time(NULL) - start < 5)
+            pause(10);
+        runtime.stop();
+        for(i = 0; i < 8; i++)
+            delete clients[i];
+        CPPUNIT_ASSERT(handler.count == 8);
+    }
+
+    CPPUNIT_TEST_SUITE(EventLoop_Test);
+    CPPUNIT_TEST(test_post);
+    CPPUNIT_TEST(test_wakeup);
+    CPPUNIT_TEST(test_attach);
+    CPPUNIT_TEST(test_timers);
+    CPPUNIT_TEST(test_flush);
+    CPPUNIT_TEST(test_readyAgain);
+    CPPUNIT_TEST(test_leastLoaded);
+    CPPUNIT_TEST(test_listen);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(EventLoop_Test);
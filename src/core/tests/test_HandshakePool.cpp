@@ -0,0 +1,200 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string>
+#include <vector>
+
+#include "HandshakePool.h"
+#include "common/Clock.h"
+#include "common/Metrics.h"
+
+/**
+ * Connects a plain TCP peer to an SSL client; the peer never speaks SSL.
+ */
+static SSLClient *silentPeer(TCPSocket **peer)
+{
+    TCPServer *server = TCPServer::Listen(0);
+    *peer = TCPSocket::Connect("127.0.0.1", server->GetLocalPort());
+    TCPSocket *accepted = server->Accept(-1);
+    delete server;
+    return SSLClient::Prepare(accepted, SSLClient::CLIENT);
+}
+
+class RecordingHandshakeObserver : public HandshakeObserver {
+
+public:
+    std::vector<SSLClient*> done;
+    std::vector<std::string> errors;
+
+    void handshakeDone(SSLClient *client)
+    {
+        done.push_back(client);
+    }
+
+    void handshakeFailed(const std::string &error)
+    {
+        errors.push_back(error);
+    }
+
+    /** Runs the loop until there are that many results. */
+    void waitFor(EventLoop *loop, size_t results)
+    {
+        unsigned long long start = monotonicMillis();
+        while(done.size() + errors.size() < results
+         && monotonicMillis() - start < 5000)
+            loop->runOnce(100);
+    }
+
+};
+
+class HandshakePool_Test : public CppUnit::TestFixture {
+
+public:
+    void setUp()
+    {
+        SSLSocket::Init();
+    }
+
+    void test_timeout()
+    {
+        // A peer that doesn't answer fails the handshake after the timeout
+        EventLoop loop;
+        RecordingHandshakeObserver observer;
+        HandshakePool pool(1, 256, 200);
+        Metrics &metrics = Metrics::global();
+        unsigned long long handshakes =
+                metrics.histogram("ssl.handshake_us").count();
+        unsigned long long waits =
+                metrics.histogram("ssl.handshake_queue_us").count();
+        long long failures =
+                metrics.counter("ssl.handshake_failures").value();
+        TCPSocket *peer;
+        SSLClient *client = silentPeer(&peer);
+        unsigned long long start = monotonicMillis();
+        CPPUNIT_ASSERT(pool.submit(client, &loop, &observer));
+        observer.waitFor(&loop, 1);
+        unsigned long long elapsed = monotonicMillis() - start;
+        delete peer;
+
+        CPPUNIT_ASSERT(observer.done.empty());
+        CPPUNIT_ASSERT(observer.errors.size() == 1);
+        CPPUNIT_ASSERT(elapsed >= 150 && elapsed < 3000);
+        CPPUNIT_ASSERT(pool.failures() == 1);
+        CPPUNIT_ASSERT(pool.queueWait().count() == 1);
+        CPPUNIT_ASSERT(pool.handshakeTime().count() == 1);
+        CPPUNIT_ASSERT(pool.handshakeTime().max() >= 150000);
+        // The pool also reports to the process metrics
+        CPPUNIT_ASSERT(metrics.histogram("ssl.handshake_us").count()
+                == handshakes + 1);
+        CPPUNIT_ASSERT(metrics.histogram("ssl.handshake_queue_us").count()
+                == waits + 1);
+        CPPUNIT_ASSERT(metrics.counter("ssl.handshake_failures").value()
+                == failures + 1);
+    }
+
+    void test_garbage()
+    {
+        // A peer answering something else than SSL fails right away
+        EventLoop loop;
+        RecordingHandshakeObserver observer;
+        HandshakePool pool(1);
+        TCPSocket *peer;
+        SSLClient *client = silentPeer(&peer);
+        const char garbage[] = "NOTICE AUTH :*** This is not SSL\r\n";
+        peer->Send(garbage, sizeof(garbage) - 1);
+        unsigned long long start = monotonicMillis();
+        CPPUNIT_ASSERT(pool.submit(client, &loop, &observer));
+        observer.waitFor(&loop, 1);
+        unsigned long long elapsed = monotonicMillis() - start;
+        delete peer;
+
+        CPPUNIT_ASSERT(observer.errors.size() == 1);
+        CPPUNIT_ASSERT(elapsed < HandshakePool::DEFAULT_TIMEOUT / 2);
+        CPPUNIT_ASSERT(pool.failures() == 1);
+    }
+
+    void test_abort()
+    {
+        // Destroying the pool waits for the current handshake (bounded by
+        // the timeout), and aborts the queued ones
+        EventLoop loop;
+        RecordingHandshakeObserver observer;
+        std::vector<TCPSocket*> peers(3);
+        Counter &queued = Metrics::global().counter("ssl.handshake_queue");
+        long long queued_before = queued.value();
+        unsigned long long start;
+        {
+            HandshakePool pool(1, 256, 300);
+            size_t i;
+            for(i = 0; i < peers.size(); i++)
+                CPPUNIT_ASSERT(pool.submit(silentPeer(&peers[i]), &loop,
+                        &observer));
+            start = monotonicMillis();
+        }
+        unsigned long long elapsed = monotonicMillis() - start;
+        observer.waitFor(&loop, 3);
+        size_t i;
+        for(i = 0; i < peers.size(); i++)
+            delete peers[i];
+
+        CPPUNIT_ASSERT(elapsed < 3000);
+        CPPUNIT_ASSERT(observer.done.empty());
+        CPPUNIT_ASSERT(observer.errors.size() == 3);
+        unsigned int aborted = 0;
+        for(i = 0; i < observer.errors.size(); i++)
+            if(observer.errors[i] == "Handshake aborted")
+                aborted++;
+        CPPUNIT_ASSERT(aborted >= 2);
+        CPPUNIT_ASSERT(queued.value() == queued_before);
+    }
+
+    void test_acceptAll()
+    {
+        // An SSLServer leaves the handshakes to the pool: a client that
+        // doesn't send anything doesn't block AcceptAll()
+        EventLoop loop;
+        RecordingHandshakeObserver observer;
+        HandshakePool pool(1, 256, 200);
+        SSLServer *server = SSLServer::Listen(0);
+        TCPSocket *peer = TCPSocket::Connect("127.0.0.1",
+                server->GetLocalPort());
+        CPPUNIT_ASSERT(server->Wait(5000));
+        std::vector<TCPSocket*> sockets;
+        unsigned long long start = monotonicMillis();
+        CPPUNIT_ASSERT(server->AcceptAll(&sockets) == 1);
+        CPPUNIT_ASSERT(monotonicMillis() - start < 100);
+        SSLClient *client = dynamic_cast<SSLClient*>(sockets[0]);
+        CPPUNIT_ASSERT(client != NULL);
+        CPPUNIT_ASSERT(!client->IsHandshakeDone());
+
+        CPPUNIT_ASSERT(pool.submit(client, &loop, &observer));
+        observer.waitFor(&loop, 1);
+        delete peer;
+        delete server;
+        CPPUNIT_ASSERT(observer.errors.size() == 1);
+    }
+
+    void test_noThreads()
+    {
+        // Refused: the caller keeps the client
+        EventLoop loop;
+        RecordingHandshakeObserver observer;
+        HandshakePool pool(0);
+        TCPSocket *peer;
+        SSLClient *client = silentPeer(&peer);
+        CPPUNIT_ASSERT(!pool.submit(client, &loop, &observer));
+        CPPUNIT_ASSERT(pool.queueDepth() == 0);
+        delete client;
+        delete peer;
+    }
+
+    CPPUNIT_TEST_SUITE(HandshakePool_Test);
+    CPPUNIT_TEST(test_timeout);
+    CPPUNIT_TEST(test_garbage);
+    CPPUNIT_TEST(test_abort);
+    CPPUNIT_TEST(test_acceptAll);
+    CPPUNIT_TEST(test_noThreads);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(HandshakePool_Test);
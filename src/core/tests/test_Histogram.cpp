@@ -0,0 +1,132 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <vector>
+
+#include "common/Histogram.h"
+#include "common/Thread.h"
+
+class Recorder : public Thread {
+
+private:
+    Histogram *m_pHistogram;
+    unsigned int m_iCount;
+
+public:
+    Recorder(Histogram *histogram, unsigned int count)
+      : m_pHistogram(histogram), m_iCount(count)
+    {
+    }
+
+protected:
+    void run()
+    {
+        unsigned int i;
+        for(i = 1; i <= m_iCount; i++)
+            m_pHistogram->record(i);
+    }
+
+};
+
+class Histogram_Test : public CppUnit::TestFixture {
+
+public:
+    void test_empty()
+    {
+        Histogram hist;
+        CPPUNIT_ASSERT(hist.count() == 0);
+        CPPUNIT_ASSERT(hist.mean() == 0);
+        CPPUNIT_ASSERT(hist.max() == 0);
+        CPPUNIT_ASSERT(hist.percentile(0.5) == 0);
+    }
+
+    void test_small()
+    {
+        // Below SUB_BUCKETS, each value has its own bucket
+        Histogram hist;
+        unsigned int i;
+        for(i = 0; i < Histogram::SUB_BUCKETS; i++)
+            hist.record(i);
+        CPPUNIT_ASSERT(hist.count() == Histogram::SUB_BUCKETS);
+        CPPUNIT_ASSERT(hist.max() == Histogram::SUB_BUCKETS - 1);
+        CPPUNIT_ASSERT(hist.percentile(0.5) == 7);
+        CPPUNIT_ASSERT(hist.percentile(0) == 0);
+        CPPUNIT_ASSERT(hist.percentile(1) == Histogram::SUB_BUCKETS - 1);
+    }
+
+    void test_percentiles()
+    {
+        Histogram hist;
+        unsigned long long i;
+        for(i = 1; i <= 1000; i++)
+            hist.record(i);
+        CPPUNIT_ASSERT(hist.count() == 1000);
+        CPPUNIT_ASSERT(hist.mean() == 500);
+        CPPUNIT_ASSERT(hist.max() == 1000);
+        // Within the size of a bucket: 1/16th of the power of two
+        unsigned long long p50 = hist.percentile(0.5);
+        CPPUNIT_ASSERT(p50 >= 500 && p50 < 500 + 500 / 16 + 1);
+        unsigned long long p90 = hist.percentile(0.9);
+        CPPUNIT_ASSERT(p90 >= 900 && p90 < 900 + 900 / 16 + 1);
+        unsigned long long p99 = hist.percentile(0.99);
+        CPPUNIT_ASSERT(p99 >= 990 && p99 <= 1000);
+        // Never above the maximum
+        CPPUNIT_ASSERT(hist.percentile(1) == 1000);
+
+        // Huge values, in the last buckets
+        hist.record(~0ULL);
+        CPPUNIT_ASSERT(hist.max() == ~0ULL);
+        CPPUNIT_ASSERT(hist.percentile(1) == ~0ULL);
+
+        hist.reset();
+        CPPUNIT_ASSERT(hist.count() == 0);
+        CPPUNIT_ASSERT(hist.max() == 0);
+    }
+
+    void test_merge()
+    {
+        Histogram a, b;
+        a.record(10);
+        a.record(20);
+        b.record(3000);
+        a.merge(b);
+        CPPUNIT_ASSERT(a.count() == 3);
+        CPPUNIT_ASSERT(a.mean() == 1010);
+        CPPUNIT_ASSERT(a.max() == 3000);
+        CPPUNIT_ASSERT(a.percentile(0.3) == 10);
+        CPPUNIT_ASSERT(b.count() == 1);
+    }
+
+    void test_threads()
+    {
+        // Recording from several threads loses nothing
+        const unsigned int THREADS = 4;
+        const unsigned int COUNT = 100000;
+        Histogram hist;
+        std::vector<Recorder*> recorders;
+        unsigned int i;
+        for(i = 0; i < THREADS; i++)
+        {
+            recorders.push_back(new Recorder(&hist, COUNT));
+            recorders.back()->start();
+        }
+        for(i = 0; i < THREADS; i++)
+        {
+            recorders[i]->join();
+            delete recorders[i];
+        }
+        CPPUNIT_ASSERT(hist.count() == THREADS * COUNT);
+        CPPUNIT_ASSERT(hist.max() == COUNT);
+        CPPUNIT_ASSERT(hist.mean() == (COUNT + 1) / 2);
+    }
+
+    CPPUNIT_TEST_SUITE(Histogram_Test);
+    CPPUNIT_TEST(test_empty);
+    CPPUNIT_TEST(test_small);
+    CPPUNIT_TEST(test_percentiles);
+    CPPUNIT_TEST(test_merge);
+    CPPUNIT_TEST(test_threads);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Histogram_Test);
@@ -0,0 +1,126 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <vector>
+
+#include "Mailbox.h"
+#include "common/Thread.h"
+
+class Message : public MailboxNode {
+
+public:
+    unsigned int producer;
+    unsigned int seq;
+
+};
+
+class Producer : public Thread {
+
+private:
+    Mailbox<Message> *m_pMailbox;
+    std::vector<Message> m_Messages;
+    volatile int *m_pFinished;
+
+public:
+    Producer(Mailbox<Message> *mailbox, unsigned int id, unsigned int count,
+            volatile int *finished)
+      : m_pMailbox(mailbox), m_Messages(count), m_pFinished(finished)
+    {
+        unsigned int i;
+        for(i = 0; i < count; i++)
+        {
+            m_Messages[i].producer = id;
+            m_Messages[i].seq = i;
+        }
+    }
+
+protected:
+    void run()
+    {
+        size_t i;
+        for(i = 0; i < m_Messages.size(); i++)
+            m_pMailbox->push(&m_Messages[i]);
+        __sync_fetch_and_add(m_pFinished, 1);
+    }
+
+};
+
+class Mailbox_Test : public CppUnit::TestFixture {
+
+public:
+    void test_order()
+    {
+        Mailbox<Message> mailbox;
+        CPPUNIT_ASSERT(mailbox.pop() == NULL);
+        Message messages[3];
+        int i;
+        for(i = 0; i < 3; i++)
+        {
+            messages[i].seq = i;
+            mailbox.push(&messages[i]);
+        }
+        CPPUNIT_ASSERT(mailbox.pop() == &messages[0]);
+        CPPUNIT_ASSERT(mailbox.pop() == &messages[1]);
+        // A node can be pushed again once it was popped
+        mailbox.push(&messages[0]);
+        CPPUNIT_ASSERT(mailbox.pop() == &messages[2]);
+        CPPUNIT_ASSERT(mailbox.pop() == &messages[0]);
+        CPPUNIT_ASSERT(mailbox.pop() == NULL);
+        CPPUNIT_ASSERT(mailbox.pop() == NULL);
+    }
+
+    void test_producers()
+    {
+        // Several threads pushing while the consumer pops: nothing is lost
+        // or duplicated, and the messages of each producer stay in order
+        const unsigned int PRODUCERS = 4;
+        const unsigned int COUNT = 200000;
+        Mailbox<Message> mailbox;
+        volatile int finished = 0;
+        std::vector<Producer*> producers;
+        unsigned int p;
+        for(p = 0; p < PRODUCERS; p++)
+            producers.push_back(new Producer(&mailbox, p, COUNT, &finished));
+        for(p = 0; p < PRODUCERS; p++)
+            producers[p]->start();
+
+        std::vector<unsigned int> next(PRODUCERS, 0);
+        unsigned int received = 0;
+        bool ordered = true;
+        for(;;)
+        {
+            // Read before popping: once all the producers are done, an empty
+            // mailbox means everything was received
+            bool done = (finished == (int)PRODUCERS);
+            Message *msg = mailbox.pop();
+            if(msg == NULL)
+            {
+                if(done)
+                    break;
+                continue;
+            }
+            if(msg->producer >= PRODUCERS
+             || msg->seq != next[msg->producer])
+                ordered = false;
+            else
+                next[msg->producer]++;
+            received++;
+        }
+
+        for(p = 0; p < PRODUCERS; p++)
+            producers[p]->join();
+        bool empty = (mailbox.pop() == NULL);
+        for(p = 0; p < PRODUCERS; p++)
+            delete producers[p];
+        CPPUNIT_ASSERT(ordered);
+        CPPUNIT_ASSERT(received == PRODUCERS * COUNT);
+        CPPUNIT_ASSERT(empty);
+    }
+
+    CPPUNIT_TEST_SUITE(Mailbox_Test);
+    CPPUNIT_TEST(test_order);
+    CPPUNIT_TEST(test_producers);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Mailbox_Test);
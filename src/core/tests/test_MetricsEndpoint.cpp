@@ -0,0 +1,89 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string>
+
+#ifndef __WIN32__
+    #include <cstring>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+#include "MetricsEndpoint.h"
+
+class MetricsEndpoint_Test : public CppUnit::TestFixture {
+
+public:
+#ifndef __WIN32__
+    /**
+     * Connects to the endpoint, lets the loop answer, and reads until the
+     * connection is closed.
+     */
+    static std::string fetch(MetricsEndpoint *endpoint, EventLoop *loop)
+    {
+        struct sockaddr_un sun;
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        strcpy(sun.sun_path, endpoint->path().c_str());
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        CPPUNIT_ASSERT(connect(sock, (struct sockaddr*)&sun, sizeof(sun))
+                == 0);
+        loop->runOnce(1000);
+
+        std::string result;
+        char buffer[256];
+        int ret;
+        while((ret = recv(sock, buffer, sizeof(buffer), 0)) > 0)
+            result.append(buffer, ret);
+        close(sock);
+        return result;
+    }
+#endif
+
+    void test_dump()
+    {
+#ifndef __WIN32__
+        Metrics metrics;
+        metrics.counter("test.requests").add(3);
+        metrics.histogram("test.latency_us").record(42);
+
+        std::string path = "test_metrics.sock";
+        // A stale socket file is replaced
+        {
+            MetricsEndpoint stale(path, metrics);
+        }
+        EventLoop loop;
+        MetricsEndpoint *endpoint = new MetricsEndpoint(path, metrics);
+        loop.add(endpoint->server(), endpoint);
+
+        std::string first = fetch(endpoint, &loop);
+        CPPUNIT_ASSERT(first == metrics.dump());
+        CPPUNIT_ASSERT(first.find("test.requests 3\n") != std::string::npos);
+
+        // Values are read for each connection
+        metrics.counter("test.requests").add();
+        std::string second = fetch(endpoint, &loop);
+        CPPUNIT_ASSERT(second.find("test.requests 4\n") != std::string::npos);
+
+        loop.remove(endpoint->server());
+        delete endpoint;
+        CPPUNIT_ASSERT(access(path.c_str(), F_OK) != 0);
+#endif
+    }
+
+    void test_badPath()
+    {
+        CPPUNIT_ASSERT_THROW(MetricsEndpoint(std::string(200, 'x')),
+                SocketCantUsePort);
+        CPPUNIT_ASSERT_THROW(MetricsEndpoint("no/such/dir/metrics.sock"),
+                SocketCantUsePort);
+    }
+
+    CPPUNIT_TEST_SUITE(MetricsEndpoint_Test);
+    CPPUNIT_TEST(test_dump);
+    CPPUNIT_TEST(test_badPath);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(MetricsEndpoint_Test);
@@ -35,14 +35,35 @@
  *     If multiple prefixes are specified, the server strips the one to the
  *   left and relays the command on the connection it identified.
  *
- * @li <tt>DSHOWLOG [#][[...]PREFIX2~]PREFIX1~<buffer> <range></tt> @n
+ * @li <tt>DSHOWLOG [#][[...]PREFIX2~]PREFIX1~<buffer> <range> [<stream id> <window>]</tt> @n
  *     Downloads the log for the specified date/position. @n
+ *     The answer is streamed back as <tt>DLOGDATA <stream id> <position>
+ *   :<line></tt> lines, terminated by a <tt>DLOGEND <stream id>
+ *   <status></tt> line, where status is COMPLETE, NOCONTENT (nothing matched
+ *   the range), ERROR or ABORTED (a connection on the way was lost). The
+ *   stream id is chosen by the querier, and the window is the number of
+ *   DLOGDATA lines it is ready to receive; <tt>DLOGCREDIT <stream id>
+ *   <lines></tt> allows the sender to send more. If they are omitted, "*"
+ *   and an unlimited window are assumed. @n
+ *     <tt>DLOGCANCEL <stream id></tt>, sent upstream, stops a stream before
+ *   its end (for instance because the client went away): the sender sends
+ *   nothing more for it, not even a DLOGEND, and relays forward the cancel
+ *   upstream. @n
+ *     Relays forward the DLOGDATA lines as they arrive. They send the
+ *   command upstream with their own window, and only give credit back as
+ *   they manage to forward lines downstream, so a slow client can't make
+ *   them buffer more than this window. @n
  *     The server receiving this request can either answer directly if it
  *   possesses the required content (in its logs or cached), or stripping the
  *   prefix to the left and relay the command on the connection it
  *   identified. @n
+ *     Relays keep the content they forwarded back in a bounded cache, keyed
+ *   by the remaining prefix chain, the buffer and the line positions, so
+ *   that repeated requests don't travel the whole chain again. Ranges that
+ *   extend to the end of a log are only served from the cache until the
+ *   owner of the log appends to it. @n
  *     When the last server is reached, if no content is to be sent back, it
- *   must indicate it back to the querier (TODO : how?). @n
+ *   answers with a DLOGEND with the NOCONTENT status. @n
  *     <buffer> may be:
  *     <ul>
  *     <li>"~server": messages from the server (that do not belong in a
@@ -51,6 +72,19 @@
  *     <li>"~systemlog": system logs of the core
  *     </ul>
  *
+ * @li <tt>DSEARCHLOG [#][[...]PREFIX2~]PREFIX1~<buffer> [max results] :<terms></tt> @n
+ *     Searches the log of the specified buffer for the lines containing all
+ *   of the given terms. @n
+ *     Terms are matched as whole words, case-insensitively; punctuation is
+ *   ignored but nicknames are kept whole. @n
+ *     The server holding the log answers with one or more
+ *   <tt>DSEARCHRESULT [#][[...]PREFIX2~]PREFIX1~<buffer> <segment>:<offset>
+ *   [...]</tt> lines, listing the positions of the most recent matches in
+ *   increasing order, followed by a DSEARCHRESULT with no position. These
+ *   lines can then be fetched with DSHOWLOG. @n
+ *     If multiple prefixes are specified, the server strips the one to the
+ *   left and relays the command on the connection it identified.
+ *
  * @li <tt>DLISTLOGS [[...]PREFIX2~]PREFIX1</tt> @n
  *     Downloads the logs list. @n
  *     If only one prefix is specified, the server receiving the DLISTLOGS
@@ -59,6 +93,33 @@
  *     If multiple prefixes are specified, the server strips the one to the
  *   left and relays the command on the connection it identified.
  *
+ * @li <tt>DSTATS [[...]PREFIX2~]PREFIX1</tt> @n
+ *     Downloads the metrics of a server. @n
+ *     If only one prefix is specified, the server receiving the DSTATS
+ *   answers with one <tt>DSTATSDATA [[...]PREFIX2~]PREFIX1 :<line></tt> line
+ *   per metric, followed by a DSTATSDATA with no line. Each line is a dotted
+ *   metric name followed either by a value (counters, ie
+ *   "net.bytes_sent 123456") or by the count, mean, percentiles and maximum
+ *   of a distribution (ie "irc.parse_ns count=1000 mean=210 p50=191 p90=255
+ *   p99=511 max=4863"); durations end with their unit. The same lines
+ *   can be read locally from a MetricsEndpoint. @n
+ *     If multiple prefixes are specified, the server strips the one to the
+ *   left and relays the command on the connection it identified.
+ *
+ * @li <tt>DTRACE [[...]PREFIX2~]PREFIX1</tt> @n
+ *     Measures the latency of a chain of relays. @n
+ *     The command is relayed like the others, and the server identified by
+ *   the last prefix answers with a <tt>DTRACEREPLY</tt>, which goes back
+ *   the same way. It is meant to be sent with a trace tag (see below).
+ *
+ * Lines can carry a trace, as an IRCv3 message tag: <tt>\@dtrace=<trace id>
+ * [,<server>:<microseconds>]...</tt>. Clients add it to DQUOTE, DSHOWLOG,
+ * DTRACE or PRIVMSG lines they want traced; each server forwarding such a
+ * line appends its name and the time the line spent there, and the answer
+ * (DLOGEND, DTRACEREPLY) carries the tag back, so the client gets a
+ * hop-by-hop breakdown of the round-trip time. Servers that don't trace
+ * just drop the tag. See Trace.
+ *
  * The standard IRC commands are still available, with the added notations:
  *   <ul>
  *   <li>[[...]PREFIX2~]PREFIX1~Nickname and
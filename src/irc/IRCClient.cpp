@@ -1,5 +1,31 @@
 #include "IRCClient.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <sstream>
+
+#include "IRCCommand.h"
+#include "common/Clock.h"
+#include "common/Metrics.h"
+
+static Histogram &parseTime = Metrics::global().histogram("irc.parse_ns");
+static Histogram &dispatchTime =
+        Metrics::global().histogram("irc.dispatch_ns");
+static Counter &parseErrors = Metrics::global().counter("irc.parse_errors");
+static Histogram &lagTime = Metrics::global().histogram("irc.lag_ms");
+
+/**
+ * Indicates whether a string can be sent as a middle parameter: a target,
+ * key or mask. Anything that would end the parameter, or the line, is
+ * refused.
+ */
+static bool isValidParam(const std::string &param)
+{
+    return !param.empty() && param[0] != ':'
+     && param.find_first_of(std::string(" \r\n\0", 4)) == std::string::npos;
+}
+
 IRCError::IRCError(const std::string &message)
   : m_sMessage(message)
 {
@@ -14,17 +40,1117 @@ const char *IRCError::what() const throw()
     return m_sMessage.c_str();
 }
 
+WhoisReply::WhoisReply()
+  : exists(false), ircOperator(false), idle(-1)
+{
+}
+
+
+/*============================================================================*/
+
+User::User(IRCClient *client, const std::string &nick)
+  : m_pClient(client), m_sNick(nick)
+{
+}
+
+void User::update(const StringView &user, const StringView &host)
+{
+    // Most of the time nothing changed; don't copy the strings then
+    if(!user.empty() && m_sUser != user)
+        user.copyTo(&m_sUser);
+    if(!host.empty() && m_sHost != host)
+        host.copyTo(&m_sHost);
+}
+
+void User::updateRealname(const StringView &realname)
+{
+    if(!realname.empty() && m_sRealname != realname)
+        realname.copyTo(&m_sRealname);
+}
+
+void User::asyncWhois(UserWhoisObserver *observer)
+{
+    m_pClient->whois(m_sNick, observer);
+}
+
+void User::sendMessage(const std::string &msg)
+{
+    m_pClient->sendMessage(m_sNick, msg);
+}
+
+void User::sendAction(const std::string &action)
+{
+    m_pClient->sendMessage(m_sNick, "\x01" "ACTION " + action + "\x01");
+}
+
+void User::sendNotice(const std::string &notice)
+{
+    m_pClient->sendNotice(m_sNick, notice);
+}
+
+
+/*============================================================================*/
+
+IRCClient::ClientTimer::ClientTimer(IRCClient *client,
+        void (IRCClient::*method)())
+  : m_pClient(client), m_pMethod(method)
+{
+}
+
+void IRCClient::ClientTimer::Expired()
+{
+    (m_pClient->*m_pMethod)();
+}
+
 IRCClient::IRCClient(NetStream *stream)
-  : m_pConnection(new LineConnection(stream))
+  : m_pConnection(new LineConnection(stream)), m_bConnected(true),
+    m_iLineBudget(DEFAULT_LINE_BUDGET), m_pTimers(NULL),
+    m_FlushTimer(this, &IRCClient::flushTimer),
+    m_Keepalive(this, &IRCClient::keepalive),
+    m_iKeepaliveInterval(0), m_iKeepaliveTimeout(0),
+    m_iLastActivity(0), m_bPingPending(false), m_iPingSent(0),
+    m_iLag(-1), m_iUserLimit(DEFAULT_USER_LIMIT), m_iWhoisOrder(0),
+    m_iQueryCacheTTL(60000),
+    m_iQueryTimeout(60000), m_QueryTimer(this, &IRCClient::queryTimer)
 {
 }
 
 IRCClient::IRCClient(LineConnection *connection)
-  : m_pConnection(connection)
+  : m_pConnection(connection), m_bConnected(true),
+    m_iLineBudget(DEFAULT_LINE_BUDGET), m_pTimers(NULL),
+    m_FlushTimer(this, &IRCClient::flushTimer),
+    m_Keepalive(this, &IRCClient::keepalive),
+    m_iKeepaliveInterval(0), m_iKeepaliveTimeout(0),
+    m_iLastActivity(0), m_bPingPending(false), m_iPingSent(0),
+    m_iLag(-1), m_iUserLimit(DEFAULT_USER_LIMIT), m_iWhoisOrder(0),
+    m_iQueryCacheTTL(60000),
+    m_iQueryTimeout(60000), m_QueryTimer(this, &IRCClient::queryTimer)
+{
+}
+
+IRCClient::~IRCClient()
 {
+    std::map<std::string, User*>::iterator it = m_Users.begin();
+    for(; it != m_Users.end(); ++it)
+        it->second->release();
+    delete m_pConnection;
 }
 
 void IRCClient::RegisterSockets(SocketSetRegistrar *registrar)
 {
     m_pConnection->RegisterSockets(registrar);
 }
+
+void IRCClient::SetFlushScheduler(FlushScheduler *scheduler)
+{
+    m_pConnection->SetFlushScheduler(scheduler);
+}
+
+void IRCClient::readCommands(bool wait) throw(SocketConnectionClosed)
+{
+    // Lines left by process() come first
+    if(m_Pending.empty())
+        receive(wait);
+    while(!m_Pending.empty())
+        handleLine(nextPending());
+}
+
+bool IRCClient::process() throw(SocketConnectionClosed)
+{
+    if(m_Pending.empty())
+        receive(false);
+    unsigned int handled = 0;
+    while(!m_Pending.empty()
+     && (m_iLineBudget == 0 || handled < m_iLineBudget))
+    {
+        handleLine(nextPending());
+        handled++;
+    }
+    return !m_Pending.empty();
+}
+
+void IRCClient::setLineBudget(unsigned int budget)
+{
+    m_iLineBudget = budget;
+}
+
+void IRCClient::receive(bool wait) throw(SocketConnectionClosed)
+{
+    std::list<std::string> lines = m_pConnection->readLines(wait);
+    if(!lines.empty())
+    {
+        if(m_pTimers != NULL)
+            m_iLastActivity = m_pTimers->Now();
+        m_Pending.splice(m_Pending.end(), lines);
+    }
+}
+
+std::string IRCClient::nextPending()
+{
+    // Taken off the list before being handled, so that a line is never
+    // handled twice if handling it throws
+    std::string line;
+    line.swap(m_Pending.front());
+    m_Pending.pop_front();
+    return line;
+}
+
+void IRCClient::handleLine(const std::string &line)
+        throw(SocketConnectionClosed)
+{
+    // Answer PINGs without parsing the line: the reply is the line itself,
+    // without the source and with the command changed
+    size_t pos = 0;
+    if(!line.empty() && line[0] == '@')
+    {
+        pos = line.find(' ');
+        if(pos == std::string::npos)
+            return ;
+        pos++;
+    }
+    if(pos < line.size() && line[pos] == ':')
+    {
+        pos = line.find(' ', pos);
+        if(pos == std::string::npos)
+            return ;
+        pos++;
+    }
+    if(line.compare(pos, 4, "PING") == 0
+     && (line.size() == pos + 4 || line[pos + 4] == ' '))
+    {
+        std::string reply("PONG");
+        reply.append(line, pos + 4, std::string::npos);
+        sendLine(reply, OutputQueue::CONTROL);
+        return ;
+    }
+
+    // Ignore lines we can't make sense of; this doesn't throw, so a server
+    // sending garbage costs no more than one sending valid lines
+    IRCCommand command;
+    unsigned long long start = monotonicNanos();
+    IRCCommand::EParseError error = command.tryParse(line);
+    unsigned long long parsed = monotonicNanos();
+    parseTime.record(parsed - start);
+    if(error != IRCCommand::PARSE_OK)
+    {
+        parseErrors.add();
+        return ;
+    }
+    handleCommand(command);
+    commandReceived(command, line);
+    dispatchTime.record(monotonicNanos() - parsed);
+}
+
+void IRCClient::commandReceived(const IRCCommand&, const std::string&)
+{
+}
+
+void IRCClient::handleCommand(const IRCCommand &command)
+{
+    // Learn about the user sending the command; the source was split when
+    // the line was parsed, and nothing is copied unless it changed
+    if(!command.source.empty())
+    {
+        IRCCommand::Source source = command.getSource();
+        if(!source.nick.empty() && !source.user.empty())
+        {
+            if(command.type == IRCCommand::QUIT)
+                forgetUser(source.nick.str());
+            else if(command.type == IRCCommand::NICK)
+            {
+                updateUser(source.nick, source.user, source.host);
+                if(!command.args.empty())
+                    renameUser(source.nick.str(), command.args[0]);
+            }
+            else
+            {
+                User *u = updateUser(source.nick, source.user, source.host);
+                // extended-join: JOIN <channel> <account> :<realname>
+                if(u != NULL && command.type == IRCCommand::JOIN
+                 && command.args.size() >= 3)
+                    u->updateRealname(command.args[2]);
+            }
+        }
+    }
+
+    if(command.type == IRCCommand::ISUPPORT)
+    {
+        ISupport::ECaseMapping casemapping = m_ISupport.getCaseMapping();
+        m_ISupport.parse(command);
+        if(m_ISupport.getCaseMapping() != casemapping)
+            caseMappingChanged();
+        const std::map<std::string, unsigned int> &targmax =
+                m_ISupport.getTargMax();
+        std::map<std::string, unsigned int>::const_iterator it;
+        for(it = targmax.begin(); it != targmax.end(); ++it)
+            m_Output.setTargetLimit(it->first, it->second);
+        unsigned int limit;
+        if(m_ISupport.getTargetLimit("PRIVMSG", &limit))
+            m_Output.setTargetLimit("PRIVMSG", limit);
+        if(m_ISupport.getTargetLimit("NOTICE", &limit))
+            m_Output.setTargetLimit("NOTICE", limit);
+    }
+    else if(command.type == IRCCommand::WHOISUSER
+     || command.type == IRCCommand::WHOISSERVER
+     || command.type == IRCCommand::WHOISOPERATOR
+     || command.type == IRCCommand::WHOISIDLE
+     || command.type == IRCCommand::WHOISCHANNELS
+     || command.type == IRCCommand::AWAY
+     || command.type == IRCCommand::ENDOFWHOIS)
+        handleWhois(command);
+    else if(command.type == IRCCommand::WHOREP
+     || command.type == IRCCommand::ENDOFWHO)
+        handleWho(command);
+    else if(command.type == IRCCommand::TRYAGAIN)
+        handleTryAgain(command);
+    else if(command.type == IRCCommand::PONG)
+    {
+        if(m_bPingPending && !command.args.empty()
+         && command.args.back() == m_sPingToken)
+        {
+            m_iLag = (int)(m_pTimers->Now() - m_iPingSent);
+            m_bPingPending = false;
+            lagTime.record(m_iLag);
+        }
+    }
+}
+
+void IRCClient::handleWhois(const IRCCommand &command)
+{
+    if(command.args.size() < 2)
+        return ;
+    const std::vector<std::string> &args = command.args;
+    if(command.type == IRCCommand::WHOISUSER && args.size() >= 6)
+    {
+        User *user = updateUser(args[1], args[2], args[3]);
+        if(user != NULL)
+            user->updateRealname(args[5]);
+    }
+
+    std::map<std::string, PendingWhois>::iterator it =
+            m_PendingWhois.find(m_ISupport.casefold(args[1]));
+    if(it == m_PendingWhois.end())
+        return ;
+    WhoisReply &reply = it->second.reply;
+
+    switch(command.type)
+    {
+    case IRCCommand::WHOISUSER:
+        if(args.size() >= 6)
+        {
+            reply.exists = true;
+            reply.nick = args[1];
+            reply.user = args[2];
+            reply.host = args[3];
+            reply.realname = args[5];
+        }
+        break;
+    case IRCCommand::WHOISSERVER:
+        if(args.size() >= 4)
+        {
+            reply.server = args[2];
+            reply.serverInfo = args[3];
+        }
+        break;
+    case IRCCommand::WHOISOPERATOR:
+        reply.ircOperator = true;
+        break;
+    case IRCCommand::WHOISIDLE:
+        if(args.size() >= 3)
+            reply.idle = atoi(args[2].c_str());
+        break;
+    case IRCCommand::WHOISCHANNELS:
+        {
+            size_t i;
+            for(i = 2; i < args.size(); i++)
+                if(!args[i].empty())
+                    reply.channels.push_back(args[i]);
+        }
+        break;
+    case IRCCommand::AWAY:
+        if(args.size() >= 3)
+            reply.away = args[2];
+        break;
+    default: // ENDOFWHOIS
+        whoisDone(it, true);
+        break;
+    }
+}
+
+void IRCClient::whoisDone(std::map<std::string, PendingWhois>::iterator it,
+        bool answered)
+{
+    // Take the query out of the table first, observers might send new ones
+    PendingWhois done = it->second;
+    if(answered && m_iQueryCacheTTL > 0 && m_pTimers != NULL)
+    {
+        CachedReply<WhoisReply> &cached = m_WhoisCache[it->first];
+        cached.reply = done.reply;
+        cached.name = done.reply.nick;
+        cached.time = m_pTimers->Now();
+        scheduleQueryTimer();
+    }
+    m_PendingWhois.erase(it);
+    // Don't make up a user the server said doesn't exist
+    User *user = done.reply.exists?getUser(done.reply.nick):
+            findUser(done.reply.nick);
+    size_t i;
+    for(i = 0; i < done.observers.size(); i++)
+        done.observers[i]->whoisAvailable(user, done.reply);
+}
+
+void IRCClient::handleWho(const IRCCommand &command)
+{
+    const std::vector<std::string> &args = command.args;
+    if(command.type == IRCCommand::WHOREP && args.size() >= 9)
+    {
+        User *user = updateUser(args[5], args[2], args[3]);
+        if(user != NULL)
+            user->updateRealname(args[8]);
+    }
+
+    // The server answers in order, so the replies are for the oldest query
+    // still waiting
+    if(m_PendingWho.empty())
+        return ;
+    if(command.type == IRCCommand::WHOREP)
+    {
+        if(args.size() < 9)
+            return ;
+        WhoReply reply;
+        reply.channel = args[1];
+        reply.user = args[2];
+        reply.host = args[3];
+        reply.server = args[4];
+        reply.nick = args[5];
+        reply.flags = args[6];
+        reply.hopcount = atoi(args[7].c_str());
+        reply.realname = args[8];
+        m_WhoReplies.push_back(reply);
+        return ;
+    }
+
+    // ENDOFWHO: the replies since the previous one are for this query, if
+    // it is one of ours (it might have been sent with sendLine())
+    if(args.size() < 2)
+        return ;
+    std::vector<WhoReply> replies;
+    replies.swap(m_WhoReplies);
+    std::list<PendingWho>::iterator it = m_PendingWho.begin();
+    while(it != m_PendingWho.end() && !m_ISupport.equals(it->mask, args[1]))
+        ++it;
+    if(it == m_PendingWho.end())
+        return ;
+    // Take the queries out of the list first, observers might send new
+    // ones; the ones sent before this one won't get an answer anymore
+    std::list<PendingWho> failed;
+    failed.splice(failed.end(), m_PendingWho, m_PendingWho.begin(), it);
+    PendingWho done = *it;
+    m_PendingWho.erase(it);
+    if(m_iQueryCacheTTL > 0 && m_pTimers != NULL)
+    {
+        CachedReply<std::vector<WhoReply> > &cached =
+                m_WhoCache[m_ISupport.casefold(done.mask)];
+        cached.reply = replies;
+        cached.name = done.mask;
+        cached.time = m_pTimers->Now();
+        scheduleQueryTimer();
+    }
+    whoFailed(&failed);
+    size_t i;
+    for(i = 0; i < done.observers.size(); i++)
+        done.observers[i]->whoAvailable(done.mask, replies);
+}
+
+void IRCClient::whoFailed(std::list<PendingWho> *failed)
+{
+    const std::vector<WhoReply> none;
+    std::list<PendingWho>::const_iterator it = failed->begin();
+    for(; it != failed->end(); ++it)
+    {
+        size_t i;
+        for(i = 0; i < it->observers.size(); i++)
+            it->observers[i]->whoAvailable(it->mask, none);
+    }
+}
+
+void IRCClient::handleTryAgain(const IRCCommand &command)
+{
+    // RPL_TRYAGAIN: the server dropped the query instead of answering it;
+    // it doesn't say which one, but it answers in order
+    if(command.args.size() < 2)
+        return ;
+    const std::string &query = command.args[1];
+    if(query == "WHOIS" && !m_PendingWhois.empty())
+    {
+        std::map<std::string, PendingWhois>::iterator oldest, it;
+        oldest = it = m_PendingWhois.begin();
+        for(++it; it != m_PendingWhois.end(); ++it)
+            if(it->second.order - oldest->second.order > UINT_MAX / 2)
+                oldest = it;
+        whoisDone(oldest, false);
+    }
+    else if(query == "WHO" && !m_PendingWho.empty())
+    {
+        std::list<PendingWho> failed;
+        failed.splice(failed.end(), m_PendingWho, m_PendingWho.begin());
+        m_WhoReplies.clear();
+        whoFailed(&failed);
+    }
+}
+
+void IRCClient::queryTimer()
+{
+    const unsigned long long now = m_pTimers->Now();
+
+    if(m_iQueryTimeout > 0)
+    {
+        // Queries the server didn't answer; observers might send new ones,
+        // which are not expired
+        std::vector<std::string> expired;
+        std::map<std::string, PendingWhois>::iterator w;
+        for(w = m_PendingWhois.begin(); w != m_PendingWhois.end(); ++w)
+            if(now - w->second.sent >= m_iQueryTimeout)
+                expired.push_back(w->first);
+        std::vector<std::string>::const_iterator key;
+        for(key = expired.begin(); key != expired.end(); ++key)
+        {
+            w = m_PendingWhois.find(*key);
+            if(w != m_PendingWhois.end()
+             && now - w->second.sent >= m_iQueryTimeout)
+                whoisDone(w, false);
+        }
+
+        std::list<PendingWho> failed;
+        while(!m_PendingWho.empty()
+         && now - m_PendingWho.front().sent >= m_iQueryTimeout)
+            failed.splice(failed.end(), m_PendingWho, m_PendingWho.begin());
+        if(!failed.empty())
+        {
+            m_WhoReplies.clear();
+            whoFailed(&failed);
+        }
+    }
+
+    // Answers are only looked up while they are fresh, but they would stay
+    // in the tables until the same query is made again
+    {
+        std::map<std::string, CachedReply<WhoisReply> >::iterator it, next;
+        for(it = m_WhoisCache.begin(); it != m_WhoisCache.end(); it = next)
+        {
+            next = it;
+            ++next;
+            if(now - it->second.time >= m_iQueryCacheTTL)
+                m_WhoisCache.erase(it);
+        }
+    }
+    {
+        std::map<std::string, CachedReply<std::vector<WhoReply> > >::iterator
+                it, next;
+        for(it = m_WhoCache.begin(); it != m_WhoCache.end(); it = next)
+        {
+            next = it;
+            ++next;
+            if(now - it->second.time >= m_iQueryCacheTTL)
+                m_WhoCache.erase(it);
+        }
+    }
+
+    scheduleQueryTimer();
+}
+
+void IRCClient::scheduleQueryTimer()
+{
+    if(m_pTimers == NULL || !m_bConnected || m_QueryTimer.IsArmed())
+        return ;
+    // The next query to time out or answer to expire; new ones come after
+    // it, except when the timeout or the TTL is changed (which reschedules)
+    bool found = false;
+    unsigned long long next = 0;
+    if(m_iQueryTimeout > 0)
+    {
+        std::map<std::string, PendingWhois>::const_iterator it;
+        for(it = m_PendingWhois.begin(); it != m_PendingWhois.end(); ++it)
+            if(!found || it->second.sent + m_iQueryTimeout < next)
+            {
+                next = it->second.sent + m_iQueryTimeout;
+                found = true;
+            }
+        if(!m_PendingWho.empty()
+         && (!found || m_PendingWho.front().sent + m_iQueryTimeout < next))
+        {
+            next = m_PendingWho.front().sent + m_iQueryTimeout;
+            found = true;
+        }
+    }
+    {
+        std::map<std::string, CachedReply<WhoisReply> >::const_iterator it;
+        for(it = m_WhoisCache.begin(); it != m_WhoisCache.end(); ++it)
+            if(!found || it->second.time + m_iQueryCacheTTL < next)
+            {
+                next = it->second.time + m_iQueryCacheTTL;
+                found = true;
+            }
+    }
+    {
+        std::map<std::string, CachedReply<std::vector<WhoReply> > >
+                ::const_iterator it;
+        for(it = m_WhoCache.begin(); it != m_WhoCache.end(); ++it)
+            if(!found || it->second.time + m_iQueryCacheTTL < next)
+            {
+                next = it->second.time + m_iQueryCacheTTL;
+                found = true;
+            }
+    }
+    if(!found)
+        return ;
+    unsigned long long now = m_pTimers->Now();
+    m_pTimers->Schedule(&m_QueryTimer, (next > now)?next - now:0);
+}
+
+User *IRCClient::getUser(const std::string &nick) const
+{
+    return lookupUser(nick, true);
+}
+
+User *IRCClient::findUser(const std::string &nick) const
+{
+    return lookupUser(nick, false);
+}
+
+User *IRCClient::lookupUser(const StringView &nick, bool create) const
+{
+    // Fold into a buffer that is reused, so that looking up a known user
+    // doesn't allocate
+    m_sFoldBuffer.resize(nick.size());
+    size_t i;
+    for(i = 0; i < nick.size(); i++)
+        m_sFoldBuffer[i] = m_ISupport.fold(nick[i]);
+    std::map<std::string, User*>::iterator it = m_Users.find(m_sFoldBuffer);
+    if(it != m_Users.end())
+    {
+        User *user = it->second;
+        m_UserOrder.splice(m_UserOrder.begin(), m_UserOrder,
+                user->m_OrderPos);
+        return user;
+    }
+    if(!create)
+        return NULL;
+
+    std::string name = nick.str();
+    if(!isValidNick(name))
+        return NULL;
+    User *user = new User(const_cast<IRCClient*>(this), name);
+    it = m_Users.insert(std::make_pair(m_sFoldBuffer, user)).first;
+    m_UserOrder.push_front(it);
+    user->m_OrderPos = m_UserOrder.begin();
+    if(m_iUserLimit > 0 && m_Users.size() > m_iUserLimit)
+        pruneUsers();
+    return user;
+}
+
+bool IRCClient::isValidNick(const std::string &nick) const
+{
+    return !nick.empty() && !m_ISupport.isChannel(nick)
+     && nick.find_first_of(" ,!@*?:") == std::string::npos;
+}
+
+void IRCClient::pruneUsers() const
+{
+    // Forget the users seen the longest time ago that only we hold; the
+    // others are moved out of the way. The most recent one (just created)
+    // is never reached
+    size_t left = m_UserOrder.size() - 1;
+    while(m_Users.size() > m_iUserLimit && left-- > 0)
+    {
+        std::map<std::string, User*>::iterator it = m_UserOrder.back();
+        User *user = it->second;
+        if(user->getReferences() > 1)
+            m_UserOrder.splice(m_UserOrder.begin(), m_UserOrder,
+                    user->m_OrderPos);
+        else
+        {
+            m_UserOrder.pop_back();
+            m_Users.erase(it);
+            user->release();
+        }
+    }
+}
+
+void IRCClient::setUserLimit(unsigned int limit)
+{
+    m_iUserLimit = limit;
+    if(m_iUserLimit > 0 && m_Users.size() > m_iUserLimit)
+        pruneUsers();
+}
+
+User *IRCClient::updateUser(const StringView &nick, const StringView &user,
+        const StringView &host)
+{
+    User *u = lookupUser(nick, true);
+    if(u != NULL)
+    {
+        if(u->m_sNick != nick)
+            nick.copyTo(&u->m_sNick);
+        u->update(user, host);
+    }
+    return u;
+}
+
+void IRCClient::renameUser(const std::string &old_nick,
+        const std::string &new_nick)
+{
+    std::string old_key = m_ISupport.casefold(old_nick);
+    std::map<std::string, User*>::iterator it = m_Users.find(old_key);
+    if(it == m_Users.end())
+        return ;
+    User *user = it->second;
+    if(m_ISupport.casefold(new_nick) == old_key)
+    {
+        user->m_sNick = new_nick;
+        return ;
+    }
+    if(!isValidNick(new_nick))
+        return ;
+    std::string new_key = m_ISupport.casefold(new_nick);
+    std::map<std::string, User*>::iterator to = m_Users.find(new_key);
+    if(to != m_Users.end())
+    {
+        // We had a User for the new nick already, replace it
+        m_UserOrder.erase(to->second->m_OrderPos);
+        to->second->release();
+        to->second = user;
+    }
+    else
+        to = m_Users.insert(std::make_pair(new_key, user)).first;
+    *user->m_OrderPos = to;
+    m_Users.erase(it);
+    user->m_sNick = new_nick;
+}
+
+void IRCClient::forgetUser(const std::string &nick)
+{
+    std::map<std::string, User*>::iterator it =
+            m_Users.find(m_ISupport.casefold(nick));
+    if(it != m_Users.end())
+    {
+        m_UserOrder.erase(it->second->m_OrderPos);
+        it->second->release();
+        m_Users.erase(it);
+    }
+}
+
+void IRCClient::caseMappingChanged()
+{
+    // The keys were folded with the previous mapping: fold the names again.
+    // Names that now fold the same are merged, keeping the most recently
+    // seen user
+    std::map<std::string, User*> users;
+    std::list<std::map<std::string, User*>::iterator>::iterator o;
+    o = m_UserOrder.begin();
+    while(o != m_UserOrder.end())
+    {
+        User *user = (*o)->second;
+        std::pair<std::map<std::string, User*>::iterator, bool> ins =
+                users.insert(std::make_pair(m_ISupport.casefold(user->m_sNick),
+                        user));
+        if(ins.second)
+        {
+            *o = ins.first;
+            ++o;
+        }
+        else
+        {
+            o = m_UserOrder.erase(o);
+            user->release();
+        }
+    }
+    m_Users.swap(users);
+
+    // Pending queries for the same user are merged into the oldest one
+    std::map<std::string, PendingWhois> pending;
+    std::map<std::string, PendingWhois>::iterator w;
+    for(w = m_PendingWhois.begin(); w != m_PendingWhois.end(); ++w)
+    {
+        std::string key = m_ISupport.casefold(w->second.reply.nick);
+        std::map<std::string, PendingWhois>::iterator to = pending.find(key);
+        if(to == pending.end())
+            pending[key] = w->second;
+        else
+        {
+            PendingWhois &merged = to->second;
+            if(w->second.order < merged.order)
+            {
+                merged.sent = w->second.sent;
+                merged.order = w->second.order;
+            }
+            merged.observers.insert(merged.observers.end(),
+                    w->second.observers.begin(), w->second.observers.end());
+        }
+    }
+    m_PendingWhois.swap(pending);
+
+    refoldCache(&m_WhoisCache);
+    refoldCache(&m_WhoCache);
+}
+
+template<class T>
+void IRCClient::refoldCache(std::map<std::string, CachedReply<T> > *cache)
+{
+    // Keeps the most recent of the replies that now fold the same
+    std::map<std::string, CachedReply<T> > refolded;
+    typename std::map<std::string, CachedReply<T> >::const_iterator it;
+    for(it = cache->begin(); it != cache->end(); ++it)
+    {
+        std::string key = m_ISupport.casefold(it->second.name);
+        typename std::map<std::string, CachedReply<T> >::iterator to =
+                refolded.find(key);
+        if(to == refolded.end())
+            refolded[key] = it->second;
+        else if(it->second.time > to->second.time)
+            to->second = it->second;
+    }
+    cache->swap(refolded);
+}
+
+void IRCClient::whois(const std::string &nick, UserWhoisObserver *observer)
+        throw(SocketConnectionClosed)
+{
+    if(!isValidParam(nick))
+    {
+        WhoisReply reply;
+        reply.nick = nick;
+        observer->whoisAvailable(NULL, reply);
+        return ;
+    }
+    std::string key = m_ISupport.casefold(nick);
+
+    if(m_iQueryCacheTTL > 0 && m_pTimers != NULL)
+    {
+        std::map<std::string, CachedReply<WhoisReply> >::iterator it =
+                m_WhoisCache.find(key);
+        if(it != m_WhoisCache.end())
+        {
+            if(m_pTimers->Now() - it->second.time < m_iQueryCacheTTL)
+            {
+                WhoisReply reply = it->second.reply;
+                observer->whoisAvailable(reply.exists?getUser(reply.nick):
+                        findUser(reply.nick), reply);
+                return ;
+            }
+            m_WhoisCache.erase(it);
+        }
+    }
+
+    std::map<std::string, PendingWhois>::iterator it =
+            m_PendingWhois.find(key);
+    if(it != m_PendingWhois.end())
+    {
+        it->second.observers.push_back(observer);
+        return ;
+    }
+    PendingWhois &pending = m_PendingWhois[key];
+    pending.reply.nick = nick;
+    pending.observers.push_back(observer);
+    pending.sent = (m_pTimers != NULL)?m_pTimers->Now():0;
+    pending.order = m_iWhoisOrder++;
+    scheduleQueryTimer();
+    sendLine("WHOIS " + nick);
+}
+
+void IRCClient::who(const std::string &mask, WhoObserver *observer)
+        throw(SocketConnectionClosed)
+{
+    if(!isValidParam(mask))
+    {
+        std::vector<WhoReply> replies;
+        observer->whoAvailable(mask, replies);
+        return ;
+    }
+    if(m_iQueryCacheTTL > 0 && m_pTimers != NULL)
+    {
+        std::map<std::string, CachedReply<std::vector<WhoReply> > >::iterator
+                it = m_WhoCache.find(m_ISupport.casefold(mask));
+        if(it != m_WhoCache.end())
+        {
+            if(m_pTimers->Now() - it->second.time < m_iQueryCacheTTL)
+            {
+                std::vector<WhoReply> replies = it->second.reply;
+                observer->whoAvailable(mask, replies);
+                return ;
+            }
+            m_WhoCache.erase(it);
+        }
+    }
+
+    std::list<PendingWho>::iterator it = m_PendingWho.begin();
+    for(; it != m_PendingWho.end(); ++it)
+        if(m_ISupport.equals(it->mask, mask))
+        {
+            it->observers.push_back(observer);
+            return ;
+        }
+    PendingWho pending;
+    pending.mask = mask;
+    pending.observers.push_back(observer);
+    pending.sent = (m_pTimers != NULL)?m_pTimers->Now():0;
+    m_PendingWho.push_back(pending);
+    scheduleQueryTimer();
+    sendLine("WHO " + mask);
+}
+
+void IRCClient::cancelQueries(UserWhoisObserver *observer)
+{
+    std::map<std::string, PendingWhois>::iterator it = m_PendingWhois.begin();
+    for(; it != m_PendingWhois.end(); ++it)
+    {
+        std::vector<UserWhoisObserver*> &observers = it->second.observers;
+        observers.erase(std::remove(observers.begin(), observers.end(),
+                observer), observers.end());
+    }
+}
+
+void IRCClient::cancelQueries(WhoObserver *observer)
+{
+    std::list<PendingWho>::iterator it = m_PendingWho.begin();
+    for(; it != m_PendingWho.end(); ++it)
+    {
+        std::vector<WhoObserver*> &observers = it->observers;
+        observers.erase(std::remove(observers.begin(), observers.end(),
+                observer), observers.end());
+    }
+}
+
+void IRCClient::setQueryCacheTTL(unsigned int ttl)
+{
+    m_iQueryCacheTTL = ttl;
+    if(ttl == 0)
+    {
+        m_WhoisCache.clear();
+        m_WhoCache.clear();
+    }
+    m_QueryTimer.Cancel();
+    scheduleQueryTimer();
+}
+
+void IRCClient::setQueryTimeout(unsigned int timeout)
+{
+    m_iQueryTimeout = timeout;
+    m_QueryTimer.Cancel();
+    scheduleQueryTimer();
+}
+
+void IRCClient::setTimers(TimerWheel *timers)
+{
+    m_FlushTimer.Cancel();
+    m_Keepalive.Cancel();
+    m_QueryTimer.Cancel();
+    m_pTimers = timers;
+    m_bPingPending = false;
+    if(m_pTimers != NULL && m_bConnected)
+    {
+        m_iLastActivity = m_pTimers->Now();
+        // The queries waiting were timed with another clock, or none
+        std::map<std::string, PendingWhois>::iterator w;
+        for(w = m_PendingWhois.begin(); w != m_PendingWhois.end(); ++w)
+            w->second.sent = m_iLastActivity;
+        std::list<PendingWho>::iterator it;
+        for(it = m_PendingWho.begin(); it != m_PendingWho.end(); ++it)
+            it->sent = m_iLastActivity;
+        scheduleQueryTimer();
+        if(m_iKeepaliveInterval > 0)
+            m_pTimers->Schedule(&m_Keepalive, m_iKeepaliveInterval);
+        if(m_Output.size() > 0)
+            m_pTimers->Schedule(&m_FlushTimer, 0);
+    }
+}
+
+void IRCClient::sendLine(const std::string &line,
+        OutputQueue::EPriority priority, const std::string &key)
+        throw(SocketConnectionClosed)
+{
+    queued(m_Output.push(line, priority, key));
+}
+
+bool IRCClient::sendMessage(const std::string &target, const std::string &msg)
+        throw(SocketConnectionClosed)
+{
+    return sendText("PRIVMSG", target, msg);
+}
+
+bool IRCClient::sendNotice(const std::string &target, const std::string &msg)
+        throw(SocketConnectionClosed)
+{
+    return sendText("NOTICE", target, msg);
+}
+
+bool IRCClient::sendText(const char *command, const std::string &target,
+        const std::string &text) throw(SocketConnectionClosed)
+{
+    if(!isValidParam(target))
+        return false;
+    std::string prefix(command);
+    prefix += " " + target + " :";
+    size_t overhead = prefix.size() + OutputQueue::SOURCE_RESERVE;
+    size_t room = (overhead < OutputQueue::MAX_LINE)?
+            OutputQueue::MAX_LINE - overhead:1;
+
+    std::vector<std::string> parts;
+    OutputQueue::split(text, room, &parts);
+    bool batchable = false;
+    std::vector<std::string>::const_iterator it = parts.begin();
+    for(; it != parts.end(); ++it)
+        batchable = m_Output.push(prefix + *it, OutputQueue::BULK);
+    queued(batchable);
+    return true;
+}
+
+bool IRCClient::join(const std::string &channel, const std::string &key)
+        throw(SocketConnectionClosed)
+{
+    if(!isValidParam(channel) || (!key.empty() && !isValidParam(key)))
+        return false;
+    if(key.empty())
+        sendLine("JOIN " + channel);
+    else
+        sendLine("JOIN " + channel + " " + key);
+    return true;
+}
+
+void IRCClient::isOn(const std::vector<std::string> &nicks)
+        throw(SocketConnectionClosed)
+{
+    bool batchable = false;
+    std::vector<std::string>::const_iterator it = nicks.begin();
+    for(; it != nicks.end(); ++it)
+        if(isValidParam(*it))
+            batchable = m_Output.push("ISON " + *it);
+    queued(batchable);
+}
+
+void IRCClient::setTargetLimit(const std::string &command, unsigned int limit)
+{
+    m_Output.setTargetLimit(command, limit);
+}
+
+void IRCClient::queued(bool batchable) throw(SocketConnectionClosed)
+{
+    if(m_FlushTimer.IsArmed())
+        return ;
+    // If the next line might get merged with this one, give the caller until
+    // the next tick of the loop to send it
+    if(batchable && m_pTimers != NULL)
+        m_pTimers->Schedule(&m_FlushTimer, 0);
+    else
+        flushOutput();
+}
+
+void IRCClient::setFloodControl(unsigned int burst, unsigned int interval)
+{
+    m_Output.setRate(burst, interval);
+}
+
+void IRCClient::flushOutput() throw(SocketConnectionClosed)
+{
+    if(m_pTimers == NULL)
+    {
+        m_Output.flushAll(m_pConnection);
+        return ;
+    }
+    int wait = m_Output.flush(m_pTimers->Now(), m_pConnection);
+    if(wait >= 0)
+        m_pTimers->Schedule(&m_FlushTimer, wait);
+}
+
+void IRCClient::flushTimer()
+{
+    try
+    {
+        flushOutput();
+    }
+    catch(SocketConnectionClosed &e)
+    {
+        disconnected("Connection closed");
+    }
+}
+
+void IRCClient::setKeepalive(unsigned int interval, unsigned int timeout)
+{
+    m_Keepalive.Cancel();
+    m_iKeepaliveInterval = interval;
+    m_iKeepaliveTimeout = timeout;
+    m_bPingPending = false;
+    if(m_pTimers != NULL && m_bConnected && m_iKeepaliveInterval > 0)
+    {
+        m_iLastActivity = m_pTimers->Now();
+        m_pTimers->Schedule(&m_Keepalive, m_iKeepaliveInterval);
+    }
+}
+
+int IRCClient::getLag() const
+{
+    if(m_bPingPending)
+    {
+        unsigned long long waiting = m_pTimers->Now() - m_iPingSent;
+        if(m_iLag < 0 || waiting > (unsigned long long)m_iLag)
+            return (waiting > INT_MAX)?INT_MAX:(int)waiting;
+    }
+    return m_iLag;
+}
+
+void IRCClient::keepalive()
+{
+    if(!m_bConnected)
+        return ;
+    unsigned long long now = m_pTimers->Now();
+
+    if(m_bPingPending)
+    {
+        // Waiting for a PONG; anything received since the PING shows the
+        // link is still up
+        unsigned long long since = (m_iLastActivity > m_iPingSent)?
+                m_iLastActivity:m_iPingSent;
+        if(now - since >= m_iKeepaliveTimeout)
+        {
+            disconnected("Ping timeout");
+            return ;
+        }
+        m_pTimers->Schedule(&m_Keepalive,
+                m_iKeepaliveTimeout - (now - since));
+    }
+    else if(now - m_iLastActivity >= m_iKeepaliveInterval)
+    {
+        std::ostringstream token;
+        token << "distrirc-" << now;
+        m_sPingToken = token.str();
+        m_bPingPending = true;
+        m_iPingSent = now;
+        m_pTimers->Schedule(&m_Keepalive, m_iKeepaliveTimeout);
+        try
+        {
+            sendLine("PING :" + m_sPingToken, OutputQueue::CONTROL);
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            disconnected("Connection closed");
+        }
+    }
+    else
+        m_pTimers->Schedule(&m_Keepalive,
+                m_iKeepaliveInterval - (now - m_iLastActivity));
+}
+
+void IRCClient::disconnected(const std::string &reason)
+{
+    if(!m_bConnected)
+        return ;
+    m_bConnected = false;
+    m_Keepalive.Cancel();
+    m_FlushTimer.Cancel();
+    m_QueryTimer.Cancel();
+    m_Output.clear();
+    m_PendingWhois.clear();
+    m_PendingWho.clear();
+    m_WhoReplies.clear();
+    connectionLost(reason);
+}
@@ -2,15 +2,24 @@
 #define HEADER_IRCCLIENT_H
 
 #include <exception>
+#include <list>
+#include <map>
 #include <string>
+#include <vector>
 
 #include "sockets/Socket.h"
+#include "sockets/TimerWheel.h"
 #include "common/ReferenceCounted.h"
+#include "common/StringView.h"
 #include "LineConnection.h"
+#include "OutputQueue.h"
+#include "ISupport.h"
 
+class IRCClient;
 class User;
 class ChannelUser;
 class Channel;
+class IRCCommand;
 
 /**
  * Base class for exceptions thrown by IRCClient.
@@ -32,14 +41,82 @@ public:
  * Interfaces.
  */
 
+/**
+ * The answer to a WHOIS query.
+ */
+struct WhoisReply {
+
+    /**
+     * false if the server said there is no such user, or if the query
+     * failed (the server refused it or didn't answer in time).
+     */
+    bool exists;
+    std::string nick;
+    std::string user;
+    std::string host;
+    std::string realname;
+    std::string server;
+    std::string serverInfo;
+    bool ircOperator;
+    /** Idle time in seconds, or -1 if the server didn't say. */
+    int idle;
+    /** The channels, with their membership prefixes ("@#rezo"). */
+    std::vector<std::string> channels;
+    /** The away message, or "" if the user isn't away. */
+    std::string away;
+
+    WhoisReply();
+
+};
+
+/**
+ * One line of the answer to a WHO query.
+ */
+struct WhoReply {
+
+    std::string channel;
+    std::string user;
+    std::string host;
+    std::string server;
+    std::string nick;
+    /** 'H' (here) or 'G' (gone), then '*' for IRC operators and prefixes. */
+    std::string flags;
+    int hopcount;
+    std::string realname;
+
+};
+
 /**
  * Callback for a WHOIS query on a user.
  */
 class UserWhoisObserver {
 
 public:
-    /** Called when the WHOIS information is received back from the server. */
-    virtual void whoisAvailable(User *user, const std::string &whois) = 0;
+    /**
+     * Called when the WHOIS information is received back from the server.
+     *
+     * @param user NULL if the user doesn't exist and we never heard of it.
+     */
+    virtual void whoisAvailable(User *user, const WhoisReply &whois) = 0;
+
+};
+
+/**
+ * Callback for a WHO query.
+ */
+class WhoObserver {
+
+public:
+    /**
+     * Called when the answer to the WHO query is received back from the
+     * server.
+     *
+     * @param mask The mask that was queried, as passed to IRCClient::who().
+     * @param replies The users that matched; also empty if the query failed
+     * (the server refused it or didn't answer in time).
+     */
+    virtual void whoAvailable(const std::string &mask,
+            const std::vector<WhoReply> &replies) = 0;
 
 };
 
@@ -112,6 +189,22 @@ public:
  */
 class User : public ReferenceCounted {
 
+private:
+    IRCClient *m_pClient;
+    std::string m_sNick;
+    std::string m_sUser;
+    std::string m_sHost;
+    std::string m_sRealname;
+    // Position in the table of users of the client, from the most recently
+    // seen
+    std::list<std::map<std::string, User*>::iterator>::iterator m_OrderPos;
+
+    User(IRCClient *client, const std::string &nick);
+    void update(const StringView &user, const StringView &host);
+    void updateRealname(const StringView &realname);
+
+    friend class IRCClient;
+
 public:
     /**
      * Returns the nickname of the user.
@@ -152,6 +245,7 @@ public:
      * As this will have to wait for the server to return the information, you
      * have to provide an observer to be notified when the information is
      * known.
+     * @see IRCClient::whois()
      */
     void asyncWhois(UserWhoisObserver *observer);
     /** Send a private message to this user. */
@@ -259,8 +353,88 @@ public:
  */
 class IRCClient : public Waitable {
 
+public:
+    /** Default maximum number of lines handled by a call to process(). */
+    static const unsigned int DEFAULT_LINE_BUDGET = 512;
+    /** Default number of users the client remembers, see setUserLimit(). */
+    static const unsigned int DEFAULT_USER_LIMIT = 50000;
+
 private:
+    /**
+     * A timer calling a method of the client.
+     */
+    class ClientTimer : public Timer {
+
+    private:
+        IRCClient *m_pClient;
+        void (IRCClient::*m_pMethod)();
+
+    public:
+        ClientTimer(IRCClient *client, void (IRCClient::*method)());
+        void Expired();
+
+    };
+
     LineConnection *m_pConnection;
+    bool m_bConnected;
+
+    // Lines received but not handled yet, see process()
+    std::list<std::string> m_Pending;
+    unsigned int m_iLineBudget;
+
+    TimerWheel *m_pTimers;
+    ISupport m_ISupport;
+
+    OutputQueue m_Output;
+    ClientTimer m_FlushTimer;
+
+    ClientTimer m_Keepalive;
+    unsigned int m_iKeepaliveInterval;
+    unsigned int m_iKeepaliveTimeout;
+    unsigned long long m_iLastActivity;
+    bool m_bPingPending;
+    unsigned long long m_iPingSent;
+    std::string m_sPingToken;
+    int m_iLag;
+
+    // Users, by casefolded nickname, and from the most recently seen;
+    // mutable because getUser() creates them
+    mutable std::map<std::string, User*> m_Users;
+    mutable std::list<std::map<std::string, User*>::iterator> m_UserOrder;
+    mutable std::string m_sFoldBuffer;
+    unsigned int m_iUserLimit;
+
+    // Queries waiting for an answer, and the recent answers
+    struct PendingWhois {
+        WhoisReply reply;
+        std::vector<UserWhoisObserver*> observers;
+        unsigned long long sent;
+        unsigned int order;
+    };
+    struct PendingWho {
+        std::string mask;
+        std::vector<WhoObserver*> observers;
+        unsigned long long sent;
+    };
+    template<class T>
+    struct CachedReply {
+        T reply;
+        // The nickname or mask that was queried, to fold it again if the
+        // CASEMAPPING changes
+        std::string name;
+        unsigned long long time;
+    };
+    std::map<std::string, PendingWhois> m_PendingWhois;
+    std::list<PendingWho> m_PendingWho;
+    // WHO replies since the last ENDOFWHO, for the query it will end
+    std::vector<WhoReply> m_WhoReplies;
+    unsigned int m_iWhoisOrder;
+    std::map<std::string, CachedReply<WhoisReply> > m_WhoisCache;
+    std::map<std::string, CachedReply<std::vector<WhoReply> > > m_WhoCache;
+    unsigned int m_iQueryCacheTTL;
+    unsigned int m_iQueryTimeout;
+    // Fails the queries that time out and prunes the caches
+    ClientTimer m_QueryTimer;
 
 public:
     /**
@@ -271,21 +445,284 @@ public:
     IRCClient(NetStream *stream);
     /**
      * Create a client using a LineConnection.
+     *
+     * The client takes ownership of the connection, and deletes it when
+     * destroyed.
      */
     IRCClient(LineConnection *connection);
 
+    virtual ~IRCClient();
+
     void RegisterSockets(SocketSetRegistrar *registrar);
 
+    /** Passed to the LineConnection, so that output is sent once per loop. */
+    void SetFlushScheduler(FlushScheduler *scheduler);
+
+    /**
+     * Reads the lines available from the server and handles them.
+     *
+     * PINGs from the server are answered right away, before anything else is
+     * done with the line, so that a slow observer can't get us disconnected.
+     * Lines left by process() are handled first; the line budget doesn't
+     * apply.
+     */
+    void readCommands(bool wait = false) throw(SocketConnectionClosed);
+
+    /**
+     * Handles the lines received from the server, a bounded number at a
+     * time; this is what an event loop calls when the connection is ready.
+     *
+     * The connection is only read (and drained, see
+     * LineConnection::readLines()) once the lines of the previous read have
+     * all been handled. At most the line budget is handled per call, so that
+     * a flooding server can't hold the loop for long; the lines left are
+     * kept, and the next call handles them without reading.
+     *
+     * The connection being closed is only reported (by throwing) once the
+     * lines received before have been handled.
+     * @return true if lines are left: the caller should call process()
+     * again soon, even though the connection might not be readable (see
+     * EventLoop::readyAgain()).
+     */
+    bool process() throw(SocketConnectionClosed);
+
+    /** Indicates whether lines were received but not handled yet. */
+    inline bool hasPendingLines() const
+    {
+        return !m_Pending.empty();
+    }
+
+    /**
+     * Sets the maximum number of lines handled by a call to process().
+     *
+     * The default is DEFAULT_LINE_BUDGET; 0 means no limit.
+     */
+    void setLineBudget(unsigned int budget);
+
+    /**
+     * Sets the timer wheel used by this client.
+     *
+     * This is typically the one of the EventLoop handling this client; its
+     * clock is used for flood control and to measure the lag. Without a
+     * wheel, lines are sent right away and there is no keepalive.
+     */
+    void setTimers(TimerWheel *timers);
+
+    /**
+     * Sends a line to the server, through the flood control.
+     *
+     * The line is sent as is: it must not contain CR, LF or NUL.
+     * @param key See OutputQueue::push().
+     */
+    void sendLine(const std::string &line,
+            OutputQueue::EPriority priority = OutputQueue::NORMAL,
+            const std::string &key = "") throw(SocketConnectionClosed);
+
+    /**
+     * Sends a PRIVMSG, split into several if it is too long.
+     *
+     * Each line of the message is sent as its own PRIVMSG (see
+     * OutputQueue::split()).
+     * @return false if the target isn't a valid parameter (empty, or
+     * containing spaces or line breaks), in which case nothing is sent.
+     */
+    bool sendMessage(const std::string &target, const std::string &msg)
+            throw(SocketConnectionClosed);
+
+    /**
+     * Sends a NOTICE, split into several if it is too long.
+     *
+     * @see sendMessage()
+     */
+    bool sendNotice(const std::string &target, const std::string &msg)
+            throw(SocketConnectionClosed);
+
+    /**
+     * Joins a channel.
+     *
+     * JOINs sent in a row are batched into as few lines as possible.
+     * @return false if the channel or the key contain spaces or line
+     * breaks, in which case nothing is sent.
+     */
+    bool join(const std::string &channel, const std::string &key = "")
+            throw(SocketConnectionClosed);
+
+    /**
+     * Asks the server which of these users are connected (ISON).
+     *
+     * The nicknames are packed into as few ISON queries as possible; the
+     * answers come back as ISON (303) replies. Nicknames containing spaces
+     * or line breaks are skipped.
+     */
+    void isOn(const std::vector<std::string> &nicks)
+            throw(SocketConnectionClosed);
+
+    /**
+     * Sets the maximum number of targets the server accepts for a command.
+     *
+     * @see OutputQueue::setTargetLimit()
+     */
+    void setTargetLimit(const std::string &command, unsigned int limit);
+
+    /**
+     * Changes the flood control rate.
+     *
+     * @see OutputQueue::OutputQueue()
+     */
+    void setFloodControl(unsigned int burst, unsigned int interval);
+
+    /**
+     * Enables the keepalive; needs a timer wheel, see setTimers().
+     *
+     * When nothing has been received for 'interval' milliseconds, a PING is
+     * sent to the server; if nothing comes back within 'timeout'
+     * milliseconds, the link is considered dead and connectionLost() is
+     * called. The replies are also used to measure the lag.
+     *
+     * An interval of 0 disables the keepalive.
+     */
+    void setKeepalive(unsigned int interval = 60000,
+            unsigned int timeout = 60000);
+
+    /**
+     * Returns the lag to the server, in milliseconds.
+     *
+     * This is the round-trip time of the last keepalive PING, or the time
+     * since the current one was sent if it is longer. Returns -1 if it hasn't
+     * been measured yet.
+     */
+    int getLag() const;
+
+    /**
+     * Sends a WHOIS query.
+     *
+     * Queries for the same nickname that are still waiting for an answer are
+     * sent only once, and answers received less than the cache TTL ago are
+     * reused (in which case the observer is called before this method
+     * returns). A nickname containing spaces or line breaks isn't sent; the
+     * observer is called right away with a reply that doesn't exist.
+     */
+    void whois(const std::string &nick, UserWhoisObserver *observer)
+            throw(SocketConnectionClosed);
+
+    /**
+     * Sends a WHO query.
+     *
+     * Same as whois(): queries are deduplicated and cached. The server
+     * answers in order, so the queries still waiting when the answer to a
+     * later one ends are failed. A mask containing spaces or line breaks
+     * isn't sent; the observer is called right away with no replies.
+     */
+    void who(const std::string &mask, WhoObserver *observer)
+            throw(SocketConnectionClosed);
+
+    /**
+     * Removes an observer from the queries it is waiting for.
+     *
+     * Use this before destroying an observer whose queries might not have
+     * been answered yet.
+     */
+    void cancelQueries(UserWhoisObserver *observer);
+    void cancelQueries(WhoObserver *observer);
+
+    /**
+     * Changes how long WHOIS and WHO answers are reused, in milliseconds.
+     *
+     * 0 disables the cache; it also needs a timer wheel, see setTimers().
+     */
+    void setQueryCacheTTL(unsigned int ttl);
+
+    /**
+     * Changes how long a WHOIS or WHO query waits for its answer, in
+     * milliseconds.
+     *
+     * A query that isn't answered in time fails: its observers are called
+     * with an empty answer, which is not cached. 0 means to wait forever; it
+     * also needs a timer wheel, see setTimers().
+     */
+    void setQueryTimeout(unsigned int timeout);
+
+    /**
+     * The features advertised by the server (ISUPPORT).
+     *
+     * These are the RFC 1459 defaults until the server sends its 005
+     * replies.
+     */
+    inline const ISupport &getISupport() const
+    {
+        return m_ISupport;
+    }
+
+    /** Indicates whether the connection is still up. */
+    inline bool isConnected() const
+    {
+        return m_bConnected;
+    }
+
+private:
+    void receive(bool wait) throw(SocketConnectionClosed);
+    std::string nextPending();
+    void handleLine(const std::string &line) throw(SocketConnectionClosed);
+    void handleCommand(const IRCCommand &command);
+    User *lookupUser(const StringView &nick, bool create) const;
+    bool isValidNick(const std::string &nick) const;
+    void pruneUsers() const;
+    User *updateUser(const StringView &nick, const StringView &user,
+            const StringView &host);
+    void renameUser(const std::string &old_nick,
+            const std::string &new_nick);
+    void forgetUser(const std::string &nick);
+    void caseMappingChanged();
+    template<class T>
+    void refoldCache(std::map<std::string, CachedReply<T> > *cache);
+    void handleWhois(const IRCCommand &command);
+    void handleWho(const IRCCommand &command);
+    void handleTryAgain(const IRCCommand &command);
+    void whoisDone(std::map<std::string, PendingWhois>::iterator it,
+            bool answered);
+    void whoFailed(std::list<PendingWho> *failed);
+    void queryTimer();
+    void scheduleQueryTimer();
+    bool sendText(const char *command, const std::string &target,
+            const std::string &text) throw(SocketConnectionClosed);
+    void queued(bool batchable) throw(SocketConnectionClosed);
+    void flushOutput() throw(SocketConnectionClosed);
+    void flushTimer();
+    void keepalive();
+    void disconnected(const std::string &reason);
+
 public:
     /**
      * Get a specific user on the network.
      *
      * A new User instance might get created; it may not correspond to an
-     * actual user on the network (we just can't know).
+     * actual user on the network (we just can't know). grab() it to keep it
+     * past the current call, see setUserLimit().
      * @return NULL if the nickname is invalid.
      */
     User *getUser(const std::string &nick) const;
 
+    /**
+     * Get a user that we know of.
+     *
+     * Users are learned passively from the traffic (sources of commands, WHO
+     * replies, extended JOINs, ...), so their username and host are usually
+     * known without having to ask the server.
+     * @return NULL if we haven't heard of this user.
+     */
+    User *findUser(const std::string &nick) const;
+
+    /**
+     * Sets how many users the client remembers.
+     *
+     * Every source seen creates a User, and the client can't know when we
+     * stop sharing a channel with someone; past this limit, the users seen
+     * the longest time ago are forgotten, unless someone else holds them
+     * (see ReferenceCounted::grab()). The default is DEFAULT_USER_LIMIT; 0
+     * means no limit.
+     */
+    void setUserLimit(unsigned int limit);
+
 protected:
     /**
      * Called when a new channel is joined.
@@ -296,7 +733,41 @@ protected:
      * with an error message.
      */
     virtual void connectionLost(const std::string &quitMsg) = 0;
+    /**
+     * Called for each command received from the server, after the client
+     * handled it; the default does nothing.
+     *
+     * PINGs are answered directly and don't get here.
+     * @param line The line as it was received, to relay it unchanged.
+     */
+    virtual void commandReceived(const IRCCommand &command,
+            const std::string &line);
 
 };
 
+
+/*==============================================================================
+ * Inline methods.
+ */
+
+inline std::string User::getNick() const
+{
+    return m_sNick;
+}
+
+inline std::string User::getUser() const
+{
+    return m_sUser;
+}
+
+inline std::string User::getHost() const
+{
+    return m_sHost;
+}
+
+inline std::string User::getRealname() const
+{
+    return m_sRealname;
+}
+
 #endif
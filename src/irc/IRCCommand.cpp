@@ -1,5 +1,6 @@
 #include "IRCCommand.h"
 
+#include <cctype>
 #include <cstdarg>
 
 static const char *const COMMANDS[IRCCommand::UNKNOWN] = {
@@ -30,6 +31,8 @@ static const char *const COMMANDS[IRCCommand::UNKNOWN] = {
     "376", // ENDOFMOTD
     "422", // NOMOTD
     "303", // ISON
+    "005", // ISUPPORT
+    "263", // TRYAGAIN
 
     "PRIVMSG", // PRIVMSG
     "NOTICE", // NOTICE
@@ -51,50 +54,81 @@ IRCCommand::Invalid::Invalid(const std::string &message)
 {
 }
 
+IRCCommand::IRCCommand()
+  : type(UNKNOWN),
+    m_iSourceBang(std::string::npos), m_iSourceAt(std::string::npos)
+{
+}
+
 IRCCommand::IRCCommand(const std::string &line) throw(Invalid)
+{
+    EParseError error = tryParse(line);
+    if(error != PARSE_OK)
+        throw Invalid(parseErrorMessage(error));
+}
+
+IRCCommand::EParseError IRCCommand::tryParse(const std::string &line)
 {
     size_t pos = 0;
     const size_t end = line.size();
+    size_t nb_args = 0;
 
     if(end == 0)
-        throw Invalid("Line is empty");
+        return PARSE_EMPTY;
 
-    // Read the source
-    if(line[0] == ':')
+    // Read the message tags
+    if(line[0] == '@')
     {
         pos = line.find(' ', 1);
         if(pos == std::string::npos)
-            throw Invalid("Line contains doesn't contain a command");
-        source = line.substr(1, pos - 1);
-        pos++;
+            return PARSE_NO_COMMAND;
+        tags.assign(line, 1, pos - 1);
+        pos = line.find_first_not_of(' ', pos);
+        if(pos == std::string::npos)
+            return PARSE_NO_COMMAND;
+    }
+    else
+        tags.clear();
+
+    // Read the source
+    if(line[pos] == ':')
+    {
+        size_t source_end = line.find(' ', pos + 1);
+        if(source_end == std::string::npos)
+            return PARSE_NO_COMMAND;
+        source.assign(line, pos + 1, source_end - pos - 1);
+        pos = source_end + 1;
     }
     else
-        source = "";
+        source.clear();
+    findSeparators(source, &m_iSourceBang, &m_iSourceAt);
 
     // Read and recognize the command
     {
         size_t cmd_end = line.find(' ', pos);
         if(cmd_end == std::string::npos)
             cmd_end = end;
-        std::string cmd = line.substr(pos, cmd_end - pos);
+        const size_t cmd_len = cmd_end - pos;
+        if(cmd_len == 0)
+            return PARSE_NO_COMMAND;
         type = UNKNOWN;
         int i;
         for(i = 0; i < UNKNOWN; i++)
-            if(cmd == COMMANDS[i])
+            if(line.compare(pos, cmd_len, COMMANDS[i]) == 0)
+            {
                 type = (EType)i;
-        if(type == UNKNOWN)
-        {
-            const char *ptr = cmd.c_str();
-            char *endptr;
-            int num = strtol(ptr, &endptr, 10);
-            if( (endptr == ptr + cmd.size()) && 400 <= num && num <= 599)
-                type = OTHERERROR;
-        }
+                break;
+            }
+        if(type == UNKNOWN && cmd_len == 3
+         && (line[pos] == '4' || line[pos] == '5')
+         && isdigit((unsigned char)line[pos + 1])
+         && isdigit((unsigned char)line[pos + 2]))
+            type = OTHERERROR;
 
         pos = cmd_end + 1;
     }
 
-    // Read the arguments
+    // Read the arguments, reusing the strings already in 'args'
     while(pos < end)
     {
         // Various fixes for commands that use unpractical formats (ex. with
@@ -106,35 +140,57 @@ IRCCommand::IRCCommand(const std::string &line) throw(Invalid)
                 type == ISON);
         bool force_colon = (
                 type == WHOREP &&
-                args.size() == 8);
+                nb_args == 8);
         bool colon = line[pos] == ':';
         if(colon)
             pos++;
+        size_t param_end;
         if( (colon && !ignore_colon) || force_colon)
-        {
-            args.push_back(line.substr(pos, end - pos));
-            break;
-        }
+            param_end = end;
         else
         {
-            size_t param_end = line.find(' ', pos);
+            param_end = line.find(' ', pos);
             if(param_end == std::string::npos)
                 param_end = end;
-            args.push_back(line.substr(pos, param_end - pos));
-            pos = param_end;
-            if(pos != end)
-                pos++;
         }
+        if(nb_args < args.size())
+            args[nb_args].assign(line, pos, param_end - pos);
+        else
+            args.push_back(line.substr(pos, param_end - pos));
+        nb_args++;
+        pos = param_end;
+        if(pos != end)
+            pos++;
+    }
+    args.resize(nb_args);
+
+    return PARSE_OK;
+}
+
+const char *IRCCommand::parseErrorMessage(EParseError error)
+{
+    switch(error)
+    {
+    case PARSE_OK:
+        return "No error";
+    case PARSE_EMPTY:
+        return "Line is empty";
+    case PARSE_NO_COMMAND:
+        return "Line doesn't contain a command";
+    default:
+        return "Unknown error";
     }
 }
 
 IRCCommand::IRCCommand(EType type_, const std::vector<std::string> &args_)
-  : type(type_), args(args_)
+  : type(type_), args(args_),
+    m_iSourceBang(std::string::npos), m_iSourceAt(std::string::npos)
 {
 }
 
 IRCCommand::IRCCommand(EType type_, ...)
-  : type(type_)
+  : type(type_),
+    m_iSourceBang(std::string::npos), m_iSourceAt(std::string::npos)
 {
     va_list ap;
     va_start(ap, type_);
@@ -147,6 +203,7 @@ IRCCommand::IRCCommand(EType type_, ...)
 IRCCommand::IRCCommand(const std::string &source_, EType type_, ...)
   : type(type_), source(source_)
 {
+    findSeparators(source, &m_iSourceBang, &m_iSourceAt);
     va_list ap;
     va_start(ap, type_);
     const char *args_;
@@ -157,46 +214,69 @@ IRCCommand::IRCCommand(const std::string &source_, EType type_, ...)
 
 std::string IRCCommand::readSource(std::string *user, std::string *host)
 {
-    return readSource(source, user, host);
+    Source parts = getSource();
+    if(user != NULL) parts.user.copyTo(user);
+    if(host != NULL) parts.host.copyTo(host);
+    return parts.nick.str();
+}
+
+IRCCommand::Source IRCCommand::getSource() const
+{
+    return makeSource(source, m_iSourceBang, m_iSourceAt);
+}
+
+std::string IRCCommand::readSource(const std::string &usermask,
+        std::string *user, std::string *host)
+{
+    Source parts = splitSource(usermask);
+    if(user != NULL) parts.user.copyTo(user);
+    if(host != NULL) parts.host.copyTo(host);
+    return parts.nick.str();
+}
+
+IRCCommand::Source IRCCommand::splitSource(const std::string &usermask)
+{
+    size_t bang, at;
+    findSeparators(usermask, &bang, &at);
+    return makeSource(usermask, bang, at);
+}
+
+void IRCCommand::findSeparators(const std::string &usermask, size_t *bang,
+        size_t *at)
+{
+    *at = usermask.rfind('@');
+    if(*at == std::string::npos || *at == 0)
+        *bang = std::string::npos;
+    else
+        *bang = usermask.rfind('!', *at);
 }
 
 // 1 [:]nick!user@host
 // 2 [:]user@host
 // 3 [:]host
-std::string IRCCommand::readSource(const std::string &usermask,
-        std::string *user, std::string *host)
+IRCCommand::Source IRCCommand::makeSource(const std::string &usermask,
+        size_t bang, size_t at)
 {
     size_t begin = 0;
-    if(usermask[0] == ':')
+    if(!usermask.empty() && usermask[0] == ':')
         begin = 1;
-
-    size_t ar = usermask.rfind('@');
+    Source parts;
 
     // Case 3
-    if(ar == std::string::npos)
+    if(at == std::string::npos)
+        parts.host = StringView(usermask, begin, usermask.size() - begin);
+    // Case 2
+    else if(bang == std::string::npos)
     {
-        if(user != NULL) *user = "";
-        if(host != NULL) *host = usermask.substr(begin);
-        return "";
+        parts.user = StringView(usermask, begin, at - begin);
+        parts.host = StringView(usermask, at + 1, usermask.size() - at - 1);
     }
-    // Case 1 or 2
+    // Case 1
     else
     {
-        size_t ex = usermask.rfind('!', ar);
-
-        // Case 2
-        if(ex == std::string::npos)
-        {
-            if(user != NULL) *user = usermask.substr(begin, ar - begin);
-            if(host != NULL) *host = usermask.substr(ar + 1);
-            return "";
-        }
-        // Case 1
-        else
-        {
-            if(user != NULL) *user = usermask.substr(ex + 1, ar - ex - 1);
-            if(host != NULL) *host = usermask.substr(ar + 1);
-            return usermask.substr(begin, ex - begin);
-        }
+        parts.nick = StringView(usermask, begin, bang - begin);
+        parts.user = StringView(usermask, bang + 1, at - bang - 1);
+        parts.host = StringView(usermask, at + 1, usermask.size() - at - 1);
     }
+    return parts;
 }
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 
+#include "common/StringView.h"
 #include "IRCClient.h"
 
 /*
@@ -61,6 +62,8 @@ public:
         ENDOFMOTD,      // 376 "End of /MOTD command"
         NOMOTD,         // 422 "MOTD File is missing"
         ISON,           // 303 nick, ...
+        ISUPPORT,       // 005 nick, token, ..., "are supported by this server"
+        TRYAGAIN,       // 263 command, "Please wait a while and try again."
 
         PRIVMSG,        // target, message
         NOTICE,         // target, message
@@ -79,10 +82,26 @@ public:
         UNKNOWN         // Not necessarily an error...
     };
 
+    /**
+     * The reasons a line can't be parsed, returned by tryParse().
+     */
+    enum EParseError {
+        PARSE_OK,
+        PARSE_EMPTY,        // The line is empty
+        PARSE_NO_COMMAND    // There is no command after the source
+    };
+
 public:
     /** The type of this command or UNKNOWN. */
     EType type;
 
+    /**
+     * The IRCv3 message tags, without the leading '@' ("a=b;c"), or empty.
+     *
+     * Tags are not interpreted here; see Trace for the ones we use.
+     */
+    std::string tags;
+
     /**
      * The source of the command as a single string.
      *
@@ -98,9 +117,34 @@ public:
      */
     std::vector<std::string> args;
 
+    /**
+     * The parts of a source, as views into the source string.
+     *
+     * Like readSource(), fields that are not present are empty.
+     */
+    struct Source {
+        StringView nick;
+        StringView user;
+        StringView host;
+    };
+
+private:
+    // Position of the '!' and '@' in 'source' (or npos), found once when the
+    // command is constructed
+    size_t m_iSourceBang;
+    size_t m_iSourceAt;
+
 public:
+    /**
+     * Constructs an empty command, to be filled by tryParse().
+     */
+    IRCCommand();
+
     /**
      * Parse a line into an IRC command.
+     *
+     * Throws if the line can't be parsed; see tryParse() for a version that
+     * doesn't.
      */
     explicit IRCCommand(const std::string &line) throw(Invalid);
 
@@ -125,6 +169,21 @@ public:
      */
     IRCCommand(const std::string &source, EType type_, ...);
 
+    /**
+     * Parse a line into this command, without throwing.
+     *
+     * This is what is used on each line received from the server, where bad
+     * lines are simply skipped. The strings of the previous command are
+     * reused, so parsing a stream of lines into the same object allocates
+     * little.
+     * @return PARSE_OK, or the reason why the line was rejected; in that case
+     * the content of the command is unspecified.
+     */
+    EParseError tryParse(const std::string &line);
+
+    /** Describes a parse error. */
+    static const char *parseErrorMessage(EParseError error);
+
     /**
      * Pass the source to readSource(const std::string&, std::string*,
      * std::string*).
@@ -133,6 +192,14 @@ public:
      */
     std::string readSource(std::string *user, std::string *host);
 
+    /**
+     * Returns the parts of the source, without allocating.
+     *
+     * The source was split when the command was constructed, so this is
+     * cheap; the views are valid as long as 'source' is not modified.
+     */
+    Source getSource() const;
+
 public:
     /**
      * Interpret an IRC source string.
@@ -146,6 +213,20 @@ public:
     static std::string readSource(const std::string &usermask,
             std::string *user, std::string *host);
 
+    /**
+     * Interpret an IRC source string, without allocating.
+     *
+     * Same as readSource(const std::string&, std::string*, std::string*),
+     * but returns views into 'usermask'.
+     */
+    static Source splitSource(const std::string &usermask);
+
+private:
+    static void findSeparators(const std::string &usermask, size_t *bang,
+            size_t *at);
+    static Source makeSource(const std::string &usermask, size_t bang,
+            size_t at);
+
 };
 
 #endif
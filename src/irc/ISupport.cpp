@@ -0,0 +1,278 @@
+#include "ISupport.h"
+
+#include <cstdlib>
+
+#include "IRCCommand.h"
+
+/**
+ * Decodes the \xHH escapes that can appear in ISUPPORT values.
+ */
+static std::string unescape(const std::string &value)
+{
+    std::string result;
+    size_t pos = 0;
+    while(pos < value.size())
+    {
+        if(value[pos] == '\\' && pos + 3 < value.size()
+         && value[pos + 1] == 'x')
+        {
+            char hex[3] = {value[pos + 2], value[pos + 3], '\0'};
+            char *end;
+            long c = strtol(hex, &end, 16);
+            if(end == hex + 2)
+            {
+                result += (char)c;
+                pos += 4;
+                continue;
+            }
+        }
+        result += value[pos++];
+    }
+    return result;
+}
+
+ISupport::ISupport()
+  : m_iNickLen(9), m_iMaxTargets(0)
+{
+    unsigned int i;
+    for(i = 0; i < 256; i++)
+        m_ChanModes[i] = CHANMODE_UNKNOWN;
+    setCaseMapping(CASEMAPPING_RFC1459);
+    setPrefix("(ov)@+");
+    setChanModes("b,k,l,imnpst");
+    setChanTypes("#&");
+}
+
+void ISupport::parse(const IRCCommand &command)
+{
+    // The first argument is our nickname, the last one is the human-readable
+    // "are supported by this server"
+    size_t i;
+    for(i = 1; i + 1 < command.args.size(); i++)
+        parseToken(command.args[i]);
+}
+
+void ISupport::parseToken(const std::string &token)
+{
+    if(token.empty())
+        return ;
+
+    // "-TOKEN" restores the default
+    bool negate = (token[0] == '-');
+    size_t eq = token.find('=');
+    std::string name = token.substr(negate?1:0,
+            (eq == std::string::npos)?std::string::npos:eq - (negate?1:0));
+    std::string value;
+    if(!negate && eq != std::string::npos)
+        value = unescape(token.substr(eq + 1));
+
+    if(name == "CASEMAPPING")
+    {
+        if(value == "ascii")
+            setCaseMapping(CASEMAPPING_ASCII);
+        else if(value == "strict-rfc1459")
+            setCaseMapping(CASEMAPPING_STRICT_RFC1459);
+        else if(negate || value == "rfc1459")
+            setCaseMapping(CASEMAPPING_RFC1459);
+        else
+            // Unknown mappings (rfc7613, ...) at least fold ASCII
+            setCaseMapping(CASEMAPPING_ASCII);
+    }
+    else if(name == "PREFIX")
+        setPrefix(negate?"(ov)@+":value);
+    else if(name == "CHANMODES")
+        setChanModes(negate?"b,k,l,imnpst":value);
+    else if(name == "CHANTYPES")
+        setChanTypes(negate?"#&":value);
+    else if(name == "NICKLEN")
+        m_iNickLen = negate?9:strtoul(value.c_str(), NULL, 10);
+    else if(name == "MAXTARGETS")
+        m_iMaxTargets = negate?0:strtoul(value.c_str(), NULL, 10);
+    else if(name == "TARGMAX")
+        setTargMax(negate?"":value);
+    else if(name == "NETWORK")
+        m_sNetwork = value;
+}
+
+void ISupport::setCaseMapping(ECaseMapping mapping)
+{
+    m_eCaseMapping = mapping;
+    unsigned int i;
+    for(i = 0; i < 256; i++)
+        m_CaseFold[i] = (unsigned char)i;
+    for(i = 'A'; i <= 'Z'; i++)
+        m_CaseFold[i] = (unsigned char)(i - 'A' + 'a');
+    if(mapping != CASEMAPPING_ASCII)
+    {
+        m_CaseFold['['] = '{';
+        m_CaseFold[']'] = '}';
+        m_CaseFold['\\'] = '|';
+        if(mapping == CASEMAPPING_RFC1459)
+            m_CaseFold['~'] = '^';
+    }
+}
+
+void ISupport::setPrefix(const std::string &value)
+{
+    unsigned int i;
+    for(i = 0; i < 256; i++)
+    {
+        m_PrefixBySymbol[i] = 0;
+        m_PrefixByMode[i] = 0;
+        if(m_ChanModes[i] == CHANMODE_PREFIX)
+            m_ChanModes[i] = CHANMODE_UNKNOWN;
+    }
+    m_sPrefixModes = "";
+    m_sPrefixSymbols = "";
+
+    // "(ov)@+"; an empty value means no membership modes
+    size_t close = value.find(')');
+    if(value.empty() || value[0] != '(' || close == std::string::npos)
+        return ;
+    std::string modes = value.substr(1, close - 1);
+    std::string symbols = value.substr(close + 1);
+    if(modes.size() != symbols.size())
+        return ;
+    if(modes.size() > MAX_PREFIXES)
+    {
+        modes.resize(MAX_PREFIXES);
+        symbols.resize(MAX_PREFIXES);
+    }
+    m_sPrefixModes = modes;
+    m_sPrefixSymbols = symbols;
+    for(i = 0; i < modes.size(); i++)
+    {
+        m_PrefixByMode[(unsigned char)modes[i]] = i + 1;
+        m_PrefixBySymbol[(unsigned char)symbols[i]] = i + 1;
+        m_ChanModes[(unsigned char)modes[i]] = CHANMODE_PREFIX;
+    }
+}
+
+void ISupport::setChanModes(const std::string &value)
+{
+    unsigned int i;
+    for(i = 0; i < 256; i++)
+        if(m_ChanModes[i] != CHANMODE_PREFIX)
+            m_ChanModes[i] = CHANMODE_UNKNOWN;
+
+    // "A,B,C,D"; later groups might be added to the standard, ignore them
+    unsigned int group = CHANMODE_LIST;
+    for(i = 0; i < value.size() && group <= CHANMODE_FLAG; i++)
+    {
+        unsigned char c = value[i];
+        if(c == ',')
+            group++;
+        else if(m_ChanModes[c] != CHANMODE_PREFIX)
+            m_ChanModes[c] = group;
+    }
+}
+
+void ISupport::setChanTypes(const std::string &value)
+{
+    unsigned int i;
+    for(i = 0; i < 256; i++)
+        m_ChanTypes[i] = false;
+    m_sChanTypes = value;
+    for(i = 0; i < value.size(); i++)
+        m_ChanTypes[(unsigned char)value[i]] = true;
+}
+
+void ISupport::setTargMax(const std::string &value)
+{
+    // "JOIN:,KICK:4,PRIVMSG:20"; no number means no limit
+    m_TargMax.clear();
+    size_t pos = 0;
+    while(pos < value.size())
+    {
+        size_t end = value.find(',', pos);
+        if(end == std::string::npos)
+            end = value.size();
+        size_t colon = value.find(':', pos);
+        if(colon != std::string::npos && colon < end)
+        {
+            std::string command = value.substr(pos, colon - pos);
+            std::string limit = value.substr(colon + 1, end - colon - 1);
+            m_TargMax[command] = strtoul(limit.c_str(), NULL, 10);
+        }
+        pos = end + 1;
+    }
+}
+
+std::string ISupport::casefold(const std::string &name) const
+{
+    std::string result(name);
+    size_t i;
+    for(i = 0; i < result.size(); i++)
+        result[i] = fold(result[i]);
+    return result;
+}
+
+bool ISupport::equals(const std::string &a, const std::string &b) const
+{
+    if(a.size() != b.size())
+        return false;
+    size_t i;
+    for(i = 0; i < a.size(); i++)
+        if(fold(a[i]) != fold(b[i]))
+            return false;
+    return true;
+}
+
+unsigned int ISupport::readPrefixes(const std::string &nick,
+        size_t *length) const
+{
+    unsigned int mask = 0;
+    size_t i = 0;
+    unsigned char bit;
+    while(i < nick.size()
+     && (bit = m_PrefixBySymbol[(unsigned char)nick[i]]) != 0)
+    {
+        mask |= 1u << (bit - 1);
+        i++;
+    }
+    if(length != NULL)
+        *length = i;
+    return mask;
+}
+
+char ISupport::prefixSymbol(unsigned int mask) const
+{
+    unsigned int i;
+    for(i = 0; i < m_sPrefixSymbols.size(); i++)
+        if(mask & (1u << i))
+            return m_sPrefixSymbols[i];
+    return '\0';
+}
+
+bool ISupport::chanModeTakesParam(char mode, bool set) const
+{
+    switch(chanMode(mode))
+    {
+    case CHANMODE_LIST:
+    case CHANMODE_ALWAYS:
+    case CHANMODE_PREFIX:
+        return true;
+    case CHANMODE_SET:
+        return set;
+    default:
+        return false;
+    }
+}
+
+bool ISupport::getTargetLimit(const std::string &command,
+        unsigned int *limit) const
+{
+    std::map<std::string, unsigned int>::const_iterator it =
+            m_TargMax.find(command);
+    if(it != m_TargMax.end())
+    {
+        *limit = it->second;
+        return true;
+    }
+    if(m_iMaxTargets > 0 && (command == "PRIVMSG" || command == "NOTICE"))
+    {
+        *limit = m_iMaxTargets;
+        return true;
+    }
+    return false;
+}
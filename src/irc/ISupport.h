@@ -0,0 +1,202 @@
+#ifndef HEADER_ISUPPORT_H
+#define HEADER_ISUPPORT_H
+
+#include <map>
+#include <string>
+
+class IRCCommand;
+
+/**
+ * The features advertised by a server through RPL_ISUPPORT (005).
+ *
+ * Servers send a few 005 lines after registration, listing tokens such as
+ * CASEMAPPING=ascii or PREFIX=(ov)@+. They are turned here into lookup
+ * tables, built once when the tokens are received, so that code handling
+ * each line (comparing nicknames, reading membership prefixes, classifying
+ * mode letters) is a table lookup instead of a test on the server's flavor.
+ *
+ * Until the server says otherwise, the values are the ones of RFC 1459.
+ *
+ * See http://tools.ietf.org/html/draft-brocklesby-irc-isupport-03
+ */
+class ISupport {
+
+public:
+    enum ECaseMapping {
+        CASEMAPPING_ASCII,
+        CASEMAPPING_RFC1459,
+        CASEMAPPING_STRICT_RFC1459
+    };
+
+    /** The kind of a channel mode, from CHANMODES and PREFIX. */
+    enum EChanMode {
+        CHANMODE_UNKNOWN,
+        CHANMODE_LIST,      // A: list, always takes a parameter (b, e, I)
+        CHANMODE_ALWAYS,    // B: always takes a parameter (k)
+        CHANMODE_SET,       // C: takes a parameter when set (l)
+        CHANMODE_FLAG,      // D: never takes a parameter (i, m, n, ...)
+        CHANMODE_PREFIX     // Membership mode, takes a nickname (o, v)
+    };
+
+    /** Maximum number of membership modes (bits in a prefix mask). */
+    static const unsigned int MAX_PREFIXES = 16;
+
+private:
+    ECaseMapping m_eCaseMapping;
+    unsigned char m_CaseFold[256];
+
+    // Membership modes, from the highest; a user's modes are stored as a
+    // mask where bit i is set for m_sPrefixModes[i]
+    std::string m_sPrefixModes;
+    std::string m_sPrefixSymbols;
+    unsigned char m_PrefixBySymbol[256];
+    unsigned char m_PrefixByMode[256];
+
+    unsigned char m_ChanModes[256];
+    bool m_ChanTypes[256];
+    std::string m_sChanTypes;
+
+    unsigned int m_iNickLen;
+    unsigned int m_iMaxTargets;
+    std::map<std::string, unsigned int> m_TargMax;
+    std::string m_sNetwork;
+
+public:
+    /** Creates a record with the defaults from RFC 1459. */
+    ISupport();
+
+    /**
+     * Reads the tokens of an ISUPPORT (005) command.
+     *
+     * Can be called for each 005 line; tokens override (or, with a '-'
+     * prefix, reset) the values read previously.
+     */
+    void parse(const IRCCommand &command);
+
+    /** Reads a single token, eg "NICKLEN=30". */
+    void parseToken(const std::string &token);
+
+    /** Folds a character according to the CASEMAPPING. */
+    inline char fold(char c) const
+    {
+        return (char)m_CaseFold[(unsigned char)c];
+    }
+
+    /** Folds a nickname or channel name according to the CASEMAPPING. */
+    std::string casefold(const std::string &name) const;
+
+    /** Compares two nicknames or channel names, ignoring case. */
+    bool equals(const std::string &a, const std::string &b) const;
+
+    inline ECaseMapping getCaseMapping() const
+    {
+        return m_eCaseMapping;
+    }
+
+    /** Indicates whether a target is a channel, according to CHANTYPES. */
+    inline bool isChannel(const std::string &name) const
+    {
+        return !name.empty() && m_ChanTypes[(unsigned char)name[0]];
+    }
+
+    inline const std::string &getChanTypes() const
+    {
+        return m_sChanTypes;
+    }
+
+    /**
+     * Reads the membership prefixes in front of a nickname.
+     *
+     * Handles the multiple prefixes of multi-prefix ("@+nick").
+     * @param length Location where to write the number of prefix characters,
+     * or NULL.
+     * @return The mask of the membership modes.
+     */
+    unsigned int readPrefixes(const std::string &nick, size_t *length) const;
+
+    /**
+     * Mask of a membership mode letter ('o'), or 0 if it isn't one.
+     */
+    inline unsigned int prefixModeMask(char mode) const
+    {
+        unsigned char i = m_PrefixByMode[(unsigned char)mode];
+        return (i == 0)?0:(1u << (i - 1));
+    }
+
+    /**
+     * Mask of a membership prefix symbol ('@'), or 0 if it isn't one.
+     */
+    inline unsigned int prefixSymbolMask(char symbol) const
+    {
+        unsigned char i = m_PrefixBySymbol[(unsigned char)symbol];
+        return (i == 0)?0:(1u << (i - 1));
+    }
+
+    /**
+     * Returns the symbol of the highest mode in a mask, or 0 if the mask is
+     * empty.
+     */
+    char prefixSymbol(unsigned int mask) const;
+
+    inline const std::string &getPrefixModes() const
+    {
+        return m_sPrefixModes;
+    }
+
+    inline const std::string &getPrefixSymbols() const
+    {
+        return m_sPrefixSymbols;
+    }
+
+    /** Kind of a channel mode letter. */
+    inline EChanMode chanMode(char mode) const
+    {
+        return (EChanMode)m_ChanModes[(unsigned char)mode];
+    }
+
+    /**
+     * Indicates whether a channel mode takes a parameter.
+     *
+     * @param set Whether the mode is being set ('+') or unset ('-').
+     */
+    bool chanModeTakesParam(char mode, bool set) const;
+
+    /** Maximum length of a nickname. */
+    inline unsigned int getNickLen() const
+    {
+        return m_iNickLen;
+    }
+
+    /**
+     * Maximum number of targets for a command, from TARGMAX (or MAXTARGETS
+     * for PRIVMSG and NOTICE).
+     *
+     * @param command Uppercase command name.
+     * @param limit Location where to write the limit, 0 meaning no limit.
+     * @return false if the server didn't advertise a limit for this command.
+     */
+    bool getTargetLimit(const std::string &command,
+            unsigned int *limit) const;
+
+    /** The TARGMAX entries, 0 meaning no limit. */
+    inline const std::map<std::string, unsigned int> &getTargMax() const
+    {
+        return m_TargMax;
+    }
+
+    /** Name of the network, or "" if not advertised. */
+    inline const std::string &getNetwork() const
+    {
+        return m_sNetwork;
+    }
+
+private:
+    void setCaseMapping(ECaseMapping mapping);
+    void setPrefix(const std::string &value);
+    void setChanModes(const std::string &value);
+    void setChanTypes(const std::string &value);
+    void setTargMax(const std::string &value);
+
+};
+
+#endif
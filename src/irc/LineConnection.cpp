@@ -1,37 +1,278 @@
 #include "LineConnection.h"
 
+#include <cstring>
+
+#include "common/MemoryBudget.h"
+#include "common/Metrics.h"
+
+static Counter &linesReceived =
+        Metrics::global().counter("irc.lines_received");
+static Counter &linesSent = Metrics::global().counter("irc.lines_sent");
+static Counter &overlongLines =
+        Metrics::global().counter("irc.lines_overlong");
+static Counter &bufferBytes = Metrics::global().counter("irc.buffer_bytes");
+static Counter &budgetRefused =
+        Metrics::global().counter("irc.budget_refused");
+
 LineConnection::LineConnection(NetStream *stream)
-  : m_pStream(stream)
+  : m_pStream(stream), m_iMaxLine(MAX_LINE_RFC), m_eOverflowPolicy(TRUNCATE),
+    m_pBudget(NULL), m_iReserved(0), m_bOverflow(false), m_iOverlongLines(0),
+    m_iLinesRead(0), m_iLinesWritten(0), m_pScheduler(NULL),
+    m_bFlushScheduled(false), m_bClosed(false)
 {
 }
 
 LineConnection::~LineConnection()
 {
+    if(m_bFlushScheduled)
+        m_pScheduler->CancelFlush(this);
+    // Try to send the last lines (ie QUIT)
+    try
+    {
+        Flush();
+    }
+    catch(SocketConnectionClosed &e)
+    {
+    }
+    releaseBudget();
+    bufferBytes.sub(m_sBuffer.size());
     delete m_pStream;
 }
 
 std::list<std::string> LineConnection::readLines(bool wait)
             throw(SocketConnectionClosed)
 {
-    char buffer[128];
-    int ret = m_pStream->Recv(buffer, 128, wait);
     std::list<std::string> lines;
-    size_t prev_size = m_sBuffer.size();
-    m_sBuffer.append(buffer, ret);
-    size_t pos = m_sBuffer.find('\n', prev_size);
-    while(pos != std::string::npos)
-    {
-        std::string result = m_sBuffer.substr(0, pos);
-        m_sBuffer = m_sBuffer.substr(pos+1);
-        if(result[pos-1] == '\r')
-            result.resize(pos-1);
-        lines.push_back(result);
-        pos = m_sBuffer.find('\n', 0);
+    if(m_bClosed)
+        throw SocketConnectionClosed();
+
+    // Drain what is available: keep reading while the reads fill the buffer
+    // (a short read means the socket was emptied) or the stream has data of
+    // its own, up to a limit so that other connections get their turn
+    char buffer[RECV_SIZE];
+    unsigned int reads = 0;
+    unsigned long long before = m_iLinesRead;
+    for(;;)
+    {
+        int ret;
+        try
+        {
+            ret = m_pStream->Recv(buffer, RECV_SIZE, wait && reads == 0);
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            // Return what we got, the next call will throw
+            if(reads == 0)
+                throw;
+            m_bClosed = true;
+            break;
+        }
+        reads++;
+        splitLines(buffer, ret, &lines);
+        if(reads >= MAX_READS
+         || ((size_t)ret < RECV_SIZE && !m_pStream->HasPending()))
+            break;
     }
+    if(m_iLinesRead != before)
+        linesReceived.add(m_iLinesRead - before);
     return lines;
 }
 
+void LineConnection::splitLines(const char *data, size_t size,
+        std::list<std::string> *lines)
+{
+    const char *pos = data;
+    const char *const end = data + size;
+    while(pos < end)
+    {
+        const char *nl = (const char*)memchr(pos, '\n', end - pos);
+        if(nl == NULL)
+        {
+            appendPartial(pos, end - pos);
+            break;
+        }
+        appendPartial(pos, nl - pos);
+        endLine(lines);
+        pos = nl + 1;
+    }
+}
+
+void LineConnection::appendPartial(const char *data, size_t size)
+{
+    // Part of the line was dropped already: keeping what follows would
+    // return the end of the line as if it were a whole one
+    if(m_bOverflow)
+        return ;
+    // Keep one more byte than the maximum, for the CR
+    size_t room = m_iMaxLine + 1;
+    room = (m_sBuffer.size() < room)?room - m_sBuffer.size():0;
+    if(size > room)
+    {
+        m_bOverflow = true;
+        size = room;
+    }
+    if(size == 0)
+        return ;
+    if(m_pBudget != NULL)
+    {
+        if(!m_pBudget->reserve(size))
+        {
+            m_bOverflow = true;
+            budgetRefused.add();
+            return ;
+        }
+        m_iReserved += size;
+    }
+    m_sBuffer.append(data, size);
+    bufferBytes.add(size);
+}
+
+void LineConnection::endLine(std::list<std::string> *lines)
+{
+    // The buffer is emptied below, either way
+    bufferBytes.sub(m_sBuffer.size());
+    if(!m_sBuffer.empty() && m_sBuffer[m_sBuffer.size() - 1] == '\r')
+        m_sBuffer.resize(m_sBuffer.size() - 1);
+    if(m_sBuffer.size() > m_iMaxLine)
+    {
+        m_bOverflow = true;
+        m_sBuffer.resize(m_iMaxLine);
+    }
+    releaseBudget();
+
+    if(m_bOverflow)
+    {
+        m_iOverlongLines++;
+        overlongLines.add();
+        m_bOverflow = false;
+        if(m_eOverflowPolicy == DISCARD)
+        {
+            m_sBuffer.clear();
+            return ;
+        }
+    }
+    lines->push_back(std::string());
+    lines->back().swap(m_sBuffer);
+    m_iLinesRead++;
+}
+
+void LineConnection::releaseBudget()
+{
+    if(m_pBudget != NULL && m_iReserved > 0)
+        m_pBudget->release(m_iReserved);
+    m_iReserved = 0;
+}
+
+void LineConnection::writeLine(const std::string &line)
+        throw(SocketConnectionClosed)
+{
+    if(m_pScheduler == NULL)
+    {
+        NetStream::Chunk chunks[2] = {
+            {line.data(), line.size()},
+            {"\r\n", 2}
+        };
+        m_pStream->SendV(chunks, 2);
+        m_iLinesWritten++;
+        linesSent.add();
+        return ;
+    }
+    m_Output.push_back(line);
+    if(!m_bFlushScheduled)
+    {
+        m_bFlushScheduled = true;
+        m_pScheduler->ScheduleFlush(this);
+    }
+}
+
+void LineConnection::Flush() throw(SocketConnectionClosed)
+{
+    m_bFlushScheduled = false;
+    if(m_Output.empty())
+        return ;
+    m_Chunks.resize(m_Output.size() * 2);
+    size_t i;
+    for(i = 0; i < m_Output.size(); i++)
+    {
+        m_Chunks[2*i].data = m_Output[i].data();
+        m_Chunks[2*i].size = m_Output[i].size();
+        m_Chunks[2*i + 1].data = "\r\n";
+        m_Chunks[2*i + 1].size = 2;
+    }
+    try
+    {
+        m_pStream->SendV(&m_Chunks[0], m_Chunks.size());
+    }
+    catch(SocketConnectionClosed &e)
+    {
+        m_Output.clear();
+        throw;
+    }
+    m_iLinesWritten += m_Output.size();
+    linesSent.add(m_Output.size());
+    m_Output.clear();
+}
+
 void LineConnection::RegisterSockets(SocketSetRegistrar *registrar)
 {
     m_pStream->RegisterSockets(registrar);
 }
+
+void LineConnection::setMaxLineLength(size_t length, EOverflowPolicy policy)
+{
+    m_iMaxLine = length;
+    m_eOverflowPolicy = policy;
+}
+
+void LineConnection::setBudget(MemoryBudget *budget)
+{
+    if(budget == m_pBudget)
+        return ;
+    releaseBudget();
+    m_pBudget = budget;
+    if(m_pBudget != NULL && !m_sBuffer.empty())
+    {
+        if(m_pBudget->reserve(m_sBuffer.size()))
+            m_iReserved = m_sBuffer.size();
+        else
+        {
+            // Drop what was buffered of the current line
+            bufferBytes.sub(m_sBuffer.size());
+            m_sBuffer.clear();
+            m_bOverflow = true;
+            budgetRefused.add();
+        }
+    }
+}
+
+bool LineConnection::setProfile(const TCPProfile &profile)
+{
+    return m_pStream->SetProfile(profile);
+}
+
+void LineConnection::SetFlushScheduler(FlushScheduler *scheduler)
+{
+    if(m_bFlushScheduled)
+        m_pScheduler->CancelFlush(this);
+    m_bFlushScheduled = false;
+    m_pScheduler = scheduler;
+    if(!m_Output.empty())
+    {
+        if(m_pScheduler != NULL)
+        {
+            m_bFlushScheduled = true;
+            m_pScheduler->ScheduleFlush(this);
+        }
+        else
+        {
+            try
+            {
+                Flush();
+            }
+            catch(SocketConnectionClosed &e)
+            {
+                // Will be noticed on the next read
+            }
+        }
+    }
+}
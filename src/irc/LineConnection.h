@@ -3,37 +3,181 @@
 
 #include <string>
 #include <list>
+#include <vector>
 
 #include "sockets/Socket.h"
 
+class MemoryBudget;
+
 /**
  * A buffered stream that allows to receive full lines.
+ *
+ * The length of the lines is bounded: a peer that never sends a line feed
+ * can't make the buffer grow beyond the maximum line length. Lines that are
+ * too long are truncated or discarded, according to the policy, but the
+ * stream stays framed: the next line starts after the next line feed.
+ *
+ * Once attached to an event loop (through SetFlushScheduler()), lines
+ * written are buffered and sent together at the end of the loop's iteration,
+ * with a single vectored write.
  */
-class LineConnection : public Waitable {
+class LineConnection : public Waitable, public Flushable {
+
+public:
+    /** What to do with a line longer than the maximum. */
+    enum EOverflowPolicy {
+        TRUNCATE,   // Return the beginning of the line
+        DISCARD     // Drop the line entirely
+    };
+
+    /** Maximum length of a line in RFC 1459, without the CR LF. */
+    static const size_t MAX_LINE_RFC = 510;
+
+    /** Maximum length of a line with IRCv3 message tags (8191 for tags). */
+    static const size_t MAX_LINE_TAGS = 8191 + MAX_LINE_RFC;
+
+    /** Size of the reads. */
+    static const size_t RECV_SIZE = 16384;
+
+    /** Maximum number of reads done by one call to readLines(). */
+    static const unsigned int MAX_READS = 16;
 
 private:
     NetStream *m_pStream;
     std::string m_sBuffer;
 
+    size_t m_iMaxLine;
+    EOverflowPolicy m_eOverflowPolicy;
+    MemoryBudget *m_pBudget;
+    size_t m_iReserved;         // Bytes of m_sBuffer reserved from m_pBudget
+    bool m_bOverflow;           // Some of the current line was dropped
+    unsigned long long m_iOverlongLines;
+    unsigned long long m_iLinesRead;
+    unsigned long long m_iLinesWritten;
+
+    // Lines waiting to be flushed, without CR LF
+    std::vector<std::string> m_Output;
+    std::vector<NetStream::Chunk> m_Chunks;
+    FlushScheduler *m_pScheduler;
+    bool m_bFlushScheduled;
+
+    // The connection was closed after data was returned
+    bool m_bClosed;
+
 public:
     /**
      * Create a line-buffered connection from the given network stream.
      */
     LineConnection(NetStream *stream);
-    ~LineConnection();
+    virtual ~LineConnection();
     /**
      * Receives data and returns the full lines that have been received.
      *
+     * Reads everything that is available (up to MAX_READS * RECV_SIZE
+     * bytes), so that a single wakeup handles a whole burst. If wait is
+     * specified, only the first read waits.
      * Might return an empty list even if wait was specified, if data was
      * received but didn't make a full line.
+     * If the connection is closed after some data was read, the lines are
+     * returned and the next call throws.
      * This method WILL NOT return the partial line received before the
      * connection was lost.
      */
     std::list<std::string> readLines(bool wait = false)
             throw(SocketConnectionClosed);
 
+    /**
+     * Sends a line.
+     *
+     * The line terminator (CR LF) is appended; 'line' shouldn't contain one.
+     * If a FlushScheduler was set, the line is only buffered, and sent when
+     * Flush() is called.
+     */
+    void writeLine(const std::string &line) throw(SocketConnectionClosed);
+
+    /** Sends the buffered lines, if any. */
+    void Flush() throw(SocketConnectionClosed);
+
+    /** Number of lines waiting to be flushed. */
+    inline size_t getPendingLines() const
+    {
+        return m_Output.size();
+    }
+
     void RegisterSockets(SocketSetRegistrar *registrar);
 
+    /**
+     * Sets the scheduler that will flush the output, enabling buffering.
+     *
+     * With NULL, lines are sent as soon as they are written (the default);
+     * lines that were buffered are sent.
+     */
+    void SetFlushScheduler(FlushScheduler *scheduler);
+
+    /**
+     * Sets the maximum length of received lines, not counting the line
+     * terminator.
+     *
+     * The default is MAX_LINE_RFC; use MAX_LINE_TAGS once message-tags have
+     * been negotiated.
+     */
+    void setMaxLineLength(size_t length,
+            EOverflowPolicy policy = TRUNCATE);
+
+    inline size_t getMaxLineLength() const
+    {
+        return m_iMaxLine;
+    }
+
+    /**
+     * Accounts the buffered partial line in a budget shared with other
+     * connections.
+     *
+     * When the budget is exhausted, the line being received is handled as if
+     * it were too long. The budget must outlive the connection; NULL removes
+     * it.
+     */
+    void setBudget(MemoryBudget *budget);
+
+    /** Number of bytes of partial line currently buffered. */
+    inline size_t getBufferedSize() const
+    {
+        return m_sBuffer.size();
+    }
+
+    /**
+     * Changes the options of the underlying connection, for instance to
+     * TCPProfile::BULK while a log is being streamed on it.
+     *
+     * @return false if the stream doesn't support it.
+     */
+    bool setProfile(const TCPProfile &profile);
+
+    /** Number of lines that were truncated or discarded. */
+    inline unsigned long long getOverlongLines() const
+    {
+        return m_iOverlongLines;
+    }
+
+    /** Number of lines returned by readLines(). */
+    inline unsigned long long getLinesRead() const
+    {
+        return m_iLinesRead;
+    }
+
+    /** Number of lines sent (not counting those still buffered). */
+    inline unsigned long long getLinesWritten() const
+    {
+        return m_iLinesWritten;
+    }
+
+private:
+    void splitLines(const char *data, size_t size,
+            std::list<std::string> *lines);
+    void appendPartial(const char *data, size_t size);
+    void endLine(std::list<std::string> *lines);
+    void releaseBudget();
+
 };
 
 #endif
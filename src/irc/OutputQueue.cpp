@@ -0,0 +1,244 @@
+#include "OutputQueue.h"
+
+#include <algorithm>
+
+#include "common/Clock.h"
+#include "common/Metrics.h"
+
+static Counter &queuedLines = Metrics::global().counter("irc.sendqueue_lines");
+static Histogram &queueWait =
+        Metrics::global().histogram("irc.sendqueue_wait_us");
+
+OutputQueue::OutputQueue(unsigned int burst, unsigned int interval)
+  : m_iSize(0), m_iBurst((burst > 0)?burst:1), m_iInterval(interval),
+    m_iTheoretical(0)
+{
+    m_TargetLimits["PRIVMSG"] = 1;
+    m_TargetLimits["NOTICE"] = 1;
+}
+
+OutputQueue::~OutputQueue()
+{
+    queuedLines.sub(m_iSize);
+}
+
+void OutputQueue::setRate(unsigned int burst, unsigned int interval)
+{
+    m_iBurst = (burst > 0)?burst:1;
+    m_iInterval = interval;
+}
+
+void OutputQueue::setTargetLimit(const std::string &command,
+        unsigned int limit)
+{
+    m_TargetLimits[command] = limit;
+}
+
+bool OutputQueue::push(const std::string &line, EPriority priority,
+        const std::string &key)
+{
+    std::deque<Entry> &queue = m_Queues[priority];
+    if(!key.empty())
+    {
+        std::deque<Entry>::iterator it = queue.begin();
+        for(; it != queue.end(); ++it)
+            if(it->key == key)
+            {
+                it->line = line;
+                return false;
+            }
+    }
+    Entry entry;
+    entry.line = line;
+    entry.key = key;
+    entry.queued = monotonicMicros();
+    if(key.empty())
+        parseBatch(&entry);
+
+    if(!entry.batch.empty() && !queue.empty()
+     && queue.back().batch == entry.batch)
+    {
+        // Merge with the last line waiting, if the server allows it
+        Entry &last = queue.back();
+        unsigned int limit = 0;
+        std::map<std::string, unsigned int>::const_iterator it =
+                m_TargetLimits.find(entry.command);
+        if(it != m_TargetLimits.end())
+            limit = it->second;
+        if( (limit == 0 || last.count + entry.count <= limit)
+         && last.line.size() + 1 + entry.targets.size() <= MAX_LINE)
+        {
+            last.targets += last.separator;
+            last.targets += entry.targets;
+            last.count += entry.count;
+            last.line = last.command + " " + last.targets + last.tail;
+            return true;
+        }
+    }
+
+    queue.push_back(entry);
+    m_iSize++;
+    queuedLines.add();
+    return !entry.batch.empty();
+}
+
+void OutputQueue::parseBatch(Entry *entry)
+{
+    const std::string &line = entry->line;
+    size_t space = line.find(' ');
+    if(space == std::string::npos || space + 1 == line.size())
+        return ;
+    entry->command = line.substr(0, space);
+    std::string rest = line.substr(space + 1);
+    entry->tail = "";
+    if(entry->command == "JOIN")
+    {
+        // "JOIN 0" leaves all channels, keys would have to be reordered
+        if(rest == "0" || rest.find(' ') != std::string::npos)
+            return ;
+        entry->separator = ',';
+    }
+    else if(entry->command == "ISON")
+    {
+        if(rest[0] == ':')
+            rest.erase(0, 1);
+        if(rest.empty())
+            return ;
+        entry->separator = ' ';
+    }
+    else if(entry->command == "PRIVMSG" || entry->command == "NOTICE")
+    {
+        size_t target_end = rest.find(' ');
+        if(target_end == std::string::npos || target_end == 0)
+            return ;
+        entry->tail = rest.substr(target_end);
+        rest.resize(target_end);
+        entry->separator = ',';
+    }
+    else
+        return ;
+
+    entry->targets = rest;
+    entry->count = 1;
+    size_t pos = rest.find(entry->separator);
+    for(; pos != std::string::npos; pos = rest.find(entry->separator, pos+1))
+        entry->count++;
+    entry->batch = entry->command + entry->tail;
+}
+
+int OutputQueue::flush(unsigned long long now, LineConnection *connection)
+        throw(SocketConnectionClosed)
+{
+    // Generic cell rate algorithm: m_iTheoretical is the time at which the
+    // bucket would be full again; a line can be sent if that is less than
+    // 'burst' lines ahead of now
+    const unsigned long long tolerance =
+            (unsigned long long)(m_iBurst - 1) * m_iInterval;
+    unsigned int priority = 0;
+    while(m_iSize > 0)
+    {
+        if(m_iTheoretical < now)
+            m_iTheoretical = now;
+        if(m_iTheoretical - now > tolerance)
+            return (int)(m_iTheoretical - now - tolerance);
+
+        while(m_Queues[priority].empty())
+            priority++;
+        std::deque<Entry> &queue = m_Queues[priority];
+        connection->writeLine(queue.front().line);
+        sent(queue.front());
+        queue.pop_front();
+        m_iSize--;
+        m_iTheoretical += m_iInterval;
+    }
+    return -1;
+}
+
+void OutputQueue::flushAll(LineConnection *connection)
+        throw(SocketConnectionClosed)
+{
+    unsigned int priority;
+    for(priority = 0; priority < PRIORITIES; priority++)
+    {
+        std::deque<Entry> &queue = m_Queues[priority];
+        while(!queue.empty())
+        {
+            connection->writeLine(queue.front().line);
+            sent(queue.front());
+            queue.pop_front();
+            m_iSize--;
+        }
+    }
+}
+
+void OutputQueue::sent(const Entry &entry)
+{
+    queuedLines.sub();
+    queueWait.record(monotonicMicros() - entry.queued);
+}
+
+void OutputQueue::clear()
+{
+    queuedLines.sub(m_iSize);
+    unsigned int priority;
+    for(priority = 0; priority < PRIORITIES; priority++)
+        m_Queues[priority].clear();
+    m_iSize = 0;
+}
+
+/**
+ * Splits a line (without line breaks) so that each part fits in 'max_bytes'.
+ */
+static void splitLine(const std::string &text, size_t max_bytes,
+        std::vector<std::string> *parts)
+{
+    size_t pos = 0;
+    while(text.size() - pos > max_bytes)
+    {
+        // Don't cut before an UTF-8 continuation byte
+        size_t cut = max_bytes;
+        while(cut > 0 && ((unsigned char)text[pos + cut] & 0xC0) == 0x80)
+            cut--;
+        if(cut == 0)
+            cut = max_bytes;
+
+        // Cut at a space if there is one in the second half (the space is
+        // dropped)
+        size_t space = text.rfind(' ', pos + cut);
+        if(space != std::string::npos && space > pos + cut/2)
+        {
+            parts->push_back(text.substr(pos, space - pos));
+            pos = space + 1;
+        }
+        else
+        {
+            parts->push_back(text.substr(pos, cut));
+            pos += cut;
+        }
+    }
+    if(pos < text.size())
+        parts->push_back(text.substr(pos));
+}
+
+void OutputQueue::split(const std::string &text, size_t max_bytes,
+        std::vector<std::string> *parts)
+{
+    size_t before = parts->size();
+    std::string line;
+    size_t pos = 0;
+    while(pos <= text.size())
+    {
+        // Each line becomes its own parts: a line break sent to the server
+        // would end the command, and the rest would be read as another one
+        size_t end = text.find_first_of("\r\n", pos);
+        if(end == std::string::npos)
+            end = text.size();
+        line.assign(text, pos, end - pos);
+        line.erase(std::remove(line.begin(), line.end(), '\0'), line.end());
+        if(!line.empty())
+            splitLine(line, max_bytes, parts);
+        pos = end + 1;
+    }
+    if(parts->size() == before)
+        parts->push_back("");
+}
@@ -0,0 +1,152 @@
+#ifndef HEADER_OUTPUTQUEUE_H
+#define HEADER_OUTPUTQUEUE_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sockets/Socket.h"
+#include "LineConnection.h"
+
+/**
+ * Flood control for the lines sent to an IRC server.
+ *
+ * Servers disconnect clients that send too much too fast, usually allowing a
+ * small burst then about one line every couple of seconds. Lines are queued
+ * here and sent as fast as a token bucket allows: 'burst' lines can go out at
+ * once, then one line every 'interval' milliseconds.
+ *
+ * Queued lines have a priority; a line is never sent while a line of a more
+ * urgent class is waiting, so that PONGs and commands don't get stuck behind
+ * a long paste.
+ *
+ * A line can be queued with a key, in which case it replaces the line with
+ * the same key that is still waiting (if any). This is used for commands
+ * that set a state (TOPIC, AWAY, ...), where only the last one matters.
+ *
+ * Commands that accept several targets are batched: a JOIN (without key),
+ * ISON, or PRIVMSG/NOTICE with the same text as the last line waiting in the
+ * queue is merged into it, as long as the result fits in a line and in the
+ * number of targets the server accepts (see setTargetLimit()).
+ */
+class OutputQueue {
+
+public:
+    enum EPriority {
+        CONTROL,    // PONG, PING, QUIT, ...
+        NORMAL,     // Other commands
+        BULK,       // PRIVMSG and NOTICE
+
+        PRIORITIES
+    };
+
+    /** Maximum length of a line, not including CR LF (RFC 2812, 2.3). */
+    static const size_t MAX_LINE = 510;
+
+    /**
+     * Room left for the source the server prepends when relaying a message
+     * (':nick!user@host ').
+     */
+    static const size_t SOURCE_RESERVE = 100;
+
+private:
+    struct Entry {
+        std::string line;
+        std::string key;
+
+        // Batching; 'batch' is empty if the line can't be merged
+        std::string batch;
+        std::string command;
+        std::string targets;
+        std::string tail;
+        char separator;
+        unsigned int count;
+
+        unsigned long long queued;  // When it was pushed, in microseconds
+    };
+
+    std::deque<Entry> m_Queues[PRIORITIES];
+    std::map<std::string, unsigned int> m_TargetLimits;
+    size_t m_iSize;
+    unsigned int m_iBurst;
+    unsigned int m_iInterval;
+    unsigned long long m_iTheoretical;
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param burst Number of lines that can be sent at once.
+     * @param interval Time (in milliseconds) it takes to earn a new line.
+     */
+    OutputQueue(unsigned int burst = 5, unsigned int interval = 2000);
+
+    ~OutputQueue();
+
+    /** Changes the rate; the lines already sent still count. */
+    void setRate(unsigned int burst, unsigned int interval);
+
+    /**
+     * Sets the maximum number of targets for a command.
+     *
+     * This is the TARGMAX the server advertises. By default, PRIVMSG and
+     * NOTICE are limited to a single target and JOIN and ISON are only
+     * limited by the line length.
+     *
+     * @param limit The maximum, or 0 for no limit.
+     */
+    void setTargetLimit(const std::string &command, unsigned int limit);
+
+    /**
+     * Queues a line.
+     *
+     * @param key If not empty, a line with the same key and priority that is
+     * still queued is replaced by this one, keeping its place.
+     * @return true if the line might be merged with the next one, ie it is
+     * worth waiting a bit before flushing.
+     */
+    bool push(const std::string &line, EPriority priority = NORMAL,
+            const std::string &key = "");
+
+    /**
+     * Sends the lines that the bucket allows.
+     *
+     * @param now Current time, in milliseconds.
+     * @return The time (in milliseconds) after which more lines can be sent,
+     * or -1 if the queue is now empty.
+     */
+    int flush(unsigned long long now, LineConnection *connection)
+            throw(SocketConnectionClosed);
+
+    /** Sends all the queued lines, ignoring the rate. */
+    void flushAll(LineConnection *connection) throw(SocketConnectionClosed);
+
+    /** Number of queued lines. */
+    inline size_t size() const
+    {
+        return m_iSize;
+    }
+
+    /** Drops the queued lines. */
+    void clear();
+
+    /**
+     * Splits a message so that each part fits in 'max_bytes'.
+     *
+     * Parts never end in the middle of an UTF-8 sequence, and are cut at a
+     * space (which is dropped) when there is one in the second half of the
+     * part. Each line of the text (ended by CR, LF or CRLF) gets its own
+     * parts; empty lines and NUL bytes are dropped. An empty text gives a
+     * single empty part.
+     */
+    static void split(const std::string &text, size_t max_bytes,
+            std::vector<std::string> *parts);
+
+private:
+    static void parseBatch(Entry *entry);
+    static void sent(const Entry &entry);
+
+};
+
+#endif
@@ -0,0 +1,136 @@
+#include "Trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "common/Clock.h"
+#include "common/Metrics.h"
+
+const char *const Trace::TAG = "dtrace";
+
+static Histogram &hopTime = Metrics::global().histogram("relay.hop_us");
+
+Trace::Trace()
+{
+}
+
+Trace Trace::start()
+{
+    static unsigned int sequence = 0;
+    unsigned long long seed = monotonicNanos()
+            ^ ((unsigned long long)rand() << 32);
+    seed ^= (unsigned long long)__sync_add_and_fetch(&sequence, 1) << 16;
+    char id[17];
+    snprintf(id, sizeof(id), "%016llx", seed);
+    Trace trace;
+    trace.id = id;
+    return trace;
+}
+
+bool Trace::parse(const std::string &tags)
+{
+    const size_t tag_len = strlen(TAG);
+    size_t pos = 0;
+    while(pos < tags.size())
+    {
+        size_t end = tags.find(';', pos);
+        if(end == std::string::npos)
+            end = tags.size();
+        if(end - pos > tag_len && tags[pos + tag_len] == '='
+         && tags.compare(pos, tag_len, TAG) == 0)
+        {
+            std::string value = tags.substr(pos + tag_len + 1,
+                    end - pos - tag_len - 1);
+            size_t comma = value.find(',');
+            id = value.substr(0, comma);
+            hops.clear();
+            while(comma != std::string::npos)
+            {
+                size_t start = comma + 1;
+                comma = value.find(',', start);
+                size_t hop_end = (comma == std::string::npos)?value.size():
+                        comma;
+                size_t colon = value.rfind(':', hop_end - 1);
+                if(colon == std::string::npos || colon < start)
+                    return false;
+                Hop hop;
+                hop.name = value.substr(start, colon - start);
+                hop.micros = strtoull(value.c_str() + colon + 1, NULL, 10);
+                hops.push_back(hop);
+            }
+            return !id.empty();
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+void Trace::addHop(const std::string &name, unsigned long long micros)
+{
+    Hop hop;
+    hop.micros = micros;
+    size_t i;
+    for(i = 0; i < name.size(); i++)
+    {
+        // Separators of the tag, and what would need escaping in a tag value
+        char c = name[i];
+        if(c != ',' && c != ':' && c != ';' && c != ' ' && c != '\\'
+         && c != '\r' && c != '\n' && c != '\0')
+            hop.name += c;
+    }
+    hops.push_back(hop);
+}
+
+std::string Trace::toTag() const
+{
+    std::string tag(TAG);
+    tag += '=';
+    tag += id;
+    char buffer[24];
+    std::vector<Hop>::const_iterator it = hops.begin();
+    for(; it != hops.end(); ++it)
+    {
+        tag += ',';
+        tag += it->name;
+        snprintf(buffer, sizeof(buffer), ":%llu", it->micros);
+        tag += buffer;
+    }
+    return tag;
+}
+
+std::string Trace::tagLine(const std::string &line) const
+{
+    return "@" + toTag() + " " + line;
+}
+
+std::string Trace::breakdown(unsigned long long total) const
+{
+    std::string result;
+    char buffer[24];
+    unsigned long long servers = 0;
+    std::vector<Hop>::const_iterator it = hops.begin();
+    for(; it != hops.end(); ++it)
+    {
+        result += it->name;
+        snprintf(buffer, sizeof(buffer), " %lluus, ", it->micros);
+        result += buffer;
+        servers += it->micros;
+    }
+    snprintf(buffer, sizeof(buffer), "network %lluus",
+            (total > servers)?total - servers:0);
+    result += buffer;
+    return result;
+}
+
+std::string Trace::forward(const std::string &tags, const std::string &line,
+        const std::string &name, unsigned long long received)
+{
+    Trace trace;
+    if(tags.empty() || !trace.parse(tags))
+        return line;
+    unsigned long long elapsed = monotonicMicros() - received;
+    hopTime.record(elapsed);
+    trace.addHop(name, elapsed);
+    return trace.tagLine(line);
+}
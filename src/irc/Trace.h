@@ -0,0 +1,99 @@
+#ifndef HEADER_TRACE_H
+#define HEADER_TRACE_H
+
+#include <string>
+#include <vector>
+
+/**
+ * Latency tracing across DistrIRC hops.
+ *
+ * Tracing is opt-in: a client that wants to know where the time goes adds a
+ * "dtrace" message tag to an extended-protocol line (DQUOTE, DSHOWLOG, a
+ * PRIVMSG to a prefixed target, or DTRACE):
+ * @code
+ * @dtrace=5f3a09c2e1d47b80 DQUOTE relay2~freenode :PRIVMSG #a :hi
+ * @endcode
+ * Each server that forwards a traced line appends itself and the time (in
+ * microseconds) the line spent there, between being received and being
+ * forwarded:
+ * @code
+ * @dtrace=5f3a09c2e1d47b80,relay1:35,relay2:120 PRIVMSG #a :hi
+ * @endcode
+ * The answer (DTRACEREPLY, DLOGEND) carries the tag back, the hops of the
+ * return path being appended the same way; the client can then compare the
+ * time spent in each server with the round-trip time it measured, see
+ * breakdown(). Only durations are exchanged, so the clocks of the servers
+ * don't have to agree.
+ *
+ * Traced lines are longer than 510 bytes; the connections between DistrIRC
+ * servers must accept LineConnection::MAX_LINE_TAGS.
+ */
+class Trace {
+
+public:
+    /** Name of the message tag. */
+    static const char *const TAG;
+
+    /** The time spent in a server. */
+    struct Hop {
+        std::string name;
+        unsigned long long micros;
+    };
+
+public:
+    std::string id;
+    std::vector<Hop> hops;
+
+public:
+    /** Constructs an empty trace; see start() and parse(). */
+    Trace();
+
+    /** Starts a new trace, with a random identifier and no hops. */
+    static Trace start();
+
+    /**
+     * Reads the trace from the message tags of a line.
+     *
+     * @param tags The tags, without the '@' (see IRCCommand::tags).
+     * @return false if there is no valid trace tag.
+     */
+    bool parse(const std::string &tags);
+
+    /** Appends a hop; characters that can't appear in the tag are dropped. */
+    void addHop(const std::string &name, unsigned long long micros);
+
+    /** Formats the tag, ie "dtrace=<id>,<hop>:<micros>,...". */
+    std::string toTag() const;
+
+    /** Prefixes a line (that has no tags) with the tag. */
+    std::string tagLine(const std::string &line) const;
+
+    /**
+     * Describes where the time went, for instance
+     * "relay1 35us, relay2 120us, network 845us".
+     *
+     * @param total The round-trip time measured by the client, in
+     * microseconds; what the hops don't account for is the network.
+     */
+    std::string breakdown(unsigned long long total) const;
+
+    /**
+     * Forwards a line, the way a relay does.
+     *
+     * If the tags of the received line hold a trace, this server is added to
+     * it with the time elapsed since the line was received, that time is
+     * recorded in the "relay.hop_us" histogram (see Metrics), and the
+     * tagged line is returned; otherwise the line is returned unchanged.
+     *
+     * @param tags The tags of the received line.
+     * @param line The line to send, without tags.
+     * @param name The name of this server in the trace.
+     * @param received When the line was received, from monotonicMicros().
+     */
+    static std::string forward(const std::string &tags,
+            const std::string &line, const std::string &name,
+            unsigned long long received);
+
+};
+
+#endif
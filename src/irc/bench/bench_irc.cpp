@@ -0,0 +1,366 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "common/Benchmark.h"
+#include "IRCCommand.h"
+#include "LineConnection.h"
+
+/*
+ * Micro-benchmarks of the irc library: parsing of the commands a server
+ * sends, splitting of sources, and framing of received data into lines.
+ *
+ * Usage: bench_irc [--json] [--repeat=N] [--min-time=MS] [filter...]
+ * See BenchmarkSuite.
+ */
+
+static const char *const SERVER = ":irc.inp-net.rezosup.org";
+
+struct Line {
+    const char *name;
+    const char *line;
+};
+
+static const Line COMMANDS[] = {
+    {"PRIVMSG", ":Remram!distrirc@staff.rezosup.net PRIVMSG #rezo :hi all, "
+            "how is it going?"},
+    {"NOTICE", ":irc.inp-net.rezosup.org NOTICE AUTH :*** Looking up your "
+            "hostname..."},
+    {"JOIN", ":guitou!~guitou@RZ-b2fe20de.rez-gif.supelec.fr JOIN :#rezo"},
+    {"QUIT", ":ttdx!ttdx@RZ-c8308929.rez-gif.supelec.fr QUIT :Ping timeout"},
+    {"PING", "PING :irc.inp-net.rezosup.org"},
+    {"TOPIC", ":irc.inp-net.rezosup.org 332 Test #rezo :Welcome on the "
+            "channel of the Rezo | http://www.rezosup.org/"},
+    {"ERROR", ":irc.inp-net.rezosup.org 482 Test #rezo :You're not channel "
+            "operator"},
+    {"NAMES", ":irc.inp-net.rezosup.org 353 Test = #rezo :Test @guitou ttdx "
+            "BuLi @Remram @exenon @TsCl_ @ciblout paradis"},
+    {"WHO", ":irc.inp-net.rezosup.org 352 Test #rezo tscl "
+            "RZ-b2fe20de.rez-gif.supelec.fr irc.supelec.rezosup.org BuLi H "
+            ":3 Pierre Montagnier"},
+    {"tags", "@dtrace=5f3a09c2e1d47b80,relay1:35,relay2:120 "
+            ":Remram!distrirc@staff.rezosup.net PRIVMSG #rezo :hi"},
+};
+
+static std::vector<std::string> adversarialLines()
+{
+    std::vector<std::string> lines;
+    lines.push_back("");
+    lines.push_back(":");
+    lines.push_back(":irc.inp-net.rezosup.org");
+    lines.push_back(":irc.inp-net.rezosup.org ");
+    lines.push_back("   ");
+    lines.push_back("\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"\"");
+    lines.push_back(":" + std::string(500, 'A'));
+    lines.push_back("PRIVMSG" + std::string(200, ' ') + ":x");
+    return lines;
+}
+
+/**
+ * What joining a big channel looks like: the NAMES replies, as long as the
+ * server makes them, then the end.
+ */
+static std::vector<std::string> namesFlood(unsigned int users)
+{
+    std::vector<std::string> lines;
+    std::string line;
+    char nick[32];
+    unsigned int i;
+    for(i = 0; i < users; i++)
+    {
+        if(line.empty())
+            line = std::string(SERVER) + " 353 Test = #bigchannel :";
+        else
+            line += ' ';
+        const char *prefix = (i % 17 == 0)?"@":(i % 5 == 0)?"+":"";
+        snprintf(nick, sizeof(nick), "%suser%u", prefix, i);
+        line += nick;
+        if(line.size() > 480 || i + 1 == users)
+        {
+            lines.push_back(line);
+            line.clear();
+        }
+    }
+    lines.push_back(std::string(SERVER)
+            + " 366 Test #bigchannel :End of /NAMES list.");
+    return lines;
+}
+
+/** The WHO replies for a big channel, one line per user, then the end. */
+static std::vector<std::string> whoFlood(unsigned int users)
+{
+    std::vector<std::string> lines;
+    char line[512];
+    unsigned int i;
+    for(i = 0; i < users; i++)
+    {
+        snprintf(line, sizeof(line), "%s 352 Test #bigchannel ~user%u "
+                "RZ-%08x.rez-gif.supelec.fr irc.supelec.rezosup.org user%u "
+                "%s :%u Real Name %u", SERVER, i, i * 2654435761U, i,
+                (i % 17 == 0)?"H@":(i % 3 == 0)?"G":"H", i % 4, i);
+        lines.push_back(line);
+    }
+    lines.push_back(std::string(SERVER)
+            + " 315 Test #bigchannel :End of /WHO list.");
+    return lines;
+}
+
+
+/*============================================================================*/
+
+/** Parses lines with IRCCommand::tryParse(), reusing the command. */
+class ParseBenchmark : public Benchmark {
+
+private:
+    std::vector<std::string> m_Lines;
+
+public:
+    ParseBenchmark(const std::string &name,
+            const std::vector<std::string> &lines)
+      : Benchmark("irc.parse/" + name, "line"), m_Lines(lines)
+    {
+    }
+
+    unsigned long long run(unsigned long long iterations)
+    {
+        IRCCommand command;
+        unsigned long long parsed = 0;
+        unsigned long long i;
+        for(i = 0; i < iterations; i++)
+        {
+            size_t j;
+            for(j = 0; j < m_Lines.size(); j++)
+            {
+                command.tryParse(m_Lines[j]);
+                parsed++;
+            }
+        }
+        return parsed;
+    }
+
+};
+
+/** Same with the throwing constructor, for comparison. */
+class ConstructBenchmark : public Benchmark {
+
+private:
+    std::vector<std::string> m_Lines;
+
+public:
+    ConstructBenchmark(const std::string &name,
+            const std::vector<std::string> &lines)
+      : Benchmark("irc.construct/" + name, "line"), m_Lines(lines)
+    {
+    }
+
+    unsigned long long run(unsigned long long iterations)
+    {
+        unsigned long long parsed = 0;
+        unsigned long long i;
+        for(i = 0; i < iterations; i++)
+        {
+            size_t j;
+            for(j = 0; j < m_Lines.size(); j++)
+            {
+                try
+                {
+                    IRCCommand command(m_Lines[j]);
+                }
+                catch(IRCCommand::Invalid &e)
+                {
+                }
+                parsed++;
+            }
+        }
+        return parsed;
+    }
+
+};
+
+/**
+ * Splits sources, with the allocating readSource() or with splitSource().
+ */
+class SourceBenchmark : public Benchmark {
+
+private:
+    std::string m_sSource;
+    bool m_bSplit;
+    unsigned long long m_iChars;        // Keeps the results used
+
+public:
+    SourceBenchmark(const std::string &name, const std::string &source,
+            bool split)
+      : Benchmark(std::string(split?"irc.splitSource/":"irc.readSource/")
+            + name, "call"),
+        m_sSource(source), m_bSplit(split), m_iChars(0)
+    {
+    }
+
+    unsigned long long run(unsigned long long iterations)
+    {
+        unsigned long long i;
+        for(i = 0; i < iterations; i++)
+        {
+            if(m_bSplit)
+            {
+                IRCCommand::Source source =
+                        IRCCommand::splitSource(m_sSource);
+                m_iChars += source.nick.size();
+            }
+            else
+            {
+                std::string user, host;
+                std::string nick = IRCCommand::readSource(m_sSource,
+                        &user, &host);
+                m_iChars += nick.size();
+            }
+        }
+        return iterations;
+    }
+
+};
+
+
+/*============================================================================*/
+
+/**
+ * A stream that returns the same lines over and over, in chunks of a fixed
+ * size, like FakeStream in the tests; it never blocks nor closes.
+ */
+class ChunkStream : public NetStream {
+
+private:
+    std::string m_sData;
+    size_t m_iChunk;
+    size_t m_iPos;
+
+public:
+    ChunkStream(const std::string &data, size_t chunk)
+      : m_sData(data), m_iChunk(chunk), m_iPos(0)
+    {
+    }
+
+    void Send(const char*, size_t) throw(SocketConnectionClosed)
+    {
+    }
+
+    int Recv(char *data, size_t size_max, bool) throw(SocketConnectionClosed)
+    {
+        size_t size = std::min(size_max, m_iChunk);
+        size_t done = 0;
+        while(done < size)
+        {
+            size_t n = std::min(size - done, m_sData.size() - m_iPos);
+            memcpy(data + done, m_sData.data() + m_iPos, n);
+            done += n;
+            m_iPos = (m_iPos + n) % m_sData.size();
+        }
+        return (int)done;
+    }
+
+    void RegisterSockets(SocketSetRegistrar*)
+    {
+    }
+
+};
+
+/**
+ * Calls LineConnection::readLines() on a stream that returns chunks of a
+ * given size; small chunks split the lines, chunks of RECV_SIZE make
+ * readLines() do MAX_READS reads per call.
+ */
+class ReadLinesBenchmark : public Benchmark {
+
+private:
+    std::string m_sData;
+    size_t m_iChunk;
+    LineConnection *m_pConnection;
+
+    static std::string name(size_t chunk)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "irc.readLines/%lu",
+                (unsigned long)chunk);
+        return buffer;
+    }
+
+public:
+    ReadLinesBenchmark(const std::string &data, size_t chunk)
+      : Benchmark(name(chunk), "line"), m_sData(data), m_iChunk(chunk),
+        m_pConnection(NULL)
+    {
+    }
+
+    void setUp()
+    {
+        m_pConnection = new LineConnection(new ChunkStream(m_sData,
+                m_iChunk));
+    }
+
+    unsigned long long run(unsigned long long iterations)
+    {
+        unsigned long long lines = 0;
+        unsigned long long i;
+        for(i = 0; i < iterations; i++)
+            lines += m_pConnection->readLines().size();
+        return lines;
+    }
+
+    void tearDown()
+    {
+        delete m_pConnection;
+        m_pConnection = NULL;
+    }
+
+};
+
+
+/*============================================================================*/
+
+int main(int argc, char **argv)
+{
+    BenchmarkSuite suite;
+
+    std::vector<std::string> all;
+    size_t i;
+    for(i = 0; i < sizeof(COMMANDS)/sizeof(COMMANDS[0]); i++)
+    {
+        std::vector<std::string> one(1, COMMANDS[i].line);
+        suite.add(new ParseBenchmark(COMMANDS[i].name, one));
+        all.push_back(COMMANDS[i].line);
+    }
+    std::vector<std::string> adversarial = adversarialLines();
+    std::vector<std::string> names = namesFlood(5000);
+    std::vector<std::string> who = whoFlood(5000);
+    suite.add(new ParseBenchmark("NAMES-flood", names));
+    suite.add(new ParseBenchmark("WHO-flood", who));
+    suite.add(new ParseBenchmark("mix", all));
+    suite.add(new ParseBenchmark("adversarial", adversarial));
+    suite.add(new ConstructBenchmark("mix", all));
+    suite.add(new ConstructBenchmark("adversarial", adversarial));
+
+    const char *sources[][2] = {
+        {"user", "guitou!~guitou@RZ-b2fe20de.rez-gif.supelec.fr"},
+        {"nick", "guitou"},
+        {"server", "irc.inp-net.rezosup.org"},
+    };
+    for(i = 0; i < sizeof(sources)/sizeof(sources[0]); i++)
+    {
+        suite.add(new SourceBenchmark(sources[i][0], sources[i][1], false));
+        suite.add(new SourceBenchmark(sources[i][0], sources[i][1], true));
+    }
+
+    // A backlog of the usual traffic, framed with CR LF
+    std::string data;
+    for(i = 0; i < all.size(); i++)
+        data += all[i] + "\r\n";
+    for(i = 0; i < 50; i++)
+        data += who[i] + "\r\n";
+    const size_t chunks[] = {1, 16, 100, 1460, LineConnection::RECV_SIZE};
+    for(i = 0; i < sizeof(chunks)/sizeof(chunks[0]); i++)
+        suite.add(new ReadLinesBenchmark(data, chunks[i]));
+
+    return suite.main(argc, argv);
+}
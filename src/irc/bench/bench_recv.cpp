@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "common/Clock.h"
+#include "common/Thread.h"
+#include "sockets/TCP.h"
+#include "LineConnection.h"
+
+/*
+ * Measures the receive path: a thread replays a backlog of lines through a
+ * loopback TCP connection as fast as it can, and the main thread reads them
+ * with a LineConnection, counting the calls to readLines() (ie wakeups of an
+ * event loop).
+ *
+ * Usage: bench_recv [lines]
+ */
+
+class Writer : public Thread {
+
+private:
+    TCPSocket *m_pSocket;
+    unsigned int m_iLines;
+
+public:
+    Writer(TCPSocket *sock, unsigned int lines)
+      : m_pSocket(sock), m_iLines(lines)
+    {
+    }
+
+protected:
+    void run()
+    {
+        std::string batch;
+        unsigned int i;
+        for(i = 0; i < m_iLines; i++)
+        {
+            char line[128];
+            sprintf(line, ":Remram!distrirc@staff.rezosup.net PRIVMSG #rezo "
+                    ":backlog line number %u\r\n", i);
+            batch += line;
+            if(batch.size() > 60000 || i + 1 == m_iLines)
+            {
+                m_pSocket->Send(batch.data(), batch.size());
+                batch.clear();
+            }
+        }
+    }
+
+};
+
+int main(int argc, char **argv)
+{
+    unsigned int lines = 1000000;
+    if(argc > 1)
+        lines = strtoul(argv[1], NULL, 10);
+
+    TCPServer *server = TCPServer::Listen(0);
+    TCPSocket *sender = TCPSocket::Connect("127.0.0.1",
+            server->GetLocalPort());
+    LineConnection conn(server->Accept(-1));
+    delete server;
+
+    Writer writer(sender, lines);
+    unsigned long long start = monotonicMicros();
+    writer.start();
+    unsigned int received = 0;
+    unsigned long long calls = 0;
+    while(received < lines)
+    {
+        received += conn.readLines(true).size();
+        calls++;
+    }
+    unsigned long long elapsed = monotonicMicros() - start;
+    writer.join();
+    delete sender;
+
+    printf("%u lines in %llu us: %.0f lines/s, %llu calls to readLines() "
+            "(%.1f lines per call)\n",
+            lines, elapsed, lines * 1000000.0 / (elapsed?elapsed:1),
+            calls, (double)lines / calls);
+    return 0;
+}
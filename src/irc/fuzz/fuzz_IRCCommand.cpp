@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include <cstdlib>
+#include <string>
+
+#include "IRCCommand.h"
+
+/**
+ * Fuzz target for the IRC command parser.
+ *
+ * The input is a single line. The parser must not crash nor throw from
+ * tryParse(), and the throwing constructor must agree with it.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    static IRCCommand reused;
+    const std::string line((const char*)data, size);
+
+    IRCCommand::EParseError error = reused.tryParse(line);
+    bool thrown = false;
+    try
+    {
+        IRCCommand command(line);
+        if(error != IRCCommand::PARSE_OK)
+            abort();
+
+        // Parsing into a reused object gives the same result
+        if(command.type != reused.type || command.source != reused.source
+         || command.args != reused.args)
+            abort();
+
+        // The source views point into the source string
+        IRCCommand::Source source = command.getSource();
+        const char *begin = command.source.data();
+        const char *end = begin + command.source.size();
+        const StringView *parts[3] = {&source.nick, &source.user,
+                &source.host};
+        int i;
+        for(i = 0; i < 3; i++)
+            if(!parts[i]->empty() && (parts[i]->data() < begin
+             || parts[i]->data() + parts[i]->size() > end))
+                abort();
+    }
+    catch(IRCCommand::Invalid &e)
+    {
+        thrown = true;
+    }
+    if(thrown != (error != IRCCommand::PARSE_OK))
+        abort();
+    return 0;
+}
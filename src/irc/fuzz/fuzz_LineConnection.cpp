@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include <cstdlib>
+#include <cstring>
+#include <list>
+#include <string>
+
+#include "LineConnection.h"
+#include "IRCCommand.h"
+
+/**
+ * A stream returning the fuzzer's input in chunks of varying sizes.
+ */
+class FuzzStream : public NetStream {
+
+private:
+    const uint8_t *m_pData;
+    size_t m_iSize;
+    size_t m_iPos;
+
+public:
+    FuzzStream(const uint8_t *data, size_t size)
+      : m_pData(data), m_iSize(size), m_iPos(0)
+    {
+    }
+
+    void Send(const char*, size_t) throw(SocketConnectionClosed)
+    {
+    }
+
+    int Recv(char *data, size_t size_max, bool)
+            throw(SocketConnectionClosed)
+    {
+        if(m_iPos >= m_iSize)
+            throw SocketConnectionClosed();
+        // Each chunk is prefixed by its size
+        size_t size = m_pData[m_iPos++];
+        if(size > size_max)
+            size = size_max;
+        if(size > m_iSize - m_iPos)
+            size = m_iSize - m_iPos;
+        memcpy(data, m_pData + m_iPos, size);
+        m_iPos += size;
+        return size;
+    }
+
+    void RegisterSockets(SocketSetRegistrar*)
+    {
+    }
+
+    inline size_t total() const
+    {
+        return m_iSize;
+    }
+
+};
+
+/**
+ * Fuzz target for the line splitting, and the parsing of what comes out.
+ *
+ * Lines returned must never contain a line feed, and their total size can't
+ * be more than what was received.
+ */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    LineConnection conn(new FuzzStream(data, size));
+    IRCCommand command;
+    size_t received = 0;
+    try
+    {
+        for(;;)
+        {
+            std::list<std::string> lines = conn.readLines();
+            std::list<std::string>::const_iterator it = lines.begin();
+            for(; it != lines.end(); ++it)
+            {
+                if(it->find('\n') != std::string::npos)
+                    abort();
+                received += it->size() + 1;
+                command.tryParse(*it);
+            }
+            if(received > size)
+                abort();
+        }
+    }
+    catch(SocketConnectionClosed &e)
+    {
+    }
+    return 0;
+}
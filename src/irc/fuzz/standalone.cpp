@@ -0,0 +1,45 @@
+#include <stdint.h>
+#include <cstdio>
+#include <vector>
+
+/*
+ * Driver for the fuzz targets when not building with libFuzzer.
+ *
+ * Runs the target once on each file given on the command line, which allows
+ * to replay a corpus or a crash; with no argument, reads a single input from
+ * stdin, which is what AFL expects.
+ */
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static void runFile(FILE *fp)
+{
+    std::vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t ret;
+    while((ret = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        data.insert(data.end(), buffer, buffer + ret);
+    LLVMFuzzerTestOneInput(data.empty()?NULL:&data[0], data.size());
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        runFile(stdin);
+        return 0;
+    }
+    int i;
+    for(i = 1; i < argc; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+        if(fp == NULL)
+        {
+            fprintf(stderr, "Can't open %s\n", argv[i]);
+            return 1;
+        }
+        runFile(fp);
+        fclose(fp);
+    }
+    return 0;
+}
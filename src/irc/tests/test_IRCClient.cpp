@@ -0,0 +1,664 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "IRCClient.h"
+#include "IRCCommand.h"
+#include "common/Metrics.h"
+
+#include <cstdio>
+#include <stdexcept>
+
+/**
+ * A stream that returns the data it is fed, and records what is sent.
+ */
+class ScriptStream : public NetStream {
+
+public:
+    std::string input;
+    std::string output;
+    bool closed;
+    unsigned int reads;
+
+    ScriptStream()
+      : closed(false), reads(0)
+    {
+    }
+
+    void Send(const char *data, size_t size) throw(SocketConnectionClosed)
+    {
+        if(closed)
+            throw SocketConnectionClosed();
+        output.append(data, size);
+    }
+
+    int Recv(char *data, size_t size_max, bool)
+            throw(SocketConnectionClosed)
+    {
+        reads++;
+        if(input.empty() && closed)
+            throw SocketConnectionClosed();
+        size_t size = (input.size() < size_max)?input.size():size_max;
+        input.copy(data, size);
+        input.erase(0, size);
+        return size;
+    }
+
+    void RegisterSockets(SocketSetRegistrar*)
+    {
+        throw std::runtime_error("ScriptStream::RegisterSockets called");
+    }
+
+};
+
+class TestClient : public IRCClient {
+
+public:
+    std::string lost;
+    std::vector<std::string> received;
+
+    TestClient(NetStream *stream)
+      : IRCClient(stream)
+    {
+    }
+
+protected:
+    void newChannel(Channel*)
+    {
+    }
+
+    void connectionLost(const std::string &quitMsg)
+    {
+        lost = quitMsg;
+    }
+
+    void commandReceived(const IRCCommand &command, const std::string &line)
+    {
+        if(command.type == IRCCommand::PRIVMSG)
+            received.push_back("privmsg " + line);
+        else
+            received.push_back(line);
+    }
+
+};
+
+class RecordingObserver : public UserWhoisObserver, public WhoObserver {
+
+public:
+    std::vector<WhoisReply> whois;
+    std::vector<User*> users;
+    std::vector<std::string> masks;
+    std::vector<std::vector<WhoReply> > who;
+
+    void whoisAvailable(User *user, const WhoisReply &reply)
+    {
+        whois.push_back(reply);
+        users.push_back(user);
+    }
+
+    void whoAvailable(const std::string &mask,
+            const std::vector<WhoReply> &replies)
+    {
+        masks.push_back(mask);
+        who.push_back(replies);
+    }
+
+};
+
+class IRCClient_Test : public CppUnit::TestFixture {
+
+public:
+    void test_pong()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        stream->input = "PING :irc.example.org\r\n"
+                ":irc.example.org PING irc.example.org :token\r\n"
+                ":nick!user@host PRIVMSG #chan :PING me\r\n"
+                "PINGU\r\n";
+        client.readCommands();
+        CPPUNIT_ASSERT(stream->output ==
+                "PONG :irc.example.org\r\n"
+                "PONG irc.example.org :token\r\n");
+    }
+
+    void test_lag()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        TimerWheel timers(0);
+        client.setTimers(&timers);
+        client.setKeepalive(1000, 500);
+        CPPUNIT_ASSERT(client.getLag() == -1);
+
+        // Activity delays the PING
+        timers.Advance(600);
+        stream->input = ":irc.example.org NOTICE * :hello\r\n";
+        client.readCommands();
+        timers.Advance(1200);
+        CPPUNIT_ASSERT(stream->output.empty());
+        timers.Advance(1600);
+        CPPUNIT_ASSERT(stream->output == "PING :distrirc-1600\r\n");
+        stream->output.clear();
+
+        timers.Advance(1700);
+        CPPUNIT_ASSERT(client.getLag() == 100);
+        Histogram &lag = Metrics::global().histogram("irc.lag_ms");
+        unsigned long long count = lag.count();
+        stream->input = ":irc.example.org PONG irc.example.org "
+                ":distrirc-1600\r\n";
+        client.readCommands();
+        timers.Advance(1750);
+        CPPUNIT_ASSERT(client.getLag() == 100);
+        CPPUNIT_ASSERT(lag.count() == count + 1);
+        CPPUNIT_ASSERT(client.isConnected());
+        CPPUNIT_ASSERT(client.lost.empty());
+    }
+
+    void test_timeout()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        TimerWheel timers(0);
+        client.setTimers(&timers);
+        client.setKeepalive(1000, 500);
+        timers.Advance(1000);
+        CPPUNIT_ASSERT(stream->output == "PING :distrirc-1000\r\n");
+        timers.Advance(1499);
+        CPPUNIT_ASSERT(client.isConnected());
+        timers.Advance(1500);
+        CPPUNIT_ASSERT(!client.isConnected());
+        CPPUNIT_ASSERT(client.lost == "Ping timeout");
+        CPPUNIT_ASSERT(timers.Count() == 0);
+    }
+
+    void test_flood()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        TimerWheel timers(0);
+        client.setTimers(&timers);
+        client.setFloodControl(2, 1000);
+        client.sendMessage("#chan", "one");
+        client.sendMessage("#chan", "two");
+        client.sendMessage("#chan", std::string(700, 'a'));
+        CPPUNIT_ASSERT(stream->output.empty());
+        timers.Advance(1);
+        CPPUNIT_ASSERT(stream->output ==
+                "PRIVMSG #chan :one\r\nPRIVMSG #chan :two\r\n");
+        stream->output.clear();
+
+        // The PONG goes before the rest of the message
+        stream->input = "PING :irc.example.org\r\n";
+        client.readCommands();
+        CPPUNIT_ASSERT(stream->output.empty());
+        timers.Advance(1001);
+        CPPUNIT_ASSERT(stream->output == "PONG :irc.example.org\r\n");
+        timers.Advance(3001);
+        CPPUNIT_ASSERT(stream->output.size() == 23 + 2 * 15 + 700 + 2 * 2);
+        CPPUNIT_ASSERT(timers.Count() == 0);
+    }
+
+    void test_join()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        TimerWheel timers(0);
+        client.setTimers(&timers);
+        char name[16];
+        int i;
+        for(i = 0; i < 300; i++)
+        {
+            sprintf(name, "#channel%03d", i);
+            client.join(name);
+        }
+        client.join("#secret", "key");
+        std::vector<std::string> nicks;
+        nicks.push_back("alice");
+        nicks.push_back("bob");
+        client.isOn(nicks);
+        CPPUNIT_ASSERT(stream->output.empty());
+
+        timers.Advance(60000);
+        // 300 channels of 11 characters, 42 to a line
+        size_t lines = 0, pos = 0;
+        while((pos = stream->output.find("\r\n", pos)) != std::string::npos)
+        {
+            lines++;
+            pos += 2;
+        }
+        CPPUNIT_ASSERT(lines == 8 + 1 + 1);
+        CPPUNIT_ASSERT(stream->output.compare(0, 29,
+                "JOIN #channel000,#channel001,") == 0);
+        CPPUNIT_ASSERT(stream->output.find("\r\nJOIN #channel042,")
+                != std::string::npos);
+        CPPUNIT_ASSERT(stream->output.find(
+                "#channel299\r\nJOIN #secret key\r\nISON alice bob\r\n")
+                != std::string::npos);
+    }
+
+    void test_injection()
+    {
+        // Line breaks can't be used to send other commands
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        CPPUNIT_ASSERT(client.sendMessage("#a", "hi\r\nQUIT :x"));
+        CPPUNIT_ASSERT(stream->output ==
+                "PRIVMSG #a :hi\r\nPRIVMSG #a :QUIT :x\r\n");
+
+        stream->output.clear();
+        CPPUNIT_ASSERT(!client.sendMessage("#a :x\r\nQUIT", "hi"));
+        CPPUNIT_ASSERT(!client.sendNotice("#a b", "hi"));
+        CPPUNIT_ASSERT(!client.sendMessage("", "hi"));
+        CPPUNIT_ASSERT(!client.join("#a\nQUIT"));
+        CPPUNIT_ASSERT(!client.join("#a", "key\r\nQUIT"));
+        CPPUNIT_ASSERT(!client.join("#a", "two words"));
+        std::vector<std::string> nicks;
+        nicks.push_back("bob\r\nQUIT");
+        client.isOn(nicks);
+        RecordingObserver observer;
+        client.whois("bob\nQUIT", &observer);
+        client.who(std::string("#a\0", 3), &observer);
+        CPPUNIT_ASSERT(stream->output.empty());
+        CPPUNIT_ASSERT(observer.whois.size() == 1);
+        CPPUNIT_ASSERT(!observer.whois[0].exists);
+        CPPUNIT_ASSERT(observer.users[0] == NULL);
+        CPPUNIT_ASSERT(observer.who.size() == 1);
+        CPPUNIT_ASSERT(observer.who[0].empty());
+    }
+
+    void test_isupport()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        TimerWheel timers(0);
+        client.setTimers(&timers);
+        stream->input = ":irc.example.org 005 Test CASEMAPPING=ascii "
+                "TARGMAX=PRIVMSG:3 :are supported by this server\r\n";
+        client.readCommands();
+        CPPUNIT_ASSERT(client.getISupport().getCaseMapping()
+                == ISupport::CASEMAPPING_ASCII);
+        client.sendMessage("#a", "hi");
+        client.sendMessage("#b", "hi");
+        client.sendMessage("Remram", "hi");
+        client.sendMessage("#c", "hi");
+        timers.Advance(1);
+        CPPUNIT_ASSERT(stream->output ==
+                "PRIVMSG #a,#b,Remram :hi\r\nPRIVMSG #c :hi\r\n");
+    }
+
+    void test_whois()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        TimerWheel timers(0);
+        client.setTimers(&timers);
+        RecordingObserver a, b;
+        client.whois("Remram", &a);
+        client.getUser("remram")->asyncWhois(&b);
+        client.whois("nobody", &a);
+        CPPUNIT_ASSERT(stream->output ==
+                "WHOIS Remram\r\nWHOIS nobody\r\n");
+
+        stream->input =
+                ":irc.example.org 311 Test Remram Remram staff.example.org * :Remi Rampin\r\n"
+                ":irc.example.org 319 Test Remram :@#rezo #supelec\r\n"
+                ":irc.example.org 312 Test Remram irc.example.org :Test server\r\n"
+                ":irc.example.org 301 Test Remram :lunch\r\n"
+                ":irc.example.org 317 Test Remram 42 1337808621 :seconds idle, signon time\r\n"
+                ":irc.example.org 401 Test nobody :No such nick/channel\r\n"
+                ":irc.example.org 318 Test Remram :End of /WHOIS list.\r\n"
+                ":irc.example.org 318 Test nobody :End of /WHOIS list.\r\n";
+        while(!stream->input.empty())
+            client.readCommands();
+        CPPUNIT_ASSERT(a.whois.size() == 2);
+        CPPUNIT_ASSERT(b.whois.size() == 1);
+        const WhoisReply &reply = b.whois[0];
+        CPPUNIT_ASSERT(reply.exists);
+        CPPUNIT_ASSERT(reply.host == "staff.example.org");
+        CPPUNIT_ASSERT(reply.realname == "Remi Rampin");
+        CPPUNIT_ASSERT(reply.server == "irc.example.org");
+        CPPUNIT_ASSERT(reply.channels.size() == 2);
+        CPPUNIT_ASSERT(reply.channels[0] == "@#rezo");
+        CPPUNIT_ASSERT(reply.away == "lunch");
+        CPPUNIT_ASSERT(reply.idle == 42);
+        CPPUNIT_ASSERT(!reply.ircOperator);
+        CPPUNIT_ASSERT(!a.whois[1].exists);
+        // No User for a nick that doesn't exist
+        CPPUNIT_ASSERT(a.users[1] == NULL);
+        CPPUNIT_ASSERT(client.findUser("nobody") == NULL);
+        CPPUNIT_ASSERT(client.getUser("REMRAM")->getHost()
+                == "staff.example.org");
+
+        // Answered from the cache
+        stream->output.clear();
+        timers.Advance(30000);
+        client.whois("remram", &b);
+        CPPUNIT_ASSERT(b.whois.size() == 2);
+        CPPUNIT_ASSERT(b.whois[1].realname == "Remi Rampin");
+        CPPUNIT_ASSERT(stream->output.empty());
+        timers.Advance(60000);
+        client.whois("remram", &b);
+        CPPUNIT_ASSERT(b.whois.size() == 2);
+        timers.Advance(60001);
+        CPPUNIT_ASSERT(stream->output == "WHOIS remram\r\n");
+    }
+
+    void test_who()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        RecordingObserver a, b;
+        client.who("#rezo", &a);
+        client.who("Remram", &b);
+        client.who("#REZO", &b);
+        CPPUNIT_ASSERT(stream->output == "WHO #rezo\r\nWHO Remram\r\n");
+        client.cancelQueries((WhoObserver*)&a);
+
+        stream->input =
+                ":irc.example.org 352 Test #rezo distrirc example.net irc.example.org Test H :0 Remram\r\n"
+                ":irc.example.org 352 Test #rezo Remram staff.example.org irc.example.org Remram H*@ :3 Remi Rampin\r\n"
+                ":irc.example.org 315 Test #rezo :End of /WHO list.\r\n"
+                ":irc.example.org 352 Test #rezo Remram staff.example.org irc.example.org Remram H*@ :3 Remi Rampin\r\n"
+                ":irc.example.org 315 Test Remram :End of /WHO list.\r\n";
+        while(!stream->input.empty())
+            client.readCommands();
+        CPPUNIT_ASSERT(a.who.empty());
+        CPPUNIT_ASSERT(b.who.size() == 2);
+        CPPUNIT_ASSERT(b.masks[0] == "#rezo");
+        CPPUNIT_ASSERT(b.who[0].size() == 2);
+        CPPUNIT_ASSERT(b.who[0][1].flags == "H*@");
+        CPPUNIT_ASSERT(b.who[0][1].hopcount == 3);
+        CPPUNIT_ASSERT(b.who[0][1].realname == "Remi Rampin");
+        CPPUNIT_ASSERT(b.masks[1] == "Remram");
+        CPPUNIT_ASSERT(b.who[1].size() == 1);
+    }
+
+    void test_queryFailures()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        TimerWheel timers(0);
+        client.setTimers(&timers);
+        client.setFloodControl(100, 1);
+        client.setQueryTimeout(1000);
+        client.setQueryCacheTTL(5000);
+        RecordingObserver o;
+        client.who("#a", &o);
+        client.who("#b", &o);
+        client.who("#c", &o);
+        client.whois("x", &o);
+        client.whois("y", &o);
+
+        // Refused queries end the oldest one
+        stream->input =
+                ":irc.example.org 263 Test WHO :Please wait a while and try again.\r\n"
+                ":irc.example.org 263 Test WHOIS :Please wait a while and try again.\r\n";
+        while(!stream->input.empty())
+            client.readCommands();
+        CPPUNIT_ASSERT(o.masks.size() == 1);
+        CPPUNIT_ASSERT(o.masks[0] == "#a");
+        CPPUNIT_ASSERT(o.who[0].empty());
+        CPPUNIT_ASSERT(o.whois.size() == 1);
+        CPPUNIT_ASSERT(o.whois[0].nick == "x");
+        CPPUNIT_ASSERT(!o.whois[0].exists);
+
+        // The answer to a WHO that isn't ours is ignored; the answer to #c
+        // means #b won't get one
+        stream->input =
+                ":irc.example.org 352 Test #raw u h irc.example.org raw H :0 Raw\r\n"
+                ":irc.example.org 315 Test #raw :End of /WHO list.\r\n"
+                ":irc.example.org 352 Test #c u h irc.example.org c H :0 C\r\n"
+                ":irc.example.org 315 Test #c :End of /WHO list.\r\n";
+        while(!stream->input.empty())
+            client.readCommands();
+        CPPUNIT_ASSERT(o.masks.size() == 3);
+        CPPUNIT_ASSERT(o.masks[1] == "#b");
+        CPPUNIT_ASSERT(o.who[1].empty());
+        CPPUNIT_ASSERT(o.masks[2] == "#c");
+        CPPUNIT_ASSERT(o.who[2].size() == 1);
+        CPPUNIT_ASSERT(o.who[2][0].nick == "c");
+
+        // Unanswered queries time out, and are not cached
+        timers.Advance(999);
+        CPPUNIT_ASSERT(o.whois.size() == 1);
+        timers.Advance(1000);
+        CPPUNIT_ASSERT(o.whois.size() == 2);
+        CPPUNIT_ASSERT(o.whois[1].nick == "y");
+        CPPUNIT_ASSERT(!o.whois[1].exists);
+        stream->output.clear();
+        client.whois("y", &o);
+        CPPUNIT_ASSERT(stream->output == "WHOIS y\r\n");
+        client.cancelQueries((UserWhoisObserver*)&o);
+        timers.Advance(2000);
+
+        // Expired answers are pruned, then nothing is left to do
+        timers.Advance(5000);
+        CPPUNIT_ASSERT(timers.Count() == 0);
+        stream->output.clear();
+        client.who("#c", &o);
+        CPPUNIT_ASSERT(stream->output == "WHO #c\r\n");
+    }
+
+    void test_caseMappingChange()
+    {
+        // The 005 comes after traffic was seen with the default rfc1459
+        // mapping, where "a[b" and "a{b" are the same nickname
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        TimerWheel timers(0);
+        client.setTimers(&timers);
+        client.setQueryCacheTTL(60000);
+        RecordingObserver o;
+        stream->input =
+                ":a[b!u@h PRIVMSG #rezo :hi\r\n"
+                ":irc.example.org 352 Test #rezo u h irc.example.org c[d H :0 C\r\n"
+                ":irc.example.org 315 Test c[d :End of /WHO list.\r\n";
+        client.who("c[d", &o);
+        client.whois("e[f", &o);
+        while(!stream->input.empty())
+            client.readCommands();
+        User *user = client.findUser("a[b");
+        CPPUNIT_ASSERT(user != NULL);
+        CPPUNIT_ASSERT(client.findUser("a{b") == user);
+        CPPUNIT_ASSERT(o.who.size() == 1);
+
+        stream->input = ":irc.example.org 005 Test CASEMAPPING=ascii "
+                ":are supported by this server\r\n";
+        client.readCommands();
+        CPPUNIT_ASSERT(client.findUser("a[b") == user);
+        CPPUNIT_ASSERT(client.findUser("a{b") == NULL);
+
+        // The pending WHOIS gets its answer
+        stream->input =
+                ":irc.example.org 311 Test e[f u h * :E\r\n"
+                ":irc.example.org 318 Test e[f :End of /WHOIS list.\r\n";
+        client.readCommands();
+        CPPUNIT_ASSERT(o.whois.size() == 1);
+        CPPUNIT_ASSERT(o.whois[0].exists);
+        CPPUNIT_ASSERT(o.whois[0].realname == "E");
+
+        // The cached answers are found under the new mapping, and only there
+        stream->output.clear();
+        client.who("c[d", &o);
+        client.whois("e[f", &o);
+        CPPUNIT_ASSERT(o.who.size() == 2);
+        CPPUNIT_ASSERT(o.who[1].size() == 1);
+        CPPUNIT_ASSERT(o.whois.size() == 2);
+        CPPUNIT_ASSERT(stream->output.empty());
+        client.who("c{d", &o);
+        client.whois("e{f", &o);
+        CPPUNIT_ASSERT(stream->output == "WHO c{d\r\nWHOIS e{f\r\n");
+
+        // Back to rfc1459: nicknames that are now the same are merged,
+        // keeping the most recently seen user
+        stream->input =
+                ":x[y!u@h PRIVMSG #rezo :1\r\n"
+                ":x{y!u@h PRIVMSG #rezo :2\r\n";
+        client.readCommands();
+        User *older = client.findUser("x[y");
+        User *recent = client.findUser("x{y");
+        CPPUNIT_ASSERT(older != NULL && recent != older);
+        stream->input = ":irc.example.org 005 Test CASEMAPPING=rfc1459 "
+                ":are supported by this server\r\n";
+        client.readCommands();
+        CPPUNIT_ASSERT(client.findUser("x[y") == recent);
+        CPPUNIT_ASSERT(client.findUser("x{y") == recent);
+        CPPUNIT_ASSERT(client.findUser("a{b") == user);
+        // Both queries for "e{f" are answered by one reply
+        client.whois("E[F", &o);
+        stream->input =
+                ":irc.example.org 311 Test e{f u h * :E\r\n"
+                ":irc.example.org 318 Test e{f :End of /WHOIS list.\r\n";
+        client.readCommands();
+        CPPUNIT_ASSERT(o.whois.size() == 4);
+    }
+
+    void test_passive()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        stream->input =
+                ":Remram!remi@staff.example.org PRIVMSG #rezo :hi\r\n"
+                ":irc.example.org NOTICE * :server notice\r\n"
+                ":guitou!gui@example.net JOIN #rezo acct :Guillaume\r\n"
+                ":irc.example.org 352 Test #rezo zertrin example.com irc.example.org Zertrin G@ :3 Zer Trin\r\n"
+                ":ttdx!t@example.org QUIT :bye\r\n";
+        while(!stream->input.empty())
+            client.readCommands();
+
+        User *remram = client.findUser("remram");
+        CPPUNIT_ASSERT(remram != NULL);
+        CPPUNIT_ASSERT(remram->getNick() == "Remram");
+        CPPUNIT_ASSERT(remram->getUser() == "remi");
+        CPPUNIT_ASSERT(remram->getHost() == "staff.example.org");
+        CPPUNIT_ASSERT(client.findUser("irc.example.org") == NULL);
+        CPPUNIT_ASSERT(client.findUser("guitou")->getRealname()
+                == "Guillaume");
+        CPPUNIT_ASSERT(client.findUser("Zertrin")->getHost()
+                == "example.com");
+        CPPUNIT_ASSERT(client.findUser("Zertrin")->getRealname()
+                == "Zer Trin");
+        CPPUNIT_ASSERT(client.findUser("ttdx") == NULL);
+
+        // Nick changes keep the User
+        remram->grab();
+        stream->input =
+                ":Remram!remi@staff.example.org NICK :Remram_\r\n"
+                ":Remram_!remi@other.example.org NICK :REMRAM_\r\n";
+        while(!stream->input.empty())
+            client.readCommands();
+        CPPUNIT_ASSERT(client.findUser("Remram") == NULL);
+        CPPUNIT_ASSERT(client.findUser("remram_") == remram);
+        CPPUNIT_ASSERT(remram->getNick() == "REMRAM_");
+        CPPUNIT_ASSERT(remram->getHost() == "other.example.org");
+        remram->release();
+    }
+
+    void test_userLimit()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        client.setUserLimit(3);
+        stream->input =
+                ":a!u@h PRIVMSG #rezo :1\r\n"
+                ":b!u@h PRIVMSG #rezo :2\r\n"
+                ":c!u@h PRIVMSG #rezo :3\r\n"
+                ":a!u@h PRIVMSG #rezo :4\r\n"
+                ":d!u@h PRIVMSG #rezo :5\r\n";
+        client.readCommands();
+        // b was seen the longest time ago
+        CPPUNIT_ASSERT(client.findUser("b") == NULL);
+        CPPUNIT_ASSERT(client.findUser("a") != NULL);
+        CPPUNIT_ASSERT(client.findUser("c") != NULL);
+        CPPUNIT_ASSERT(client.findUser("d") != NULL);
+
+        // Users held elsewhere are kept
+        User *c = client.findUser("c");
+        c->grab();
+        client.findUser("d");
+        client.findUser("a");
+        stream->input =
+                ":e!u@h PRIVMSG #rezo :6\r\n"
+                ":c!u@h NICK :f\r\n";
+        client.readCommands();
+        CPPUNIT_ASSERT(client.findUser("d") == NULL);
+        CPPUNIT_ASSERT(client.findUser("f") == c);
+        CPPUNIT_ASSERT(client.findUser("a") != NULL);
+        CPPUNIT_ASSERT(client.findUser("e") != NULL);
+        c->release();
+    }
+
+    void test_commandReceived()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        stream->input =
+                ":Remram!remi@staff.example.org PRIVMSG #rezo :hi\r\n"
+                "PING :irc.example.org\r\n"
+                ":irc.example.org\r\n"
+                "@dtrace=1 :irc.example.org NOTICE * :hello\r\n";
+        client.readCommands();
+        // Answered PINGs and garbage are not passed on
+        CPPUNIT_ASSERT(client.received.size() == 2);
+        CPPUNIT_ASSERT(client.received[0] ==
+                "privmsg :Remram!remi@staff.example.org PRIVMSG #rezo :hi");
+        CPPUNIT_ASSERT(client.received[1] ==
+                "@dtrace=1 :irc.example.org NOTICE * :hello");
+    }
+
+    void test_process()
+    {
+        ScriptStream *stream = new ScriptStream;
+        TestClient client(stream);
+        client.setLineBudget(2);
+        stream->input =
+                ":a!u@h PRIVMSG #rezo :1\r\n"
+                ":a!u@h PRIVMSG #rezo :2\r\n"
+                ":a!u@h PRIVMSG #rezo :3\r\n"
+                ":a!u@h PRIVMSG #rezo :4\r\n"
+                ":a!u@h PRIVMSG #rezo :5\r\n";
+        CPPUNIT_ASSERT(client.process());
+        CPPUNIT_ASSERT(client.received.size() == 2);
+        CPPUNIT_ASSERT(client.hasPendingLines());
+        // The lines left are handled without reading again
+        unsigned int reads = stream->reads;
+        stream->input = ":a!u@h PRIVMSG #rezo :6\r\n";
+        CPPUNIT_ASSERT(client.process());
+        CPPUNIT_ASSERT(client.received.size() == 4);
+        CPPUNIT_ASSERT(!client.process());
+        CPPUNIT_ASSERT(client.received.size() == 5);
+        CPPUNIT_ASSERT(client.received[4] ==
+                "privmsg :a!u@h PRIVMSG #rezo :5");
+        CPPUNIT_ASSERT(stream->reads == reads);
+
+        // The lines received before the connection was closed are handled
+        // before it is reported
+        stream->input += ":a!u@h PRIVMSG #rezo :7\r\n"
+                ":a!u@h PRIVMSG #rezo :8\r\n";
+        stream->closed = true;
+        CPPUNIT_ASSERT(client.process());
+        CPPUNIT_ASSERT(!client.process());
+        CPPUNIT_ASSERT(client.received.size() == 8);
+        CPPUNIT_ASSERT_THROW(client.process(), SocketConnectionClosed);
+    }
+
+    CPPUNIT_TEST_SUITE(IRCClient_Test);
+    CPPUNIT_TEST(test_pong);
+    CPPUNIT_TEST(test_lag);
+    CPPUNIT_TEST(test_timeout);
+    CPPUNIT_TEST(test_flood);
+    CPPUNIT_TEST(test_join);
+    CPPUNIT_TEST(test_injection);
+    CPPUNIT_TEST(test_isupport);
+    CPPUNIT_TEST(test_whois);
+    CPPUNIT_TEST(test_who);
+    CPPUNIT_TEST(test_queryFailures);
+    CPPUNIT_TEST(test_caseMappingChange);
+    CPPUNIT_TEST(test_passive);
+    CPPUNIT_TEST(test_userLimit);
+    CPPUNIT_TEST(test_commandReceived);
+    CPPUNIT_TEST(test_process);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(IRCClient_Test);
@@ -33,9 +33,9 @@ SessionLine session[] = {
     {":irc.inp-net.rezosup.org 004 Test irc.inp-net.rezosup.org solid-ircd-3.4.8stable+rz2e-cho7 aAbcCdefFghHiIjkKmnoOrRsvwxXy bceiIjklLmMnoOprRstv",
      IRCCommand(IRCCommand::UNKNOWN, "Test", "irc.inp-net.rezosup.org", "solid-ircd-3.4.8stable+rz2e-cho7", "aAbcCdefFghHiIjkKmnoOrRsvwxXy", "bceiIjklLmMnoOprRstv", NULL)},
     {":irc.inp-net.rezosup.org 005 Test NETWORK=RezoSup MAXBANS=100 MAXCHANNELS=20 CHANNELLEN=32 KICKLEN=307 NICKLEN=30 TOPICLEN=307 MODES=6 CHANTYPES=# CHANLIMIT=#:20 PREFIX=(ohv)@%+ STATUSMSG=@+ :are available on this server",
-     IRCCommand(IRCCommand::UNKNOWN, "Test", "NETWORK=RezoSup", "MAXBANS=100", "MAXCHANNELS=20", "CHANNELLEN=32", "KICKLEN=307", "NICKLEN=30", "TOPICLEN=307", "MODES=6", "CHANTYPES=#", "CHANLIMIT=#:20", "PREFIX=(ohv)@%+", "STATUSMSG=@+", "are available on this server", NULL)},
+     IRCCommand(IRCCommand::ISUPPORT, "Test", "NETWORK=RezoSup", "MAXBANS=100", "MAXCHANNELS=20", "CHANNELLEN=32", "KICKLEN=307", "NICKLEN=30", "TOPICLEN=307", "MODES=6", "CHANTYPES=#", "CHANLIMIT=#:20", "PREFIX=(ohv)@%+", "STATUSMSG=@+", "are available on this server", NULL)},
     {":irc.inp-net.rezosup.org 005 Test CASEMAPPING=ascii WATCH=128 SILENCE=10 ELIST=cmntu EXCEPTS INVEX CHANMODES=beI,k,jl,cimMnOprRstNS MAXLIST=b:100,e:45,I:100 TARGMAX=DCCALLOW:,JOIN:,KICK:4,KILL:20,NOTICE:20,PART:,PRIVMSG:20,WHOIS:,WHOWAS: :are available on this server",
-     IRCCommand(IRCCommand::UNKNOWN, "Test", "CASEMAPPING=ascii", "WATCH=128", "SILENCE=10", "ELIST=cmntu", "EXCEPTS", "INVEX", "CHANMODES=beI,k,jl,cimMnOprRstNS", "MAXLIST=b:100,e:45,I:100", "TARGMAX=DCCALLOW:,JOIN:,KICK:4,KILL:20,NOTICE:20,PART:,PRIVMSG:20,WHOIS:,WHOWAS:", "are available on this server", NULL)},
+     IRCCommand(IRCCommand::ISUPPORT, "Test", "CASEMAPPING=ascii", "WATCH=128", "SILENCE=10", "ELIST=cmntu", "EXCEPTS", "INVEX", "CHANMODES=beI,k,jl,cimMnOprRstNS", "MAXLIST=b:100,e:45,I:100", "TARGMAX=DCCALLOW:,JOIN:,KICK:4,KILL:20,NOTICE:20,PART:,PRIVMSG:20,WHOIS:,WHOWAS:", "are available on this server", NULL)},
     {":irc.inp-net.rezosup.org 251 Test :There are 9 users and 624 invisible on 18 servers",
      IRCCommand(IRCCommand::UNKNOWN, "Test", "There are 9 users and 624 invisible on 18 servers", NULL)},
     {":irc.inp-net.rezosup.org 252 Test 26 :IRC Operators online",
@@ -154,6 +154,38 @@ public:
         CPPUNIT_ASSERT(host == "remram44.github.com");
     }
 
+    void test_splitSource()
+    {
+        std::string mask("Remr@m[away]!distrirc@remram44.github.com");
+        IRCCommand::Source source = IRCCommand::splitSource(mask);
+        CPPUNIT_ASSERT(source.nick.str() == "Remr@m[away]");
+        CPPUNIT_ASSERT(source.user.str() == "distrirc");
+        CPPUNIT_ASSERT(source.host.str() == "remram44.github.com");
+        CPPUNIT_ASSERT(source.nick.data() == mask.data());
+
+        std::string server(":remram44.github.com");
+        source = IRCCommand::splitSource(server);
+        CPPUNIT_ASSERT(source.nick.empty());
+        CPPUNIT_ASSERT(source.user.empty());
+        CPPUNIT_ASSERT(source.host.str() == "remram44.github.com");
+
+        // Split when parsed, still valid after a copy
+        IRCCommand parsed(":Remram!distrirc@staff.rezosup.net PRIVMSG #rezo :hi");
+        IRCCommand copy(parsed);
+        source = copy.getSource();
+        CPPUNIT_ASSERT(source.nick.str() == "Remram");
+        CPPUNIT_ASSERT(source.user.str() == "distrirc");
+        CPPUNIT_ASSERT(source.host.str() == "staff.rezosup.net");
+        CPPUNIT_ASSERT(source.host.data() + source.host.size()
+                == copy.source.data() + copy.source.size());
+
+        IRCCommand built("Remram!distrirc@host", IRCCommand::QUIT, "bye",
+                NULL);
+        CPPUNIT_ASSERT(built.getSource().host.str() == "host");
+        CPPUNIT_ASSERT(IRCCommand(IRCCommand::QUIT, "bye", NULL)
+                .getSource().host.empty());
+    }
+
     void test_commands()
     {
         size_t i;
@@ -178,9 +210,43 @@ public:
         }
     }
 
+    void test_tryParse()
+    {
+        IRCCommand cmd;
+        CPPUNIT_ASSERT(cmd.tryParse("") == IRCCommand::PARSE_EMPTY);
+        CPPUNIT_ASSERT(cmd.tryParse(":irc.rezosup.org")
+                == IRCCommand::PARSE_NO_COMMAND);
+        CPPUNIT_ASSERT(cmd.tryParse(":irc.rezosup.org ")
+                == IRCCommand::PARSE_NO_COMMAND);
+        CPPUNIT_ASSERT(cmd.tryParse(" PING :x")
+                == IRCCommand::PARSE_NO_COMMAND);
+        CPPUNIT_ASSERT_THROW(IRCCommand(":"), IRCCommand::Invalid);
+
+        // The same object can be reused, fewer arguments than before
+        CPPUNIT_ASSERT(cmd.tryParse(":Remram!distrirc@host PRIVMSG #rezo :hi all")
+                == IRCCommand::PARSE_OK);
+        CPPUNIT_ASSERT(cmd.type == IRCCommand::PRIVMSG);
+        CPPUNIT_ASSERT(cmd.args.size() == 2);
+        CPPUNIT_ASSERT(cmd.args[1] == "hi all");
+        CPPUNIT_ASSERT(cmd.getSource().nick.str() == "Remram");
+        CPPUNIT_ASSERT(cmd.tryParse("PING x") == IRCCommand::PARSE_OK);
+        CPPUNIT_ASSERT(cmd.type == IRCCommand::PING);
+        CPPUNIT_ASSERT(cmd.source.empty());
+        CPPUNIT_ASSERT(cmd.getSource().host.empty());
+        CPPUNIT_ASSERT(cmd.args.size() == 1 && cmd.args[0] == "x");
+
+        CPPUNIT_ASSERT(cmd.tryParse(":srv 482 Test #a :not op")
+                == IRCCommand::PARSE_OK);
+        CPPUNIT_ASSERT(cmd.type == IRCCommand::OTHERERROR);
+        CPPUNIT_ASSERT(cmd.tryParse(":srv 4x2 Test") == IRCCommand::PARSE_OK);
+        CPPUNIT_ASSERT(cmd.type == IRCCommand::UNKNOWN);
+    }
+
     CPPUNIT_TEST_SUITE(IRCCommand_test);
     CPPUNIT_TEST(test_readSource);
+    CPPUNIT_TEST(test_splitSource);
     CPPUNIT_TEST(test_commands);
+    CPPUNIT_TEST(test_tryParse);
     CPPUNIT_TEST_SUITE_END();
 
 };
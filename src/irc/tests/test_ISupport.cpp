@@ -0,0 +1,102 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "ISupport.h"
+#include "IRCCommand.h"
+
+class ISupport_Test : public CppUnit::TestFixture {
+
+public:
+    void test_defaults()
+    {
+        ISupport isupport;
+        CPPUNIT_ASSERT(isupport.getCaseMapping()
+                == ISupport::CASEMAPPING_RFC1459);
+        CPPUNIT_ASSERT(isupport.equals("Rem[ram]~", "rem{RAM}^"));
+        CPPUNIT_ASSERT(!isupport.equals("remram", "remrams"));
+        CPPUNIT_ASSERT(isupport.isChannel("#rezo"));
+        CPPUNIT_ASSERT(isupport.isChannel("&local"));
+        CPPUNIT_ASSERT(!isupport.isChannel("Remram"));
+        CPPUNIT_ASSERT(!isupport.isChannel(""));
+        CPPUNIT_ASSERT(isupport.getNickLen() == 9);
+        CPPUNIT_ASSERT(isupport.prefixModeMask('o') == 1);
+        CPPUNIT_ASSERT(isupport.prefixModeMask('v') == 2);
+        CPPUNIT_ASSERT(isupport.prefixModeMask('h') == 0);
+        unsigned int limit;
+        CPPUNIT_ASSERT(!isupport.getTargetLimit("PRIVMSG", &limit));
+    }
+
+    void test_parse()
+    {
+        ISupport isupport;
+        isupport.parse(IRCCommand(":irc.inp-net.rezosup.org 005 Test NETWORK=RezoSup MAXBANS=100 MAXCHANNELS=20 CHANNELLEN=32 KICKLEN=307 NICKLEN=30 TOPICLEN=307 MODES=6 CHANTYPES=# CHANLIMIT=#:20 PREFIX=(ohv)@%+ STATUSMSG=@+ :are available on this server"));
+        isupport.parse(IRCCommand(":irc.inp-net.rezosup.org 005 Test CASEMAPPING=ascii WATCH=128 SILENCE=10 ELIST=cmntu EXCEPTS INVEX CHANMODES=beI,k,jl,cimMnOprRstNS MAXLIST=b:100,e:45,I:100 TARGMAX=DCCALLOW:,JOIN:,KICK:4,KILL:20,NOTICE:20,PART:,PRIVMSG:20,WHOIS:,WHOWAS: :are available on this server"));
+
+        CPPUNIT_ASSERT(isupport.getNetwork() == "RezoSup");
+        CPPUNIT_ASSERT(isupport.getNickLen() == 30);
+
+        CPPUNIT_ASSERT(isupport.getCaseMapping()
+                == ISupport::CASEMAPPING_ASCII);
+        CPPUNIT_ASSERT(isupport.equals("RemRam", "remram"));
+        CPPUNIT_ASSERT(!isupport.equals("Rem[ram]", "rem{ram}"));
+        CPPUNIT_ASSERT(isupport.casefold("#ReZo[1]") == "#rezo[1]");
+
+        CPPUNIT_ASSERT(isupport.isChannel("#rezo"));
+        CPPUNIT_ASSERT(!isupport.isChannel("&local"));
+
+        size_t length;
+        CPPUNIT_ASSERT(isupport.readPrefixes("@+Remram", &length) == 5);
+        CPPUNIT_ASSERT(length == 2);
+        CPPUNIT_ASSERT(isupport.readPrefixes("%guitou", &length) == 2);
+        CPPUNIT_ASSERT(length == 1);
+        CPPUNIT_ASSERT(isupport.readPrefixes("ttdx", &length) == 0);
+        CPPUNIT_ASSERT(length == 0);
+        CPPUNIT_ASSERT(isupport.prefixSymbol(4 | 2) == '%');
+        CPPUNIT_ASSERT(isupport.prefixSymbol(0) == '\0');
+
+        CPPUNIT_ASSERT(isupport.chanMode('b') == ISupport::CHANMODE_LIST);
+        CPPUNIT_ASSERT(isupport.chanMode('k') == ISupport::CHANMODE_ALWAYS);
+        CPPUNIT_ASSERT(isupport.chanMode('l') == ISupport::CHANMODE_SET);
+        CPPUNIT_ASSERT(isupport.chanMode('n') == ISupport::CHANMODE_FLAG);
+        CPPUNIT_ASSERT(isupport.chanMode('h') == ISupport::CHANMODE_PREFIX);
+        CPPUNIT_ASSERT(isupport.chanMode('z') == ISupport::CHANMODE_UNKNOWN);
+        CPPUNIT_ASSERT(isupport.chanModeTakesParam('l', true));
+        CPPUNIT_ASSERT(!isupport.chanModeTakesParam('l', false));
+        CPPUNIT_ASSERT(isupport.chanModeTakesParam('o', false));
+
+        unsigned int limit;
+        CPPUNIT_ASSERT(isupport.getTargetLimit("PRIVMSG", &limit));
+        CPPUNIT_ASSERT(limit == 20);
+        CPPUNIT_ASSERT(isupport.getTargetLimit("JOIN", &limit));
+        CPPUNIT_ASSERT(limit == 0);
+        CPPUNIT_ASSERT(!isupport.getTargetLimit("ISON", &limit));
+    }
+
+    void test_negate()
+    {
+        ISupport isupport;
+        isupport.parseToken("PREFIX=(qaohv)~&@%+");
+        isupport.parseToken("NETWORK=Some\\x20Net");
+        isupport.parseToken("MAXTARGETS=4");
+        CPPUNIT_ASSERT(isupport.prefixModeMask('v') == 16);
+        CPPUNIT_ASSERT(isupport.getNetwork() == "Some Net");
+        unsigned int limit;
+        CPPUNIT_ASSERT(isupport.getTargetLimit("NOTICE", &limit));
+        CPPUNIT_ASSERT(limit == 4);
+
+        isupport.parseToken("-PREFIX");
+        isupport.parseToken("-MAXTARGETS");
+        CPPUNIT_ASSERT(isupport.prefixModeMask('v') == 2);
+        CPPUNIT_ASSERT(isupport.prefixModeMask('q') == 0);
+        CPPUNIT_ASSERT(isupport.chanMode('q') == ISupport::CHANMODE_UNKNOWN);
+        CPPUNIT_ASSERT(!isupport.getTargetLimit("NOTICE", &limit));
+    }
+
+    CPPUNIT_TEST_SUITE(ISupport_Test);
+    CPPUNIT_TEST(test_defaults);
+    CPPUNIT_TEST(test_parse);
+    CPPUNIT_TEST(test_negate);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ISupport_Test);
@@ -1,9 +1,13 @@
 #include <cppunit/extensions/HelperMacros.h>
 
 #include "LineConnection.h"
+#include "common/MemoryBudget.h"
+#include "common/Metrics.h"
 
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
+#include <vector>
 
 //#define _DEBUG_FAKESTREAM
 
@@ -121,14 +125,111 @@ public:
 
 CPPUNIT_TEST_SUITE_REGISTRATION(FakeStream_Test);
 
+/**
+ * A stream recording what is sent, and the number of writes.
+ */
+class RecordingStream : public NetStream {
+
+public:
+    std::string output;
+    unsigned int writes;
+
+    RecordingStream()
+      : writes(0)
+    {
+    }
+
+    void Send(const char *data, size_t size) throw(SocketConnectionClosed)
+    {
+        writes++;
+        output.append(data, size);
+    }
+
+    void SendV(const Chunk *chunks, size_t count)
+            throw(SocketConnectionClosed)
+    {
+        writes++;
+        size_t i;
+        for(i = 0; i < count; i++)
+            output.append(chunks[i].data, chunks[i].size);
+    }
+
+    int Recv(char*, size_t, bool) throw(SocketConnectionClosed)
+    {
+        throw std::runtime_error("RecordingStream::Recv called");
+    }
+
+    void RegisterSockets(SocketSetRegistrar*)
+    {
+        throw std::runtime_error("RecordingStream::RegisterSockets called");
+    }
+
+};
+
+/**
+ * A stream returning the data it is fed, as much as asked for.
+ */
+class DrainStream : public NetStream {
+
+public:
+    std::string input;
+    bool closed;
+    unsigned int reads;
+
+    DrainStream()
+      : closed(false), reads(0)
+    {
+    }
+
+    void Send(const char*, size_t) throw(SocketConnectionClosed)
+    {
+        throw std::runtime_error("DrainStream::Send called");
+    }
+
+    int Recv(char *data, size_t size_max, bool)
+            throw(SocketConnectionClosed)
+    {
+        reads++;
+        if(input.empty() && closed)
+            throw SocketConnectionClosed();
+        size_t size = (input.size() < size_max)?input.size():size_max;
+        input.copy(data, size);
+        input.erase(0, size);
+        return size;
+    }
+
+    void RegisterSockets(SocketSetRegistrar*)
+    {
+        throw std::runtime_error("DrainStream::RegisterSockets called");
+    }
+
+};
+
+class FakeScheduler : public FlushScheduler {
+
+public:
+    std::vector<Flushable*> scheduled;
+
+    void ScheduleFlush(Flushable *obj)
+    {
+        scheduled.push_back(obj);
+    }
+
+    void CancelFlush(Flushable *obj)
+    {
+        scheduled.erase(std::remove(scheduled.begin(), scheduled.end(), obj),
+                scheduled.end());
+    }
+
+};
+
 class LineConnection_Test : public CppUnit::TestFixture {
 
 public:
     /*
-     * Note that LineConnection receives to an internal buffer, so it won't be
-     * receiving more that 128 bytes at once no matter what the FakeStream
-     * wants to return.
-     * Isn't a problem here -- we're using much smaller sizes.
+     * Note that LineConnection keeps reading as long as the reads fill its
+     * buffer (RECV_SIZE bytes), so the small chunks used here are each read
+     * by a single call; test_drain checks the other case.
      */
 
     void test_simple()
@@ -215,10 +316,219 @@ public:
         delete conn;
     }
 
+    void test_overlong()
+    {
+        const char *data = "123456789\r\n12345\r\n1234567" "89\nab\n";
+        const int sizes[] = {25, 6, -1};
+        FakeStream *stream = new FakeStream(data, sizes);
+        LineConnection *conn = new LineConnection(stream);
+        conn->setMaxLineLength(5);
+        {
+            std::list<std::string> l = conn->readLines();
+            CPPUNIT_ASSERT(l.size() == 2);
+            std::list<std::string>::const_iterator it = l.begin();
+            CPPUNIT_ASSERT(std::string("12345") == *it++);
+            CPPUNIT_ASSERT(std::string("12345") == *it++);
+            // The partial line doesn't grow past the maximum
+            CPPUNIT_ASSERT(conn->getBufferedSize() == 6);
+        }
+        {
+            std::list<std::string> l = conn->readLines();
+            CPPUNIT_ASSERT(l.size() == 2);
+            std::list<std::string>::const_iterator it = l.begin();
+            CPPUNIT_ASSERT(std::string("12345") == *it++);
+            CPPUNIT_ASSERT(std::string("ab") == *it++);
+        }
+        CPPUNIT_ASSERT(conn->getOverlongLines() == 2);
+        delete conn;
+
+        stream = new FakeStream(data, sizes);
+        conn = new LineConnection(stream);
+        conn->setMaxLineLength(5, LineConnection::DISCARD);
+        {
+            std::list<std::string> l = conn->readLines();
+            CPPUNIT_ASSERT(l.size() == 1);
+            CPPUNIT_ASSERT(std::string("12345") == l.front());
+        }
+        {
+            std::list<std::string> l = conn->readLines();
+            CPPUNIT_ASSERT(l.size() == 1);
+            CPPUNIT_ASSERT(std::string("ab") == l.front());
+        }
+        CPPUNIT_ASSERT(conn->getOverlongLines() == 2);
+        delete conn;
+    }
+
+    void test_budget()
+    {
+        MemoryBudget budget(8);
+        const char *data1 = "abcdef" "gh\nabcd";
+        const int sizes1[] = {6, 7, -1};
+        const char *data2 = "12345" "678" "\n";
+        const int sizes2[] = {5, 3, 1, -1};
+        LineConnection *conn1 = new LineConnection(
+                new FakeStream(data1, sizes1));
+        LineConnection *conn2 = new LineConnection(
+                new FakeStream(data2, sizes2));
+        conn1->setBudget(&budget);
+        conn2->setBudget(&budget);
+
+        CPPUNIT_ASSERT(conn1->readLines().empty());
+        CPPUNIT_ASSERT(budget.getUsed() == 6);
+        // Doesn't fit in the budget
+        CPPUNIT_ASSERT(conn2->readLines().empty());
+        CPPUNIT_ASSERT(budget.getUsed() == 6);
+        CPPUNIT_ASSERT(budget.getRefused() == 1);
+        {
+            std::list<std::string> l = conn1->readLines();
+            CPPUNIT_ASSERT(l.size() == 1);
+            CPPUNIT_ASSERT(std::string("abcdefgh") == l.front());
+            CPPUNIT_ASSERT(budget.getUsed() == 4);
+        }
+        // There is room again, but the start of the line was lost: nothing
+        // more is kept until the end of the line
+        CPPUNIT_ASSERT(conn2->readLines().empty());
+        CPPUNIT_ASSERT(budget.getUsed() == 4);
+        {
+            std::list<std::string> l = conn2->readLines();
+            CPPUNIT_ASSERT(l.size() == 1);
+            CPPUNIT_ASSERT(l.front().empty());
+            CPPUNIT_ASSERT(conn2->getOverlongLines() == 1);
+        }
+        CPPUNIT_ASSERT(budget.getPeak() == 8);
+        delete conn1;
+        delete conn2;
+        CPPUNIT_ASSERT(budget.getUsed() == 0);
+    }
+
+    void test_flush()
+    {
+        RecordingStream *stream = new RecordingStream;
+        LineConnection *conn = new LineConnection(stream);
+        conn->writeLine("NICK Remram");
+        CPPUNIT_ASSERT(stream->output == "NICK Remram\r\n");
+        CPPUNIT_ASSERT(stream->writes == 1);
+
+        // With a scheduler, lines are sent together when flushed
+        FakeScheduler scheduler;
+        conn->SetFlushScheduler(&scheduler);
+        conn->writeLine("JOIN #rezo");
+        conn->writeLine("PRIVMSG #rezo :hi");
+        CPPUNIT_ASSERT(conn->getPendingLines() == 2);
+        CPPUNIT_ASSERT(stream->writes == 1);
+        CPPUNIT_ASSERT(scheduler.scheduled.size() == 1);
+        scheduler.scheduled[0]->Flush();
+        scheduler.scheduled.clear();
+        CPPUNIT_ASSERT(stream->writes == 2);
+        CPPUNIT_ASSERT(stream->output ==
+                "NICK Remram\r\nJOIN #rezo\r\nPRIVMSG #rezo :hi\r\n");
+
+        // Pending lines are sent when detached
+        conn->writeLine("QUIT");
+        CPPUNIT_ASSERT(scheduler.scheduled.size() == 1);
+        conn->SetFlushScheduler(NULL);
+        CPPUNIT_ASSERT(scheduler.scheduled.empty());
+        CPPUNIT_ASSERT(stream->writes == 3);
+        CPPUNIT_ASSERT(conn->getLinesWritten() == 4);
+        delete conn;
+    }
+
+    void test_metrics()
+    {
+        Counter &sent = Metrics::global().counter("irc.lines_sent");
+        Counter &received = Metrics::global().counter("irc.lines_received");
+        long long sent_before = sent.value();
+        long long received_before = received.value();
+
+        DrainStream *input = new DrainStream;
+        input->input = "a\r\nb\nc";
+        LineConnection *conn = new LineConnection(input);
+        CPPUNIT_ASSERT(conn->readLines().size() == 2);
+        CPPUNIT_ASSERT(conn->getLinesRead() == 2);
+        CPPUNIT_ASSERT(received.value() - received_before == 2);
+        delete conn;
+
+        RecordingStream *output = new RecordingStream;
+        conn = new LineConnection(output);
+        conn->writeLine("x");
+        conn->writeLine("y");
+        CPPUNIT_ASSERT(sent.value() - sent_before == 2);
+        delete conn;
+
+        // Bytes of partial lines are counted until the line ends or the
+        // connection goes away
+        Counter &buffered = Metrics::global().counter("irc.buffer_bytes");
+        Counter &refused = Metrics::global().counter("irc.budget_refused");
+        long long buffered_before = buffered.value();
+        long long refused_before = refused.value();
+        MemoryBudget budget(4);
+        const char *data = "ab" "cd\nef" "ghijkl";
+        const int sizes[] = {2, 5, 6, -1};
+        conn = new LineConnection(new FakeStream(data, sizes));
+        conn->setBudget(&budget);
+        CPPUNIT_ASSERT(conn->readLines().empty());
+        CPPUNIT_ASSERT(buffered.value() - buffered_before == 2);
+        CPPUNIT_ASSERT(conn->readLines().size() == 1);
+        CPPUNIT_ASSERT(buffered.value() - buffered_before == 2);
+        CPPUNIT_ASSERT(conn->readLines().empty());
+        CPPUNIT_ASSERT(refused.value() - refused_before == 1);
+        CPPUNIT_ASSERT(buffered.value() - buffered_before == 2);
+        delete conn;
+        CPPUNIT_ASSERT(buffered.value() == buffered_before);
+
+        std::string dump = Metrics::global().dump();
+        CPPUNIT_ASSERT(dump.find("irc.lines_sent ") != std::string::npos);
+    }
+
+    void test_drain()
+    {
+        // Reads filling the buffer are followed by another one
+        DrainStream *stream = new DrainStream;
+        stream->input.assign(LineConnection::RECV_SIZE * 2 - 1, 'a');
+        stream->input += "\nb\n";
+        LineConnection *conn = new LineConnection(stream);
+        conn->setMaxLineLength(LineConnection::MAX_LINE_TAGS);
+        {
+            std::list<std::string> l = conn->readLines();
+            CPPUNIT_ASSERT(stream->input.empty());
+            CPPUNIT_ASSERT(stream->reads == 3);
+            CPPUNIT_ASSERT(l.size() == 2);
+            CPPUNIT_ASSERT(l.back() == "b");
+        }
+        CPPUNIT_ASSERT(conn->readLines().empty());
+        delete conn;
+    }
+
+    void test_closeAfterData()
+    {
+        // The connection is closed while draining: lines are returned, the
+        // next call throws
+        DrainStream *stream = new DrainStream;
+        stream->input.assign(LineConnection::RECV_SIZE - 2, 'a');
+        stream->input += "\nb";
+        stream->closed = true;
+        LineConnection *conn = new LineConnection(stream);
+        {
+            std::list<std::string> l = conn->readLines();
+            CPPUNIT_ASSERT(l.size() == 1);
+            CPPUNIT_ASSERT(l.front().size() == LineConnection::MAX_LINE_RFC);
+        }
+        CPPUNIT_ASSERT(stream->reads == 2);
+        CPPUNIT_ASSERT_THROW(conn->readLines(), SocketConnectionClosed);
+        CPPUNIT_ASSERT(stream->reads == 2);
+        delete conn;
+    }
+
     CPPUNIT_TEST_SUITE(LineConnection_Test);
     CPPUNIT_TEST(test_simple);
     CPPUNIT_TEST(test_crlf);
     CPPUNIT_TEST(test_binary);
+    CPPUNIT_TEST(test_overlong);
+    CPPUNIT_TEST(test_budget);
+    CPPUNIT_TEST(test_flush);
+    CPPUNIT_TEST(test_drain);
+    CPPUNIT_TEST(test_closeAfterData);
+    CPPUNIT_TEST(test_metrics);
     CPPUNIT_TEST_SUITE_END();
 
 };
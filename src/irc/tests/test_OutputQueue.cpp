@@ -0,0 +1,166 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "OutputQueue.h"
+
+#include <stdexcept>
+
+class RecordStream : public NetStream {
+
+public:
+    std::string output;
+
+    void Send(const char *data, size_t size) throw(SocketConnectionClosed)
+    {
+        output.append(data, size);
+    }
+
+    int Recv(char*, size_t, bool) throw(SocketConnectionClosed)
+    {
+        throw std::runtime_error("RecordStream::Recv called");
+    }
+
+    void RegisterSockets(SocketSetRegistrar*)
+    {
+        throw std::runtime_error("RecordStream::RegisterSockets called");
+    }
+
+};
+
+class OutputQueue_Test : public CppUnit::TestFixture {
+
+public:
+    void test_rate()
+    {
+        RecordStream *stream = new RecordStream;
+        LineConnection conn(stream);
+        OutputQueue queue(2, 1000);
+        queue.push("PRIVMSG #a :1", OutputQueue::BULK);
+        queue.push("PRIVMSG #a :2", OutputQueue::BULK);
+        queue.push("PRIVMSG #a :3", OutputQueue::BULK);
+        queue.push("PRIVMSG #a :4", OutputQueue::BULK);
+        CPPUNIT_ASSERT(queue.flush(5000, &conn) == 1000);
+        CPPUNIT_ASSERT(stream->output ==
+                "PRIVMSG #a :1\r\nPRIVMSG #a :2\r\n");
+        stream->output.clear();
+
+        // Control lines go first
+        queue.push("PONG :x", OutputQueue::CONTROL);
+        CPPUNIT_ASSERT(queue.flush(5500, &conn) == 500);
+        CPPUNIT_ASSERT(stream->output.empty());
+        CPPUNIT_ASSERT(queue.flush(6000, &conn) == 1000);
+        CPPUNIT_ASSERT(stream->output == "PONG :x\r\n");
+        CPPUNIT_ASSERT(queue.flush(7000, &conn) == 1000);
+        CPPUNIT_ASSERT(queue.flush(8000, &conn) == -1);
+        CPPUNIT_ASSERT(stream->output ==
+                "PONG :x\r\nPRIVMSG #a :3\r\nPRIVMSG #a :4\r\n");
+        CPPUNIT_ASSERT(queue.size() == 0);
+
+        // The bucket fills up again
+        stream->output.clear();
+        queue.push("A");
+        queue.push("B");
+        queue.push("C");
+        CPPUNIT_ASSERT(queue.flush(20000, &conn) == 1000);
+        CPPUNIT_ASSERT(stream->output == "A\r\nB\r\n");
+    }
+
+    void test_key()
+    {
+        RecordStream *stream = new RecordStream;
+        LineConnection conn(stream);
+        OutputQueue queue(1, 1000);
+        queue.push("AWAY :lunch", OutputQueue::NORMAL, "AWAY");
+        queue.push("TOPIC #a :one", OutputQueue::NORMAL, "TOPIC #a");
+        queue.push("TOPIC #b :one", OutputQueue::NORMAL, "TOPIC #b");
+        queue.push("TOPIC #a :two", OutputQueue::NORMAL, "TOPIC #a");
+        queue.push("AWAY", OutputQueue::NORMAL, "AWAY");
+        CPPUNIT_ASSERT(queue.size() == 3);
+        queue.flushAll(&conn);
+        CPPUNIT_ASSERT(stream->output ==
+                "AWAY\r\nTOPIC #a :two\r\nTOPIC #b :one\r\n");
+    }
+
+    void test_batch()
+    {
+        RecordStream *stream = new RecordStream;
+        LineConnection conn(stream);
+        OutputQueue queue;
+        CPPUNIT_ASSERT(queue.push("JOIN #a"));
+        CPPUNIT_ASSERT(queue.push("JOIN #b,#c"));
+        CPPUNIT_ASSERT(!queue.push("JOIN #d key"));
+        CPPUNIT_ASSERT(queue.push("JOIN #e"));
+        CPPUNIT_ASSERT(queue.push("ISON alice"));
+        CPPUNIT_ASSERT(queue.push("ISON :bob carol"));
+        CPPUNIT_ASSERT(queue.push("PRIVMSG #a :hi"));
+        CPPUNIT_ASSERT(queue.push("PRIVMSG #b :hi"));
+        CPPUNIT_ASSERT(queue.size() == 6);
+        queue.setTargetLimit("PRIVMSG", 3);
+        CPPUNIT_ASSERT(queue.push("PRIVMSG #c :hi"));
+        CPPUNIT_ASSERT(queue.push("PRIVMSG #d :hi"));
+        CPPUNIT_ASSERT(queue.push("PRIVMSG #d :hello"));
+        CPPUNIT_ASSERT(queue.size() == 7);
+        queue.flushAll(&conn);
+        CPPUNIT_ASSERT(stream->output ==
+                "JOIN #a,#b,#c\r\n"
+                "JOIN #d key\r\n"
+                "JOIN #e\r\n"
+                "ISON alice bob carol\r\n"
+                "PRIVMSG #a :hi\r\n"
+                "PRIVMSG #b,#c,#d :hi\r\n"
+                "PRIVMSG #d :hello\r\n");
+    }
+
+    void test_split()
+    {
+        std::vector<std::string> parts;
+        OutputQueue::split("hello", 10, &parts);
+        CPPUNIT_ASSERT(parts.size() == 1 && parts[0] == "hello");
+
+        parts.clear();
+        OutputQueue::split("", 10, &parts);
+        CPPUNIT_ASSERT(parts.size() == 1 && parts[0] == "");
+
+        parts.clear();
+        OutputQueue::split("the quick brown fox", 10, &parts);
+        CPPUNIT_ASSERT(parts.size() == 2);
+        CPPUNIT_ASSERT(parts[0] == "the quick");
+        CPPUNIT_ASSERT(parts[1] == "brown fox");
+
+        parts.clear();
+        OutputQueue::split("abcdefghijklmnop", 6, &parts);
+        CPPUNIT_ASSERT(parts.size() == 3);
+        CPPUNIT_ASSERT(parts[0] == "abcdef");
+        CPPUNIT_ASSERT(parts[2] == "mnop");
+
+        // "é" is 2 bytes, it must not be cut
+        parts.clear();
+        OutputQueue::split("r\xC3\xA9mi r\xC3\xA9mi", 2, &parts);
+        CPPUNIT_ASSERT(parts.size() == 6);
+        CPPUNIT_ASSERT(parts[0] == "r");
+        CPPUNIT_ASSERT(parts[1] == "\xC3\xA9");
+        CPPUNIT_ASSERT(parts[2] == "mi");
+
+        // Line breaks start a new part, empty lines and NULs are dropped
+        parts.clear();
+        OutputQueue::split(std::string("hi\r\nQUIT :x\n\nb\0ye\r", 18), 10,
+                &parts);
+        CPPUNIT_ASSERT(parts.size() == 3);
+        CPPUNIT_ASSERT(parts[0] == "hi");
+        CPPUNIT_ASSERT(parts[1] == "QUIT :x");
+        CPPUNIT_ASSERT(parts[2] == "bye");
+
+        parts.clear();
+        OutputQueue::split("\r\n", 10, &parts);
+        CPPUNIT_ASSERT(parts.size() == 1 && parts[0] == "");
+    }
+
+    CPPUNIT_TEST_SUITE(OutputQueue_Test);
+    CPPUNIT_TEST(test_rate);
+    CPPUNIT_TEST(test_key);
+    CPPUNIT_TEST(test_batch);
+    CPPUNIT_TEST(test_split);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(OutputQueue_Test);
@@ -0,0 +1,169 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "Trace.h"
+#include "IRCCommand.h"
+#include "LineConnection.h"
+#include "sockets/TCP.h"
+#include "common/Clock.h"
+
+class Trace_Test : public CppUnit::TestFixture {
+
+private:
+    /** Connects two LineConnections over loopback. */
+    static void connectPair(LineConnection **a, LineConnection **b)
+    {
+        TCPServer *server = TCPServer::Listen(0);
+        *a = new LineConnection(TCPSocket::Connect("127.0.0.1",
+                server->GetLocalPort()));
+        *b = new LineConnection(server->Accept(-1));
+        delete server;
+        (*a)->setMaxLineLength(LineConnection::MAX_LINE_TAGS);
+        (*b)->setMaxLineLength(LineConnection::MAX_LINE_TAGS);
+    }
+
+    static std::string readLine(LineConnection *conn)
+    {
+        std::list<std::string> lines;
+        while(lines.empty())
+            lines = conn->readLines();
+        CPPUNIT_ASSERT(lines.size() == 1);
+        return lines.front();
+    }
+
+    /**
+     * What a relay does with a DTRACE: strips the first prefix and forwards
+     * the command; if 'last', answers it instead.
+     */
+    static void relayRequest(LineConnection *from, LineConnection *to,
+            const char *name, unsigned long long delay = 0)
+    {
+        IRCCommand command(readLine(from));
+        unsigned long long received = monotonicMicros();
+        CPPUNIT_ASSERT(command.args.size() == 1);
+        // Pretend this relay is slow
+        while(monotonicMicros() - received < delay)
+            ;
+        const std::string &target = command.args[0];
+        size_t tilde = target.find('~');
+        if(tilde == std::string::npos)
+            to->writeLine(Trace::forward(command.tags, "DTRACEREPLY", name,
+                    received));
+        else
+            to->writeLine(Trace::forward(command.tags,
+                    "DTRACE " + target.substr(tilde + 1), name, received));
+    }
+
+    static void relayReply(LineConnection *from, LineConnection *to,
+            const char *name)
+    {
+        IRCCommand command(readLine(from));
+        unsigned long long received = monotonicMicros();
+        to->writeLine(Trace::forward(command.tags, "DTRACEREPLY", name,
+                received));
+    }
+
+public:
+    void test_tag()
+    {
+        Trace trace = Trace::start();
+        CPPUNIT_ASSERT(trace.id.size() == 16);
+        CPPUNIT_ASSERT(Trace::start().id != trace.id);
+        trace.addHop("relay1", 35);
+        trace.addHop("re,l:ay 2", 120);
+        CPPUNIT_ASSERT(trace.toTag() ==
+                "dtrace=" + trace.id + ",relay1:35,relay2:120");
+
+        Trace parsed;
+        CPPUNIT_ASSERT(parsed.parse("a=b;" + trace.toTag() + ";c"));
+        CPPUNIT_ASSERT(parsed.id == trace.id);
+        CPPUNIT_ASSERT(parsed.hops.size() == 2);
+        CPPUNIT_ASSERT(parsed.hops[1].name == "relay2");
+        CPPUNIT_ASSERT(parsed.hops[1].micros == 120);
+        CPPUNIT_ASSERT(parsed.breakdown(1000) ==
+                "relay1 35us, relay2 120us, network 845us");
+
+        CPPUNIT_ASSERT(!parsed.parse("a=b;dtracex=12"));
+        CPPUNIT_ASSERT(!parsed.parse("dtrace=12,nocolon"));
+        CPPUNIT_ASSERT(!parsed.parse("dtrace="));
+
+        // Untraced lines are forwarded unchanged
+        CPPUNIT_ASSERT(Trace::forward("", "DQUOTE a :b", "r", 0) ==
+                "DQUOTE a :b");
+        CPPUNIT_ASSERT(Trace::forward("x=y", "DQUOTE a :b", "r", 0) ==
+                "DQUOTE a :b");
+    }
+
+    void test_commandTags()
+    {
+        IRCCommand command("@dtrace=ab,r:1 :nick!u@h PRIVMSG #a :hi");
+        CPPUNIT_ASSERT(command.tags == "dtrace=ab,r:1");
+        CPPUNIT_ASSERT(command.source == "nick!u@h");
+        CPPUNIT_ASSERT(command.type == IRCCommand::PRIVMSG);
+        CPPUNIT_ASSERT(command.args.size() == 2);
+        CPPUNIT_ASSERT(command.args[1] == "hi");
+
+        CPPUNIT_ASSERT(command.tryParse("@a=b PING :x")
+                == IRCCommand::PARSE_OK);
+        CPPUNIT_ASSERT(command.source.empty());
+        CPPUNIT_ASSERT(command.type == IRCCommand::PING);
+        CPPUNIT_ASSERT(command.tryParse("PING :x") == IRCCommand::PARSE_OK);
+        CPPUNIT_ASSERT(command.tags.empty());
+        CPPUNIT_ASSERT(command.tryParse("@a=b")
+                == IRCCommand::PARSE_NO_COMMAND);
+    }
+
+    void test_loopback()
+    {
+        // client -> relay1 -> relay2 -> relay3, relay2 being slow
+        LineConnection *client, *r1_up, *r1_down, *r2_up, *r2_down, *r3_up;
+        connectPair(&client, &r1_up);
+        connectPair(&r1_down, &r2_up);
+        connectPair(&r2_down, &r3_up);
+
+        Trace trace = Trace::start();
+        unsigned long long start = monotonicMicros();
+        client->writeLine(trace.tagLine("DTRACE relay1~relay2~relay3"));
+        relayRequest(r1_up, r1_down, "relay1");
+        relayRequest(r2_up, r2_down, "relay2", 20000);
+        relayRequest(r3_up, r3_up, "relay3");
+        relayReply(r2_down, r2_up, "relay2");
+        relayReply(r1_down, r1_up, "relay1");
+        IRCCommand reply(readLine(client));
+        unsigned long long total = monotonicMicros() - start;
+
+        CPPUNIT_ASSERT(reply.args.empty());
+        Trace result;
+        CPPUNIT_ASSERT(result.parse(reply.tags));
+        CPPUNIT_ASSERT(result.id == trace.id);
+        CPPUNIT_ASSERT(result.hops.size() == 5);
+        const char *names[5] = {"relay1", "relay2", "relay3", "relay2",
+                "relay1"};
+        unsigned long long sum = 0;
+        size_t i;
+        for(i = 0; i < 5; i++)
+        {
+            CPPUNIT_ASSERT(result.hops[i].name == names[i]);
+            sum += result.hops[i].micros;
+        }
+        CPPUNIT_ASSERT(result.hops[1].micros >= 20000);
+        CPPUNIT_ASSERT(sum <= total);
+        CPPUNIT_ASSERT(result.breakdown(total).find("relay2 ")
+                != std::string::npos);
+
+        delete client;
+        delete r1_up;
+        delete r1_down;
+        delete r2_up;
+        delete r2_down;
+        delete r3_up;
+    }
+
+    CPPUNIT_TEST_SUITE(Trace_Test);
+    CPPUNIT_TEST(test_tag);
+    CPPUNIT_TEST(test_commandTags);
+    CPPUNIT_TEST(test_loopback);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(Trace_Test);
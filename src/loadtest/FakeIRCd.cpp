@@ -0,0 +1,347 @@
+#include "FakeIRCd.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "common/Clock.h"
+#include "common/Metrics.h"
+#include "irc/LineConnection.h"
+
+const char *const FakeIRCd::NAME = "irc.fake.example.org";
+
+static Counter &messagesSent =
+        Metrics::global().counter("loadtest.messages_sent");
+static Counter &linesSent = Metrics::global().counter("loadtest.lines_sent");
+
+FakeIRCd::Config::Config()
+  : channels(1000), users(10000), rate(50000), netsplitInterval(0),
+    netsplitUsers(0), namesInterval(0)
+{
+}
+
+/**
+ * A connection to the server.
+ */
+class FakeIRCd::Session : public EventHandler {
+
+private:
+    FakeIRCd *m_pServer;
+
+public:
+    LineConnection connection;
+    std::string nick;
+    bool registered;
+
+    Session(FakeIRCd *server, TCPSocket *sock)
+      : m_pServer(server), connection(sock), registered(false)
+    {
+    }
+
+    void send(const std::string &line)
+    {
+        connection.writeLine(line);
+        linesSent.add();
+    }
+
+    void ready(EventLoop *loop, Waitable*)
+    {
+        std::list<std::string> lines;
+        try
+        {
+            lines = connection.readLines();
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            loop->remove(&connection);
+            m_pServer->sessionClosed(this);
+            return ;
+        }
+        std::list<std::string>::const_iterator it = lines.begin();
+        for(; it != lines.end(); ++it)
+        {
+            // Clients don't send a source, and we don't need the arguments
+            // parsed; the first word is the command
+            const std::string &line = *it;
+            size_t space = line.find(' ');
+            std::string command = line.substr(0, space);
+            std::string rest = (space == std::string::npos)?"":
+                    line.substr(space + 1);
+            if(command == "NICK")
+                nick = (!rest.empty() && rest[0] == ':')?rest.substr(1):rest;
+            else if(command == "USER" && !registered && !nick.empty())
+                m_pServer->sessionRegistered(this);
+            else if(command == "PING")
+                send(std::string(":") + NAME + " PONG " + NAME + " " + rest);
+        }
+    }
+
+};
+
+/**
+ * Accepts the connections.
+ */
+class FakeIRCd::Listener : public EventHandler {
+
+private:
+    FakeIRCd *m_pServer;
+
+public:
+    Listener(FakeIRCd *server)
+      : m_pServer(server)
+    {
+    }
+
+    void ready(EventLoop *loop, Waitable*)
+    {
+        std::vector<TCPSocket*> sockets;
+        m_pServer->m_pServer->AcceptAll(&sockets);
+        std::vector<TCPSocket*>::iterator it = sockets.begin();
+        for(; it != sockets.end(); ++it)
+        {
+            Session *session = new Session(m_pServer, *it);
+            m_pServer->m_Sessions.push_back(session);
+            loop->add(&session->connection, session);
+        }
+    }
+
+};
+
+/**
+ * A timer calling a method of the server periodically.
+ */
+class FakeIRCd::PeriodicTimer : public Timer {
+
+private:
+    FakeIRCd *m_pServer;
+    void (FakeIRCd::*m_pMethod)();
+    unsigned int m_iInterval;
+
+public:
+    PeriodicTimer(FakeIRCd *server, void (FakeIRCd::*method)(),
+            unsigned int interval)
+      : m_pServer(server), m_pMethod(method), m_iInterval(interval)
+    {
+    }
+
+    void Expired()
+    {
+        (m_pServer->*m_pMethod)();
+        m_pServer->m_Loop.timers().Schedule(this, m_iInterval);
+    }
+
+};
+
+FakeIRCd::FakeIRCd(const Config &config) throw(SocketError)
+  : m_Config(config), m_pNetsplit(NULL), m_pNames(NULL),
+    m_iTrafficStart(0), m_iGenerated(0), m_iRandom(0x2545F491),
+    m_iRegistered(0), m_bTraffic(0)
+{
+    m_pServer = TCPServer::Listen(0);
+    // The thread isn't running yet, so the loop can be set up from here
+    m_pListener = new Listener(this);
+    m_Loop.add(m_pServer, m_pListener);
+    m_pTraffic = new PeriodicTimer(this, &FakeIRCd::traffic, 1);
+    m_Loop.timers().Schedule(m_pTraffic, 1);
+    if(m_Config.netsplitInterval > 0 && m_Config.netsplitUsers > 0)
+    {
+        m_pNetsplit = new PeriodicTimer(this, &FakeIRCd::netsplit,
+                m_Config.netsplitInterval);
+        m_Loop.timers().Schedule(m_pNetsplit, m_Config.netsplitInterval);
+    }
+    if(m_Config.namesInterval > 0)
+    {
+        m_pNames = new PeriodicTimer(this, &FakeIRCd::names,
+                m_Config.namesInterval);
+        m_Loop.timers().Schedule(m_pNames, m_Config.namesInterval);
+    }
+}
+
+FakeIRCd::~FakeIRCd()
+{
+    stop();
+    delete m_pTraffic;
+    delete m_pNetsplit;
+    delete m_pNames;
+    std::vector<Session*>::iterator it = m_Sessions.begin();
+    for(; it != m_Sessions.end(); ++it)
+    {
+        m_Loop.remove(&(*it)->connection);
+        delete *it;
+    }
+    m_Loop.remove(m_pServer);
+    delete m_pServer;
+    delete m_pListener;
+}
+
+void FakeIRCd::start()
+{
+    m_Loop.start();
+}
+
+void FakeIRCd::stop()
+{
+    m_Loop.stop();
+    m_Loop.join();
+}
+
+void FakeIRCd::setTraffic(bool enabled)
+{
+    __sync_lock_test_and_set(&m_bTraffic, enabled?1:0);
+}
+
+int FakeIRCd::getPort() const
+{
+    return m_pServer->GetLocalPort();
+}
+
+void FakeIRCd::sessionRegistered(Session *session)
+{
+    session->registered = true;
+    const std::string &nick = session->nick;
+    session->send(std::string(":") + NAME + " 001 " + nick
+            + " :Welcome to the fake network " + nick);
+    session->send(std::string(":") + NAME + " 005 " + nick
+            + " CHANTYPES=# PREFIX=(ov)@+ CASEMAPPING=rfc1459"
+            " NETWORK=Fake :are supported by this server");
+    // Joining every channel gets the NAMES flood of each
+    char channel[32];
+    unsigned int c;
+    for(c = 0; c < m_Config.channels; c++)
+    {
+        snprintf(channel, sizeof(channel), "#chan%u", c);
+        session->send(":" + nick + "!relay@127.0.0.1 JOIN " + channel);
+        sendNames(session, c);
+    }
+    m_Registered.push_back(session);
+    __sync_fetch_and_add(&m_iRegistered, 1);
+}
+
+void FakeIRCd::sessionClosed(Session *session)
+{
+    m_Sessions.erase(std::remove(m_Sessions.begin(), m_Sessions.end(),
+            session), m_Sessions.end());
+    if(session->registered)
+    {
+        m_Registered.erase(std::remove(m_Registered.begin(),
+                m_Registered.end(), session), m_Registered.end());
+        __sync_fetch_and_sub(&m_iRegistered, 1);
+    }
+    delete session;
+}
+
+void FakeIRCd::traffic()
+{
+    if(!m_bTraffic || m_Registered.empty() || m_Config.users == 0)
+    {
+        m_iTrafficStart = 0;
+        return ;
+    }
+    unsigned long long now = monotonicNanos();
+    if(m_iTrafficStart == 0)
+    {
+        m_iTrafficStart = now;
+        m_iGenerated = 0;
+    }
+    // What should have been sent since the traffic started; if we fell
+    // behind, don't send more than a tenth of a second at once
+    unsigned long long due = (now - m_iTrafficStart) / 1000
+            * m_Config.rate / 1000000;
+    unsigned long long count = due - m_iGenerated;
+    if(count > m_Config.rate / 10 + 1)
+    {
+        count = m_Config.rate / 10 + 1;
+        m_iGenerated = due - count;
+    }
+
+    char line[512];
+    unsigned long long i;
+    for(i = 0; i < count; i++)
+    {
+        unsigned int user = random() % m_Config.users;
+        snprintf(line, sizeof(line), ":user%u!u%u@h%u.example.net PRIVMSG "
+                "#chan%u :t=%llu message %llu from the load generator",
+                user, user, user, user % m_Config.channels,
+                monotonicNanos(), m_iGenerated);
+        m_Registered[m_iGenerated % m_Registered.size()]->send(line);
+        m_iGenerated++;
+    }
+    messagesSent.add(count);
+}
+
+void FakeIRCd::netsplit()
+{
+    if(!m_bTraffic || m_Config.users == 0)
+        return ;
+    // A server splits with a batch of users, which come back right away
+    unsigned int first = random() % m_Config.users;
+    unsigned int count = std::min(m_Config.netsplitUsers, m_Config.users);
+    char line[256];
+    std::vector<Session*>::iterator it;
+    for(it = m_Registered.begin(); it != m_Registered.end(); ++it)
+    {
+        unsigned int i;
+        for(i = 0; i < count; i++)
+        {
+            unsigned int user = (first + i) % m_Config.users;
+            snprintf(line, sizeof(line), ":user%u!u%u@h%u.example.net QUIT "
+                    ":hub.fake.example.org leaf.fake.example.org",
+                    user, user, user);
+            (*it)->send(line);
+        }
+        for(i = 0; i < count; i++)
+        {
+            unsigned int user = (first + i) % m_Config.users;
+            snprintf(line, sizeof(line), ":user%u!u%u@h%u.example.net JOIN "
+                    "#chan%u", user, user, user, user % m_Config.channels);
+            (*it)->send(line);
+        }
+    }
+}
+
+void FakeIRCd::names()
+{
+    if(!m_bTraffic || m_Config.channels == 0)
+        return ;
+    unsigned int channel = random() % m_Config.channels;
+    std::vector<Session*>::iterator it;
+    for(it = m_Registered.begin(); it != m_Registered.end(); ++it)
+        sendNames(*it, channel);
+}
+
+void FakeIRCd::sendNames(Session *session, unsigned int channel)
+{
+    // User u is on channel u % channels
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), " 353 %s = #chan%u :",
+            session->nick.c_str(), channel);
+    const std::string prefix = std::string(":") + NAME + buffer;
+    std::string line = prefix + "@" + session->nick;
+    unsigned int user;
+    for(user = channel; user < m_Config.users; user += m_Config.channels)
+    {
+        if(line.size() > 480)
+        {
+            session->send(line);
+            line = prefix;
+        }
+        else
+            line += ' ';
+        snprintf(buffer, sizeof(buffer), "%suser%u",
+                (user % 17 == 0)?"@":(user % 5 == 0)?"+":"", user);
+        line += buffer;
+    }
+    session->send(line);
+    snprintf(buffer, sizeof(buffer), " 366 %s #chan%u :End of /NAMES list.",
+            session->nick.c_str(), channel);
+    session->send(std::string(":") + NAME + buffer);
+}
+
+unsigned int FakeIRCd::random()
+{
+    // xorshift32: repeatable, and cheap next to the rest
+    m_iRandom ^= m_iRandom << 13;
+    m_iRandom ^= m_iRandom >> 17;
+    m_iRandom ^= m_iRandom << 5;
+    return m_iRandom;
+}
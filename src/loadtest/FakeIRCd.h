@@ -0,0 +1,109 @@
+#ifndef HEADER_FAKEIRCD_H
+#define HEADER_FAKEIRCD_H
+
+#include <string>
+#include <vector>
+
+#include "core/EventLoop.h"
+
+/**
+ * A fake IRC server, generating traffic for load tests.
+ *
+ * It accepts any number of connections (the links of the relay being
+ * tested), registers them without checking anything, and puts each of them
+ * in every channel of a simulated network: JOIN then the NAMES flood of each
+ * channel. Once the traffic is turned on, it sends PRIVMSGs from random users
+ * to their channels at a fixed rate, spread over the links; the text of each
+ * starts with the time it was sent ("t=<monotonicNanos()>"), so that the
+ * receiving end can measure the latency. Periodic netsplits (a batch of QUITs
+ * then JOINs) and NAMES floods can be added.
+ *
+ * The server runs on its own EventLoop; the methods can be called from any
+ * thread.
+ */
+class FakeIRCd {
+
+public:
+    /** The simulated network. */
+    struct Config {
+        unsigned int channels;
+        /** Users, spread over the channels; nicknames are "user<n>". */
+        unsigned int users;
+        /** PRIVMSGs per second, over all the links. */
+        unsigned int rate;
+        /** Time between netsplits, in milliseconds, or 0. */
+        unsigned int netsplitInterval;
+        /** Number of users that quit and rejoin at each netsplit. */
+        unsigned int netsplitUsers;
+        /** Time between NAMES floods, in milliseconds, or 0. */
+        unsigned int namesInterval;
+
+        Config();
+    };
+
+    static const char *const NAME;
+
+private:
+    class Session;
+    class Listener;
+    class PeriodicTimer;
+
+    const Config m_Config;
+    EventLoop m_Loop;
+    TCPServer *m_pServer;
+    Listener *m_pListener;
+    PeriodicTimer *m_pTraffic;
+    PeriodicTimer *m_pNetsplit;
+    PeriodicTimer *m_pNames;
+
+    // Only used from the thread of the loop
+    std::vector<Session*> m_Sessions;
+    std::vector<Session*> m_Registered;
+    unsigned long long m_iTrafficStart;
+    unsigned long long m_iGenerated;
+    unsigned int m_iRandom;
+
+    volatile int m_iRegistered;
+    volatile int m_bTraffic;
+
+    FakeIRCd(const FakeIRCd&);
+    FakeIRCd &operator=(const FakeIRCd&);
+
+public:
+    /**
+     * Constructor: listens on a random port of the loopback interface.
+     */
+    FakeIRCd(const Config &config) throw(SocketError);
+
+    /** Destructor: stops the server and closes the connections. */
+    ~FakeIRCd();
+
+    /** Starts the thread of the server. */
+    void start();
+
+    /** Stops the thread of the server. */
+    void stop();
+
+    /** Turns the traffic on or off. */
+    void setTraffic(bool enabled);
+
+    int getPort() const;
+
+    /** Number of connections that completed the registration. */
+    inline int registered() const
+    {
+        return m_iRegistered;
+    }
+
+private:
+    void sessionRegistered(Session *session);
+    void sessionClosed(Session *session);
+    void traffic();
+    void netsplit();
+    void names();
+    void sendNames(Session *session, unsigned int channel);
+    unsigned int random();
+
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "LoadSink.h"
+
+#include <cstdlib>
+
+#include "common/Clock.h"
+#include "common/Metrics.h"
+#include "irc/LineConnection.h"
+
+static Counter &linesReceived =
+        Metrics::global().counter("loadtest.lines_received");
+static Counter &messagesReceived =
+        Metrics::global().counter("loadtest.messages_received");
+static Histogram &latency = Metrics::global().histogram("loadtest.latency_us");
+
+class LoadSink::Client : public EventHandler {
+
+public:
+    LineConnection connection;
+
+    Client(TCPSocket *sock)
+      : connection(sock)
+    {
+    }
+
+    void ready(EventLoop *loop, Waitable*)
+    {
+        std::list<std::string> lines;
+        try
+        {
+            lines = connection.readLines();
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            loop->remove(&connection);
+            return ;
+        }
+        unsigned long long now = monotonicNanos();
+        unsigned long long count = 0, messages = 0;
+        std::list<std::string>::const_iterator it = lines.begin();
+        for(; it != lines.end(); ++it)
+        {
+            count++;
+            size_t pos = it->find(" :t=");
+            if(pos == std::string::npos)
+                continue;
+            unsigned long long sent = strtoull(it->c_str() + pos + 4, NULL,
+                    10);
+            latency.record((now > sent)?(now - sent) / 1000:0);
+            messages++;
+        }
+        linesReceived.add(count);
+        messagesReceived.add(messages);
+    }
+
+};
+
+LoadSink::LoadSink() throw(SocketError)
+{
+}
+
+LoadSink::~LoadSink()
+{
+    stop();
+    std::vector<Client*>::iterator it = m_Clients.begin();
+    for(; it != m_Clients.end(); ++it)
+    {
+        m_Loop.remove(&(*it)->connection);
+        delete *it;
+    }
+}
+
+void LoadSink::connect(const char *host, int port, unsigned int clients)
+    throw(SocketError)
+{
+    unsigned int i;
+    for(i = 0; i < clients; i++)
+    {
+        Client *client = new Client(TCPSocket::Connect(host, port));
+        m_Clients.push_back(client);
+        m_Loop.add(&client->connection, client);
+    }
+}
+
+void LoadSink::start()
+{
+    m_Loop.start();
+}
+
+void LoadSink::stop()
+{
+    m_Loop.stop();
+    m_Loop.join();
+}
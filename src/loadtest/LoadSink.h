@@ -0,0 +1,46 @@
+#ifndef HEADER_LOADSINK_H
+#define HEADER_LOADSINK_H
+
+#include <vector>
+
+#include "core/EventLoop.h"
+
+/**
+ * The receiving end of a load test: downstream connections that read
+ * everything the relay sends them.
+ *
+ * The PRIVMSGs from FakeIRCd carry the time they were sent; their latency is
+ * recorded in the "loadtest.latency_us" histogram, and the lines counted in
+ * "loadtest.lines_received" and "loadtest.messages_received" (see Metrics).
+ * The clients run on their own EventLoop.
+ */
+class LoadSink {
+
+private:
+    class Client;
+
+    EventLoop m_Loop;
+    std::vector<Client*> m_Clients;
+
+    LoadSink(const LoadSink&);
+    LoadSink &operator=(const LoadSink&);
+
+public:
+    LoadSink() throw(SocketError);
+
+    /** Destructor: stops the thread and closes the connections. */
+    ~LoadSink();
+
+    /** Opens connections; must be called before start(). */
+    void connect(const char *host, int port, unsigned int clients)
+        throw(SocketError);
+
+    /** Starts the thread reading the connections. */
+    void start();
+
+    /** Stops the thread. */
+    void stop();
+
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "Relay.h"
+
+#include "common/Metrics.h"
+#include "irc/IRCClient.h"
+#include "irc/IRCCommand.h"
+
+static Counter &linesRelayed = Metrics::global().counter("relay.lines");
+static Counter &batchesRelayed = Metrics::global().counter("relay.batches");
+
+/**
+ * Lines to relay, shared by the tasks posted to the downstream loops; the
+ * last task to finish with it deletes it.
+ */
+class Relay::Batch {
+
+private:
+    volatile int m_iRefs;
+
+public:
+    std::vector<std::string> lines;
+
+    Batch()
+      : m_iRefs(1)
+    {
+    }
+
+    void grab()
+    {
+        __sync_fetch_and_add(&m_iRefs, 1);
+    }
+
+    void release()
+    {
+        if(__sync_sub_and_fetch(&m_iRefs, 1) == 0)
+            delete this;
+    }
+
+};
+
+/**
+ * A downstream connection; only used from the thread of its loop, except for
+ * the list of downstreams.
+ */
+class Relay::Downstream : public EventHandler {
+
+public:
+    EventLoop *const owner;
+    LineConnection connection;
+    bool closed;
+
+    Downstream(EventLoop *loop, TCPSocket *sock)
+      : owner(loop), connection(sock), closed(false)
+    {
+    }
+
+    void ready(EventLoop *loop, Waitable*)
+    {
+        try
+        {
+            // Downstreams don't say anything we need
+            connection.readLines();
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            loop->remove(&connection);
+            closed = true;
+        }
+    }
+
+};
+
+/**
+ * Writes a batch to a downstream, on the thread of its loop.
+ */
+class Relay::ForwardTask : public LoopTask {
+
+private:
+    Downstream *m_pDownstream;
+    Batch *m_pBatch;
+
+public:
+    ForwardTask(Downstream *downstream, Batch *batch)
+      : m_pDownstream(downstream), m_pBatch(batch)
+    {
+        m_pBatch->grab();
+    }
+
+    ~ForwardTask()
+    {
+        // Also when the loop is destroyed with the task still queued
+        m_pBatch->release();
+    }
+
+    void run(EventLoop*)
+    {
+        if(m_pDownstream->closed)
+            return ;
+        try
+        {
+            std::vector<std::string>::const_iterator it;
+            it = m_pBatch->lines.begin();
+            for(; it != m_pBatch->lines.end(); ++it)
+                m_pDownstream->connection.writeLine(*it);
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            // Noticed when reading
+        }
+    }
+
+};
+
+/**
+ * A connection to an IRC server.
+ */
+class Relay::Link : public IRCClient, public EventHandler {
+
+private:
+    Relay *m_pRelay;
+    Batch *m_pBatch;
+
+public:
+    Link(Relay *relay, TCPSocket *sock)
+      : IRCClient(sock), m_pRelay(relay), m_pBatch(NULL)
+    {
+    }
+
+    void ready(EventLoop *loop, Waitable*)
+    {
+        m_pBatch = new Batch;
+        try
+        {
+            // A bounded number of lines per wakeup, so that a flooding
+            // server doesn't hold up the other connections of the loop
+            if(process())
+                loop->readyAgain(this);
+        }
+        catch(SocketConnectionClosed &e)
+        {
+            loop->remove(this);
+        }
+        if(!m_pBatch->lines.empty())
+            m_pRelay->forward(m_pBatch);
+        m_pBatch->release();
+        m_pBatch = NULL;
+    }
+
+protected:
+    void newChannel(Channel*)
+    {
+    }
+
+    void connectionLost(const std::string&)
+    {
+    }
+
+    void commandReceived(const IRCCommand &command, const std::string &line)
+    {
+        // What a client would be shown; the replies to our own queries and
+        // the registration are not relayed
+        switch(command.type)
+        {
+        case IRCCommand::PRIVMSG:
+        case IRCCommand::NOTICE:
+        case IRCCommand::JOIN:
+        case IRCCommand::PART:
+        case IRCCommand::QUIT:
+        case IRCCommand::NICK:
+        case IRCCommand::TOPIC:
+        case IRCCommand::NAMESARE:
+        case IRCCommand::ENDOFNAMES:
+            m_pBatch->lines.push_back(line);
+            break;
+        default:
+            break;
+        }
+    }
+
+};
+
+Relay::Relay(CoreRuntime &runtime)
+  : m_Runtime(runtime)
+{
+}
+
+Relay::~Relay()
+{
+    std::vector<Link*>::iterator l = m_Links.begin();
+    for(; l != m_Links.end(); ++l)
+        delete *l;
+    std::vector<Downstream*>::iterator d = m_Downstreams.begin();
+    for(; d != m_Downstreams.end(); ++d)
+        delete *d;
+}
+
+int Relay::listen(int port) throw(SocketCantUsePort)
+{
+    return m_Runtime.listen(port, this);
+}
+
+void Relay::connect(const char *host, int port, const std::string &nick)
+    throw(SocketError)
+{
+    Link *link = new Link(this, TCPSocket::Connect(host, port));
+    // Not attached yet: these are sent right away
+    link->sendLine("NICK " + nick);
+    link->sendLine("USER distrirc 0 * :DistrIRC load test");
+    {
+        MutexLock lock(m_Mutex);
+        m_Links.push_back(link);
+    }
+    m_Runtime.attach(link, link);
+}
+
+size_t Relay::downstreams()
+{
+    MutexLock lock(m_Mutex);
+    return m_Downstreams.size();
+}
+
+void Relay::accepted(EventLoop *loop, TCPSocket *sock)
+{
+    Downstream *downstream = new Downstream(loop, sock);
+    {
+        MutexLock lock(m_Mutex);
+        m_Downstreams.push_back(downstream);
+    }
+    loop->add(&downstream->connection, downstream);
+}
+
+void Relay::forward(Batch *batch)
+{
+    linesRelayed.add(batch->lines.size());
+    batchesRelayed.add();
+    MutexLock lock(m_Mutex);
+    std::vector<Downstream*>::iterator it = m_Downstreams.begin();
+    for(; it != m_Downstreams.end(); ++it)
+        (*it)->owner->post(new ForwardTask(*it, batch));
+}
@@ -0,0 +1,70 @@
+#ifndef HEADER_RELAY_H
+#define HEADER_RELAY_H
+
+#include <string>
+#include <vector>
+
+#include "common/Thread.h"
+#include "core/CoreRuntime.h"
+
+/**
+ * The path a line takes through the core, for load tests.
+ *
+ * Links are IRCClients connected to IRC servers, each handled by one of the
+ * loops of a CoreRuntime; downstreams are the connections accepted on the
+ * listeners of the runtime (DistrIRC clients). Everything a link receives
+ * from its server is relayed to every downstream: the lines handled in one
+ * call of IRCClient::process() are posted as a single LoopTask to the loop of
+ * each downstream, which writes them out at the end of its iteration.
+ */
+class Relay : public AcceptHandler {
+
+private:
+    class Batch;
+    class ForwardTask;
+    class Link;
+    class Downstream;
+
+    CoreRuntime &m_Runtime;
+    Mutex m_Mutex;
+    std::vector<Link*> m_Links;
+    std::vector<Downstream*> m_Downstreams;
+
+    Relay(const Relay&);
+    Relay &operator=(const Relay&);
+
+public:
+    Relay(CoreRuntime &runtime);
+
+    /**
+     * Destructor: closes the connections.
+     *
+     * @warning The runtime must have been stopped.
+     */
+    ~Relay();
+
+    /**
+     * Listens for downstream connections.
+     *
+     * @return The port number used.
+     */
+    int listen(int port = 0) throw(SocketCantUsePort);
+
+    /**
+     * Connects a link to an IRC server and registers with the given
+     * nickname.
+     */
+    void connect(const char *host, int port, const std::string &nick)
+        throw(SocketError);
+
+    /** Number of downstream connections. */
+    size_t downstreams();
+
+    void accepted(EventLoop *loop, TCPSocket *sock);
+
+private:
+    void forward(Batch *batch);
+
+};
+
+#endif
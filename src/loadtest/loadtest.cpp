@@ -0,0 +1,215 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef __WIN32__
+    #include <windows.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "common/Clock.h"
+#include "common/Metrics.h"
+#include "core/CoreRuntime.h"
+#include "FakeIRCd.h"
+#include "LoadSink.h"
+#include "Relay.h"
+
+/*
+ * End-to-end load test, on loopback: FakeIRCd -> links of a Relay, running on
+ * a CoreRuntime -> downstream connections of a LoadSink.
+ *
+ * Once the links are registered (and through the NAMES floods of the
+ * channels), the server sends PRIVMSGs at the given rate for the given
+ * duration, with netsplits and NAMES floods if asked; then the received
+ * lines per second and the latency percentiles are reported, one value per
+ * line (the format of Metrics::dump()).
+ *
+ * Usage: loadtest [--option=value...] [--metrics]
+ * See usage() for the options; --metrics also dumps all the metrics of the
+ * process (parse times, bytes sent, ...), which are those of the three
+ * parts together.
+ */
+
+static void usage(const char *program)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --channels=N     channels of the fake network (1000)\n"
+            "  --users=N        users, spread over the channels (10000)\n"
+            "  --rate=N         PRIVMSGs per second (50000)\n"
+            "  --duration=S     length of the test in seconds (10)\n"
+            "  --netsplit=MS    time between netsplits, 0 for none (0)\n"
+            "  --split-users=N  users splitting each time (users/10)\n"
+            "  --names=MS       time between NAMES floods, 0 for none (0)\n"
+            "  --links=N        connections to the fake server (4)\n"
+            "  --downstreams=N  connections from the relay to the sink (2)\n"
+            "  --threads=N      loops of the core, 0 for one per CPU (0)\n"
+            "  --metrics        dump all the metrics at the end\n",
+            program);
+}
+
+static void pause(unsigned int ms)
+{
+#ifdef __WIN32__
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+/**
+ * Waits until a counter reaches a value, or stops moving for a second, for at
+ * most 'timeout' milliseconds.
+ */
+static void waitIdle(Counter &counter, long long expected,
+        unsigned int timeout)
+{
+    long long last = -1;
+    unsigned long long start = monotonicMillis();
+    unsigned long long moved = start;
+    unsigned long long now;
+    while((now = monotonicMillis()) - start < timeout)
+    {
+        long long value = counter.value();
+        if(value >= expected)
+            break;
+        if(value != last)
+            moved = now;
+        else if(now - moved >= 1000)
+            break;
+        last = value;
+        pause(10);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    FakeIRCd::Config config;
+    unsigned int duration = 10;
+    unsigned int links = 4;
+    unsigned int downstreams = 2;
+    unsigned int threads = 0;
+    bool splitUsersSet = false;
+    bool dumpMetrics = false;
+
+    int i;
+    for(i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        const char *eq = strchr(arg, '=');
+        std::string name(arg, eq?eq - arg:strlen(arg));
+        unsigned int value = eq?strtoul(eq + 1, NULL, 10):0;
+        if(name == "--metrics")
+            dumpMetrics = true;
+        else if(eq == NULL)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        else if(name == "--channels")
+            config.channels = value;
+        else if(name == "--users")
+            config.users = value;
+        else if(name == "--rate")
+            config.rate = value;
+        else if(name == "--duration")
+            duration = value;
+        else if(name == "--netsplit")
+            config.netsplitInterval = value;
+        else if(name == "--split-users")
+        {
+            config.netsplitUsers = value;
+            splitUsersSet = true;
+        }
+        else if(name == "--names")
+            config.namesInterval = value;
+        else if(name == "--links")
+            links = value;
+        else if(name == "--downstreams")
+            downstreams = value;
+        else if(name == "--threads")
+            threads = value;
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(config.channels == 0 || links == 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    if(!splitUsersSet)
+        config.netsplitUsers = config.users / 10;
+
+    Metrics &metrics = Metrics::global();
+    Counter &messagesSent = metrics.counter("loadtest.messages_sent");
+    Counter &linesSent = metrics.counter("loadtest.lines_sent");
+    Counter &messagesReceived = metrics.counter("loadtest.messages_received");
+    Counter &linesReceived = metrics.counter("loadtest.lines_received");
+    Histogram &latency = metrics.histogram("loadtest.latency_us");
+
+    FakeIRCd ircd(config);
+    ircd.start();
+    CoreRuntime runtime(threads);
+    Relay relay(runtime);
+    int port = relay.listen();
+    runtime.start();
+    LoadSink sink;
+    sink.connect("127.0.0.1", port, downstreams);
+    sink.start();
+    while(relay.downstreams() < downstreams)
+        pause(10);
+
+    // Registration, with the NAMES floods
+    char nick[32];
+    unsigned int l;
+    for(l = 0; l < links; l++)
+    {
+        snprintf(nick, sizeof(nick), "relay%u", l);
+        relay.connect("127.0.0.1", ircd.getPort(), nick);
+    }
+    while(ircd.registered() < (int)links)
+        pause(10);
+    waitIdle(linesReceived, linesSent.value() * downstreams, 10000);
+    fprintf(stderr, "%u links registered, %lld lines; sending traffic for "
+            "%us\n", links, linesSent.value(), duration);
+
+    // Traffic
+    long long linesBefore = linesReceived.value();
+    unsigned long long start = monotonicMillis();
+    ircd.setTraffic(true);
+    pause(duration * 1000);
+    ircd.setTraffic(false);
+    waitIdle(messagesReceived, messagesSent.value() * downstreams, 10000);
+    unsigned long long elapsed = monotonicMillis() - start;
+
+    long long lines = linesReceived.value() - linesBefore;
+    printf("loadtest.duration_ms %llu\n", elapsed);
+    printf("loadtest.messages_sent %lld\n", messagesSent.value());
+    printf("loadtest.messages_expected %lld\n",
+            messagesSent.value() * downstreams);
+    printf("loadtest.messages_received %lld\n", messagesReceived.value());
+    printf("loadtest.traffic_lines_received %lld\n", lines);
+    printf("loadtest.traffic_lines_per_s %.0f\n",
+            lines * 1000.0 / (elapsed?elapsed:1));
+    printf("loadtest.latency_us count=%llu mean=%llu p50=%llu p90=%llu "
+            "p99=%llu max=%llu\n",
+            latency.count(), latency.mean(), latency.percentile(0.5),
+            latency.percentile(0.9), latency.percentile(0.99),
+            latency.max());
+
+    fflush(stdout);
+
+    // Upstream first: the server might be blocked writing to a link, which
+    // needs the relay running to finish, and so on
+    ircd.stop();
+    runtime.stop();
+    sink.stop();
+    if(dumpMetrics)
+        printf("%s", metrics.dump().c_str());
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include "LogCache.h"
+
+/** Accounted for each cached line, in addition to its content. */
+static const size_t LINE_OVERHEAD = sizeof(std::string);
+
+LogCache::Buffer::Buffer()
+  : end_known(false), end(0)
+{
+}
+
+LogCache::LogCache(size_t max_bytes)
+  : m_iBytes(0), m_iMaxBytes(max_bytes), m_iHits(0), m_iMisses(0)
+{
+}
+
+LogCache::~LogCache()
+{
+    clear();
+}
+
+void LogCache::insert(const std::string &prefixes, const std::string &buffer,
+        unsigned int first, const std::vector<std::string> &lines,
+        bool reaches_end)
+{
+    if(lines.empty() && !reaches_end)
+        return;
+
+    const Key key(prefixes, buffer);
+    BufferMap::iterator b = m_Buffers.find(key);
+    if(b == m_Buffers.end())
+    {
+        b = m_Buffers.insert(std::make_pair(key, Buffer())).first;
+        b->second.key = key;
+    }
+    Buffer &buf = b->second;
+
+    unsigned int last = first + lines.size();
+    if(reaches_end)
+    {
+        buf.end_known = true;
+        buf.end = last;
+    }
+    if(lines.empty())
+        return;
+
+    // Find the ranges that overlap or touch the new one
+    std::vector<Range*> merged;
+    std::map<unsigned int, Range*>::iterator it;
+    it = buf.ranges.upper_bound(first);
+    if(it != buf.ranges.begin())
+    {
+        --it;
+        if(it->second->last() < first)
+            ++it;
+    }
+    unsigned int new_first = first, new_last = last;
+    while(it != buf.ranges.end() && it->first <= last)
+    {
+        Range *r = it->second;
+        if(r->first < new_first)
+            new_first = r->first;
+        if(r->last() > new_last)
+            new_last = r->last();
+        merged.push_back(r);
+        ++it;
+    }
+
+    Range *range = new Range;
+    range->buffer = &buf;
+    range->first = new_first;
+    range->lines.resize(new_last - new_first);
+    range->bytes = 0;
+
+    // Older content first, so that the new lines take precedence
+    std::vector<Range*>::iterator m = merged.begin();
+    for(; m != merged.end(); ++m)
+    {
+        size_t j;
+        for(j = 0; j < (*m)->lines.size(); j++)
+            range->lines[(*m)->first - new_first + j].swap((*m)->lines[j]);
+        removeRange(*m, false);
+    }
+    size_t i;
+    for(i = 0; i < lines.size(); i++)
+        range->lines[first - new_first + i] = lines[i];
+    for(i = 0; i < range->lines.size(); i++)
+        range->bytes += range->lines[i].size() + LINE_OVERHEAD;
+
+    m_LRU.push_front(range);
+    range->lru = m_LRU.begin();
+    buf.ranges[new_first] = range;
+    m_iBytes += range->bytes;
+
+    evict();
+}
+
+bool LogCache::lookup(const std::string &prefixes, const std::string &buffer,
+        unsigned int first, unsigned int last,
+        std::vector<std::string> *lines)
+{
+    BufferMap::iterator b = m_Buffers.find(Key(prefixes, buffer));
+    if(b == m_Buffers.end())
+    {
+        m_iMisses++;
+        return false;
+    }
+    Buffer &buf = b->second;
+
+    if(last == END)
+    {
+        if(!buf.end_known)
+        {
+            m_iMisses++;
+            return false;
+        }
+        last = buf.end;
+    }
+    if(first >= last)
+    {
+        m_iHits++;
+        return true;
+    }
+
+    std::map<unsigned int, Range*>::iterator it;
+    it = buf.ranges.upper_bound(first);
+    if(it == buf.ranges.begin())
+    {
+        m_iMisses++;
+        return false;
+    }
+    --it;
+    Range *r = it->second;
+    if(r->last() < last)
+    {
+        m_iMisses++;
+        return false;
+    }
+
+    lines->insert(lines->end(),
+            r->lines.begin() + (first - r->first),
+            r->lines.begin() + (last - r->first));
+    m_LRU.splice(m_LRU.begin(), m_LRU, r->lru);
+    m_iHits++;
+    return true;
+}
+
+void LogCache::appended(const std::string &prefixes,
+        const std::string &buffer)
+{
+    BufferMap::iterator b = m_Buffers.find(Key(prefixes, buffer));
+    if(b == m_Buffers.end())
+        return;
+    b->second.end_known = false;
+    if(b->second.ranges.empty())
+        m_Buffers.erase(b);
+}
+
+void LogCache::invalidate(const std::string &prefixes,
+        const std::string &buffer)
+{
+    BufferMap::iterator b = m_Buffers.find(Key(prefixes, buffer));
+    if(b == m_Buffers.end())
+        return;
+    while(!b->second.ranges.empty())
+        removeRange(b->second.ranges.begin()->second, false);
+    m_Buffers.erase(b);
+}
+
+void LogCache::clear()
+{
+    while(!m_LRU.empty())
+        removeRange(m_LRU.back());
+    m_Buffers.clear();
+}
+
+void LogCache::removeRange(Range *range, bool drop_empty)
+{
+    Buffer *buf = range->buffer;
+    m_iBytes -= range->bytes;
+    m_LRU.erase(range->lru);
+    buf->ranges.erase(range->first);
+    delete range;
+    if(drop_empty && buf->ranges.empty() && !buf->end_known)
+    {
+        const Key key = buf->key;
+        m_Buffers.erase(key);
+    }
+}
+
+void LogCache::evict()
+{
+    while(m_iBytes > m_iMaxBytes && !m_LRU.empty())
+        removeRange(m_LRU.back());
+}
@@ -0,0 +1,140 @@
+#ifndef HEADER_LOGCACHE_H
+#define HEADER_LOGCACHE_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Cache of log ranges, kept by relays to answer DSHOWLOG requests.
+ *
+ * A relay that forwarded a DSHOWLOG can keep the lines that came back, so
+ * that the next request for the same content doesn't have to go through
+ * every hop again. Ranges are keyed by the prefix chain leading to the
+ * server owning the log (as seen from this relay, ie after stripping our
+ * own prefix) and by the buffer name; positions are line numbers in that
+ * log.
+ *
+ * Overlapping or adjacent ranges of the same log are merged. The size of
+ * the cache is bounded, the least recently used ranges being evicted first.
+ */
+class LogCache {
+
+public:
+    /** Used as the end of a range to mean "up to the end of the log". */
+    static const unsigned int END = (unsigned int)-1;
+
+private:
+    struct Buffer;
+
+    struct Range {
+        Buffer *buffer;
+        unsigned int first;
+        std::vector<std::string> lines;
+        size_t bytes;
+        std::list<Range*>::iterator lru;
+
+        inline unsigned int last() const
+        {
+            return first + lines.size();
+        }
+    };
+
+    typedef std::pair<std::string, std::string> Key;
+
+    struct Buffer {
+        Key key;
+        std::map<unsigned int, Range*> ranges;
+        bool end_known;
+        unsigned int end;
+
+        Buffer();
+    };
+
+    typedef std::map<Key, Buffer> BufferMap;
+
+    BufferMap m_Buffers;
+    std::list<Range*> m_LRU;
+    size_t m_iBytes;
+    size_t m_iMaxBytes;
+    unsigned int m_iHits;
+    unsigned int m_iMisses;
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param max_bytes Maximum size of the cached content; this only counts
+     * the lines themselves plus a small overhead per line.
+     */
+    LogCache(size_t max_bytes);
+    ~LogCache();
+
+    /**
+     * Store lines that came back from a DSHOWLOG.
+     *
+     * @param prefixes Prefix chain leading to the owner of the log.
+     * @param buffer Name of the buffer.
+     * @param first Position of the first line.
+     * @param reaches_end Whether these lines go up to the end of the log (as
+     * known by its owner when it answered).
+     */
+    void insert(const std::string &prefixes, const std::string &buffer,
+            unsigned int first, const std::vector<std::string> &lines,
+            bool reaches_end = false);
+
+    /**
+     * Look up a range.
+     *
+     * @param last Position after the last line, or END.
+     * @param lines Location where to append the cached lines.
+     * @return true if the whole range was available, in which case it was
+     * appended to lines; false if it has to be requested from the next hop.
+     */
+    bool lookup(const std::string &prefixes, const std::string &buffer,
+            unsigned int first, unsigned int last,
+            std::vector<std::string> *lines);
+
+    /**
+     * Indicate that lines were appended to a log by its owner.
+     *
+     * Ranges going up to the end of the log can no longer be served from the
+     * cache, until they are fetched again.
+     */
+    void appended(const std::string &prefixes, const std::string &buffer);
+
+    /**
+     * Drop everything that is cached for a log.
+     *
+     * Should be called when the connection to the owner is lost, as the
+     * prefix might designate something else when it comes back.
+     */
+    void invalidate(const std::string &prefixes, const std::string &buffer);
+
+    /** Drop everything that is cached. */
+    void clear();
+
+    /** Size of the cached content, in bytes. */
+    inline size_t size() const
+    {
+        return m_iBytes;
+    }
+
+    inline unsigned int hits() const
+    {
+        return m_iHits;
+    }
+
+    inline unsigned int misses() const
+    {
+        return m_iMisses;
+    }
+
+private:
+    void removeRange(Range *range, bool drop_empty = true);
+    void evict();
+
+};
+
+#endif
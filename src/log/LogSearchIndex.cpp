@@ -0,0 +1,301 @@
+#include "LogSearchIndex.h"
+
+#include <algorithm>
+#include <cstring>
+
+LogError::LogError(const std::string &message)
+  : m_sMessage(message)
+{
+}
+
+LogError::~LogError() throw()
+{
+}
+
+const char *LogError::what() const throw()
+{
+    return m_sMessage.c_str();
+}
+
+
+/*============================================================================*/
+
+LogPosition::LogPosition(unsigned int segment_, unsigned int offset_)
+  : segment(segment_), offset(offset_)
+{
+}
+
+bool LogPosition::operator==(const LogPosition &p) const
+{
+    return segment == p.segment && offset == p.offset;
+}
+
+bool LogPosition::operator<(const LogPosition &p) const
+{
+    return segment < p.segment || (segment == p.segment && offset < p.offset);
+}
+
+
+/*============================================================================*/
+
+static void writeVarint(std::string *data, unsigned int value)
+{
+    while(value >= 0x80)
+    {
+        data->push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    data->push_back((char)value);
+}
+
+static unsigned int readVarint(const std::string &data, size_t *pos)
+{
+    unsigned int value = 0;
+    int shift = 0;
+    unsigned char c;
+    do {
+        c = (unsigned char)data[(*pos)++];
+        value |= (unsigned int)(c & 0x7F) << shift;
+        shift += 7;
+    }
+    while(c & 0x80);
+    return value;
+}
+
+/*
+ * Each posting is encoded relatively to the previous one: the segment delta,
+ * then the offset delta if the segment didn't change, or the absolute offset
+ * else. At skip entries, the previous position is taken to be (0, 0) so that
+ * decoding can start there.
+ */
+static void encodePosting(std::string *data, const LogPosition &base,
+        const LogPosition &pos)
+{
+    writeVarint(data, pos.segment - base.segment);
+    if(pos.segment == base.segment)
+        writeVarint(data, pos.offset - base.offset);
+    else
+        writeVarint(data, pos.offset);
+}
+
+static LogPosition decodePosting(const std::string &data, size_t *byte,
+        const LogPosition &base)
+{
+    unsigned int segment = base.segment + readVarint(data, byte);
+    unsigned int offset = readVarint(data, byte);
+    if(segment == base.segment)
+        offset += base.offset;
+    return LogPosition(segment, offset);
+}
+
+LogSearchIndex::PostingList::PostingList()
+  : count(0)
+{
+}
+
+/**
+ * Iterates over a posting list, decoding it lazily.
+ */
+class LogSearchIndex::Cursor {
+
+private:
+    const PostingList *m_pList;
+    size_t m_iByte;
+    unsigned int m_iIndex;
+    LogPosition m_Position;
+    bool m_bValid;
+
+public:
+    Cursor(const PostingList *list)
+      : m_pList(list), m_iByte(0), m_iIndex(0), m_bValid(true)
+    {
+        next();
+    }
+
+    inline bool valid() const
+    {
+        return m_bValid;
+    }
+
+    inline const LogPosition &position() const
+    {
+        return m_Position;
+    }
+
+    void next()
+    {
+        if(m_iIndex >= m_pList->count)
+        {
+            m_bValid = false;
+            return;
+        }
+        LogPosition base;
+        if(m_iIndex % SKIP_INTERVAL != 0)
+            base = m_Position;
+        m_Position = decodePosting(m_pList->data, &m_iByte, base);
+        m_iIndex++;
+    }
+
+    /** Moves to the first posting that is not lower than target. */
+    void seek(const LogPosition &target)
+    {
+        if(!m_bValid || !(m_Position < target))
+            return;
+
+        // Find the last skip entry not greater than the target
+        const std::vector<SkipEntry> &skips = m_pList->skips;
+        size_t lo = 0, hi = skips.size();
+        while(hi - lo > 1)
+        {
+            size_t mid = (lo + hi) / 2;
+            if(target < skips[mid].position)
+                hi = mid;
+            else
+                lo = mid;
+        }
+        unsigned int skip_index = lo * SKIP_INTERVAL;
+        if(skip_index + 1 > m_iIndex)
+        {
+            m_iByte = skips[lo].byte;
+            m_iIndex = skip_index;
+            next();
+        }
+
+        while(m_bValid && m_Position < target)
+            next();
+    }
+
+};
+
+LogSearchIndex::LogSearchIndex()
+  : m_iLines(0), m_iBytes(0)
+{
+}
+
+void LogSearchIndex::addLine(const LogPosition &pos, const std::string &line)
+        throw(LogError)
+{
+    if(m_iLines > 0 && pos < m_LastPosition)
+        throw LogError("Lines must be indexed in order");
+    m_LastPosition = pos;
+    m_iLines++;
+
+    std::vector<std::string> tokens;
+    tokenize(line, &tokens);
+    std::vector<std::string>::const_iterator it = tokens.begin();
+    for(; it != tokens.end(); ++it)
+    {
+        PostingList &list = m_Index[*it];
+        if(list.count > 0 && list.last == pos)
+            continue; // Token appears several times in this line
+        size_t prev_size = list.data.size();
+        if(list.count % SKIP_INTERVAL == 0)
+        {
+            SkipEntry skip;
+            skip.byte = list.data.size();
+            skip.position = pos;
+            list.skips.push_back(skip);
+            encodePosting(&list.data, LogPosition(), pos);
+        }
+        else
+            encodePosting(&list.data, list.last, pos);
+        list.last = pos;
+        list.count++;
+        m_iBytes += list.data.size() - prev_size;
+    }
+}
+
+std::vector<LogPosition> LogSearchIndex::search(const std::string &query,
+        size_t max_results) const
+{
+    std::vector<LogPosition> results;
+
+    std::vector<std::string> tokens;
+    tokenize(query, &tokens);
+    if(tokens.empty())
+        return results;
+    std::sort(tokens.begin(), tokens.end());
+    tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+
+    // Get the posting lists, the shortest first
+    std::vector<std::pair<unsigned int, const PostingList*> > lists;
+    std::vector<std::string>::const_iterator it = tokens.begin();
+    for(; it != tokens.end(); ++it)
+    {
+        std::map<std::string, PostingList>::const_iterator l;
+        l = m_Index.find(*it);
+        if(l == m_Index.end())
+            return results;
+        lists.push_back(std::make_pair(l->second.count, &l->second));
+    }
+    std::sort(lists.begin(), lists.end());
+
+    std::vector<Cursor> cursors;
+    size_t i;
+    for(i = 0; i < lists.size(); i++)
+        cursors.push_back(Cursor(lists[i].second));
+
+    // Intersect, driven by the shortest list
+    bool exhausted = false;
+    while(!exhausted && cursors[0].valid())
+    {
+        LogPosition candidate = cursors[0].position();
+        bool match = true;
+        for(i = 1; i < cursors.size(); i++)
+        {
+            cursors[i].seek(candidate);
+            if(!cursors[i].valid())
+            {
+                exhausted = true;
+                match = false;
+                break;
+            }
+            if(candidate < cursors[i].position())
+            {
+                cursors[0].seek(cursors[i].position());
+                match = false;
+                break;
+            }
+        }
+        if(match)
+        {
+            results.push_back(candidate);
+            cursors[0].next();
+        }
+    }
+
+    if(max_results != 0 && results.size() > max_results)
+        results.erase(results.begin(), results.end() - max_results);
+    return results;
+}
+
+static inline bool isTokenChar(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9') || c >= 0x80
+        || (c != '\0' && strchr("[]\\`_^{|}-", c) != NULL);
+}
+
+void LogSearchIndex::tokenize(const std::string &line,
+        std::vector<std::string> *tokens)
+{
+    size_t pos = 0;
+    const size_t end = line.size();
+    while(pos < end)
+    {
+        while(pos < end && !isTokenChar(line[pos]))
+            pos++;
+        if(pos == end)
+            break;
+        std::string token;
+        while(pos < end && isTokenChar(line[pos]))
+        {
+            char c = line[pos++];
+            if(c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            if(token.size() < MAX_TOKEN_LENGTH)
+                token.push_back(c);
+        }
+        tokens->push_back(token);
+    }
+}
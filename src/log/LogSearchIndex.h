@@ -0,0 +1,138 @@
+#ifndef HEADER_LOGSEARCHINDEX_H
+#define HEADER_LOGSEARCHINDEX_H
+
+#include <exception>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Base class for exceptions thrown by the log module.
+ */
+class LogError : public std::exception {
+
+private:
+    const std::string m_sMessage;
+
+public:
+    LogError(const std::string &message);
+    ~LogError() throw();
+    const char *what() const throw();
+
+};
+
+/**
+ * The position of a line in the logs of a buffer.
+ *
+ * Logs are stored as a sequence of segments (typically one file per day);
+ * a line is identified by the segment it is in and its offset in that
+ * segment.
+ */
+struct LogPosition {
+
+    unsigned int segment;
+    unsigned int offset;
+
+    LogPosition(unsigned int segment_ = 0, unsigned int offset_ = 0);
+
+    bool operator==(const LogPosition &p) const;
+    bool operator<(const LogPosition &p) const;
+
+};
+
+/**
+ * Full-text index over the lines of a logged buffer.
+ *
+ * This is an inverted index: each token is mapped to the list of the
+ * positions of the lines it appears in. The index is maintained
+ * incrementally, as lines are appended to the logs, so lines have to be added
+ * in the order of their positions.
+ *
+ * Posting lists are stored delta-encoded as variable-length integers, which
+ * usually takes 2 or 3 bytes per occurrence. A skip entry is recorded every
+ * SKIP_INTERVAL postings so that an intersection doesn't have to decode the
+ * long lists (common words, active nicks) entirely.
+ */
+class LogSearchIndex {
+
+public:
+    /** Number of postings between two skip entries. */
+    static const unsigned int SKIP_INTERVAL = 64;
+    /** Tokens longer than this are truncated. */
+    static const size_t MAX_TOKEN_LENGTH = 64;
+
+private:
+    struct SkipEntry {
+        size_t byte;
+        LogPosition position;
+    };
+
+    struct PostingList {
+        std::string data;
+        unsigned int count;
+        LogPosition last;
+        std::vector<SkipEntry> skips;
+
+        PostingList();
+    };
+
+    class Cursor;
+
+    std::map<std::string, PostingList> m_Index;
+    LogPosition m_LastPosition;
+    unsigned int m_iLines;
+    size_t m_iBytes;
+
+public:
+    LogSearchIndex();
+
+    /**
+     * Index a new line.
+     *
+     * @param pos Position of the line; must not be lower than the position of
+     * the previous line that was added.
+     */
+    void addLine(const LogPosition &pos, const std::string &line)
+            throw(LogError);
+
+    /**
+     * Look for the lines containing all the tokens of the query.
+     *
+     * @param query Search terms, tokenized the same way as the lines.
+     * @param max_results Maximum number of positions to return, or 0 for no
+     * limit. The most recent ones are kept.
+     * @return The positions of the matching lines, in increasing order.
+     */
+    std::vector<LogPosition> search(const std::string &query,
+            size_t max_results = 0) const;
+
+    /** Number of lines that have been indexed. */
+    inline unsigned int lines() const
+    {
+        return m_iLines;
+    }
+
+    /** Number of distinct tokens in the index. */
+    inline size_t tokens() const
+    {
+        return m_Index.size();
+    }
+
+    /** Size of the encoded posting lists, in bytes. */
+    inline size_t memoryUsage() const
+    {
+        return m_iBytes;
+    }
+
+    /**
+     * Split a line into normalized search tokens.
+     *
+     * Tokens are made of letters, digits and the special characters allowed
+     * in nicknames; they are lowercased (ASCII).
+     */
+    static void tokenize(const std::string &line,
+            std::vector<std::string> *tokens);
+
+};
+
+#endif
@@ -0,0 +1,182 @@
+#include "LogStream.h"
+
+const char *logStreamStatusName(ELogStreamStatus status)
+{
+    switch(status)
+    {
+    case LOGSTREAM_COMPLETE:
+        return "COMPLETE";
+    case LOGSTREAM_NOCONTENT:
+        return "NOCONTENT";
+    case LOGSTREAM_ERROR:
+        return "ERROR";
+    case LOGSTREAM_ABORTED:
+    default:
+        return "ABORTED";
+    }
+}
+
+
+/*============================================================================*/
+
+LogStreamSender::LogStreamSender(const std::string &id, LogStreamLink *link,
+        unsigned int window)
+  : m_sId(id), m_pLink(link), m_iCredit(window), m_bFinished(false)
+{
+    m_pLink->streamStarted(m_sId);
+}
+
+LogStreamSender::~LogStreamSender()
+{
+    if(!m_bFinished)
+        m_pLink->streamEnded(m_sId);
+}
+
+bool LogStreamSender::push(unsigned int position, const std::string &line)
+{
+    if(m_bFinished || m_iCredit == 0)
+        return false;
+    m_pLink->sendLogData(m_sId, position, line);
+    m_iCredit--;
+    return true;
+}
+
+void LogStreamSender::finish(ELogStreamStatus status)
+{
+    if(!m_bFinished)
+    {
+        m_pLink->sendLogEnd(m_sId, status);
+        m_bFinished = true;
+        m_pLink->streamEnded(m_sId);
+    }
+}
+
+void LogStreamSender::grant(unsigned int lines)
+{
+    if(!m_bFinished)
+        m_iCredit += lines;
+}
+
+void LogStreamSender::cancel()
+{
+    if(!m_bFinished)
+    {
+        m_iCredit = 0;
+        m_bFinished = true;
+        m_pLink->streamEnded(m_sId);
+    }
+}
+
+
+/*============================================================================*/
+
+LogStreamRelay::LogStreamRelay(const std::string &id,
+        LogStreamLink *downstream, LogStreamLink *upstream,
+        unsigned int window, unsigned int downstream_window)
+  : m_sId(id), m_pDownstream(downstream), m_pUpstream(upstream),
+    m_iWindow(window), m_iDownstreamCredit(downstream_window),
+    m_iUpstreamOutstanding(window), m_bEnded(false),
+    m_eEndStatus(LOGSTREAM_COMPLETE), m_bFinished(false)
+{
+    m_pDownstream->streamStarted(m_sId);
+    m_pUpstream->streamStarted(m_sId);
+}
+
+LogStreamRelay::~LogStreamRelay()
+{
+    if(!m_bFinished)
+        ended();
+}
+
+bool LogStreamRelay::data(unsigned int position, const std::string &line)
+{
+    if(m_bEnded || m_iUpstreamOutstanding == 0)
+        return false;
+    m_iUpstreamOutstanding--;
+    Line l;
+    l.position = position;
+    m_Queue.push_back(l);
+    m_Queue.back().line = line;
+    flush();
+    return true;
+}
+
+void LogStreamRelay::end(ELogStreamStatus status)
+{
+    if(m_bEnded)
+        return;
+    m_bEnded = true;
+    m_eEndStatus = status;
+    flush();
+}
+
+void LogStreamRelay::credit(unsigned int lines)
+{
+    m_iDownstreamCredit += lines;
+    flush();
+}
+
+void LogStreamRelay::cancel()
+{
+    if(m_bFinished)
+        return;
+    if(!m_bEnded)
+        m_pUpstream->sendLogCancel(m_sId);
+    m_Queue.clear();
+    m_bEnded = true;
+    m_eEndStatus = LOGSTREAM_ABORTED;
+    m_bFinished = true;
+    ended();
+}
+
+void LogStreamRelay::abort()
+{
+    if(!m_bEnded)
+        m_pUpstream->sendLogCancel(m_sId);
+    m_Queue.clear();
+    m_bEnded = true;
+    m_eEndStatus = LOGSTREAM_ABORTED;
+    flush();
+}
+
+void LogStreamRelay::flush()
+{
+    while(!m_Queue.empty() && m_iDownstreamCredit > 0)
+    {
+        const Line &l = m_Queue.front();
+        m_pDownstream->sendLogData(m_sId, l.position, l.line);
+        m_Queue.pop_front();
+        m_iDownstreamCredit--;
+    }
+
+    if(m_bEnded)
+    {
+        if(m_Queue.empty() && !m_bFinished)
+        {
+            m_pDownstream->sendLogEnd(m_sId, m_eEndStatus);
+            m_bFinished = true;
+            ended();
+        }
+        return;
+    }
+
+    // Give back credit for the lines that left the queue; batched so that we
+    // don't send a DLOGCREDIT for each line, unless upstream is stalled
+    unsigned int available = m_iWindow - m_iUpstreamOutstanding
+            - m_Queue.size();
+    unsigned int threshold = m_iWindow / 4;
+    if(threshold == 0)
+        threshold = 1;
+    if(available > 0
+     && (available >= threshold || m_iUpstreamOutstanding == 0))
+    {
+        m_pUpstream->sendLogCredit(m_sId, available);
+        m_iUpstreamOutstanding += available;
+    }
+}
+
+void LogStreamRelay::ended()
+{
+    m_pDownstream->streamEnded(m_sId);
+    m_pUpstream->streamEnded(m_sId);
+}
@@ -0,0 +1,224 @@
+#ifndef HEADER_LOGSTREAM_H
+#define HEADER_LOGSTREAM_H
+
+#include <deque>
+#include <string>
+
+/*
+ * Streamed DSHOWLOG answers.
+ *
+ * The answer to a DSHOWLOG is sent back as a stream of DLOGDATA lines,
+ * terminated by a DLOGEND line. The receiving side controls the rate with
+ * credits: the sender may only send as many lines as it has been granted, by
+ * the window in the initial request and by subsequent DLOGCREDIT lines.
+ * Relays forward the lines as they arrive and only grant credit upstream as
+ * they manage to send them downstream, so that the amount of data buffered
+ * on a relay is bounded by its window no matter how slow the client is.
+ * A stream that is abandoned on the way is cancelled upstream with a
+ * DLOGCANCEL line, so that the sender stops and forgets about it.
+ */
+
+/**
+ * The way a log stream ended.
+ */
+enum ELogStreamStatus {
+    LOGSTREAM_COMPLETE,     // All the requested content was sent
+    LOGSTREAM_NOCONTENT,    // No content matched the request
+    LOGSTREAM_ERROR,        // The request couldn't be served
+    LOGSTREAM_ABORTED       // The stream was interrupted (connection lost)
+};
+
+/**
+ * Returns the token used on the wire for a status ("COMPLETE", ...).
+ */
+const char *logStreamStatusName(ELogStreamStatus status);
+
+/**
+ * Connection on which the messages of a log stream are sent.
+ *
+ * Implemented by whoever owns the connection, typically by sending the
+ * corresponding extended-protocol line.
+ */
+class LogStreamLink {
+
+public:
+    virtual ~LogStreamLink() {}
+
+    /** Send a line of log: DLOGDATA <id> <position> :<line> */
+    virtual void sendLogData(const std::string &id, unsigned int position,
+            const std::string &line) = 0;
+    /** Signal the end of the stream: DLOGEND <id> <status> */
+    virtual void sendLogEnd(const std::string &id,
+            ELogStreamStatus status) = 0;
+    /** Allow the peer to send more lines: DLOGCREDIT <id> <lines> */
+    virtual void sendLogCredit(const std::string &id, unsigned int lines) = 0;
+    /** Ask the peer to stop sending the stream: DLOGCANCEL <id> */
+    virtual void sendLogCancel(const std::string &id) = 0;
+
+    /**
+     * Called when a stream starts going through this link, and when it is
+     * over.
+     *
+     * Lets the owner switch the connection to options suited to bulk
+     * transfers for the duration (see TCPProfile::BULK); as several streams
+     * can use the same link, it should count them.
+     */
+    virtual void streamStarted(const std::string &)
+    {
+    }
+    virtual void streamEnded(const std::string &)
+    {
+    }
+
+};
+
+/**
+ * Sending end of a log stream, on the server that has the content.
+ */
+class LogStreamSender {
+
+private:
+    const std::string m_sId;
+    LogStreamLink *m_pLink;
+    unsigned int m_iCredit;
+    bool m_bFinished;
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param window Number of lines the requester allowed us to send.
+     */
+    LogStreamSender(const std::string &id, LogStreamLink *link,
+            unsigned int window);
+
+    /** Destructor: the stream is over for the link, even if not finished. */
+    ~LogStreamSender();
+
+    /**
+     * Sends a line if the window allows it.
+     *
+     * @return false if the line wasn't sent because we ran out of credit; it
+     * should be pushed again after the next call to grant().
+     */
+    bool push(unsigned int position, const std::string &line);
+
+    /** Ends the stream. */
+    void finish(ELogStreamStatus status = LOGSTREAM_COMPLETE);
+
+    /** Called when a DLOGCREDIT is received. */
+    void grant(unsigned int lines);
+
+    /**
+     * Called when a DLOGCANCEL is received: the stream is over, without a
+     * DLOGEND, and nothing is sent anymore.
+     */
+    void cancel();
+
+    inline unsigned int credit() const
+    {
+        return m_iCredit;
+    }
+
+    inline bool finished() const
+    {
+        return m_bFinished;
+    }
+
+};
+
+/**
+ * A log stream going through a relay.
+ *
+ * Lines coming from upstream (the server that has the content) are forwarded
+ * downstream (towards the client) as long as the downstream window allows
+ * it, and queued else. Credit is only given back upstream for the lines that
+ * left the queue, so that the queue never holds more than the window of
+ * this relay.
+ */
+class LogStreamRelay {
+
+private:
+    struct Line {
+        unsigned int position;
+        std::string line;
+    };
+
+    const std::string m_sId;
+    LogStreamLink *m_pDownstream;
+    LogStreamLink *m_pUpstream;
+    const unsigned int m_iWindow;
+    unsigned int m_iDownstreamCredit;
+    unsigned int m_iUpstreamOutstanding;
+    std::deque<Line> m_Queue;
+    bool m_bEnded;
+    ELogStreamStatus m_eEndStatus;
+    bool m_bFinished;
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param downstream Link towards the client.
+     * @param upstream Link towards the server that has the content.
+     * @param window Window of this relay, to be sent upstream with the
+     * relayed DSHOWLOG. It is the maximum number of lines queued here.
+     * @param downstream_window Window that was given by the client in its
+     * request.
+     */
+    LogStreamRelay(const std::string &id, LogStreamLink *downstream,
+            LogStreamLink *upstream, unsigned int window,
+            unsigned int downstream_window);
+
+    ~LogStreamRelay();
+
+    /**
+     * Called when a DLOGDATA is received from upstream.
+     *
+     * @return false if the upstream server sent more than its window, or
+     * after the stream ended; the line is dropped and the stream should be
+     * aborted.
+     */
+    bool data(unsigned int position, const std::string &line);
+
+    /** Called when a DLOGEND is received from upstream. */
+    void end(ELogStreamStatus status);
+
+    /** Called when a DLOGCREDIT is received from downstream. */
+    void credit(unsigned int lines);
+
+    /**
+     * Called when a DLOGCANCEL is received from downstream: the cancel is
+     * forwarded upstream and the stream ends, without a DLOGEND.
+     */
+    void cancel();
+
+    /**
+     * Aborts the stream, for instance because one of the connections was
+     * lost.
+     *
+     * Downstream gets a DLOGEND with the ABORTED status, and upstream a
+     * DLOGCANCEL if it didn't end the stream already (a link whose
+     * connection is gone should just drop it).
+     */
+    void abort();
+
+    /** Number of lines waiting for downstream credit. */
+    inline size_t queued() const
+    {
+        return m_Queue.size();
+    }
+
+    /** Whether the end of the stream was forwarded downstream. */
+    inline bool finished() const
+    {
+        return m_bFinished;
+    }
+
+private:
+    void flush();
+    void ended();
+
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "LogCache.h"
+
+static std::vector<std::string> makeLines(unsigned int first,
+        unsigned int last)
+{
+    std::vector<std::string> lines;
+    unsigned int i;
+    for(i = first; i < last; i++)
+    {
+        std::string line = "line ";
+        line += (char)('0' + i / 10);
+        line += (char)('0' + i % 10);
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+class LogCache_Test : public CppUnit::TestFixture {
+
+public:
+    void test_lookup()
+    {
+        LogCache cache(1 << 20);
+        cache.insert("net~relay", "#rezo", 10, makeLines(10, 20));
+        std::vector<std::string> lines;
+        CPPUNIT_ASSERT(cache.lookup("net~relay", "#rezo", 12, 15, &lines));
+        CPPUNIT_ASSERT(lines == makeLines(12, 15));
+        lines.clear();
+        CPPUNIT_ASSERT(!cache.lookup("net~relay", "#rezo", 5, 15, &lines));
+        CPPUNIT_ASSERT(!cache.lookup("net~relay", "#rezo", 15, 25, &lines));
+        CPPUNIT_ASSERT(!cache.lookup("net", "#rezo", 12, 15, &lines));
+        CPPUNIT_ASSERT(!cache.lookup("net~relay", "#other", 12, 15, &lines));
+        CPPUNIT_ASSERT(lines.empty());
+        CPPUNIT_ASSERT(cache.hits() == 1);
+        CPPUNIT_ASSERT(cache.misses() == 4);
+    }
+
+    void test_merge()
+    {
+        LogCache cache(1 << 20);
+        cache.insert("net", "#rezo", 10, makeLines(10, 20));
+        cache.insert("net", "#rezo", 30, makeLines(30, 40));
+        cache.insert("net", "#rezo", 20, makeLines(20, 25));
+        std::vector<std::string> lines;
+        CPPUNIT_ASSERT(cache.lookup("net", "#rezo", 10, 25, &lines));
+        CPPUNIT_ASSERT(lines == makeLines(10, 25));
+        lines.clear();
+        CPPUNIT_ASSERT(!cache.lookup("net", "#rezo", 10, 35, &lines));
+        cache.insert("net", "#rezo", 22, makeLines(22, 32));
+        CPPUNIT_ASSERT(cache.lookup("net", "#rezo", 10, 40, &lines));
+        CPPUNIT_ASSERT(lines == makeLines(10, 40));
+    }
+
+    void test_end()
+    {
+        LogCache cache(1 << 20);
+        cache.insert("net", "#rezo", 10, makeLines(10, 20), true);
+        std::vector<std::string> lines;
+        CPPUNIT_ASSERT(cache.lookup("net", "#rezo", 15, LogCache::END, &lines));
+        CPPUNIT_ASSERT(lines == makeLines(15, 20));
+        cache.appended("net", "#rezo");
+        CPPUNIT_ASSERT(!cache.lookup("net", "#rezo", 15, LogCache::END,
+                &lines));
+        lines.clear();
+        CPPUNIT_ASSERT(cache.lookup("net", "#rezo", 15, 20, &lines));
+        CPPUNIT_ASSERT(lines == makeLines(15, 20));
+        cache.invalidate("net", "#rezo");
+        CPPUNIT_ASSERT(!cache.lookup("net", "#rezo", 15, 20, &lines));
+        CPPUNIT_ASSERT(cache.size() == 0);
+    }
+
+    void test_eviction()
+    {
+        const size_t range_size = makeLines(0, 10).size()
+                * (sizeof(std::string) + 7);
+        LogCache cache(range_size * 2);
+        cache.insert("net", "#a", 0, makeLines(0, 10));
+        cache.insert("net", "#b", 0, makeLines(0, 10));
+        std::vector<std::string> lines;
+        CPPUNIT_ASSERT(cache.lookup("net", "#a", 0, 10, &lines));
+        cache.insert("net", "#c", 0, makeLines(0, 10));
+        CPPUNIT_ASSERT(cache.size() <= range_size * 2);
+        CPPUNIT_ASSERT(cache.lookup("net", "#a", 0, 10, &lines));
+        CPPUNIT_ASSERT(!cache.lookup("net", "#b", 0, 10, &lines));
+        CPPUNIT_ASSERT(cache.lookup("net", "#c", 0, 10, &lines));
+    }
+
+    CPPUNIT_TEST_SUITE(LogCache_Test);
+    CPPUNIT_TEST(test_lookup);
+    CPPUNIT_TEST(test_merge);
+    CPPUNIT_TEST(test_end);
+    CPPUNIT_TEST(test_eviction);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LogCache_Test);
@@ -0,0 +1,97 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "LogSearchIndex.h"
+
+#include <sstream>
+
+class LogSearchIndex_Test : public CppUnit::TestFixture {
+
+public:
+    void test_tokenize()
+    {
+        std::vector<std::string> tokens;
+        LogSearchIndex::tokenize(
+                "<@Remram[away]> Hello, WORLD!! see http://x.org  ",
+                &tokens);
+        CPPUNIT_ASSERT(tokens.size() == 7);
+        CPPUNIT_ASSERT(tokens[0] == "remram[away]");
+        CPPUNIT_ASSERT(tokens[1] == "hello");
+        CPPUNIT_ASSERT(tokens[2] == "world");
+        CPPUNIT_ASSERT(tokens[3] == "see");
+        CPPUNIT_ASSERT(tokens[4] == "http");
+        CPPUNIT_ASSERT(tokens[5] == "x");
+        CPPUNIT_ASSERT(tokens[6] == "org");
+    }
+
+    void test_search()
+    {
+        LogSearchIndex index;
+        index.addLine(LogPosition(0, 0), "<Remram> hello everyone");
+        index.addLine(LogPosition(0, 40), "<Zertrin> hello Remram");
+        index.addLine(LogPosition(1, 0), "<Remram> bye bye");
+        index.addLine(LogPosition(1, 17), "<TsCl> bye");
+
+        std::vector<LogPosition> r = index.search("remram");
+        CPPUNIT_ASSERT(r.size() == 3);
+        CPPUNIT_ASSERT(r[0] == LogPosition(0, 0));
+        CPPUNIT_ASSERT(r[1] == LogPosition(0, 40));
+        CPPUNIT_ASSERT(r[2] == LogPosition(1, 0));
+
+        r = index.search("Hello REMRAM");
+        CPPUNIT_ASSERT(r.size() == 2);
+        CPPUNIT_ASSERT(r[0] == LogPosition(0, 0));
+        CPPUNIT_ASSERT(r[1] == LogPosition(0, 40));
+
+        r = index.search("bye", 1);
+        CPPUNIT_ASSERT(r.size() == 1);
+        CPPUNIT_ASSERT(r[0] == LogPosition(1, 17));
+
+        CPPUNIT_ASSERT(index.search("nobody").empty());
+        CPPUNIT_ASSERT(index.search("hello bye").empty());
+        CPPUNIT_ASSERT(index.search("  ").empty());
+    }
+
+    void test_long_lists()
+    {
+        // Enough postings to go through several skip entries
+        LogSearchIndex index;
+        unsigned int i;
+        for(i = 0; i < 1000; i++)
+        {
+            std::ostringstream line;
+            line << "common line" << i;
+            if(i % 7 == 0)
+                line << " seven";
+            if(i % 11 == 0)
+                line << " eleven";
+            index.addLine(LogPosition(i / 100, (i % 100) * 80), line.str());
+        }
+        CPPUNIT_ASSERT(index.lines() == 1000);
+        CPPUNIT_ASSERT(index.search("common").size() == 1000);
+        std::vector<LogPosition> r = index.search("seven eleven common");
+        CPPUNIT_ASSERT(r.size() == 13);
+        for(i = 0; i < r.size(); i++)
+        {
+            unsigned int n = i * 77;
+            CPPUNIT_ASSERT(r[i] == LogPosition(n / 100, (n % 100) * 80));
+        }
+    }
+
+    void test_order()
+    {
+        LogSearchIndex index;
+        index.addLine(LogPosition(2, 10), "a");
+        index.addLine(LogPosition(2, 10), "b");
+        CPPUNIT_ASSERT_THROW(index.addLine(LogPosition(1, 50), "c"), LogError);
+    }
+
+    CPPUNIT_TEST_SUITE(LogSearchIndex_Test);
+    CPPUNIT_TEST(test_tokenize);
+    CPPUNIT_TEST(test_search);
+    CPPUNIT_TEST(test_long_lists);
+    CPPUNIT_TEST(test_order);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LogSearchIndex_Test);
@@ -0,0 +1,375 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "LogStream.h"
+
+#include <deque>
+#include <vector>
+
+class RecordingLink : public LogStreamLink {
+
+public:
+    std::vector<unsigned int> positions;
+    std::vector<std::string> lines;
+    unsigned int credit;
+    bool ended;
+    ELogStreamStatus status;
+    bool cancelled;
+    int streams;
+
+    RecordingLink()
+      : credit(0), ended(false), status(LOGSTREAM_COMPLETE),
+        cancelled(false), streams(0)
+    {
+    }
+
+    void sendLogData(const std::string &id, unsigned int position,
+            const std::string &line)
+    {
+        CPPUNIT_ASSERT(id == "42");
+        CPPUNIT_ASSERT(!ended);
+        positions.push_back(position);
+        lines.push_back(line);
+    }
+
+    void sendLogEnd(const std::string &id, ELogStreamStatus status_)
+    {
+        CPPUNIT_ASSERT(id == "42");
+        CPPUNIT_ASSERT(!ended);
+        ended = true;
+        status = status_;
+    }
+
+    void sendLogCredit(const std::string &id, unsigned int lines_)
+    {
+        CPPUNIT_ASSERT(id == "42");
+        credit += lines_;
+    }
+
+    void sendLogCancel(const std::string &id)
+    {
+        CPPUNIT_ASSERT(id == "42");
+        CPPUNIT_ASSERT(!cancelled);
+        cancelled = true;
+    }
+
+    void streamStarted(const std::string &id)
+    {
+        CPPUNIT_ASSERT(id == "42");
+        streams++;
+    }
+
+    void streamEnded(const std::string &id)
+    {
+        CPPUNIT_ASSERT(id == "42");
+        streams--;
+    }
+
+};
+
+/**
+ * A connection between two servers of a chain: lines go to the relay below,
+ * credit and cancels to the sender or relay above. Like on a real
+ * connection, messages are delivered later, by deliver().
+ */
+class ChainLink : public LogStreamLink {
+
+private:
+    enum EType { DATA, END, CREDIT, CANCEL };
+    struct Message {
+        EType type;
+        unsigned int value;
+        std::string line;
+    };
+    std::deque<Message> m_Messages;
+
+    void queue(EType type, unsigned int value,
+            const std::string &line = std::string())
+    {
+        Message m;
+        m.type = type;
+        m.value = value;
+        m.line = line;
+        m_Messages.push_back(m);
+    }
+
+public:
+    LogStreamRelay *downstream;
+    LogStreamSender *upstreamSender;
+    LogStreamRelay *upstreamRelay;
+    unsigned int cancels;
+    int streams;
+
+    ChainLink()
+      : downstream(NULL), upstreamSender(NULL), upstreamRelay(NULL),
+        cancels(0), streams(0)
+    {
+    }
+
+    void sendLogData(const std::string &, unsigned int position,
+            const std::string &line)
+    {
+        queue(DATA, position, line);
+    }
+
+    void sendLogEnd(const std::string &, ELogStreamStatus status)
+    {
+        queue(END, status);
+    }
+
+    void sendLogCredit(const std::string &, unsigned int lines)
+    {
+        queue(CREDIT, lines);
+    }
+
+    void sendLogCancel(const std::string &)
+    {
+        cancels++;
+        queue(CANCEL, 0);
+    }
+
+    void streamStarted(const std::string &)
+    {
+        streams++;
+    }
+
+    void streamEnded(const std::string &)
+    {
+        streams--;
+    }
+
+    /** Delivers the pending messages; returns false if there were none. */
+    bool deliver()
+    {
+        if(m_Messages.empty())
+            return false;
+        while(!m_Messages.empty())
+        {
+            Message m = m_Messages.front();
+            m_Messages.pop_front();
+            switch(m.type)
+            {
+            case DATA:
+                downstream->data(m.value, m.line);
+                break;
+            case END:
+                downstream->end((ELogStreamStatus)m.value);
+                break;
+            case CREDIT:
+                if(upstreamSender != NULL)
+                    upstreamSender->grant(m.value);
+                else
+                    upstreamRelay->credit(m.value);
+                break;
+            case CANCEL:
+                if(upstreamSender != NULL)
+                    upstreamSender->cancel();
+                else
+                    upstreamRelay->cancel();
+                break;
+            }
+        }
+        return true;
+    }
+
+};
+
+class LogStream_Test : public CppUnit::TestFixture {
+
+public:
+    void test_sender()
+    {
+        RecordingLink link;
+        LogStreamSender sender("42", &link, 2);
+        CPPUNIT_ASSERT(sender.push(10, "a"));
+        CPPUNIT_ASSERT(sender.push(11, "b"));
+        CPPUNIT_ASSERT(!sender.push(12, "c"));
+        CPPUNIT_ASSERT(link.lines.size() == 2);
+        sender.grant(5);
+        CPPUNIT_ASSERT(sender.push(12, "c"));
+        sender.finish();
+        CPPUNIT_ASSERT(!sender.push(13, "d"));
+        CPPUNIT_ASSERT(link.positions.size() == 3);
+        CPPUNIT_ASSERT(link.positions[2] == 12);
+        CPPUNIT_ASSERT(link.ended);
+        CPPUNIT_ASSERT(link.status == LOGSTREAM_COMPLETE);
+    }
+
+    void test_relay_slow_client()
+    {
+        RecordingLink client, server;
+        LogStreamRelay relay("42", &client, &server, 8, 2);
+
+        // The server sends its whole window; only 2 lines go through
+        unsigned int i;
+        for(i = 0; i < 8; i++)
+            CPPUNIT_ASSERT(relay.data(i, "line"));
+        CPPUNIT_ASSERT(client.lines.size() == 2);
+        CPPUNIT_ASSERT(relay.queued() == 6);
+        // It didn't get more than these 2 lines back
+        CPPUNIT_ASSERT(server.credit == 2);
+        CPPUNIT_ASSERT(relay.data(8, "line"));
+        CPPUNIT_ASSERT(relay.data(9, "line"));
+        // That's more than the window
+        CPPUNIT_ASSERT(!relay.data(10, "line"));
+        CPPUNIT_ASSERT(relay.queued() == 8);
+
+        relay.end(LOGSTREAM_COMPLETE);
+        CPPUNIT_ASSERT(!client.ended);
+        relay.credit(100);
+        CPPUNIT_ASSERT(client.lines.size() == 10);
+        for(i = 0; i < 10; i++)
+            CPPUNIT_ASSERT(client.positions[i] == i);
+        CPPUNIT_ASSERT(client.ended);
+        CPPUNIT_ASSERT(relay.finished());
+        CPPUNIT_ASSERT(relay.queued() == 0);
+    }
+
+    void test_relay_fast_client()
+    {
+        RecordingLink client, server;
+        LogStreamRelay relay("42", &client, &server, 8, 1000);
+        unsigned int i;
+        for(i = 0; i < 100; i++)
+        {
+            CPPUNIT_ASSERT(relay.data(i, "line"));
+            CPPUNIT_ASSERT(relay.queued() == 0);
+        }
+        CPPUNIT_ASSERT(client.lines.size() == 100);
+        // Credit is given back in batches
+        CPPUNIT_ASSERT(server.credit >= 100 - 8);
+        relay.end(LOGSTREAM_NOCONTENT);
+        CPPUNIT_ASSERT(client.ended);
+        CPPUNIT_ASSERT(client.status == LOGSTREAM_NOCONTENT);
+    }
+
+    void test_abort()
+    {
+        RecordingLink client, server;
+        LogStreamRelay relay("42", &client, &server, 8, 0);
+        CPPUNIT_ASSERT(relay.data(0, "line"));
+        relay.abort();
+        CPPUNIT_ASSERT(client.lines.empty());
+        CPPUNIT_ASSERT(client.ended);
+        CPPUNIT_ASSERT(client.status == LOGSTREAM_ABORTED);
+        CPPUNIT_ASSERT(!relay.data(1, "line"));
+        // The server is told to stop
+        CPPUNIT_ASSERT(server.cancelled);
+
+        // Once the server is done, there is nothing to cancel
+        RecordingLink client2, server2;
+        LogStreamRelay relay2("42", &client2, &server2, 8, 0);
+        CPPUNIT_ASSERT(relay2.data(0, "line"));
+        relay2.end(LOGSTREAM_COMPLETE);
+        relay2.abort();
+        CPPUNIT_ASSERT(client2.ended);
+        CPPUNIT_ASSERT(client2.status == LOGSTREAM_ABORTED);
+        CPPUNIT_ASSERT(!server2.cancelled);
+    }
+
+    void test_cancel()
+    {
+        RecordingLink link;
+        LogStreamSender sender("42", &link, 2);
+        CPPUNIT_ASSERT(sender.push(10, "a"));
+        sender.cancel();
+        CPPUNIT_ASSERT(sender.finished());
+        CPPUNIT_ASSERT(sender.credit() == 0);
+        CPPUNIT_ASSERT(link.streams == 0);
+        sender.grant(5);
+        CPPUNIT_ASSERT(!sender.push(11, "b"));
+        // No DLOGEND
+        sender.finish();
+        CPPUNIT_ASSERT(!link.ended);
+
+        // A relay forwards it upstream and drops what it has queued
+        RecordingLink client, server;
+        LogStreamRelay relay("42", &client, &server, 8, 0);
+        CPPUNIT_ASSERT(relay.data(0, "line"));
+        relay.cancel();
+        CPPUNIT_ASSERT(server.cancelled);
+        CPPUNIT_ASSERT(!client.ended);
+        CPPUNIT_ASSERT(relay.finished());
+        CPPUNIT_ASSERT(relay.queued() == 0);
+        CPPUNIT_ASSERT(client.streams == 0 && server.streams == 0);
+    }
+
+    void test_cancel_chain()
+    {
+        // sender -> relay1 -> relay2 -> client; the client goes away
+        ChainLink link1, link2;
+        RecordingLink client;
+        LogStreamSender sender("42", &link1, 4);
+        LogStreamRelay relay1("42", &link2, &link1, 4, 4);
+        LogStreamRelay relay2("42", &client, &link2, 4, 1);
+        link1.downstream = &relay1;
+        link1.upstreamSender = &sender;
+        link2.downstream = &relay2;
+        link2.upstreamRelay = &relay1;
+
+        unsigned int i;
+        for(i = 0; i < 4; i++)
+            CPPUNIT_ASSERT(sender.push(i, "line"));
+        while(link1.deliver() || link2.deliver())
+            ;
+        CPPUNIT_ASSERT(client.lines.size() == 1);
+        CPPUNIT_ASSERT(relay2.queued() == 3);
+
+        relay2.abort();
+        while(link1.deliver() || link2.deliver())
+            ;
+        CPPUNIT_ASSERT(client.ended);
+        CPPUNIT_ASSERT(client.status == LOGSTREAM_ABORTED);
+        CPPUNIT_ASSERT(link2.cancels == 1 && link1.cancels == 1);
+        CPPUNIT_ASSERT(relay1.finished());
+        CPPUNIT_ASSERT(sender.finished());
+        CPPUNIT_ASSERT(!sender.push(4, "line"));
+        CPPUNIT_ASSERT(link1.streams == 0 && link2.streams == 0);
+        CPPUNIT_ASSERT(client.streams == 0);
+    }
+
+    void test_streaming()
+    {
+        RecordingLink client, server;
+        {
+            LogStreamSender sender("42", &server, 2);
+            CPPUNIT_ASSERT(server.streams == 1);
+            sender.finish();
+            CPPUNIT_ASSERT(server.streams == 0);
+        }
+        CPPUNIT_ASSERT(server.streams == 0);
+        {
+            // Destroyed before the end
+            LogStreamSender sender("42", &server, 2);
+            CPPUNIT_ASSERT(server.streams == 1);
+        }
+        CPPUNIT_ASSERT(server.streams == 0);
+        {
+            LogStreamRelay relay("42", &client, &server, 8, 0);
+            CPPUNIT_ASSERT(client.streams == 1 && server.streams == 1);
+            CPPUNIT_ASSERT(relay.data(0, "line"));
+            relay.end(LOGSTREAM_COMPLETE);
+            // Still waiting for the client
+            CPPUNIT_ASSERT(client.streams == 1 && server.streams == 1);
+            relay.credit(1);
+            CPPUNIT_ASSERT(client.streams == 0 && server.streams == 0);
+        }
+        CPPUNIT_ASSERT(client.streams == 0 && server.streams == 0);
+        {
+            LogStreamRelay relay("42", &client, &server, 8, 0);
+        }
+        CPPUNIT_ASSERT(client.streams == 0 && server.streams == 0);
+    }
+
+    CPPUNIT_TEST_SUITE(LogStream_Test);
+    CPPUNIT_TEST(test_sender);
+    CPPUNIT_TEST(test_relay_slow_client);
+    CPPUNIT_TEST(test_relay_fast_client);
+    CPPUNIT_TEST(test_abort);
+    CPPUNIT_TEST(test_cancel);
+    CPPUNIT_TEST(test_cancel_chain);
+    CPPUNIT_TEST(test_streaming);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(LogStream_Test);
@@ -0,0 +1,205 @@
+#include "Poller.h"
+
+#include <map>
+#include <vector>
+
+#ifdef __WIN32__
+    #include <winsock2.h>
+#else
+    #include <sys/types.h>
+    #include <sys/select.h>
+    #include <sys/time.h>
+    #include <errno.h>
+    #include <poll.h>
+    #include <unistd.h>
+#endif
+
+#if defined(__linux__)
+    #include <sys/epoll.h>
+#endif
+
+
+/*============================================================================*/
+
+/**
+ * Backend using select(), available everywhere.
+ */
+class SelectPoller : public Poller {
+
+private:
+    std::map<unsigned long long, int> m_Sockets;
+
+public:
+    EType GetType() const
+    {
+        return SELECT;
+    }
+
+    void Add(int fd, unsigned long long id)
+    {
+        m_Sockets[id] = fd;
+    }
+
+    void Remove(int, unsigned long long id)
+    {
+        m_Sockets.erase(id);
+    }
+
+    size_t Wait(int timeout, unsigned long long *ready, size_t max)
+    {
+        if(m_Sockets.empty())
+            return 0; // No valid socket?
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        int greatest = -1;
+        std::map<unsigned long long, int>::const_iterator it;
+        for(it = m_Sockets.begin(); it != m_Sockets.end(); ++it)
+        {
+            FD_SET(it->second, &fds);
+            if(it->second > greatest)
+                greatest = it->second;
+        }
+
+        int ret;
+        if(timeout < 0)
+            ret = select(greatest + 1, &fds, NULL, NULL, NULL);
+        else
+        {
+            timeval tv;
+
+            tv.tv_sec = timeout/1000;
+            tv.tv_usec = (timeout % 1000) * 1000;
+
+            ret = select(greatest + 1, &fds, NULL, NULL, &tv);
+        }
+        if(ret <= 0)
+            return 0;
+
+        size_t count = 0;
+        for(it = m_Sockets.begin(); it != m_Sockets.end() && count < max;
+                ++it)
+            if(FD_ISSET(it->second, &fds))
+                ready[count++] = it->first;
+        return count;
+    }
+
+};
+
+
+/*============================================================================*/
+
+#ifdef __linux__
+
+/**
+ * Backend using epoll.
+ */
+class EpollPoller : public Poller {
+
+private:
+    int m_iEpoll;
+
+    EpollPoller(int epoll)
+      : m_iEpoll(epoll)
+    {
+    }
+
+public:
+    static EpollPoller *Create()
+    {
+        int epoll = epoll_create1(EPOLL_CLOEXEC);
+        if(epoll == -1)
+            return NULL;
+        return new EpollPoller(epoll);
+    }
+
+    ~EpollPoller()
+    {
+        close(m_iEpoll);
+    }
+
+    EType GetType() const
+    {
+        return EPOLL;
+    }
+
+    void Add(int fd, unsigned long long id)
+    {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = id;
+        epoll_ctl(m_iEpoll, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    void Remove(int fd, unsigned long long)
+    {
+        // Might fail if the socket was already closed, which removed it
+        struct epoll_event ev;
+        epoll_ctl(m_iEpoll, EPOLL_CTL_DEL, fd, &ev);
+    }
+
+    size_t Wait(int timeout, unsigned long long *ready, size_t max)
+    {
+        struct epoll_event events[64];
+        if(max > 64)
+            max = 64;
+        int ret = epoll_wait(m_iEpoll, events, max, timeout);
+        if(ret <= 0)
+            return 0;
+        int i;
+        for(i = 0; i < ret; i++)
+            ready[i] = events[i].data.u64;
+        return ret;
+    }
+
+};
+
+#endif
+
+
+/*============================================================================*/
+
+#if defined(__linux__)
+static const Poller::EType DEFAULT_TYPE = Poller::EPOLL;
+#else
+static const Poller::EType DEFAULT_TYPE = Poller::SELECT;
+#endif
+
+static Poller::EType s_ePreferred = DEFAULT_TYPE;
+
+Poller *Poller::Create(EType type)
+{
+    if(type == AUTO)
+        type = s_ePreferred;
+    Poller *poller = NULL;
+#ifdef __linux__
+    if(poller == NULL && type == EPOLL)
+        poller = EpollPoller::Create();
+#endif
+    if(poller == NULL)
+        poller = new SelectPoller;
+    return poller;
+}
+
+void Poller::SetPreferred(EType type)
+{
+    s_ePreferred = (type == AUTO)?DEFAULT_TYPE:type;
+}
+
+Poller::EType Poller::GetPreferred()
+{
+    return s_ePreferred;
+}
+
+const char *Poller::GetName(EType type)
+{
+    switch(type)
+    {
+    case SELECT:
+        return "select";
+    case EPOLL:
+        return "epoll";
+    default:
+        return "auto";
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <cstddef>
+
+/**
+ * The system mechanism used by a SocketSet to wait on its sockets.
+ *
+ * Sockets are registered once, with an identifier, and Wait() returns the
+ * identifiers of the sockets that can be read (or were closed). Readiness is
+ * level-triggered whatever the mechanism: a socket that still has data after
+ * being handled is returned again by the next Wait().
+ *
+ * Available backends:
+ *   - EPOLL (Linux, the default there): sockets are registered once in the
+ *     kernel;
+ *   - SELECT (everywhere): the set is rebuilt on each call.
+ */
+class Poller {
+
+public:
+    enum EType {
+        AUTO,       // The preferred backend, see SetPreferred()
+        SELECT,
+        EPOLL
+    };
+
+public:
+    virtual ~Poller() {}
+
+    virtual EType GetType() const = 0;
+
+    /** Starts watching a socket. */
+    virtual void Add(int fd, unsigned long long id) = 0;
+
+    /**
+     * Stops watching a socket.
+     *
+     * Must be called before the socket is closed.
+     */
+    virtual void Remove(int fd, unsigned long long id) = 0;
+
+    /**
+     * Waits for sockets to become readable.
+     *
+     * @param timeout Maximum time (in milliseconds) to wait. 0 returns
+     * immediately, and a negative value means to wait forever.
+     * @param ready Location where to write the identifiers of the ready
+     * sockets.
+     * @param max Size of 'ready'.
+     * @return The number of identifiers written, 0 on timeout.
+     */
+    virtual size_t Wait(int timeout, unsigned long long *ready,
+            size_t max) = 0;
+
+    /**
+     * Creates a poller.
+     *
+     * If the requested backend isn't available (old kernel, not the right
+     * system, forbidden by a sandbox, ...), falls back on SELECT, which
+     * always works.
+     */
+    static Poller *Create(EType type = AUTO);
+
+    /** Sets the backend used for AUTO. */
+    static void SetPreferred(EType type);
+
+    static EType GetPreferred();
+
+    /** Name of a backend, ie "epoll". */
+    static const char *GetName(EType type);
+
+};
+
+#endif
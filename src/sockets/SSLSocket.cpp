@@ -2,6 +2,18 @@
 
 #include <iostream>
 
+#ifndef __WIN32__
+    #include <unistd.h>
+#endif
+
+#include "common/Metrics.h"
+
+// Plaintext; the encrypted traffic isn't seen by TCPSocket, OpenSSL does the
+// system calls itself
+static Counter &bytesSent = Metrics::global().counter("ssl.bytes_sent");
+static Counter &bytesReceived =
+        Metrics::global().counter("ssl.bytes_received");
+
 SSLError::SSLError(const std::string &w)
   : m_w(w)
 {
@@ -185,15 +197,25 @@ SSLSocket::~SSLSocket()
     SSL_CTX_free(m_CTX);
 }
 
-SSLClient::SSLClient(int sock, SSLClient::ERole role, const SSLConfig &ctx)
+SSLClient::SSLClient(int sock, SSLClient::ERole role, const SSLConfig &ctx,
+    bool bHandshake)
     throw(SocketConnectionClosed, SSLError)
-  : SSLSocket(ctx), TCPSocket::TCPSocket(sock)
+  : SSLSocket(ctx), TCPSocket::TCPSocket(sock), m_eRole(role),
+    m_bHandshakeDone(false)
 {
     m_SSL = SSL_new(m_CTX);
     SSL_set_mode(m_SSL, SSL_MODE_AUTO_RETRY);
     m_BIO = BIO_new_socket(GetSocket(), BIO_NOCLOSE);
     SSL_set_bio(m_SSL, m_BIO, m_BIO);
-    switch(role)
+    if(bHandshake)
+        Handshake();
+}
+
+void SSLClient::Handshake() throw(SSLError)
+{
+    if(m_bHandshakeDone)
+        return;
+    switch(m_eRole)
     {
     case SSLClient::CLIENT:
         if(SSL_connect(m_SSL) < 0)
@@ -210,6 +232,7 @@ SSLClient::SSLClient(int sock, SSLClient::ERole role, const SSLConfig &ctx)
         }
         break;
     }
+    m_bHandshakeDone = true;
 }
 
 SSLClient *SSLClient::fromSocket(int sock, const SSLConfig &ctx)
@@ -224,6 +247,13 @@ SSLClient *SSLClient::fromSocket(TCPSocket *sock, const SSLConfig &ctx)
     return new SSLClient(Socket::Unlock(sock), SSLClient::CLIENT, ctx);
 }
 
+SSLClient *SSLClient::Prepare(TCPSocket *sock, SSLClient::ERole role,
+    const SSLConfig &ctx)
+    throw(SSLError)
+{
+    return new SSLClient(Socket::Unlock(sock), role, ctx, false);
+}
+
 SSLClient *SSLClient::Connect(const char *host, int port, const SSLConfig &ctx)
     throw(SocketUnknownHost, SocketConnectionRefused, SSLError)
 {
@@ -273,24 +303,72 @@ std::string SSLClient::getPeerCertCN() const
 void SSLClient::Send(const char *data, size_t size)
     throw(SocketConnectionClosed)
 {
-    SSL_write(m_SSL, data, size);
+    if(SSL_write(m_SSL, data, size) > 0)
+        bytesSent.add(size);
+}
+
+void SSLClient::SendV(const Chunk *chunks, size_t count)
+    throw(SocketConnectionClosed)
+{
+    // Maximum size of the plaintext in a TLS record
+    static const size_t RECORD_SIZE = 16384;
+    m_sRecord.reserve(RECORD_SIZE);
+    size_t i;
+    for(i = 0; i < count; i++)
+    {
+        const Chunk &chunk = chunks[i];
+        if(m_sRecord.size() + chunk.size > RECORD_SIZE && !m_sRecord.empty())
+        {
+            if(SSL_write(m_SSL, m_sRecord.data(), m_sRecord.size()) <= 0)
+            {
+                m_sRecord.clear();
+                throw SocketConnectionClosed();
+            }
+            bytesSent.add(m_sRecord.size());
+            m_sRecord.clear();
+        }
+        // Big chunks are written directly, OpenSSL splits them in records
+        if(chunk.size >= RECORD_SIZE)
+        {
+            if(SSL_write(m_SSL, chunk.data, chunk.size) <= 0)
+                throw SocketConnectionClosed();
+            bytesSent.add(chunk.size);
+        }
+        else
+            m_sRecord.append(chunk.data, chunk.size);
+    }
+    if(!m_sRecord.empty())
+    {
+        int ret = SSL_write(m_SSL, m_sRecord.data(), m_sRecord.size());
+        m_sRecord.clear();
+        if(ret <= 0)
+            throw SocketConnectionClosed();
+        bytesSent.add(ret);
+    }
 }
 
 int SSLClient::Recv(char *data, size_t size_max, bool bWait)
     throw(SocketConnectionClosed)
 {
-    if(bWait || Wait(0))
+    // Data might have been decrypted already, in which case the socket won't
+    // be readable
+    if(bWait || SSL_pending(m_SSL) > 0 || Wait(0))
     {
         int ln = SSL_read(m_SSL, data, size_max);
         if(ln <= 0)
             throw SocketConnectionClosed();
-        else
-            return ln;
+        bytesReceived.add(ln);
+        return ln;
     }
     else
         return 0;
 }
 
+bool SSLClient::HasPending() const
+{
+    return SSL_pending(m_SSL) > 0;
+}
+
 SSLClient::~SSLClient()
 {
     SSL_shutdown(m_SSL);
@@ -305,23 +383,54 @@ SSLServer::SSLServer(int sock, const SSLConfig &ctx)
 
 TCPSocket *SSLServer::Accept(int timeout)
 {
-    TCPSocket *sock = TCPServer::Accept(timeout);
-    if(sock == NULL)
-        return NULL;
-    else
-        return new SSLClient(Socket::Unlock(sock), SSLClient::SERVER, m_Config);
+    return Accept(timeout, false);
 }
 
 TCPSocket *SSLServer::Accept(int timeout, bool askForClientCert)
 {
-    TCPSocket *sock = TCPServer::Accept(timeout);
-    if(sock == NULL)
+    if(!Wait(timeout))
+        return NULL;
+    int sock = AcceptSocket();
+    if(sock == -1)
         return NULL;
     else if(askForClientCert)
-        return new SSLClient(Socket::Unlock(sock), SSLClient::SERVER_FORCE_CERT,
-                m_Config);
+        return new SSLClient(sock, SSLClient::SERVER_FORCE_CERT, m_Config);
+    else
+        return new SSLClient(sock, SSLClient::SERVER, m_Config);
+}
+
+SSLClient *SSLServer::AcceptDeferred(int timeout, bool askForClientCert)
+{
+    if(!Wait(timeout))
+        return NULL;
+    int sock = AcceptSocket();
+    if(sock == -1)
+        return NULL;
     else
-        return new SSLClient(Socket::Unlock(sock), SSLClient::SERVER, m_Config);
+        return new SSLClient(sock,
+                askForClientCert?SSLClient::SERVER_FORCE_CERT:SSLClient::SERVER,
+                m_Config, false);
+}
+
+TCPSocket *SSLServer::NewConnection(int sock)
+{
+    // No handshake here: AcceptAll() runs on an event loop, and a client that
+    // doesn't send anything would block it
+    try
+    {
+        return SSLClient::Prepare(new TCPSocket(sock), SSLClient::SERVER,
+                m_Config);
+    }
+    catch(SSLError &e)
+    {
+        // Thrown before the socket was taken over
+#ifndef __WIN32__
+        close(sock);
+#else
+        closesocket(sock);
+#endif
+        return NULL;
+    }
 }
 
 SSLServer::~SSLServer()
@@ -338,8 +447,10 @@ SSLServer *SSLServer::fromSocket(TCPServer *sock, const SSLConfig &ctx)
     return new SSLServer(Socket::Unlock(sock), ctx);
 }
 
-SSLServer *SSLServer::Listen(int port, const SSLConfig &ctx)
+SSLServer *SSLServer::Listen(int port, const SSLConfig &ctx, int backlog,
+        bool reusePort)
     throw(SocketCantUsePort)
 {
-    return new SSLServer(Socket::Unlock(TCPServer::Listen(port)), ctx);
+    return new SSLServer(
+            Socket::Unlock(TCPServer::Listen(port, backlog, reusePort)), ctx);
 }
@@ -18,6 +18,7 @@ public:
 };
 
 class SSLConfig;
+class SSLClient;
 
 class SSLSocket {
 
@@ -110,8 +111,11 @@ public:
 
     /**
      * Static method listening on a port.
+     *
+     * @see TCPServer::Listen()
      */
-    static SSLServer *Listen(int port, const SSLConfig &ctx = SSLConfig())
+    static SSLServer *Listen(int port, const SSLConfig &ctx = SSLConfig(),
+        int backlog = SOMAXCONN, bool reusePort = false)
         throw(SocketCantUsePort);
 
     /**
@@ -119,10 +123,31 @@ public:
      */
     ~SSLServer();
 
+    /**
+     * Accepts a connection and does the SSL handshake, blocking until it is
+     * done.
+     */
     TCPSocket *Accept(int timeout = 0);
 
     TCPSocket *Accept(int timeout, bool askForClientCert);
 
+    /**
+     * Accepts a connection without doing the SSL handshake.
+     *
+     * SSLClient::Handshake() has to be called on the returned socket before
+     * it can be used; this allows to do it in another thread.
+     */
+    SSLClient *AcceptDeferred(int timeout = 0, bool askForClientCert = false);
+
+protected:
+    /**
+     * Creates the SSLClient for an accepted socket, without doing the
+     * handshake: the connections returned by AcceptAll() have to be handed
+     * to a HandshakePool (or SSLClient::Handshake() called on them) before
+     * they can be used.
+     */
+    TCPSocket *NewConnection(int sock);
+
 };
 
 class SSLClient : public SSLSocket, public TCPSocket {
@@ -137,9 +162,15 @@ public:
 private:
     SSL *m_SSL;
     BIO *m_BIO;
+    ERole m_eRole;
+    bool m_bHandshakeDone;
+
+    // Buffer used by SendV() to coalesce chunks
+    std::string m_sRecord;
 
 protected:
-    SSLClient(int sock, ERole role, const SSLConfig &ctx = SSLConfig())
+    SSLClient(int sock, ERole role, const SSLConfig &ctx = SSLConfig(),
+        bool bHandshake = true)
         throw(SocketConnectionClosed, SSLError);
 
 public:
@@ -158,6 +189,17 @@ public:
         const SSLConfig &ctx = SSLConfig())
         throw(SocketConnectionClosed, SSLError);
 
+    /**
+     * Constructs a secure connection without doing the SSL handshake.
+     *
+     * Handshake() has to be called before the connection can be used. This
+     * allows to do this expensive step in another thread.
+     * @warning The given socket is destroyed.
+     */
+    static SSLClient *Prepare(TCPSocket *sock, ERole role = CLIENT,
+        const SSLConfig &ctx = SSLConfig())
+        throw(SSLError);
+
     /**
      * Static method establishing a new connection.
      *
@@ -185,6 +227,22 @@ public:
      */
     ~SSLClient();
 
+    /**
+     * Does the SSL handshake, if it wasn't done on construction.
+     *
+     * This doesn't touch anything but this object and its SSL context, so it
+     * can be called from a different thread than the one that created it.
+     */
+    void Handshake() throw(SSLError);
+
+    /**
+     * Indicates whether the handshake was done.
+     */
+    inline bool IsHandshakeDone() const
+    {
+        return m_bHandshakeDone;
+    }
+
     /**
      * Checks the certificate of the other machine.
      *
@@ -207,6 +265,15 @@ public:
      */
     void Send(const char *data, size_t size) throw(SocketConnectionClosed);
 
+    /**
+     * Sends several pieces of data.
+     *
+     * Small chunks are coalesced up to the maximum size of a TLS record, so
+     * that each record (and its overhead) carries as much data as possible.
+     */
+    void SendV(const Chunk *chunks, size_t count)
+        throw(SocketConnectionClosed);
+
     /**
      * Receives data.
      *
@@ -217,8 +284,13 @@ public:
     int Recv(char *donnees, size_t size_max, bool bWait = true)
         throw(SocketConnectionClosed);
 
+    /** Indicates whether OpenSSL holds decrypted data (SSL_pending()). */
+    bool HasPending() const;
+
     friend TCPSocket *SSLServer::Accept(int timeout = 0);
     friend TCPSocket *SSLServer::Accept(int timeout, bool askForClientCert);
+    friend SSLClient *SSLServer::AcceptDeferred(int timeout,
+        bool askForClientCert);
 
 };
 
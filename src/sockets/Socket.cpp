@@ -2,6 +2,10 @@
 
 #include <map>
 
+#ifndef __WIN32__
+    #include <poll.h>
+#endif
+
 const char *SocketFatalError::what()
 {
     return "Fatal error";
@@ -107,6 +111,14 @@ void Socket::Init() throw(SocketFatalError)
 
 bool Socket::Wait(int timeout) const
 {
+#ifndef __WIN32__
+    // Not select(): descriptors can be past FD_SETSIZE in a busy process
+    struct pollfd pfd;
+    pfd.fd = m_iSocket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, (timeout < 0)?-1:timeout) > 0;
+#else
     fd_set fds;
     FD_ZERO(&fds);
     FD_SET((SOCKET)m_iSocket, &fds);
@@ -124,6 +136,7 @@ bool Socket::Wait(int timeout) const
     }
 
     return FD_ISSET(m_iSocket, &fds);
+#endif
 }
 
 void Socket::RegisterSockets(SocketSetRegistrar *registrar)
@@ -158,120 +171,103 @@ const SockAddress *Socket::Resolve(const char *name, unsigned int types)
 
 /*============================================================================*/
 
-bool SocketSet::IsSet(Waitable *obj)
+SocketSetRegistrar::SocketSetRegistrar(SocketSet *set, Waitable *obj)
+  : m_pSet(set), m_Waitable(obj)
 {
-    std::set<Waitable*>::const_iterator it;
-    it = m_Set.find(obj);
-    return it != m_Set.end();
 }
 
-void SocketSet::Add(Waitable *obj)
+void SocketSetRegistrar::AddSocket(Socket *sock)
 {
-    if(!IsSet(obj))
-        m_Set.insert(obj);
+    m_pSet->AddSocket(m_Waitable, sock);
 }
 
-bool SocketSet::Remove(Waitable *obj)
+SocketSet::SocketSet(Poller::EType type)
+  : m_pPoller(Poller::Create(type)), m_iNextId(0)
 {
-    std::set<Waitable*>::iterator it;
-    it = m_Set.find(obj);
-    if(it != m_Set.end())
-    {
-        m_Set.erase(it);
-        return true;
-    }
-    else
-        return false;
 }
 
-void SocketSet::Clear()
+SocketSet::~SocketSet()
 {
-    m_Set.clear();
+    Clear();
+    delete m_pPoller;
 }
 
+bool SocketSet::IsSet(Waitable *obj)
+{
+    return m_Waitables.find(obj) != m_Waitables.end();
+}
 
-/*============================================================================*/
-
-class FDSetWrapper {
-
-private:
-    fd_set fds;
-    int greatest;
-    std::map<Socket*, Waitable*> registered_sockets;
-
-public:
-    FDSetWrapper();
-    void AddSocket(Waitable *obj, Socket *sock);
-    Waitable *Wait(int timeout);
+void SocketSet::Add(Waitable *obj)
+{
+    if(IsSet(obj))
+        return ;
+    m_Waitables[obj];
+    SocketSetRegistrar reg(this, obj);
+    obj->RegisterSockets(&reg);
+}
 
-};
+void SocketSet::AddSocket(Waitable *obj, Socket *sock)
+{
+    unsigned long long id = m_iNextId++;
+    Registration &registration = m_Registrations[id];
+    registration.obj = obj;
+    registration.fd = sock->GetSocket();
+    m_Waitables[obj].push_back(id);
+    m_pPoller->Add(registration.fd, id);
+}
 
-FDSetWrapper::FDSetWrapper()
+bool SocketSet::Remove(Waitable *obj)
 {
-    FD_ZERO(&fds);
-    greatest = -1;
+    std::map<Waitable*, std::vector<unsigned long long> >::iterator it;
+    it = m_Waitables.find(obj);
+    if(it == m_Waitables.end())
+        return false;
+    // Ready events left in m_Ready are dropped by Wait(), as their
+    // registration is gone
+    std::vector<unsigned long long>::const_iterator id;
+    for(id = it->second.begin(); id != it->second.end(); ++id)
+    {
+        std::map<unsigned long long, Registration>::iterator reg;
+        reg = m_Registrations.find(*id);
+        m_pPoller->Remove(reg->second.fd, *id);
+        m_Registrations.erase(reg);
+    }
+    m_Waitables.erase(it);
+    return true;
 }
 
-void FDSetWrapper::AddSocket(Waitable *obj, Socket *sock)
+void SocketSet::Clear()
 {
-    int s = sock->GetSocket();
-    if(s > greatest)
-        greatest = s;
-    registered_sockets[sock] = obj;
-    FD_SET((SOCKET)s, &fds);
+    while(!m_Waitables.empty())
+        Remove(m_Waitables.begin()->first);
+    m_Ready.clear();
 }
 
-Waitable *FDSetWrapper::Wait(int timeout)
+Waitable *SocketSet::Wait(int timeout)
 {
-    if(greatest == -1)
+    if(m_Registrations.empty())
         return NULL; // No valid socket?
 
-    if(timeout == -1)
-        select(greatest + 1, &fds, NULL, NULL, NULL);
-    else
+    if(m_Ready.empty())
     {
-        timeval tv;
-
-        tv.tv_sec = timeout/1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-
-        select(greatest + 1, &fds, NULL, NULL, &tv);
+        unsigned long long ready[64];
+        size_t count = m_pPoller->Wait(timeout, ready, 64);
+        m_Ready.insert(m_Ready.end(), ready, ready + count);
     }
 
-    std::map<Socket*, Waitable*>::const_iterator it;
-    it = registered_sockets.begin();
-    while(it != registered_sockets.end())
+    while(!m_Ready.empty())
     {
-        if(FD_ISSET(it->first->GetSocket(), &fds))
-            return it->second;
-        else
-            ++it;
+        std::map<unsigned long long, Registration>::const_iterator it;
+        it = m_Registrations.find(m_Ready.front());
+        m_Ready.pop_front();
+        if(it != m_Registrations.end())
+            return it->second.obj;
     }
 
     return NULL;
 }
 
-SocketSetRegistrar::SocketSetRegistrar(FDSetWrapper *wrapper, Waitable *obj)
-  : m_Wrapper(wrapper), m_Waitable(obj)
+Poller::EType SocketSet::GetPollerType() const
 {
-}
-
-void SocketSetRegistrar::AddSocket(Socket *sock)
-{
-    m_Wrapper->AddSocket(m_Waitable, sock);
-}
-
-Waitable *SocketSet::Wait(int timeout)
-{
-    FDSetWrapper fds;
-
-    std::set<Waitable*>::iterator it = m_Set.begin();
-    while(it != m_Set.end())
-    {
-        SocketSetRegistrar reg(&fds, *it);
-        (*it)->RegisterSockets(&reg);
-        ++it;
-    }
-
-    return fds.Wait(timeout);
+    return m_pPoller->GetType();
 }
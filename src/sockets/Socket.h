@@ -3,9 +3,14 @@
 
 #include <cstdio>
 #include <cstring>           /* For memset() */
+#include <deque>
 #include <exception>
+#include <map>
 #include <set>
 #include <sstream>
+#include <vector>
+
+#include "Poller.h"
 
 #ifdef __WIN32__
     #include <winsock2.h>
@@ -14,6 +19,7 @@
 #else
     #include <sys/types.h>
     #include <sys/socket.h>
+    #include <sys/uio.h>
     #include <sys/param.h>
     #include <netinet/in.h>
     #include <arpa/inet.h>
@@ -146,12 +152,60 @@ public:
 /*============================================================================*/
 
 class SocketSetRegistrar;
+class Flushable;
+
+/**
+ * Something that calls Flushable::Flush() later, typically an event loop at
+ * the end of its current iteration.
+ */
+class FlushScheduler {
+
+public:
+    virtual ~FlushScheduler() {}
+
+    /**
+     * Asks for obj->Flush() to be called once, soon.
+     *
+     * Should only be called once until the object is flushed.
+     */
+    virtual void ScheduleFlush(Flushable *obj) = 0;
+
+    /** Cancels a call to ScheduleFlush(), if the object is going away. */
+    virtual void CancelFlush(Flushable *obj) = 0;
+
+};
+
+/**
+ * An object buffering output, that is sent when flushed.
+ *
+ * This allows to send everything produced during one iteration of an event
+ * loop at once, with a single system call.
+ */
+class Flushable {
+
+public:
+    virtual ~Flushable() {}
+
+    /** Sends the buffered output. */
+    virtual void Flush() throw(SocketConnectionClosed) = 0;
+
+};
 
 class Waitable {
 
 public:
     virtual void RegisterSockets(SocketSetRegistrar *registrar) = 0;
 
+    /**
+     * Called by the event loop handling this object with the scheduler to
+     * use to defer output, or NULL when it is removed from the loop.
+     *
+     * Objects that don't buffer output can ignore it.
+     */
+    virtual void SetFlushScheduler(FlushScheduler*)
+    {
+    }
+
 };
 
 
@@ -228,16 +282,16 @@ public:
 
 /*============================================================================*/
 
-class FDSetWrapper;
+class SocketSet;
 
 class SocketSetRegistrar {
 
 private:
-    FDSetWrapper *m_Wrapper;
+    SocketSet *m_pSet;
     Waitable *m_Waitable;
 
 public:
-    SocketSetRegistrar(FDSetWrapper *wrapper, Waitable *obj);
+    SocketSetRegistrar(SocketSet *set, Waitable *obj);
     void AddSocket(Socket *sock);
 
 };
@@ -247,13 +301,39 @@ public:
  *
  * By putting several sockets in a SocketSet, we can put the process to sleep
  * until something happens to either one of them.
+ *
+ * The sockets of a Waitable are asked for (with RegisterSockets()) when it is
+ * added, and registered once with the system (see Poller).
  */
 class SocketSet {
 
 private:
-    std::set<Waitable*> m_Set;
+    struct Registration {
+        Waitable *obj;
+        int fd;
+    };
+
+    Poller *m_pPoller;
+    std::map<Waitable*, std::vector<unsigned long long> > m_Waitables;
+    std::map<unsigned long long, Registration> m_Registrations;
+    unsigned long long m_iNextId;
+    std::deque<unsigned long long> m_Ready;
+
+    SocketSet(const SocketSet&);
+    SocketSet &operator=(const SocketSet&);
+
+    void AddSocket(Waitable *obj, Socket *sock);
 
 public:
+    /**
+     * Constructor.
+     *
+     * @param type The system mechanism to use, see Poller::Create().
+     */
+    SocketSet(Poller::EType type = Poller::AUTO);
+
+    ~SocketSet();
+
     /**
      * Indicates whether a Waitable is already in this group.
      */
@@ -267,6 +347,7 @@ public:
     /**
      * Removes a Waitable from this group.
      *
+     * Must be done before its sockets are closed.
      * @return true If this Waitable was previously in the group, false
      * otherwise.
      */
@@ -280,6 +361,8 @@ public:
     /**
      * Waits for a change on the sockets of this group.
      *
+     * When several sockets are ready, they are returned by the next calls,
+     * without waiting again.
      * @param timeout Maximum time (in milliseconds) to wait for an event. 0
      * returns immediately, and a negative value means to wait forever.
      * @return NULL if no socket was modified, or one of the modified sockets if
@@ -287,6 +370,11 @@ public:
      */
     Waitable *Wait(int timeout = -1);
 
+    /** The mechanism in use, which might not be the one asked for. */
+    Poller::EType GetPollerType() const;
+
+    friend class SocketSetRegistrar;
+
 };
 
 
@@ -298,8 +386,17 @@ public:
  * This interface represents any type of bytestream, for instance a raw TCP
  * socket, a SSL transmission, the traversal of one or more proxies, ...
  */
+class TCPProfile;
+
 class NetStream : public virtual Waitable {
 
+public:
+    /** A piece of data, for SendV(). */
+    struct Chunk {
+        const char *data;
+        size_t size;
+    };
+
 public:
     virtual ~NetStream() {}
 
@@ -312,6 +409,20 @@ public:
     virtual void Send(const char *data, size_t size)
         throw(SocketConnectionClosed) = 0;
 
+    /**
+     * Sends several pieces of data, as if they were contiguous.
+     *
+     * Streams should implement this with a single system call when they can
+     * (writev()); the default calls Send() for each chunk.
+     */
+    virtual void SendV(const Chunk *chunks, size_t count)
+        throw(SocketConnectionClosed)
+    {
+        size_t i;
+        for(i = 0; i < count; i++)
+            Send(chunks[i].data, chunks[i].size);
+    }
+
     /**
      * Receives data.
      *
@@ -322,6 +433,27 @@ public:
     virtual int Recv(char *data, size_t size_max, bool bWait = true)
         throw(SocketConnectionClosed) = 0;
 
+    /**
+     * Indicates whether data was received and buffered by the stream itself,
+     * so that Recv() would return it immediately even if the underlying
+     * socket has nothing to read (ie decrypted data in a TLS session).
+     */
+    virtual bool HasPending() const
+    {
+        return false;
+    }
+
+    /**
+     * Changes the options of the underlying connection, if it has any.
+     *
+     * @return false if the stream isn't a TCP connection or some options
+     * couldn't be set.
+     */
+    virtual bool SetProfile(const TCPProfile &)
+    {
+        return false;
+    }
+
 };
 
 #endif
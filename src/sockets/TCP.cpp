@@ -1,17 +1,94 @@
 #include "TCP.h"
 
+#include "common/Metrics.h"
+
+#ifndef __WIN32__
+    #include <fcntl.h>
+    #include <netinet/tcp.h>
+#endif
+
+static Counter &bytesSent = Metrics::global().counter("net.bytes_sent");
+static Counter &bytesReceived =
+        Metrics::global().counter("net.bytes_received");
+static Counter &sendCalls = Metrics::global().counter("net.send_calls");
+static Counter &recvCalls = Metrics::global().counter("net.recv_calls");
+static Counter &accepted = Metrics::global().counter("net.accepted");
+static Counter &acceptDropped =
+        Metrics::global().counter("net.accept_dropped");
+
+/**
+ * Switches a socket between blocking and non-blocking mode.
+ */
+static bool SetBlocking(int sock, bool blocking)
+{
+#ifndef __WIN32__
+    int flags = fcntl(sock, F_GETFL, 0);
+    if(flags == -1)
+        return false;
+    if(blocking)
+        flags &= ~O_NONBLOCK;
+    else
+        flags |= O_NONBLOCK;
+    return fcntl(sock, F_SETFL, flags) == 0;
+#else
+    u_long mode = blocking?0:1;
+    return ioctlsocket(sock, FIONBIO, &mode) == 0;
+#endif
+}
+
+TCPProfile::TCPProfile(EPreset preset)
+  : noDelay(NOT_SET), sendBuffer(NOT_SET), recvBuffer(NOT_SET),
+    notSentLowat(NOT_SET), keepAliveIdle(NOT_SET),
+    keepAliveInterval(NOT_SET), keepAliveCount(NOT_SET)
+{
+    switch(preset)
+    {
+    case INTERACTIVE:
+        noDelay = 1;
+        notSentLowat = 16384;
+        break;
+    case BULK:
+        noDelay = 1;            // Lines are already batched by SendV()
+        sendBuffer = 1 << 20;
+        notSentLowat = 0x7FFFFFFF;
+        break;
+    case SYSTEM:
+        return ;
+    }
+    keepAliveIdle = 120;
+    keepAliveInterval = 30;
+    keepAliveCount = 4;
+}
+
+
+/*============================================================================*/
+
+/**
+ * Sets an integer option, unless it is NOT_SET.
+ */
+static bool SetOption(int sock, int level, int option, int value)
+{
+    if(value == TCPProfile::NOT_SET)
+        return true;
+    return setsockopt(sock, level, option, (const char*)&value,
+            sizeof(value)) == 0;
+}
+
 TCPSocket::TCPSocket(int sock)
   : Socket::Socket(sock)
 {
 }
 
-TCPSocket *TCPSocket::Connect(const SockAddress *dest, int port)
+TCPSocket *TCPSocket::Connect(const SockAddress *dest, int port,
+        const TCPProfile &profile)
     throw(SocketConnectionRefused)
 {
     if(dest->type() != SockAddress::V4)
         throw SocketConnectionRefused();
 
     TCPSocket *sock = new TCPSocket(socket(AF_INET, SOCK_STREAM, 0));
+    // Before connecting, so that the buffer sizes are used for the window
+    ApplyProfile(sock->GetSocket(), profile);
 
     struct sockaddr_in address;
     address.sin_family = AF_INET;
@@ -29,10 +106,12 @@ TCPSocket *TCPSocket::Connect(const SockAddress *dest, int port)
     return sock;
 }
 
-TCPSocket *TCPSocket::Connect(const char *host, int port)
+TCPSocket *TCPSocket::Connect(const char *host, int port,
+        const TCPProfile &profile)
     throw(SocketUnknownHost, SocketConnectionRefused)
 {
     TCPSocket *sock = new TCPSocket(socket(AF_INET, SOCK_STREAM, 0));
+    ApplyProfile(sock->GetSocket(), profile);
 
     // Hostname resolution
     struct sockaddr_in address;
@@ -63,18 +142,94 @@ void TCPSocket::Send(const char *data, size_t size)
     int ret = send(GetSocket(), data, size, 0);
     if(ret != (int)size)
         throw SocketConnectionClosed();
+    sendCalls.add();
+    bytesSent.add(size);
+}
+
+void TCPSocket::SendV(const Chunk *chunks, size_t count)
+    throw(SocketConnectionClosed)
+{
+    // Number of chunks passed to each system call; more than that is rare,
+    // and is sent in several calls
+    static const size_t MAX_CHUNKS = 64;
+#ifndef __WIN32__
+    struct iovec vec[MAX_CHUNKS];
+#else
+    WSABUF vec[MAX_CHUNKS];
+#endif
+    size_t first = 0;   // First chunk not completely sent
+    size_t offset = 0;  // What was sent of it
+    while(first < count)
+    {
+        size_t n;
+        for(n = 0; n < MAX_CHUNKS && first + n < count; n++)
+        {
+            const Chunk &chunk = chunks[first + n];
+            size_t skip = (n == 0)?offset:0;
+#ifndef __WIN32__
+            vec[n].iov_base = (void*)(chunk.data + skip);
+            vec[n].iov_len = chunk.size - skip;
+#else
+            vec[n].buf = (char*)(chunk.data + skip);
+            vec[n].len = chunk.size - skip;
+#endif
+        }
+
+#ifndef __WIN32__
+        ssize_t ret = writev(GetSocket(), vec, n);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0)
+            throw SocketConnectionClosed();
+        size_t sent = ret;
+#else
+        DWORD sent;
+        if(WSASend(GetSocket(), vec, n, &sent, 0, NULL, NULL) != 0
+         || sent == 0)
+            throw SocketConnectionClosed();
+#endif
+        sendCalls.add();
+        bytesSent.add(sent);
+
+        // Skip what was sent, the loop resumes in the middle of a chunk if
+        // the write was partial
+        while(first < count && sent >= chunks[first].size - offset)
+        {
+            sent -= chunks[first].size - offset;
+            offset = 0;
+            first++;
+        }
+        offset += sent;
+    }
 }
 
 int TCPSocket::Recv(char *data, size_t size_max, bool bWait)
     throw(SocketConnectionClosed)
 {
+#ifndef __WIN32__
+    // A non-blocking recv() tells us directly if nothing is available, no
+    // need for a select() first
+    if(!bWait)
+    {
+        int ln = recv(GetSocket(), data, size_max, MSG_DONTWAIT);
+        recvCalls.add();
+        if(ln < 0 && (errno == EAGAIN || errno == EWOULDBLOCK
+         || errno == EINTR))
+            return 0;
+        else if(ln <= 0)
+            throw SocketConnectionClosed();
+        bytesReceived.add(ln);
+        return ln;
+    }
+#endif
     if(bWait || Wait(0))
     {
         int ln = recv(GetSocket(), data, size_max, 0);
+        recvCalls.add();
         if(ln <= 0)
             throw SocketConnectionClosed();
-        else
-            return ln;
+        bytesReceived.add(ln);
+        return ln;
     }
     else
         return 0;
@@ -89,48 +244,230 @@ int TCPSocket::GetLocalPort() const
     return ntohs(address.sin_port);
 }
 
+bool TCPSocket::SetProfile(const TCPProfile &profile)
+{
+    return ApplyProfile(GetSocket(), profile);
+}
+
+bool TCPSocket::ApplyProfile(int sock, const TCPProfile &profile)
+{
+    bool ok = true;
+    ok &= SetOption(sock, IPPROTO_TCP, TCP_NODELAY, profile.noDelay);
+    ok &= SetOption(sock, SOL_SOCKET, SO_SNDBUF, profile.sendBuffer);
+    ok &= SetOption(sock, SOL_SOCKET, SO_RCVBUF, profile.recvBuffer);
+#ifdef TCP_NOTSENT_LOWAT
+    ok &= SetOption(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT,
+            profile.notSentLowat);
+#endif
+    if(profile.keepAliveIdle != TCPProfile::NOT_SET)
+    {
+        ok &= SetOption(sock, SOL_SOCKET, SO_KEEPALIVE,
+                (profile.keepAliveIdle > 0)?1:0);
+        if(profile.keepAliveIdle > 0)
+        {
+            // The timers are only available on some systems; Windows uses
+            // SIO_KEEPALIVE_VALS, which we don't bother with
+#if defined(TCP_KEEPIDLE)
+            ok &= SetOption(sock, IPPROTO_TCP, TCP_KEEPIDLE,
+                    profile.keepAliveIdle);
+#elif defined(TCP_KEEPALIVE)
+            ok &= SetOption(sock, IPPROTO_TCP, TCP_KEEPALIVE,
+                    profile.keepAliveIdle);
+#endif
+#ifdef TCP_KEEPINTVL
+            ok &= SetOption(sock, IPPROTO_TCP, TCP_KEEPINTVL,
+                    profile.keepAliveInterval);
+#endif
+#ifdef TCP_KEEPCNT
+            ok &= SetOption(sock, IPPROTO_TCP, TCP_KEEPCNT,
+                    profile.keepAliveCount);
+#endif
+        }
+    }
+    return ok;
+}
+
 /*============================================================================*/
 
 TCPServer::TCPServer(int sock)
-  : Socket::Socket(sock)
+  : Socket::Socket(sock), m_ClientProfile(TCPProfile::INTERACTIVE),
+    m_iSpareFd(-1)
 {
+    OpenSpareFd();
 }
 
-TCPServer *TCPServer::Listen(int port) throw(SocketCantUsePort)
+TCPServer::~TCPServer()
+{
+#ifndef __WIN32__
+    if(m_iSpareFd != -1)
+        close(m_iSpareFd);
+#endif
+}
+
+void TCPServer::OpenSpareFd()
+{
+#ifndef __WIN32__
+    m_iSpareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+#endif
+}
+
+TCPServer *TCPServer::Listen(int port, int backlog, bool reusePort)
+    throw(SocketCantUsePort)
 {
     TCPServer *sock = new TCPServer(socket(AF_INET, SOCK_STREAM, 0));
 
+#ifndef __WIN32__
+    // Allows to restart right away, while connections of the previous process
+    // are still in TIME_WAIT (on Windows, this would allow to steal the port)
+    int on = 1;
+    setsockopt(sock->GetSocket(), SOL_SOCKET, SO_REUSEADDR,
+            (const char*)&on, sizeof(on));
+#endif
+    if(reusePort)
+    {
+#ifdef SO_REUSEPORT
+        int on = 1;
+        if(setsockopt(sock->GetSocket(), SOL_SOCKET, SO_REUSEPORT,
+                (const char*)&on, sizeof(on)) == -1)
+#endif
+        {
+            delete sock;
+            throw SocketCantUsePort();
+        }
+    }
+
     struct sockaddr_in sin;
     sin.sin_addr.s_addr = INADDR_ANY;
     sin.sin_family = AF_INET;
     sin.sin_port = htons(port);
 
     if( (bind(sock->GetSocket(), (struct sockaddr*)&sin, sizeof(sin) ) == -1)
-     || (listen(sock->GetSocket(), 5) == -1) )
+     || (listen(sock->GetSocket(), backlog) == -1)
+     || !SetBlocking(sock->GetSocket(), false) )
+    {
+        delete sock;
         throw SocketCantUsePort();
+    }
 
     return sock;
 }
 
+bool TCPServer::CanReusePort()
+{
+#ifdef SO_REUSEPORT
+    return true;
+#else
+    return false;
+#endif
+}
+
 TCPSocket *TCPServer::Accept(int timeout)
 {
     if(Wait(timeout))
     {
-        struct sockaddr_in clientsin;
-        socklen_t taille = sizeof(clientsin);
-        int sock = accept(GetSocket(), (struct sockaddr*)&clientsin, &taille);
-
+        int sock = AcceptSocket();
+        // Can be -1 if the client went away, or if another thread took it
         if(sock != -1)
-            return new TCPSocket(sock);
-        else
+            return NewConnection(sock);
+    }
+
+    return NULL;
+}
+
+size_t TCPServer::AcceptAll(std::vector<TCPSocket*> *sockets, size_t max)
+{
+    size_t count = 0;
+    while(count < max)
+    {
+        int sock = AcceptSocket();
+        if(sock == -1)
+            break;
+        TCPSocket *conn = NewConnection(sock);
+        if(conn == NULL)
+            continue;
+        sockets->push_back(conn);
+        count++;
+    }
+    return count;
+}
+
+int TCPServer::AcceptSocket()
+{
+#if defined(__linux__)
+    // accept4() doesn't make the new socket inherit O_NONBLOCK
+    int sock = accept4(GetSocket(), NULL, NULL, SOCK_CLOEXEC);
+    if(sock != -1)
+    {
+        accepted.add();
+        TCPSocket::ApplyProfile(sock, m_ClientProfile);
+        return sock;
+    }
+#else
+    int sock = accept(GetSocket(), NULL, NULL);
+    if(sock != -1)
+    {
+        // Other systems copy the non-blocking flag of the server
+        accepted.add();
+        SetBlocking(sock, true);
+        TCPSocket::ApplyProfile(sock, m_ClientProfile);
+        return sock;
+    }
+#endif
+
+#ifndef __WIN32__
+    switch(errno)
+    {
+    case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+    case EWOULDBLOCK:
+#endif
+    case EINTR:
+    case ECONNABORTED:
+    case EPROTO:
+    case ENOBUFS:
+    case ENOMEM:
+        return -1;
+    // Out of file descriptors: the connection would stay in the queue, so
+    // use the spare descriptor to take it and close it
+    case EMFILE:
+    case ENFILE:
+        if(m_iSpareFd != -1)
         {
-            // Shoudln't happen! Did someone close our socket?
-            throw SocketFatalError();
-            return NULL;
+            close(m_iSpareFd);
+            int dropped = accept(GetSocket(), NULL, NULL);
+            if(dropped != -1)
+            {
+                close(dropped);
+                acceptDropped.add();
+            }
         }
+        // Can fail if another thread took the descriptor; tried again on
+        // the next call
+        OpenSpareFd();
+        return -1;
+    }
+#else
+    switch(WSAGetLastError())
+    {
+    case WSAEWOULDBLOCK:
+    case WSAECONNRESET:
+    case WSAEMFILE:
+    case WSAENOBUFS:
+        return -1;
     }
+#endif
+    // Shouldn't happen! Did someone close our socket?
+    throw SocketFatalError();
+}
 
-    return NULL;
+void TCPServer::SetClientProfile(const TCPProfile &profile)
+{
+    m_ClientProfile = profile;
+}
+
+TCPSocket *TCPServer::NewConnection(int sock)
+{
+    return new TCPSocket(sock);
 }
 
 int TCPServer::GetLocalPort() const
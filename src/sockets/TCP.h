@@ -3,6 +3,52 @@
 
 #include "Socket.h"
 
+#include <vector>
+
+
+/*============================================================================*/
+
+/**
+ * Options of a TCP connection.
+ *
+ * Fields set to NOT_SET are left as they are (system default, or whatever was
+ * set before). The presets suit the two kinds of traffic we have:
+ *   - INTERACTIVE: IRC lines, which must go out right away (no Nagle
+ *     delay), and little unsent data in the kernel so that the lines written
+ *     last don't wait behind a large queue;
+ *   - BULK: log replay, with a large send buffer and no limit on unsent data.
+ * Both enable keepalive, so that dead peers are noticed.
+ *
+ * A connection can switch profiles while it is open, see
+ * TCPSocket::SetProfile(); note that buffer sizes are not changed back when
+ * switching from BULK to INTERACTIVE (the system doesn't allow to restore its
+ * automatic sizing), only the limit on unsent data is.
+ */
+class TCPProfile {
+
+public:
+    enum EPreset {
+        SYSTEM,         // Don't change anything
+        INTERACTIVE,
+        BULK
+    };
+
+    static const int NOT_SET = -1;
+
+public:
+    int noDelay;            // TCP_NODELAY (0 or 1)
+    int sendBuffer;         // SO_SNDBUF, in bytes
+    int recvBuffer;         // SO_RCVBUF, in bytes
+    int notSentLowat;       // TCP_NOTSENT_LOWAT, in bytes (Linux, Mac OS)
+    int keepAliveIdle;      // Seconds before the first probe, 0 to disable
+    int keepAliveInterval;  // Seconds between probes
+    int keepAliveCount;     // Probes before dropping the connection
+
+public:
+    TCPProfile(EPreset preset = SYSTEM);
+
+};
+
 
 /*============================================================================*/
 
@@ -26,8 +72,10 @@ public:
      *
      * @param hote Hostname, for instance "www.debian.com".
      * @param port Port number on which to connect.
+     * @param profile Options of the connection, set before connecting.
      */
-    static TCPSocket *Connect(const char *host, int port)
+    static TCPSocket *Connect(const char *host, int port,
+        const TCPProfile &profile = TCPProfile(TCPProfile::INTERACTIVE))
         throw(SocketUnknownHost, SocketConnectionRefused);
 
     /**
@@ -35,8 +83,10 @@ public:
      *
      * @param dest Destination address.
      * @param port Port number on which to connect.
+     * @param profile Options of the connection, set before connecting.
      */
-    static TCPSocket *Connect(const SockAddress *dest, int port)
+    static TCPSocket *Connect(const SockAddress *dest, int port,
+        const TCPProfile &profile = TCPProfile(TCPProfile::INTERACTIVE))
         throw(SocketConnectionRefused);
 
     /**
@@ -47,6 +97,12 @@ public:
      */
     virtual void Send(const char *data, size_t size) throw(SocketConnectionClosed);
 
+    /**
+     * Sends several pieces of data, with writev() (WSASend() on Windows).
+     */
+    virtual void SendV(const Chunk *chunks, size_t count)
+        throw(SocketConnectionClosed);
+
     /**
      * Receives data.
      *
@@ -62,6 +118,18 @@ public:
      */
     int GetLocalPort() const;
 
+    /**
+     * Changes the options of the connection.
+     *
+     * @return false if some of the options couldn't be set; the others were.
+     */
+    virtual bool SetProfile(const TCPProfile &profile);
+
+    /**
+     * Sets options on a socket.
+     */
+    static bool ApplyProfile(int sock, const TCPProfile &profile);
+
 };
 
 
@@ -70,25 +138,48 @@ public:
 /**
  * A TCP server socket.
  *
- * Allows to listen on a port and accept TCP connections.
+ * Allows to listen on a port and accept TCP connections. The listening socket
+ * is non-blocking, so that pending connections can be drained with
+ * AcceptAll() when it becomes readable; the accepted sockets are blocking.
  */
 class TCPServer : public Socket {
 
+public:
+    /** Maximum number of connections taken by a call to AcceptAll(). */
+    static const size_t ACCEPT_BATCH = 64;
+
+private:
+    TCPProfile m_ClientProfile;
+    // Kept open to free a descriptor when they run out, see AcceptSocket()
+    int m_iSpareFd;
+
 public:
     /**
      * Constructor from a socket already listening on a port.
      */
     TCPServer(int sock);
 
-    virtual ~TCPServer() {}
+    virtual ~TCPServer();
 
     /**
      * Static method creating a server socket listening on a given port number.
      *
      * @param port Port number on which to listen for connections, or 0 for a
      * random port number.
+     * @param backlog Length of the queue of connections waiting to be
+     * accepted; the system might lower it (see somaxconn on Linux).
+     * @param reusePort Sets SO_REUSEPORT, so that several servers (one per
+     * thread) can listen on the same port, the system spreading the
+     * connections between them. Throws if the system doesn't support it, see
+     * CanReusePort().
      */
-    static TCPServer *Listen(int port) throw(SocketCantUsePort);
+    static TCPServer *Listen(int port, int backlog = SOMAXCONN,
+        bool reusePort = false) throw(SocketCantUsePort);
+
+    /**
+     * Indicates whether Listen() supports reusePort on this system.
+     */
+    static bool CanReusePort();
 
     /**
      * Accepts one connection from a client.
@@ -100,11 +191,57 @@ public:
      */
     virtual TCPSocket *Accept(int timeout = 0);
 
+    /**
+     * Accepts all the pending connections, without waiting.
+     *
+     * Meant to be called when the server is returned by a SocketSet: a single
+     * readiness event can stand for a lot of connections, when many clients
+     * (re)connect at once.
+     *
+     * @param sockets Vector to which the new connections are appended.
+     * @param max Maximum number of connections to accept; the others stay in
+     * the queue and will be returned by the next call.
+     * @return The number of connections accepted.
+     */
+    size_t AcceptAll(std::vector<TCPSocket*> *sockets,
+        size_t max = ACCEPT_BATCH);
+
     /**
      * Gets the local port to which this socket is bound, or -1.
      */
     int GetLocalPort() const;
 
+    /**
+     * Sets the options of the connections accepted from now on; INTERACTIVE
+     * by default.
+     */
+    void SetClientProfile(const TCPProfile &profile);
+
+protected:
+    /**
+     * Accepts a pending connection, if any.
+     *
+     * When the process is out of file descriptors, the connection is
+     * accepted with a spare descriptor and closed right away: left in the
+     * queue, it would keep the server readable, and an event loop would spin
+     * until descriptors are freed.
+     *
+     * @return The new socket, or -1 if no connection is waiting (or one was
+     * dropped).
+     */
+    int AcceptSocket();
+
+private:
+    void OpenSpareFd();
+
+    /**
+     * Creates the object for a newly accepted socket.
+     *
+     * @return The connection, or NULL if it couldn't be set up, in which case
+     * the socket has been closed.
+     */
+    virtual TCPSocket *NewConnection(int sock);
+
 };
 
 #endif
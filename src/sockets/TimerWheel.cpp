@@ -0,0 +1,206 @@
+#include "TimerWheel.h"
+
+#include <climits>
+
+TimerLink::TimerLink()
+  : m_pPrev(this), m_pNext(this)
+{
+}
+
+
+/*============================================================================*/
+
+Timer::Timer()
+  : m_pWheel(NULL), m_iExpiry(0), m_iLevel(0)
+{
+}
+
+Timer::~Timer()
+{
+    Cancel();
+}
+
+void Timer::Cancel()
+{
+    if(m_pWheel != NULL)
+    {
+        TimerWheel::Unlink(this);
+        m_pWheel->m_iCount--;
+        m_pWheel->m_iLevelCount[m_iLevel]--;
+        m_pWheel = NULL;
+    }
+}
+
+
+/*============================================================================*/
+
+TimerWheel::TimerWheel(unsigned long long now, unsigned int tick)
+  : m_iTickMs((tick > 0)?tick:1), m_iOrigin(now), m_iNow(0), m_iCount(0)
+{
+    unsigned int level;
+    for(level = 0; level < LEVELS; level++)
+        m_iLevelCount[level] = 0;
+}
+
+TimerWheel::~TimerWheel()
+{
+    unsigned int level, slot;
+    for(level = 0; level < LEVELS; level++)
+        for(slot = 0; slot < SLOTS; slot++)
+        {
+            TimerLink *head = &m_Slots[level][slot];
+            while(head->m_pNext != head)
+                static_cast<Timer*>(head->m_pNext)->Cancel();
+        }
+}
+
+void TimerWheel::Schedule(Timer *timer, unsigned long long delay)
+{
+    timer->Cancel();
+
+    static const unsigned long long max_ticks =
+        (1ULL << (SLOT_BITS * LEVELS)) - 1;
+    unsigned long long ticks = (delay + m_iTickMs - 1) / m_iTickMs;
+    if(ticks == 0)
+        ticks = 1;
+    else if(ticks > max_ticks)
+        ticks = max_ticks;
+
+    timer->m_iExpiry = m_iNow + ticks;
+    timer->m_pWheel = this;
+    m_iCount++;
+    Insert(timer);
+}
+
+void TimerWheel::Insert(Timer *timer)
+{
+    unsigned long long delta = timer->m_iExpiry - m_iNow;
+    unsigned int level = 0;
+    while(level < LEVELS - 1 && delta >> (SLOT_BITS * (level + 1)) != 0)
+        level++;
+    unsigned int slot = (timer->m_iExpiry >> (SLOT_BITS * level))
+            & (SLOTS - 1);
+    timer->m_iLevel = level;
+    m_iLevelCount[level]++;
+
+    TimerLink *head = &m_Slots[level][slot];
+    TimerLink *link = timer;
+    link->m_pNext = head;
+    link->m_pPrev = head->m_pPrev;
+    head->m_pPrev->m_pNext = link;
+    head->m_pPrev = link;
+}
+
+void TimerWheel::Unlink(TimerLink *link)
+{
+    link->m_pPrev->m_pNext = link->m_pNext;
+    link->m_pNext->m_pPrev = link->m_pPrev;
+    link->m_pPrev = link->m_pNext = link;
+}
+
+void TimerWheel::Cascade(unsigned int level)
+{
+    unsigned int slot = (m_iNow >> (SLOT_BITS * level)) & (SLOTS - 1);
+    TimerLink *head = &m_Slots[level][slot];
+    TimerLink list;
+    if(head->m_pNext == head)
+        return;
+
+    // Take the whole list out of the slot, then re-insert each timer
+    list.m_pNext = head->m_pNext;
+    list.m_pPrev = head->m_pPrev;
+    list.m_pNext->m_pPrev = &list;
+    list.m_pPrev->m_pNext = &list;
+    head->m_pNext = head->m_pPrev = head;
+    while(list.m_pNext != &list)
+    {
+        Timer *timer = static_cast<Timer*>(list.m_pNext);
+        Unlink(timer);
+        m_iLevelCount[level]--;
+        Insert(timer);
+    }
+}
+
+unsigned int TimerWheel::Advance(unsigned long long now)
+{
+    unsigned long long target = 0;
+    if(now > m_iOrigin)
+        target = (now - m_iOrigin) / m_iTickMs;
+
+    unsigned int fired = 0;
+    while(m_iNow < target)
+    {
+        if(m_iCount == 0)
+        {
+            m_iNow = target;
+            break;
+        }
+
+        // Skip the ticks where nothing can happen: if the lower levels are
+        // empty, go straight to the next cascade of the first one that isn't
+        unsigned int lowest = 0;
+        while(m_iLevelCount[lowest] == 0)
+            lowest++;
+        if(lowest > 0)
+        {
+            unsigned int shift = SLOT_BITS * lowest;
+            unsigned long long skip = (((m_iNow >> shift) + 1) << shift) - 1;
+            if(skip > m_iNow)
+            {
+                m_iNow = (skip < target)?skip:target;
+                continue;
+            }
+        }
+
+        m_iNow++;
+
+        // Redistribute the timers from the upper levels
+        unsigned int level = 1;
+        while(level < LEVELS
+         && (m_iNow & ((1ULL << (SLOT_BITS * level)) - 1)) == 0)
+        {
+            Cascade(level);
+            level++;
+        }
+
+        TimerLink *head = &m_Slots[0][m_iNow & (SLOTS - 1)];
+        while(head->m_pNext != head)
+        {
+            Timer *timer = static_cast<Timer*>(head->m_pNext);
+            timer->Cancel();
+            timer->Expired();
+            fired++;
+        }
+    }
+    return fired;
+}
+
+int TimerWheel::NextTimeout() const
+{
+    if(m_iCount == 0)
+        return -1;
+
+    unsigned long long best = ~0ULL;
+    unsigned int level;
+    for(level = 0; level < LEVELS; level++)
+    {
+        unsigned int shift = SLOT_BITS * level;
+        unsigned long long current = m_iNow >> shift;
+        unsigned int j;
+        for(j = 1; j <= SLOTS; j++)
+        {
+            const TimerLink *head =
+                &m_Slots[level][(current + j) & (SLOTS - 1)];
+            if(head->m_pNext != head)
+            {
+                unsigned long long ticks = ((current + j) << shift) - m_iNow;
+                if(ticks < best)
+                    best = ticks;
+                break;
+            }
+        }
+    }
+
+    unsigned long long ms = best * m_iTickMs;
+    return (ms > INT_MAX)?INT_MAX:(int)ms;
+}
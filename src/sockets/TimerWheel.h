@@ -0,0 +1,153 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <cstddef>
+
+class TimerWheel;
+
+/**
+ * Links of the doubly-linked lists of a TimerWheel.
+ */
+class TimerLink {
+
+protected:
+    TimerLink *m_pPrev;
+    TimerLink *m_pNext;
+
+    TimerLink();
+
+    friend class TimerWheel;
+
+};
+
+/**
+ * A timer, that can be armed on a TimerWheel.
+ *
+ * Subclass it and implement Expired(). A timer is either disarmed, or armed
+ * on a single wheel; arming it again moves its expiry. Destroying an armed
+ * timer cancels it.
+ */
+class Timer : private TimerLink {
+
+private:
+    TimerWheel *m_pWheel;
+    unsigned long long m_iExpiry;
+    unsigned int m_iLevel;
+
+public:
+    Timer();
+    virtual ~Timer();
+
+    /**
+     * Called when the timer expires.
+     *
+     * The timer is disarmed at this point, so it can be armed again from
+     * there.
+     */
+    virtual void Expired() = 0;
+
+    /** Disarms the timer, if it is armed. */
+    void Cancel();
+
+    /** Indicates whether the timer is armed. */
+    inline bool IsArmed() const
+    {
+        return m_pWheel != NULL;
+    }
+
+    friend class TimerWheel;
+
+};
+
+/**
+ * A hierarchical timing wheel.
+ *
+ * Timers are put in a slot of the first level if they expire in less than
+ * SLOTS ticks, of the second level if they expire in less than SLOTS^2
+ * ticks, and so on; when the first level wraps around, the timers of the
+ * next slot of the second level are redistributed on the first level. This
+ * makes arming and cancelling a timer O(1), and advancing the time O(1) per
+ * tick plus the timers that expire.
+ *
+ * The wheel doesn't read the clock itself: the owner (the event loop) calls
+ * Advance() with the current time, and uses NextTimeout() to know how long
+ * it can sleep.
+ */
+class TimerWheel {
+
+public:
+    static const unsigned int SLOT_BITS = 6;
+    static const unsigned int SLOTS = 1 << SLOT_BITS;
+    static const unsigned int LEVELS = 5;
+
+private:
+    const unsigned int m_iTickMs;
+    unsigned long long m_iOrigin;
+    unsigned long long m_iNow;
+    size_t m_iCount;
+    size_t m_iLevelCount[LEVELS];
+    TimerLink m_Slots[LEVELS][SLOTS];
+
+public:
+    /**
+     * Constructor.
+     *
+     * @param now Current time, in milliseconds.
+     * @param tick Resolution of the wheel, in milliseconds.
+     */
+    TimerWheel(unsigned long long now, unsigned int tick = 1);
+
+    /**
+     * Destructor: disarms the timers that are still armed.
+     */
+    ~TimerWheel();
+
+    /**
+     * Arms a timer.
+     *
+     * @param delay Time (in milliseconds) after which the timer expires,
+     * counted from the last call to Advance(). Rounded up to the resolution
+     * of the wheel, with a minimum of one tick.
+     */
+    void Schedule(Timer *timer, unsigned long long delay);
+
+    /**
+     * Makes the time advance, calling Expired() on the timers that expired.
+     *
+     * @param now Current time, in milliseconds.
+     * @return The number of timers that expired.
+     */
+    unsigned int Advance(unsigned long long now);
+
+    /**
+     * Returns the time to wait for the next timer.
+     *
+     * @return A delay in milliseconds, suitable as a timeout for
+     * SocketSet::Wait(), or -1 if no timer is armed. It can be shorter than
+     * the actual time before the next expiry (when timers have to be moved
+     * between levels), but never longer.
+     */
+    int NextTimeout() const;
+
+    /** Number of armed timers. */
+    inline size_t Count() const
+    {
+        return m_iCount;
+    }
+
+    /** The time of the last call to Advance(), in milliseconds. */
+    inline unsigned long long Now() const
+    {
+        return m_iOrigin + m_iNow * m_iTickMs;
+    }
+
+private:
+    void Insert(Timer *timer);
+    static void Unlink(TimerLink *link);
+    void Cascade(unsigned int level);
+
+    friend class Timer;
+
+};
+
+#endif
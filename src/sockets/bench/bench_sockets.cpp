@@ -0,0 +1,142 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#ifndef __WIN32__
+    #include <sys/resource.h>
+    #include <sys/select.h>
+#endif
+
+#include "common/Benchmark.h"
+#include "TCP.h"
+
+/*
+ * Micro-benchmarks of the sockets library: the cost of SocketSet::Wait()
+ * with each Poller, as a function of the number of sockets.
+ *
+ * Usage: bench_sockets [--json] [--repeat=N] [--min-time=MS] [filter...]
+ * See BenchmarkSuite.
+ */
+
+/**
+ * Calls SocketSet::Wait(0) on a set holding idle sockets (listeners nobody
+ * connects to) and active ones (connections with unread data, which stay
+ * readable). This is what an event loop pays per wakeup: with select() the
+ * cost grows with the idle sockets, with epoll it shouldn't.
+ */
+class WaitBenchmark : public Benchmark {
+
+private:
+    Poller::EType m_eType;
+    unsigned int m_iIdle;
+    unsigned int m_iActive;
+    SocketSet *m_pSet;
+    std::vector<Socket*> m_Sockets;
+    unsigned long long m_iReady;
+
+    static std::string name(Poller::EType type, unsigned int idle,
+            unsigned int active)
+    {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "sockets.wait/%s/%u/%u",
+                Poller::GetName(type), idle, active);
+        return buffer;
+    }
+
+public:
+    WaitBenchmark(Poller::EType type, unsigned int idle, unsigned int active)
+      : Benchmark(name(type, idle, active), "call"), m_eType(type),
+        m_iIdle(idle), m_iActive(active), m_pSet(NULL), m_iReady(0)
+    {
+    }
+
+    void setUp()
+    {
+        m_pSet = new SocketSet(m_eType);
+        unsigned int i;
+        for(i = 0; i < m_iIdle; i++)
+        {
+            TCPServer *server = TCPServer::Listen(0, 1);
+            m_Sockets.push_back(server);
+            m_pSet->Add(server);
+        }
+        TCPServer *server = TCPServer::Listen(0);
+        for(i = 0; i < m_iActive; i++)
+        {
+            TCPSocket *sender = TCPSocket::Connect("127.0.0.1",
+                    server->GetLocalPort());
+            TCPSocket *receiver = server->Accept(-1);
+            sender->Send("x", 1);
+            receiver->Wait(-1);
+            m_Sockets.push_back(sender);
+            m_Sockets.push_back(receiver);
+            m_pSet->Add(receiver);
+        }
+        delete server;
+    }
+
+    unsigned long long run(unsigned long long iterations)
+    {
+        unsigned long long i;
+        for(i = 0; i < iterations; i++)
+            if(m_pSet->Wait(0) != NULL)
+                m_iReady++;
+        return iterations;
+    }
+
+    void tearDown()
+    {
+        delete m_pSet;
+        m_pSet = NULL;
+        std::vector<Socket*>::iterator it = m_Sockets.begin();
+        for(; it != m_Sockets.end(); ++it)
+            delete *it;
+        m_Sockets.clear();
+    }
+
+};
+
+int main(int argc, char **argv)
+{
+    Socket::Init();
+#ifndef __WIN32__
+    // The biggest sets need more descriptors than the usual soft limit
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+
+    BenchmarkSuite suite;
+
+    const unsigned int sizes[][2] = {
+        {0, 1}, {100, 1}, {1000, 1}, {1000, 10}, {10000, 1}, {10000, 100},
+    };
+    const Poller::EType types[] = {
+        Poller::SELECT, Poller::EPOLL,
+    };
+    size_t t;
+    for(t = 0; t < sizeof(types)/sizeof(types[0]); t++)
+    {
+        // Don't report the fallback under the name of what was asked for
+        Poller *poller = Poller::Create(types[t]);
+        bool available = poller->GetType() == types[t];
+        delete poller;
+        if(!available)
+            continue;
+        size_t i;
+        for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+        {
+            unsigned int idle = sizes[i][0], active = sizes[i][1];
+            // select() can't take descriptors past FD_SETSIZE
+            if(types[t] == Poller::SELECT
+             && idle + 2 * active + 16 > FD_SETSIZE)
+                continue;
+            suite.add(new WaitBenchmark(types[t], idle, active));
+        }
+    }
+
+    return suite.main(argc, argv);
+}
@@ -0,0 +1,108 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <iostream>
+
+#include "TCP.h"
+
+class SocketSet_Test : public CppUnit::TestFixture {
+
+private:
+    TCPServer *m_pServer;
+    TCPSocket *m_pClients[3];
+    TCPSocket *m_pAccepted[3];
+
+public:
+    void setUp()
+    {
+        m_pServer = TCPServer::Listen(0);
+        int i;
+        for(i = 0; i < 3; i++)
+        {
+            m_pClients[i] = TCPSocket::Connect("127.0.0.1",
+                    m_pServer->GetLocalPort());
+            m_pAccepted[i] = m_pServer->Accept(-1);
+        }
+    }
+
+    void tearDown()
+    {
+        int i;
+        for(i = 0; i < 3; i++)
+        {
+            delete m_pClients[i];
+            delete m_pAccepted[i];
+        }
+        delete m_pServer;
+    }
+
+    void check(Poller::EType type)
+    {
+        SocketSet set(type);
+        int i;
+        for(i = 0; i < 3; i++)
+            set.Add(m_pAccepted[i]);
+        CPPUNIT_ASSERT(set.IsSet(m_pAccepted[1]));
+        CPPUNIT_ASSERT(set.Wait(0) == NULL);
+
+        m_pClients[1]->Send("a", 1);
+        CPPUNIT_ASSERT(set.Wait(1000) == m_pAccepted[1]);
+        // Still readable: returned again
+        CPPUNIT_ASSERT(set.Wait(1000) == m_pAccepted[1]);
+        char buffer[4];
+        CPPUNIT_ASSERT(m_pAccepted[1]->Recv(buffer, 4) == 1);
+        CPPUNIT_ASSERT(set.Wait(10) == NULL);
+
+        // Several ready sockets are all returned
+        m_pClients[0]->Send("b", 1);
+        m_pClients[2]->Send("c", 1);
+        Waitable *first = set.Wait(1000);
+        Waitable *second = set.Wait(1000);
+        CPPUNIT_ASSERT(first != second);
+        CPPUNIT_ASSERT(first == m_pAccepted[0] || first == m_pAccepted[2]);
+        CPPUNIT_ASSERT(second == m_pAccepted[0] || second == m_pAccepted[2]);
+        m_pAccepted[0]->Recv(buffer, 4);
+
+        // A removed socket isn't returned anymore
+        CPPUNIT_ASSERT(set.Remove(m_pAccepted[2]));
+        CPPUNIT_ASSERT(!set.Remove(m_pAccepted[2]));
+        CPPUNIT_ASSERT(set.Wait(10) == NULL);
+        set.Add(m_pAccepted[2]);
+        CPPUNIT_ASSERT(set.Wait(1000) == m_pAccepted[2]);
+        m_pAccepted[2]->Recv(buffer, 4);
+    }
+
+    void test_select()
+    {
+        check(Poller::SELECT);
+    }
+
+    void test_epoll()
+    {
+#ifdef __linux__
+        CPPUNIT_ASSERT(SocketSet(Poller::EPOLL).GetPollerType()
+                == Poller::EPOLL);
+#endif
+        check(Poller::EPOLL);
+    }
+
+    void test_fallback()
+    {
+        SocketSet set(Poller::SELECT);
+        CPPUNIT_ASSERT(set.GetPollerType() == Poller::SELECT);
+        // Whatever is available, something is
+        SocketSet best;
+        CPPUNIT_ASSERT(best.GetPollerType() != Poller::AUTO);
+#ifdef __linux__
+        CPPUNIT_ASSERT(Poller::GetPreferred() == Poller::EPOLL);
+#endif
+    }
+
+    CPPUNIT_TEST_SUITE(SocketSet_Test);
+    CPPUNIT_TEST(test_select);
+    CPPUNIT_TEST(test_epoll);
+    CPPUNIT_TEST(test_fallback);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SocketSet_Test);
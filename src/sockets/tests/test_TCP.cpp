@@ -0,0 +1,211 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "TCP.h"
+
+#ifndef __WIN32__
+    #include <fcntl.h>
+    #include <netinet/tcp.h>
+    #include <sys/resource.h>
+#endif
+
+#include <string>
+#include <vector>
+
+class TCP_Test : public CppUnit::TestFixture {
+
+private:
+    TCPSocket *m_pA;
+    TCPSocket *m_pB;
+
+    std::string receive(size_t size)
+    {
+        std::string result;
+        char buffer[4096];
+        while(result.size() < size)
+        {
+            int ret = m_pB->Recv(buffer, sizeof(buffer));
+            result.append(buffer, ret);
+        }
+        return result;
+    }
+
+public:
+    void setUp()
+    {
+        TCPServer *server = TCPServer::Listen(0);
+        m_pA = TCPSocket::Connect("127.0.0.1", server->GetLocalPort());
+        m_pB = server->Accept(-1);
+        delete server;
+    }
+
+    void tearDown()
+    {
+        delete m_pA;
+        delete m_pB;
+    }
+
+    void test_sendV()
+    {
+        NetStream::Chunk chunks[3] = {
+            {"PRIVMSG #a :hi", 14},
+            {"", 0},
+            {"\r\n", 2}
+        };
+        m_pA->SendV(chunks, 3);
+        CPPUNIT_ASSERT(receive(16) == "PRIVMSG #a :hi\r\n");
+    }
+
+    void test_sendVMany()
+    {
+        // More chunks than are passed to a single writev()
+        std::vector<std::string> lines;
+        std::vector<NetStream::Chunk> chunks;
+        std::string expected;
+        size_t i;
+        for(i = 0; i < 300; i++)
+        {
+            char line[32];
+            sprintf(line, "line %lu\r\n", (unsigned long)i);
+            lines.push_back(line);
+            expected += line;
+        }
+        for(i = 0; i < lines.size(); i++)
+        {
+            NetStream::Chunk chunk = {lines[i].data(), lines[i].size()};
+            chunks.push_back(chunk);
+        }
+        m_pA->SendV(&chunks[0], chunks.size());
+        CPPUNIT_ASSERT(receive(expected.size()) == expected);
+    }
+
+    void test_acceptAll()
+    {
+        TCPServer *server = TCPServer::Listen(0, 128);
+        std::vector<TCPSocket*> clients;
+        std::vector<TCPSocket*> accepted;
+        size_t i;
+        CPPUNIT_ASSERT(server->AcceptAll(&accepted) == 0);
+        for(i = 0; i < 20; i++)
+            clients.push_back(TCPSocket::Connect("127.0.0.1",
+                    server->GetLocalPort()));
+        CPPUNIT_ASSERT(server->Wait(1000));
+        // Limited batch, then the rest
+        CPPUNIT_ASSERT(server->AcceptAll(&accepted, 8) == 8);
+        CPPUNIT_ASSERT(server->AcceptAll(&accepted) == 12);
+        CPPUNIT_ASSERT(accepted.size() == 20);
+        CPPUNIT_ASSERT(server->Accept(0) == NULL);
+
+        // The accepted sockets are blocking
+        clients[3]->Send("x", 1);
+        char c;
+        CPPUNIT_ASSERT(accepted[3]->Recv(&c, 1) == 1);
+
+        for(i = 0; i < clients.size(); i++)
+        {
+            delete clients[i];
+            delete accepted[i];
+        }
+        delete server;
+    }
+
+    void test_acceptOutOfFds()
+    {
+#ifndef __WIN32__
+        TCPServer *server = TCPServer::Listen(0);
+        TCPSocket *client = TCPSocket::Connect("127.0.0.1",
+                server->GetLocalPort());
+        CPPUNIT_ASSERT(server->Wait(1000));
+
+        // Use up the descriptors, under a lowered limit
+        struct rlimit saved;
+        getrlimit(RLIMIT_NOFILE, &saved);
+        int probe = open("/dev/null", O_RDONLY);
+        close(probe);
+        struct rlimit lowered = saved;
+        lowered.rlim_cur = probe + 8;
+        CPPUNIT_ASSERT(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+        std::vector<int> fillers;
+        int fd;
+        while((fd = open("/dev/null", O_RDONLY)) != -1)
+            fillers.push_back(fd);
+
+        // The connection is dropped instead of staying in the queue
+        std::vector<TCPSocket*> accepted;
+        CPPUNIT_ASSERT(server->AcceptAll(&accepted) == 0);
+        CPPUNIT_ASSERT(!server->Wait(0));
+
+        size_t i;
+        for(i = 0; i < fillers.size(); i++)
+            close(fillers[i]);
+        setrlimit(RLIMIT_NOFILE, &saved);
+        char c;
+        CPPUNIT_ASSERT_THROW(client->Recv(&c, 1), SocketConnectionClosed);
+        delete client;
+        delete server;
+#endif
+    }
+
+    void test_reusePort()
+    {
+        if(!TCPServer::CanReusePort())
+            return ;
+        TCPServer *a = TCPServer::Listen(0, 16, true);
+        TCPServer *b = TCPServer::Listen(a->GetLocalPort(), 16, true);
+        CPPUNIT_ASSERT(a->GetLocalPort() == b->GetLocalPort());
+        // Without the option, the port can't be shared
+        bool refused = false;
+        try
+        {
+            delete TCPServer::Listen(a->GetLocalPort());
+        }
+        catch(SocketCantUsePort &e)
+        {
+            refused = true;
+        }
+        CPPUNIT_ASSERT(refused);
+        delete a;
+        delete b;
+    }
+
+    int getOption(TCPSocket *sock, int level, int option)
+    {
+        int value = 0;
+        socklen_t size = sizeof(value);
+        getsockopt(sock->GetSocket(), level, option, (char*)&value, &size);
+        return value;
+    }
+
+    void test_profile()
+    {
+        // Connect() and Accept() use INTERACTIVE
+        CPPUNIT_ASSERT(getOption(m_pA, IPPROTO_TCP, TCP_NODELAY) != 0);
+        CPPUNIT_ASSERT(getOption(m_pB, IPPROTO_TCP, TCP_NODELAY) != 0);
+        CPPUNIT_ASSERT(getOption(m_pB, SOL_SOCKET, SO_KEEPALIVE) != 0);
+
+        CPPUNIT_ASSERT(m_pB->SetProfile(TCPProfile(TCPProfile::BULK)));
+        CPPUNIT_ASSERT(getOption(m_pB, SOL_SOCKET, SO_SNDBUF) >= 1 << 20);
+        CPPUNIT_ASSERT(m_pB->SetProfile(TCPProfile(TCPProfile::INTERACTIVE)));
+
+        TCPProfile off;
+        off.noDelay = 0;
+        off.keepAliveIdle = 0;
+        CPPUNIT_ASSERT(m_pB->SetProfile(off));
+        CPPUNIT_ASSERT(getOption(m_pB, IPPROTO_TCP, TCP_NODELAY) == 0);
+        CPPUNIT_ASSERT(getOption(m_pB, SOL_SOCKET, SO_KEEPALIVE) == 0);
+        // Still usable
+        m_pA->Send("x", 1);
+        CPPUNIT_ASSERT(receive(1) == "x");
+    }
+
+    CPPUNIT_TEST_SUITE(TCP_Test);
+    CPPUNIT_TEST(test_sendV);
+    CPPUNIT_TEST(test_sendVMany);
+    CPPUNIT_TEST(test_acceptAll);
+    CPPUNIT_TEST(test_acceptOutOfFds);
+    CPPUNIT_TEST(test_reusePort);
+    CPPUNIT_TEST(test_profile);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TCP_Test);
@@ -0,0 +1,133 @@
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "TimerWheel.h"
+
+#include <vector>
+
+class RecordingTimer : public Timer {
+
+private:
+    TimerWheel *m_pWheel;
+    std::vector<unsigned long long> *m_pLog;
+
+public:
+    unsigned long long rearm;
+
+    RecordingTimer(TimerWheel *wheel, std::vector<unsigned long long> *log)
+      : m_pWheel(wheel), m_pLog(log), rearm(0)
+    {
+    }
+
+    void Expired()
+    {
+        m_pLog->push_back(m_pWheel->Now());
+        if(rearm != 0)
+            m_pWheel->Schedule(this, rearm);
+    }
+
+};
+
+class TimerWheel_Test : public CppUnit::TestFixture {
+
+public:
+    void test_expiry()
+    {
+        std::vector<unsigned long long> log;
+        TimerWheel wheel(1000);
+        RecordingTimer a(&wheel, &log), b(&wheel, &log), c(&wheel, &log);
+        wheel.Schedule(&a, 10);
+        wheel.Schedule(&b, 100);
+        wheel.Schedule(&c, 100000);
+        CPPUNIT_ASSERT(wheel.Count() == 3);
+        CPPUNIT_ASSERT(wheel.NextTimeout() > 0);
+        CPPUNIT_ASSERT(wheel.NextTimeout() <= 10);
+
+        CPPUNIT_ASSERT(wheel.Advance(1009) == 0);
+        CPPUNIT_ASSERT(wheel.Advance(1010) == 1);
+        CPPUNIT_ASSERT(!a.IsArmed());
+        CPPUNIT_ASSERT(wheel.Advance(1099) == 0);
+        CPPUNIT_ASSERT(wheel.Advance(5000) == 1);
+        CPPUNIT_ASSERT(wheel.Advance(100999) == 0);
+        CPPUNIT_ASSERT(wheel.Advance(101000) == 1);
+        CPPUNIT_ASSERT(log.size() == 3);
+        CPPUNIT_ASSERT(log[0] == 1010);
+        CPPUNIT_ASSERT(log[1] == 1100);
+        CPPUNIT_ASSERT(log[2] == 101000);
+        CPPUNIT_ASSERT(wheel.Count() == 0);
+        CPPUNIT_ASSERT(wheel.NextTimeout() == -1);
+    }
+
+    void test_cancel()
+    {
+        std::vector<unsigned long long> log;
+        TimerWheel wheel(0);
+        RecordingTimer a(&wheel, &log);
+        {
+            RecordingTimer b(&wheel, &log);
+            wheel.Schedule(&b, 50);
+        }
+        wheel.Schedule(&a, 20);
+        wheel.Schedule(&a, 30);
+        CPPUNIT_ASSERT(wheel.Count() == 1);
+        wheel.Advance(25);
+        CPPUNIT_ASSERT(log.empty());
+        a.Cancel();
+        CPPUNIT_ASSERT(wheel.Count() == 0);
+        wheel.Advance(1000);
+        CPPUNIT_ASSERT(log.empty());
+    }
+
+    void test_rearm()
+    {
+        std::vector<unsigned long long> log;
+        TimerWheel wheel(0, 10);
+        RecordingTimer a(&wheel, &log);
+        a.rearm = 1000;
+        wheel.Schedule(&a, 1000);
+        wheel.Advance(10500);
+        CPPUNIT_ASSERT(log.size() == 10);
+        unsigned int i;
+        for(i = 0; i < log.size(); i++)
+            CPPUNIT_ASSERT(log[i] == (i + 1) * 1000);
+    }
+
+    void test_next_timeout()
+    {
+        // NextTimeout() must never overshoot, whatever the levels involved
+        std::vector<unsigned long long> log;
+        TimerWheel wheel(0);
+        std::vector<RecordingTimer*> timers;
+        unsigned long long delays[] = {5, 63, 64, 65, 4095, 4096, 4097,
+                300000, 20000000};
+        size_t i;
+        for(i = 0; i < sizeof(delays)/sizeof(delays[0]); i++)
+        {
+            timers.push_back(new RecordingTimer(&wheel, &log));
+            wheel.Schedule(timers.back(), delays[i]);
+        }
+        unsigned long long now = 0;
+        while(wheel.Count() > 0)
+        {
+            int timeout = wheel.NextTimeout();
+            CPPUNIT_ASSERT(timeout > 0);
+            now += timeout;
+            wheel.Advance(now);
+        }
+        CPPUNIT_ASSERT(log.size() == i);
+        for(i = 0; i < log.size(); i++)
+        {
+            CPPUNIT_ASSERT(log[i] == delays[i]);
+            delete timers[i];
+        }
+    }
+
+    CPPUNIT_TEST_SUITE(TimerWheel_Test);
+    CPPUNIT_TEST(test_expiry);
+    CPPUNIT_TEST(test_cancel);
+    CPPUNIT_TEST(test_rearm);
+    CPPUNIT_TEST(test_next_timeout);
+    CPPUNIT_TEST_SUITE_END();
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TimerWheel_Test);